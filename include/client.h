@@ -5,6 +5,7 @@
  * This header defines the interface for a UART-based client device that:
  * - Scans and establishes UART connections with a server
  * - Receives GPIO control commands (ON/OFF/TOGGLE)
+ * - Runs timed outputs and pulse trains autonomously
  * - Manages power-saving modes
  * - Restores clocks and UART configuration after wake-up
  *
@@ -43,6 +44,7 @@ extern bool woke_up_from_dormant;
  * Continuously receives data over UART and checks if the client is in a wake-up state.
  * If not, the system enters low-power mode (`dormant`) and waits to be woken up.
  * Low-power mode is currently supported only on boards without Wi-Fi. (CYW43).
+ * Dormant mode is deferred while a timed output runs, since it stops the alarms.
  * After waking up, it resumes listening for commands.
  *
  * @note The `go_dormant_flag` should be managed externally to reflect the wake-up status.
@@ -56,6 +58,447 @@ extern bool woke_up_from_dormant;
  */
 void client_listen_for_commands(void);
 
+/**
+ * @brief Sets or clears a GPIO pin based on a number and logic level.
+ *
+ * Behavior:
+ * - If logic level is `1` (HIGH):
+ *   - Initializes the specified GPIO pin
+ *   - Sets it as output and drives it HIGH
+ *
+ * - If logic level is `0` (LOW):
+ *   - Drives the pin LOW
+ *   - Then deinitializes the pin (returns to high-impedance input)
+ *
+ * This allows toggling pins **and** releasing unused ones to save power.
+ * Safe to call from alarm callbacks.
+ *
+ * @param gpio_number GPIO pin number (0–22 and 26-28).
+ * @param gpio_state  Logic level: 0 = LOW, 1 = HIGH.
+ */
+void change_gpio(uint8_t gpio_number, uint8_t gpio_state);
+
+/**
+ * @brief Sets every controllable GPIO to a new on-mask with a single SIO write.
+ *
+ * GPIOs turning ON are configured as outputs first and GPIOs turning OFF
+ * are released afterwards, as with `change_gpio()`. The pins of the UART
+ * connection and the latch line are never touched. Safe to call from IRQs.
+ *
+ * @param gpio_mask Bit `n` set when GPIO `n` must be ON.
+ */
+void apply_gpio_mask(uint32_t gpio_mask);
+
+/**
+ * @brief Like `apply_gpio_mask()`, but only touches the GPIOs of `affected_mask`.
+ *
+ * @param affected_mask GPIOs to set. Other GPIOs keep their level.
+ * @param gpio_mask     Bit `n` set when GPIO `n` must be ON.
+ */
+void apply_gpio_mask_masked(uint32_t affected_mask, uint32_t gpio_mask);
+
+/**
+ * @brief Recalls a stored preset or sets one GPIO. Safe to call from alarm callbacks.
+ *
+ * A running timed output on the GPIO is stopped first. Commands that are
+ * neither a preset recall nor a controllable GPIO are ignored.
+ *
+ * @param command  `PRESET_RECALL_FLAG_NUMBER` or a GPIO number.
+ * @param argument Preset slot (0-based) or logic level.
+ */
+void apply_output_command(uint32_t command, uint32_t argument);
+
+/**
+ * @brief Turns a GPIO ON and runs a pulse train on it from hardware alarms.
+ *
+ * The GPIO is ON for `on_ms` and OFF for `off_ms`, `pulse_count` times,
+ * and stays OFF after the last pulse. A pulse count of 1 is a plain
+ * "ON for on_ms". A timed output already running on the GPIO is replaced.
+ * Out-of-range parameters are ignored.
+ *
+ * @param gpio_number GPIO pin number.
+ * @param on_ms       ON time of each pulse in milliseconds (1..TIMED_OUTPUT_MAX_MS).
+ * @param off_ms      OFF time between pulses in milliseconds (0..TIMED_OUTPUT_MAX_MS).
+ * @param pulse_count Number of pulses (1..TIMED_OUTPUT_MAX_PULSES).
+ */
+void timed_output_start(uint8_t gpio_number, uint32_t on_ms, uint32_t off_ms, uint32_t pulse_count);
+
+/**
+ * @brief Stops the timed output of a GPIO, leaving the GPIO at its current level.
+ *
+ * @param gpio_number GPIO pin number.
+ */
+void timed_output_cancel(uint8_t gpio_number);
+
+/**
+ * @brief Stops all running timed outputs.
+ */
+void timed_output_cancel_all(void);
+
+/**
+ * @brief Returns true while any timed output runs. The client stays awake until they finish.
+ *
+ * @return true if a timed output is running.
+ */
+bool timed_output_pending(void);
+
+/**
+ * @brief Replies to a report poll with "[37,completed_mask,on_mask]".
+ *
+ * `completed_mask` holds the GPIOs whose timed output finished since the
+ * previous report and is cleared afterwards.
+ *
+ * @param gpio_on_mask Current GPIO on-mask of the client.
+ */
+void timed_output_send_report(uint32_t gpio_on_mask);
+
+/**
+ * @brief Replies to a clock sync request with "[38,time_us_hi,time_us_lo]".
+ *
+ * @param received_us time_us_64() taken when the request frame was received.
+ */
+void time_sync_send_reply(uint64_t received_us);
+
+/**
+ * @brief Applies a command when the client clock reaches a given time.
+ *
+ * The command runs from a hardware alarm. It runs at once if the time has
+ * passed or no slot is free, and is ignored if the time is more than
+ * `APPLY_AT_MAX_DELAY_MS` ahead.
+ *
+ * @param client_time_lo Low 32 bits of the time_us_64() value to apply at.
+ * @param command        Command passed to `apply_output_command()`.
+ * @param argument       Argument passed to `apply_output_command()`.
+ */
+void apply_at_schedule(uint32_t client_time_lo, uint32_t command, uint32_t argument);
+
+/**
+ * @brief Returns true while a command waits for its apply time. The client stays awake until then.
+ *
+ * @return true if a command is pending.
+ */
+bool apply_at_pending(void);
+
+/**
+ * @brief Watches the latch line for rising edges. Does nothing unless `LATCH_LINE_ENABLED`.
+ */
+void latch_init(void);
+
+/**
+ * @brief Stages an on-mask to apply on the next rising edge of the latch line.
+ *
+ * A mask staged earlier and not applied yet is replaced.
+ *
+ * @param gpio_mask Bit `n` set when GPIO `n` must be ON.
+ * @param sequence  Commit sequence number, reported back once applied.
+ */
+void latch_stage(uint32_t gpio_mask, uint32_t sequence);
+
+/**
+ * @brief Returns true while a staged mask waits for the latch edge. The client stays awake until then.
+ *
+ * @return true if a mask is staged.
+ */
+bool latch_pending(void);
+
+/**
+ * @brief Replies to a latch poll with "[41,applied_sequence,missed_edges]".
+ *
+ * `missed_edges` counts latch edges that found no staged mask since the
+ * previous report and is cleared afterwards.
+ */
+void latch_send_report(void);
+
+/**
+ * @brief Clears the sequence and sets its length and loop count.
+ *
+ * A playing sequence is stopped first. Steps default to all OFF for
+ * `SEQUENCE_MIN_STEP_US`. A length above `SEQUENCE_MAX_STEPS` clears it.
+ *
+ * @param step_count Number of steps.
+ * @param loop_count Number of times to play the steps, 0 for ever.
+ */
+void sequence_define(uint32_t step_count, uint32_t loop_count);
+
+/**
+ * @brief Sets one step of the sequence. Ignored while it plays.
+ *
+ * @param step        Step index (0-based).
+ * @param gpio_mask   Bit `n` set when GPIO `n` must be ON during the step.
+ * @param duration_us Step duration, at least `SEQUENCE_MIN_STEP_US`.
+ */
+void sequence_set_step(uint32_t step, uint32_t gpio_mask, uint32_t duration_us);
+
+/**
+ * @brief Starts, stops or seeks the sequence.
+ *
+ * @param control A `sequence_control_t` code.
+ * @param step    Step to play from, for START and SEEK.
+ */
+void sequence_control(uint32_t control, uint32_t step);
+
+/**
+ * @brief Stops a playing sequence and leaves its GPIOs as they are.
+ *
+ * Used when another command takes over the outputs.
+ */
+void sequence_cancel(void);
+
+/**
+ * @brief Returns true while the sequence plays. The client stays awake until then.
+ *
+ * @return true if the sequence plays.
+ */
+bool sequence_pending(void);
+
+/**
+ * @brief Replies to a sequence poll with "[48,playing,step,loops_done]".
+ */
+void sequence_send_report(void);
+
+/**
+ * @brief Makes a GPIO a debounced input, changes its pull or releases it.
+ *
+ * The GPIO must not be driven. While any GPIO is an input the client stays
+ * awake, so that it can report changes.
+ *
+ * @param gpio_number GPIO to configure.
+ * @param mode        An `input_mode_t` value, `INPUT_MODE_OFF` to release the GPIO.
+ * @param debounce_ms Time the level must be stable, at most `INPUT_DEBOUNCE_MAX_MS`.
+ */
+void input_sense_configure(uint8_t gpio_number, uint32_t mode, uint32_t debounce_ms);
+
+/**
+ * @brief Returns the GPIOs configured as inputs.
+ *
+ * @return Bit `n` set when GPIO `n` is an input.
+ */
+uint32_t input_sense_mask(void);
+
+/**
+ * @brief Rings the server when input changes or ADC blocks wait to be collected. Call from the main loop.
+ *
+ * The doorbell is repeated every `INPUT_DOORBELL_RETRY_MS` until the
+ * server collects the changes.
+ */
+void input_sense_service(void);
+
+/**
+ * @brief Replies to an input collect with "[50,levels,rise_mask,fall_mask,age_us,changes,fired_rules,adc_blocks,logic_ready]".
+ *
+ * `rise_mask`, `fall_mask` and `changes` cover the debounced changes since
+ * the last collect, and `fired_rules` the local rules that fired; all are
+ * cleared afterwards. `age_us` is the time since the last change,
+ * `adc_blocks` the ADC blocks waiting to be collected and `logic_ready` 1
+ * when a full logic capture waits.
+ */
+void input_sense_send_report(void);
+
+/**
+ * @brief Sets or clears a local input rule.
+ *
+ * Outputs the rule left ON are turned OFF first. A rule without edges or
+ * outputs is cleared.
+ *
+ * @param rule_index   Rule slot (0-based, below `RULE_MAX_RULES`).
+ * @param trigger_gpio Input GPIO that triggers the rule.
+ * @param edges        `rule_edge_t` bits.
+ * @param gpio_mask    GPIOs turned ON when the rule fires.
+ * @param on_ms        Time before they turn OFF again, 0 to leave them ON.
+ */
+void rules_set(uint32_t rule_index, uint8_t trigger_gpio, uint32_t edges, uint32_t gpio_mask, uint32_t on_ms);
+
+/**
+ * @brief Runs the rules of an input on its leading edge. Called from the GPIO IRQ.
+ *
+ * @param gpio_number Input GPIO.
+ * @param rising      true for a rising edge.
+ * @return true if a rule fired.
+ */
+bool rules_on_edge(uint8_t gpio_number, bool rising);
+
+/**
+ * @brief Returns the rules that fired since the last call and clears them.
+ *
+ * @return Bit `n` set when rule `n` fired.
+ */
+uint32_t rules_take_fired(void);
+
+/**
+ * @brief Returns true while a rule's outputs wait to turn OFF or fired rules are not reported yet.
+ *
+ * @return true if the rules may still change outputs the server does not know about.
+ */
+bool rules_pending(void);
+
+/**
+ * @brief Selects the GPIOs that are PWM outputs.
+ *
+ * GPIOs leaving PWM mode become digital outputs again, driven HIGH if they
+ * are ON. GPIOs entering PWM mode run at their last duty if they are ON.
+ *
+ * @param gpio_mask GPIOs that must be PWM outputs, controllable ones only.
+ * @param on_mask   GPIOs currently ON.
+ */
+void pwm_output_configure(uint32_t gpio_mask, uint32_t on_mask);
+
+/**
+ * @brief Sets the duties of consecutive PWM channels from a duty frame.
+ *
+ * Channel `n` is the `n`-th GPIO of the PWM mask in ascending order.
+ * Outputs that are OFF keep their level at 0 and use the new duty once ON.
+ *
+ * @param first_channel Channel of the lowest packed duty.
+ * @param packed_low    Duties of the first channels, lowest channel in the low bits.
+ * @param packed_high   Duties of the next channels.
+ * @param bits          8 or 16 bits per duty. 8-bit duties are scaled to 16 bits.
+ * @param on_mask       GPIOs currently ON.
+ */
+void pwm_output_set_duties(uint32_t first_channel, uint32_t packed_low, uint32_t packed_high, uint32_t bits, uint32_t on_mask);
+
+/**
+ * @brief Switches PWM outputs between their duty and 0. Safe to call from IRQs.
+ *
+ * @param affected_mask GPIOs to switch, GPIOs that are not PWM outputs are ignored.
+ * @param on_mask       Bit `n` set when GPIO `n` must be ON.
+ */
+void pwm_output_enable_masked(uint32_t affected_mask, uint32_t on_mask);
+
+/**
+ * @brief Returns the GPIOs that are PWM outputs.
+ *
+ * @return Bit `n` set when GPIO `n` is a PWM output.
+ */
+uint32_t pwm_output_mask(void);
+
+/**
+ * @brief Sets the dividers of the running PWM slices again after clk_sys changed.
+ *
+ * The wrap, and so every duty level, stays as it is.
+ */
+void pwm_output_clock_changed(void);
+
+/**
+ * @brief Starts, restarts or stops ADC sampling.
+ *
+ * The ADC inputs on GPIOs must not be driven. While sampling the client
+ * stays awake. Settings that exceed `ADC_MAX_CONVERSIONS_HZ` leave the
+ * sampler stopped.
+ *
+ * @param channel_mask ADC inputs to sample, 0 to stop.
+ * @param rate_hz      Samples per second and channel.
+ * @param decimation   Conversions averaged into one sample, at most `ADC_DECIMATION_MAX`.
+ */
+void adc_sampling_configure(uint32_t channel_mask, uint32_t rate_hz, uint32_t decimation);
+
+/**
+ * @brief Returns the GPIOs used as ADC inputs.
+ *
+ * @return Bit `n` set when GPIO `n` is sampled.
+ */
+uint32_t adc_sampling_gpio_mask(void);
+
+/**
+ * @brief Tells whether the ADC is sampling.
+ *
+ * @return true while sampling.
+ */
+bool adc_sampling_active(void);
+
+/**
+ * @brief Returns the number of full ADC blocks waiting to be collected.
+ *
+ * @return Blocks ready.
+ */
+uint32_t adc_sampling_blocks_ready(void);
+
+/**
+ * @brief Replies to an ADC collect with "[57,blocks,dropped]" and the oldest blocks in binary.
+ *
+ * `dropped` counts the blocks lost to a full ring since the last collect.
+ *
+ * @param max_blocks Most blocks to send.
+ */
+void adc_sampling_send_blocks(uint32_t max_blocks);
+
+/**
+ * @brief Sets up a logic capture of consecutive GPIOs, or releases it.
+ *
+ * Any previous capture is stopped. The GPIOs are only read, so they keep
+ * their function. Invalid settings leave no capture set up.
+ *
+ * @param first_gpio First captured GPIO, bit 0 of every sample.
+ * @param pin_count  Captured GPIOs, 0 to release the capture.
+ * @param rate_hz    Samples per second, at most `LOGIC_MAX_RATE_HZ` and clk_sys.
+ */
+void logic_capture_configure(uint8_t first_gpio, uint8_t pin_count, uint32_t rate_hz);
+
+/**
+ * @brief Arms the logic capture, which fills the capture buffer once triggered.
+ *
+ * Ignored when no capture is set up, the trigger mask is not a run of
+ * consecutive bits or the rate is above clk_sys.
+ *
+ * @param trigger_mask  Captured GPIOs compared for the trigger, relative to the first GPIO, 0 to start at once.
+ * @param trigger_value Levels of the trigger GPIOs that start the capture.
+ */
+void logic_capture_arm(uint32_t trigger_mask, uint32_t trigger_value);
+
+/**
+ * @brief Tells whether a logic capture is armed or waits to be collected.
+ *
+ * @return true while the client must stay awake for the capture.
+ */
+bool logic_capture_active(void);
+
+/**
+ * @brief Tells whether a full logic capture waits to be collected.
+ *
+ * @return true once the capture buffer is full, until every chunk is acknowledged.
+ */
+bool logic_capture_ready(void);
+
+/**
+ * @brief Replies to a logic collect with "[60,chunks,samples]" and the next chunks in binary.
+ *
+ * @param max_chunks    Most chunks to send.
+ * @param next_sequence First chunk the server has not received; earlier chunks are acknowledged.
+ */
+void logic_capture_send_chunks(uint32_t max_chunks, uint32_t next_sequence);
+
+/**
+ * @brief Starts an image transfer and replies "[61,max_baudrate]".
+ *
+ * Refuses with a baud rate of 0 when the image does not fit the staging
+ * area, or while ADC sampling or a logic capture uses DMA. Erases the
+ * first staging block.
+ *
+ * @param size  Image size in bytes.
+ * @param crc32 CRC-32 of the image.
+ */
+void firmware_update_begin(uint32_t size, uint32_t crc32);
+
+/**
+ * @brief Switches to the transfer baud rate and receives the image into the staging area.
+ *
+ * Replies "[62,baudrate]" at the current baud rate, or "[62,0]" without a
+ * transfer started. Returns once every sector is programmed, or after
+ * `FIRMWARE_SESSION_TIMEOUT_MS` without a frame, back at `DEFAULT_BAUDRATE`.
+ *
+ * @param baudrate Transfer baud rate, at most the one offered by `firmware_update_begin()`.
+ */
+void firmware_update_receive(uint32_t baudrate);
+
+/**
+ * @brief Checks the staged image and, if valid, swaps it in and restarts.
+ *
+ * Replies "[64,1]" before the swap, or "[64,0]" when the staged image is
+ * incomplete or does not match `crc32`.
+ *
+ * @param crc32 CRC-32 of the image.
+ */
+void firmware_update_commit(uint32_t crc32);
+
 /**
  * @brief Performs a full scan of all available UART pin pairs until a valid connection is found.
  *
@@ -71,27 +514,75 @@ bool client_detect_uart_connection(void);
  *
  * This function turns off unnecessary peripherals and clock outputs (e.g., ADC, RTC, GPOUT),
  * switches to lower-frequency XOSC-based system clocks (12 MHz), disables the system PLL,
- * and enables only essential clock domains for sleep mode operation.
+ * and enables only essential clock domains for sleep mode operation. clk_peri runs from
+ * the XOSC directly, so a clock burst does not change the UART timing.
  */
 void client_turn_off_unused_power_consumers(void);
 
+/**
+ * @brief Notes a handled command frame; switches to the burst clock if the next one already waits.
+ */
+void burst_clock_frame_handled(void);
+
+/**
+ * @brief Returns to the 12 MHz XOSC clock after `CLIENT_BURST_IDLE_MS` without frames. Call from the main loop.
+ */
+void burst_clock_service(void);
+
+/**
+ * @brief Returns true while clk_sys runs from the system PLL.
+ *
+ * @return true during a clock burst. The client does not go dormant then.
+ */
+bool burst_clock_active(void);
+
+/**
+ * @brief Returns clk_sys outside clock bursts, for dividers that must work at both clocks.
+ *
+ * @return clk_sys in Hz when no burst runs.
+ */
+uint32_t burst_clock_base_hz(void);
+
+/**
+ * @brief Returns the fastest baud rate the UART allows in a burst with clk_peri from the PLL.
+ *
+ * @return Baud rate, or the limit of the current clk_peri when no burst is possible.
+ */
+uint32_t burst_clock_max_baudrate(void);
+
+/**
+ * @brief Moves clk_sys and clk_peri to the PLL for a high-baud transfer.
+ *
+ * The UART divider is derived again for the baud rate in use. Call only
+ * while the line is quiet, e.g. while the server waits for a reply.
+ */
+void burst_clock_uart_begin(void);
+
+/**
+ * @brief Moves clk_peri back to the XOSC after a high-baud transfer. clk_sys drops once idle.
+ */
+void burst_clock_uart_end(void);
+
 /**
  * @brief Prepares the system for power saving.
  *
- * Turns off unused components and sets up the wake-up pin for dormant mode.
+ * Turns off unused components and gives both UART pins to the UART, so
+ * replies and input doorbells reach the server. The TX pin only becomes
+ * the wake-up input in `enter_dormant_mode()`.
  * Currently supported only on boards without Wi-Fi. (CYW43).
  *
  * @see client_turn_off_unused_power_consumers()
- * @see set_pin_as_input_for_dormant_wakeup()
+ * @see uart_init_with_pins()
  */
 void power_saving_config(void);
 
 /**
  * @brief Enters low-power dormant mode using ROSC as the clock source.
  *
- * Configures the system to use the ROSC oscillator, then enters dormant mode.
- * The system will remain in dormant state until a high level is detected
- * on the TX pin of the active UART connection.
+ * Makes the TX pin an input pulled down, configures the system to use the
+ * ROSC oscillator, then enters dormant mode. The system will remain in
+ * dormant state until a high level is detected on the TX pin of the active
+ * UART connection.
  *
  * @note Assumes `active_uart_client_connection` is correctly initialized.
  *       The TX pin is used as the wake-up source.
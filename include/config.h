@@ -62,6 +62,12 @@
 #define SERVER_TIMEOUT_MS 500
 #endif
 
+/// Time in milliseconds the server listens for a restarted client on its pin pair.
+/// Must cover a full pass of the client over its pin pairs (~260ms).
+#ifndef SERVER_RECONNECT_LISTEN_MS
+#define SERVER_RECONNECT_LISTEN_MS 300
+#endif
+
 /// Timeout in milliseconds for sending a UART connection request.
 #ifndef CLIENT_TIMEOUT_MS
 #define CLIENT_TIMEOUT_MS 50
@@ -75,6 +81,18 @@
 #define PERIODIC_CONSOLE_CHECK_TIME_MS 1500
 #endif
 
+#ifndef CORE1_QUEUE_LENGTH
+#define CORE1_QUEUE_LENGTH 16           ///< Wakeup messages that can wait for core1
+#endif
+
+#ifndef CORE1_DEFERRED_LENGTH
+#define CORE1_DEFERRED_LENGTH 4         ///< Kinds of UART wakeup messages core1 holds back during a stream
+#endif
+
+#ifndef CORE1_STACK_SIZE
+#define CORE1_STACK_SIZE 8192           ///< Bytes, core1 also commits flash sectors
+#endif
+
 #ifndef MS_TO_US_MULTIPLIER
 #define MS_TO_US_MULTIPLIER 1000
 #endif
@@ -90,7 +108,47 @@
 #endif
 
 #ifndef NUMBER_OF_POSSIBLE_PRESETS
-#define NUMBER_OF_POSSIBLE_PRESETS 5
+#define NUMBER_OF_POSSIBLE_PRESETS 100  ///< Preset slots per client
+#endif
+
+#ifndef PRESET_POOL_SIZE
+#define PRESET_POOL_SIZE 256            ///< Distinct non-empty presets shared by all clients
+#endif
+
+#ifndef PRESET_SLOT_EMPTY
+#define PRESET_SLOT_EMPTY 0xFFFF        ///< Preset slot without pool entry (all devices OFF)
+#endif
+
+#ifndef PRESET_PWM_POOL_SIZE
+#define PRESET_PWM_POOL_SIZE 32         ///< Distinct PWM duty sets shared by all presets
+#endif
+
+#ifndef PRESET_PWM_SLOT_EMPTY
+#define PRESET_PWM_SLOT_EMPTY 0xFF      ///< Preset without PWM outputs
+#endif
+
+#ifndef SCHEDULE_MAX_ENTRIES
+#define SCHEDULE_MAX_ENTRIES 256        ///< Scheduled actions stored in flash
+#endif
+
+#ifndef SCHEDULER_WHEEL_LEVELS
+#define SCHEDULER_WHEEL_LEVELS 4        ///< Timer wheel levels, covering 2^(6 * levels) seconds
+#endif
+
+#ifndef SCHEDULER_WHEEL_SLOT_BITS
+#define SCHEDULER_WHEEL_SLOT_BITS 6     ///< 64 slots per timer wheel level
+#endif
+
+#ifndef SCHEDULER_MAX_CATCH_UP_S
+#define SCHEDULER_MAX_CATCH_UP_S 60     ///< Late ticks run one by one up to this delay, the wheel is rebuilt beyond it
+#endif
+
+#ifndef INTERLOCK_MAX_ENTRIES
+#define INTERLOCK_MAX_ENTRIES 64        ///< Cross-client interlock rules stored in flash
+#endif
+
+#ifndef GPIO_DEVICE_MASK
+#define GPIO_DEVICE_MASK 0x1C7FFFFFu    ///< Client-controllable GPIOs: 0-22 and 26-28
 #endif
 
 // === Messages ===
@@ -110,6 +168,423 @@
 #define DORMANT_FLAG_NUMBER 44
 #endif
 
+#ifndef PRESET_STORE_FLAG_NUMBER
+#define PRESET_STORE_FLAG_NUMBER 33     ///< "[33,preset,version,gpio_mask]" stores a preset on the client
+#endif
+
+#ifndef PRESET_RECALL_FLAG_NUMBER
+#define PRESET_RECALL_FLAG_NUMBER 34    ///< "[34,preset]" applies a stored preset on the client
+#endif
+
+#ifndef TIMED_ON_FLAG_NUMBER
+#define TIMED_ON_FLAG_NUMBER 35         ///< "[35,gpio,on_ms]" turns a GPIO ON, the client turns it OFF after on_ms
+#endif
+
+#ifndef PULSE_TRAIN_FLAG_NUMBER
+#define PULSE_TRAIN_FLAG_NUMBER 36      ///< "[36,gpio,on_ms,off_ms,count]" runs a pulse train on the client, ending OFF
+#endif
+
+#ifndef OUTPUT_REPORT_FLAG_NUMBER
+#define OUTPUT_REPORT_FLAG_NUMBER 37    ///< "[37,37]" polls the client, reply "[37,completed_mask,on_mask]"
+#endif
+
+#ifndef TIME_SYNC_FLAG_NUMBER
+#define TIME_SYNC_FLAG_NUMBER 38        ///< "[38,38]" asks the client for its clock, reply "[38,time_us_hi,time_us_lo]"
+#endif
+
+#ifndef APPLY_AT_FLAG_NUMBER
+#define APPLY_AT_FLAG_NUMBER 39         ///< "[39,client_time_us_lo,command,argument]" runs "[command,argument]" at a client time
+#endif
+
+#ifndef LATCH_STAGE_FLAG_NUMBER
+#define LATCH_STAGE_FLAG_NUMBER 40      ///< "[40,gpio_mask,sequence]" stages an on-mask, applied on the next latch edge
+#endif
+
+#ifndef LATCH_REPORT_FLAG_NUMBER
+#define LATCH_REPORT_FLAG_NUMBER 41     ///< "[41,41]" polls the client, reply "[41,applied_sequence,missed_edges]"
+#endif
+
+#ifndef STREAM_FRAME_FLAG_NUMBER
+#define STREAM_FRAME_FLAG_NUMBER 42     ///< "[42,address,gpio_mask]" sets the GPIOs of the client with that stream address
+#endif
+
+#ifndef STREAM_ADDRESS_FLAG_NUMBER
+#define STREAM_ADDRESS_FLAG_NUMBER 43   ///< "[43,address]" sets the client's stream address, 0 leaves streaming
+#endif
+
+#ifndef STREAM_MAX_RATE_HZ
+#define STREAM_MAX_RATE_HZ 1000         ///< Highest stream tick rate; slower rates are refused when the frames do not fit the baud rate
+#endif
+
+#ifndef SEQUENCE_DEFINE_FLAG_NUMBER
+#define SEQUENCE_DEFINE_FLAG_NUMBER 45  ///< "[45,step_count,loop_count]" clears the client's sequence, 0 loops forever
+#endif
+
+#ifndef SEQUENCE_STEP_FLAG_NUMBER
+#define SEQUENCE_STEP_FLAG_NUMBER 46    ///< "[46,step,gpio_mask,duration_us]" sets one step of the sequence
+#endif
+
+#ifndef SEQUENCE_CONTROL_FLAG_NUMBER
+#define SEQUENCE_CONTROL_FLAG_NUMBER 47 ///< "[47,control,step]" starts, stops or seeks the sequence (`sequence_control_t`)
+#endif
+
+#ifndef SEQUENCE_REPORT_FLAG_NUMBER
+#define SEQUENCE_REPORT_FLAG_NUMBER 48  ///< "[48,48]" polls the client, reply "[48,playing,step,loops_done]"
+#endif
+
+#ifndef SEQUENCE_MAX_STEPS
+#define SEQUENCE_MAX_STEPS 64           ///< Steps stored by a client sequence
+#endif
+
+#ifndef SEQUENCE_MIN_STEP_US
+#define SEQUENCE_MIN_STEP_US 20         ///< Shortest sequence step, longer than one alarm callback
+#endif
+
+#ifndef INPUT_CONFIG_FLAG_NUMBER
+#define INPUT_CONFIG_FLAG_NUMBER 49     ///< "[49,gpio,mode,debounce_ms]" makes a client GPIO an input (`input_mode_t`)
+#endif
+
+#ifndef INPUT_REPORT_FLAG_NUMBER
+#define INPUT_REPORT_FLAG_NUMBER 50     ///< "[50,50]" collects input changes, reply "[50,levels,rise_mask,fall_mask,age_us,changes,fired_rules,adc_blocks,logic_ready]"
+#endif
+
+#ifndef RULE_SET_FLAG_NUMBER
+#define RULE_SET_FLAG_NUMBER 51         ///< "[51,rule,trigger_gpio,edges,gpio_mask,on_ms]" sets a local rule on the client
+#endif
+
+#ifndef RULE_MAX_RULES
+#define RULE_MAX_RULES 16               ///< Local rules per client
+#endif
+
+#ifndef PWM_MODE_FLAG_NUMBER
+#define PWM_MODE_FLAG_NUMBER 52         ///< "[52,pwm_mask]" sets which client GPIOs are PWM outputs
+#endif
+
+#ifndef PWM_DUTY8_FLAG_NUMBER
+#define PWM_DUTY8_FLAG_NUMBER 53        ///< "[53,first_channel,packed,packed]" sets up to 8 duties, 8 bits each
+#endif
+
+#ifndef PWM_DUTY16_FLAG_NUMBER
+#define PWM_DUTY16_FLAG_NUMBER 54       ///< "[54,first_channel,packed,packed]" sets up to 4 duties, 16 bits each
+#endif
+
+#ifndef PWM_FREQUENCY_HZ
+#define PWM_FREQUENCY_HZ 1000           ///< Client PWM frequency, the duty resolution is clk_sys / frequency up to 16 bits
+#endif
+
+#ifndef ADC_CONFIG_FLAG_NUMBER
+#define ADC_CONFIG_FLAG_NUMBER 56       ///< "[56,channel_mask,rate_hz,decimation]" starts client ADC sampling, mask 0 stops it
+#endif
+
+#ifndef ADC_COLLECT_FLAG_NUMBER
+#define ADC_COLLECT_FLAG_NUMBER 57      ///< "[57,max_blocks]" collects ADC blocks, reply "[57,blocks,dropped]" and the binary blocks
+#endif
+
+#ifndef ADC_CHANNEL_MASK
+#define ADC_CHANNEL_MASK 0x1Fu          ///< ADC inputs 0-3 on GPIO 26-29 and the temperature sensor on input 4
+#endif
+
+#ifndef ADC_FIRST_GPIO
+#define ADC_FIRST_GPIO 26               ///< GPIO of ADC input 0
+#endif
+
+#ifndef ADC_MAX_CONVERSIONS_HZ
+#define ADC_MAX_CONVERSIONS_HZ 125000   ///< 12 MHz ADC clock over 96 cycles per conversion, all channels together
+#endif
+
+#ifndef ADC_DECIMATION_MAX
+#define ADC_DECIMATION_MAX 256          ///< Most conversions averaged into one sample
+#endif
+
+#ifndef ADC_BLOCK_SAMPLES
+#define ADC_BLOCK_SAMPLES 64            ///< Samples of one ADC block, all channels interleaved
+#endif
+
+#ifndef ADC_BLOCK_MAX_BYTES
+#define ADC_BLOCK_MAX_BYTES (6 + (ADC_BLOCK_SAMPLES * 3 + 1) / 2 + 2)    ///< Header, 12-bit samples and checksum on the wire
+#endif
+
+#ifndef ADC_CLIENT_BLOCKS
+#define ADC_CLIENT_BLOCKS 16            ///< ADC blocks a client buffers until they are collected
+#endif
+
+#ifndef ADC_DMA_BUFFER_SAMPLES
+#define ADC_DMA_BUFFER_SAMPLES 256      ///< Conversions per DMA buffer, the client has two
+#endif
+
+#ifndef ADC_COLLECT_MAX_BLOCKS
+#define ADC_COLLECT_MAX_BLOCKS 4        ///< Most ADC blocks read in one collect, bounds the UART lock time
+#endif
+
+#ifndef ADC_BLOCK_TIMEOUT_MS
+#define ADC_BLOCK_TIMEOUT_MS 20         ///< Time the server waits for one ADC block
+#endif
+
+#ifndef ADC_SERVER_BLOCKS
+#define ADC_SERVER_BLOCKS 8             ///< ADC blocks the server keeps per client until the host reads them
+#endif
+
+#ifndef LOGIC_CONFIG_FLAG_NUMBER
+#define LOGIC_CONFIG_FLAG_NUMBER 58     ///< "[58,first_gpio,pin_count,rate_hz]" sets up a logic capture, pin_count 0 releases it
+#endif
+
+#ifndef LOGIC_ARM_FLAG_NUMBER
+#define LOGIC_ARM_FLAG_NUMBER 59        ///< "[59,trigger_mask,trigger_value]" arms the logic capture, mask 0 starts at once
+#endif
+
+#ifndef LOGIC_COLLECT_FLAG_NUMBER
+#define LOGIC_COLLECT_FLAG_NUMBER 60    ///< "[60,max_chunks,next_sequence]" collects capture chunks, reply "[60,chunks,samples]" and the binary chunks
+#endif
+
+#ifndef LOGIC_MAX_RATE_HZ
+#define LOGIC_MAX_RATE_HZ 12000000u     ///< Fastest logic capture sample rate, one sample per cycle of the 12 MHz client clk_sys
+#endif
+
+#ifndef LOGIC_CAPTURE_WORDS
+#define LOGIC_CAPTURE_WORDS 4096        ///< 32-bit words of the client capture buffer, each holds 32 / pin_count samples
+#endif
+
+#ifndef LOGIC_CHUNK_RUNS
+#define LOGIC_CHUNK_RUNS 32             ///< Runs of one capture chunk
+#endif
+
+#ifndef LOGIC_CHUNK_MAX_BYTES
+#define LOGIC_CHUNK_MAX_BYTES (4 + LOGIC_CHUNK_RUNS * 9 + 2)    ///< Header, runs of up to 4 value and 5 length bytes, and checksum on the wire
+#endif
+
+#ifndef LOGIC_COLLECT_MAX_CHUNKS
+#define LOGIC_COLLECT_MAX_CHUNKS 4      ///< Most capture chunks read in one collect, bounds the UART lock time
+#endif
+
+#ifndef LOGIC_CHUNK_TIMEOUT_MS
+#define LOGIC_CHUNK_TIMEOUT_MS 20       ///< Time the server waits for one capture chunk
+#endif
+
+#ifndef LOGIC_SERVER_RUNS
+#define LOGIC_SERVER_RUNS 1024          ///< Runs the server keeps until the host reads them, for the one capturing client
+#endif
+
+#ifndef FIRMWARE_BEGIN_FLAG_NUMBER
+#define FIRMWARE_BEGIN_FLAG_NUMBER 61   ///< "[61,size,crc32]" starts a client image transfer, reply "[61,max_baudrate]", 0 refuses
+#endif
+
+#ifndef FIRMWARE_BAUD_FLAG_NUMBER
+#define FIRMWARE_BAUD_FLAG_NUMBER 62    ///< "[62,baudrate]" switches the client to the transfer baud rate, reply "[62,baudrate]"
+#endif
+
+#ifndef FIRMWARE_ACK_FLAG_NUMBER
+#define FIRMWARE_ACK_FLAG_NUMBER 63     ///< Client reply "[63,sector,status]" to each image frame, status 0 asks for `sector` again
+#endif
+
+#ifndef FIRMWARE_COMMIT_FLAG_NUMBER
+#define FIRMWARE_COMMIT_FLAG_NUMBER 64  ///< "[64,crc32]" swaps the staged image in and restarts the client, reply "[64,ok]"
+#endif
+
+#ifndef FIRMWARE_IMAGE_MAX_BYTES
+#define FIRMWARE_IMAGE_MAX_BYTES (256 * 1024)   ///< Largest client image, also the size of both staging areas
+#endif
+
+#ifndef FIRMWARE_SECTOR_SIZE
+#define FIRMWARE_SECTOR_SIZE 4096       ///< Image bytes per frame, one flash sector
+#endif
+
+#ifndef FIRMWARE_BLOCK_SIZE
+#define FIRMWARE_BLOCK_SIZE 65536       ///< Flash erase block of the staging areas
+#endif
+
+#ifndef FIRMWARE_FRAME_SYNC
+#define FIRMWARE_FRAME_SYNC 0xA5        ///< First byte of an image frame
+#endif
+
+#ifndef FIRMWARE_FRAME_BYTES
+#define FIRMWARE_FRAME_BYTES (1 + 4 + FIRMWARE_SECTOR_SIZE + 4)    ///< Sync byte, sector index, sector data and CRC-32 on the wire
+#endif
+
+#ifndef FIRMWARE_RING_BITS
+#define FIRMWARE_RING_BITS 14           ///< The client receives frames into a DMA ring of 1 << bits bytes
+#endif
+
+#ifndef FIRMWARE_WINDOW_FRAMES
+#define FIRMWARE_WINDOW_FRAMES 3        ///< Frames sent before the server reads their acks, must fit the client ring
+#endif
+
+#ifndef FIRMWARE_MAX_BAUDRATE
+#define FIRMWARE_MAX_BAUDRATE 921600u   ///< Fastest transfer baud rate the server offers
+#endif
+
+#ifndef FIRMWARE_REPLY_TIMEOUT_MS
+#define FIRMWARE_REPLY_TIMEOUT_MS 500   ///< Time the server waits for a begin or baud reply, the client erases its first block
+#endif
+
+#ifndef FIRMWARE_ACK_TIMEOUT_MS
+#define FIRMWARE_ACK_TIMEOUT_MS 1000    ///< Time the server waits for one frame ack, covers a block erase
+#endif
+
+#ifndef FIRMWARE_COMMIT_TIMEOUT_MS
+#define FIRMWARE_COMMIT_TIMEOUT_MS 1000 ///< Time the server waits for a commit reply, the client checks the whole image
+#endif
+
+#ifndef FIRMWARE_COPY_MS_PER_SECTOR
+#define FIRMWARE_COPY_MS_PER_SECTOR 100 ///< Time the server allows a client to swap in one sector before it restarts
+#endif
+
+#ifndef FIRMWARE_SESSION_TIMEOUT_MS
+#define FIRMWARE_SESSION_TIMEOUT_MS 3000    ///< The client leaves a transfer without a frame for this long
+#endif
+
+#ifndef FIRMWARE_RESYNC_IDLE_MS
+#define FIRMWARE_RESYNC_IDLE_MS 10      ///< Line idle time after which the client drops a damaged window
+#endif
+
+#ifndef FIRMWARE_MAX_RETRIES
+#define FIRMWARE_MAX_RETRIES 8          ///< Windows sent again before the server gives up on a client
+#endif
+
+#ifndef FIRMWARE_LOAD_TIMEOUT_MS
+#define FIRMWARE_LOAD_TIMEOUT_MS 2000   ///< Time the server waits for the next image byte from the host
+#endif
+
+#ifndef AUDIT_FLAG_NUMBER
+#define AUDIT_FLAG_NUMBER 65            ///< "[65,65]" reads back the client outputs, reply "[65,audited_mask,on_mask,busy]"
+#endif
+
+#ifndef AUDIT_TICK_MS
+#define AUDIT_TICK_MS 500               ///< Period of the output audit, one client per tick
+#endif
+
+#ifndef AUDIT_IDLE_MS
+#define AUDIT_IDLE_MS 200               ///< A tick is skipped unless the UART links were idle for this long
+#endif
+
+#ifndef AUDIT_REPLY_TIMEOUT_MS
+#define AUDIT_REPLY_TIMEOUT_MS 5        ///< Time the server listens for a readback reply
+#endif
+
+#ifndef AUDIT_LOST_AFTER_SILENT
+#define AUDIT_LOST_AFTER_SILENT 3       ///< Silent audits in a row after which an answering client is logged as lost
+#endif
+
+#ifndef CLIENT_BURST_CLOCK_KHZ
+#define CLIENT_BURST_CLOCK_KHZ 96000    ///< Client clk_sys while commands pile up, 0 keeps clients at 12 MHz
+#endif
+
+#ifndef CLIENT_BURST_IDLE_MS
+#define CLIENT_BURST_IDLE_MS 100        ///< Time without frames after which a client returns to 12 MHz
+#endif
+
+#ifndef CLOCK_GOVERNOR_ENABLED
+#define CLOCK_GOVERNOR_ENABLED 1        ///< Server clk_sys drops to the 48 MHz USB PLL while idle
+#endif
+
+#ifndef CLOCK_GOVERNOR_IDLE_MS
+#define CLOCK_GOVERNOR_IDLE_MS 250      ///< Time without USB input, UART exchanges or flash commits before clk_sys drops
+#endif
+
+#ifndef CLOCK_GOVERNOR_TICK_MS
+#define CLOCK_GOVERNOR_TICK_MS 50       ///< Period of the governor's idle check
+#endif
+
+#ifndef INPUT_DEBOUNCE_MAX_MS
+#define INPUT_DEBOUNCE_MAX_MS 1000      ///< Longest input debounce time
+#endif
+
+#ifndef INPUT_DOORBELL_RETRY_MS
+#define INPUT_DOORBELL_RETRY_MS 100     ///< Clients ring again if their changes were not collected by then
+#endif
+
+#ifndef INPUT_REPORT_TIMEOUT_MS
+#define INPUT_REPORT_TIMEOUT_MS 5       ///< Time the server waits for an input report
+#endif
+
+#ifndef INPUT_REPORT_BUFFER_SIZE
+#define INPUT_REPORT_BUFFER_SIZE 96     ///< Longest input report frame, including the terminator
+#endif
+
+#ifndef TIMED_OUTPUT_MAX_MS
+#define TIMED_OUTPUT_MAX_MS 3600000     ///< Longest ON or OFF phase of a timed output
+#endif
+
+#ifndef TIMED_OUTPUT_MAX_PULSES
+#define TIMED_OUTPUT_MAX_PULSES 1000
+#endif
+
+#ifndef OUTPUT_REPORT_MARGIN_MS
+#define OUTPUT_REPORT_MARGIN_MS 20      ///< Delay after the expected end of a timed output before polling the client
+#endif
+
+#ifndef OUTPUT_REPORT_TIMEOUT_MS
+#define OUTPUT_REPORT_TIMEOUT_MS 5      ///< Time the server listens for a report reply
+#endif
+
+#ifndef OUTPUT_REPORT_MAX_RETRIES
+#define OUTPUT_REPORT_MAX_RETRIES 3
+#endif
+
+#ifndef TIME_SYNC_SAMPLES
+#define TIME_SYNC_SAMPLES 4             ///< Exchanges per sync, the one with the shortest reply delay is kept
+#endif
+
+#ifndef TIME_SYNC_TIMEOUT_MS
+#define TIME_SYNC_TIMEOUT_MS 10         ///< Time the server listens for a sync reply
+#endif
+
+#ifndef TIME_SYNC_MAX_AGE_MS
+#define TIME_SYNC_MAX_AGE_MS 10000      ///< Resync interval once the client's drift is known
+#endif
+
+#ifndef TIME_SYNC_MAX_AGE_UNCOMPENSATED_MS
+#define TIME_SYNC_MAX_AGE_UNCOMPENSATED_MS 250  ///< Resync interval while the drift is unknown
+#endif
+
+#ifndef TIME_SYNC_MIN_DRIFT_INTERVAL_MS
+#define TIME_SYNC_MIN_DRIFT_INTERVAL_MS 200     ///< Shortest interval between two syncs used to estimate drift
+#endif
+
+#ifndef TIME_SYNC_MAX_DRIFT_PPB
+#define TIME_SYNC_MAX_DRIFT_PPB 500000  ///< Drift estimates beyond +/-500 ppm are discarded
+#endif
+
+#ifndef APPLY_AT_FRAME_BUDGET_US
+#define APPLY_AT_FRAME_BUDGET_US 3000   ///< Time reserved to send one apply-at frame
+#endif
+
+#ifndef APPLY_AT_MARGIN_US
+#define APPLY_AT_MARGIN_US 5000         ///< Extra delay before a synchronised apply
+#endif
+
+#ifndef APPLY_AT_MAX_DELAY_MS
+#define APPLY_AT_MAX_DELAY_MS 1000      ///< Clients ignore apply-at frames further ahead than this
+#endif
+
+#ifndef APPLY_AT_MAX_PENDING
+#define APPLY_AT_MAX_PENDING 4          ///< Apply-at frames a client holds at the same time
+#endif
+
+#ifndef CLIENT_COMMAND_BUFFER_SIZE
+#define CLIENT_COMMAND_BUFFER_SIZE 32   ///< Longest server-to-client frame, including the terminator
+#endif
+
+#ifndef CLIENT_COMMAND_MAX_NUMBERS
+#define CLIENT_COMMAND_MAX_NUMBERS 8    ///< Most numbers in one server-to-client frame
+#endif
+
+// === Latch Line ===
+#ifndef LATCH_LINE_ENABLED
+#define LATCH_LINE_ENABLED 0            ///< 1 when LATCH_LINE_GPIO of the server is wired to the same GPIO of every client
+#endif
+
+#ifndef LATCH_LINE_GPIO
+#define LATCH_LINE_GPIO 22              ///< Shared latch line, reserved on the server and on every client when enabled
+#endif
+
+#ifndef LATCH_PULSE_US
+#define LATCH_PULSE_US 20               ///< High time of a latch pulse
+#endif
+
+#ifndef LATCH_REPORT_TIMEOUT_MS
+#define LATCH_REPORT_TIMEOUT_MS 5       ///< Time the server listens for a latch report reply
+#endif
+
 // === Flash Memory Layout === 
 #ifndef SERVER_SECTOR_SIZE
 #define SERVER_SECTOR_SIZE    4096
@@ -123,10 +598,66 @@
 #define SERVER_FLASH_OFFSET   (PICO_FLASH_SIZE_BYTES - SERVER_SECTOR_SIZE) ///< Offset from flash end
 #endif
 
+#ifndef SERVER_TELEMETRY_SECTOR_OFFSET
+#define SERVER_TELEMETRY_SECTOR_OFFSET (SERVER_SECTOR_SIZE - SERVER_PAGE_SIZE) ///< Where older images kept the flash telemetry inside the state sector, read once at boot
+#endif
+
 #ifndef SERVER_FLASH_ADDR
 #define SERVER_FLASH_ADDR     (XIP_BASE + SERVER_FLASH_OFFSET)             ///< Runtime address of flash state
 #endif
 
+#ifndef PRESET_LIBRARY_BANK_SECTORS
+#define PRESET_LIBRARY_BANK_SECTORS 2   ///< Sectors per preset library bank
+#endif
+
+#ifndef PRESET_LIBRARY_BANK_SIZE
+#define PRESET_LIBRARY_BANK_SIZE (PRESET_LIBRARY_BANK_SECTORS * SERVER_SECTOR_SIZE)
+#endif
+
+#ifndef PRESET_LIBRARY_OFFSET
+#define PRESET_LIBRARY_OFFSET (SERVER_FLASH_OFFSET - 2 * PRESET_LIBRARY_BANK_SIZE) ///< Two banks below the state sector
+#endif
+
+#ifndef PRESET_LIBRARY_MAGIC
+#define PRESET_LIBRARY_MAGIC 0x4C425250u    ///< "PRBL"
+#endif
+
+#ifndef SCHEDULE_TABLE_OFFSET
+#define SCHEDULE_TABLE_OFFSET (PRESET_LIBRARY_OFFSET - SERVER_SECTOR_SIZE) ///< One sector below the preset library
+#endif
+
+#ifndef SCHEDULE_TABLE_MAGIC
+#define SCHEDULE_TABLE_MAGIC 0x44484353u    ///< "SCHD"
+#endif
+
+#ifndef INTERLOCK_TABLE_OFFSET
+#define INTERLOCK_TABLE_OFFSET (SCHEDULE_TABLE_OFFSET - SERVER_SECTOR_SIZE) ///< One sector below the schedule table
+#endif
+
+#ifndef INTERLOCK_TABLE_MAGIC
+#define INTERLOCK_TABLE_MAGIC 0x4B434C49u   ///< "ILCK"
+#endif
+
+#ifndef FIRMWARE_SERVER_STAGING_OFFSET
+#define FIRMWARE_SERVER_STAGING_OFFSET ((INTERLOCK_TABLE_OFFSET - FIRMWARE_IMAGE_MAX_BYTES) & ~(FIRMWARE_BLOCK_SIZE - 1)) ///< Client image on the server, block aligned below the interlock table
+#endif
+
+#ifndef EVENT_LOG_SECTORS
+#define EVENT_LOG_SECTORS 16            ///< Sectors of the persistent event log, 256 records each
+#endif
+
+#ifndef EVENT_LOG_OFFSET
+#define EVENT_LOG_OFFSET (FIRMWARE_SERVER_STAGING_OFFSET - EVENT_LOG_SECTORS * SERVER_SECTOR_SIZE) ///< Event log below the client image staging area
+#endif
+
+#ifndef FLASH_TELEMETRY_OFFSET
+#define FLASH_TELEMETRY_OFFSET (EVENT_LOG_OFFSET - SERVER_SECTOR_SIZE) ///< Flash telemetry pages below the event log
+#endif
+
+#ifndef FIRMWARE_CLIENT_STAGING_OFFSET
+#define FIRMWARE_CLIENT_STAGING_OFFSET (PICO_FLASH_SIZE_BYTES - FIRMWARE_IMAGE_MAX_BYTES) ///< Incoming image at the top of client flash
+#endif
+
 #ifndef INVALID_CLIENT_INDEX
 #define INVALID_CLIENT_INDEX -1
 #endif
@@ -0,0 +1,109 @@
+/**
+ * @file event_log.h
+ * @brief Persistent binary event log in flash for post-mortem analysis.
+ *
+ * Records boots, client and USB attaches and losses, logged errors and
+ * warnings, flash commits and user commands as fixed-size 16-byte records
+ * in a ring of `EVENT_LOG_SECTORS` flash sectors, which survives reboots.
+ * Records are staged in RAM and programmed a page at a time by core1, so
+ * writing an event never waits for flash. The log is read through the
+ * machine interface and decoded on the host with the event table below.
+ */
+
+#ifndef EVENT_LOG_H
+#define EVENT_LOG_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "config.h"
+
+/// Pages of records staged in RAM while core1 programs the previous ones.
+#ifndef EVENT_LOG_STAGING_PAGES
+#define EVENT_LOG_STAGING_PAGES 2
+#endif
+
+/// Period after which a partly filled page is programmed.
+#ifndef EVENT_LOG_FLUSH_MS
+#define EVENT_LOG_FLUSH_MS 2000
+#endif
+
+/**
+ * @brief Logged events, with the meaning of their arguments.
+ */
+typedef enum{
+    EVENT_BOOT = 1,             ///< arg0: 1 after a watchdog reboot
+    EVENT_CLIENT_ATTACHED,      ///< arg0: TX pin | RX pin << 8, arg1: handshake time in us
+    EVENT_CLIENT_LOST,          ///< arg0: client that stopped answering the audit
+    EVENT_CLIENT_RECOVERED,     ///< arg0: client that answers again, arg1: 1 after a new handshake
+    EVENT_USB_ATTACHED,         ///< The USB console came back
+    EVENT_USB_LOST,             ///< The USB console went away
+    EVENT_ERROR,                ///< arg0: log message ID, arg1: its first argument
+    EVENT_WARNING,              ///< arg0: log message ID, arg1: its first argument
+    EVENT_COMMIT,               ///< arg0: duration in ms, arg1: flash offset of the committed area
+    EVENT_COMMAND,              ///< arg0: 0 menu option, 1 host command; arg1: option, or the first 4 characters of the command
+}event_log_event_t;
+
+/**
+ * @brief One record as stored in flash. Erased records read as all 0xFF.
+ */
+typedef struct{
+    uint32_t sequence;          ///< Records written before this one, over all boots
+    uint32_t time_ms;           ///< Time since boot
+    uint32_t arg1;
+    uint16_t arg0;
+    uint8_t event;              ///< event_log_event_t
+    uint8_t check;              ///< Low byte of the CRC-32 of the fields above
+}event_record_t;
+
+/**
+ * @brief Finds the end of the log in flash, claims the spinlock and records the boot. Call once at boot.
+ *
+ * The log stays off if the firmware reaches into its flash area.
+ */
+void event_log_init(void);
+
+/**
+ * @brief Stages an event. Safe from either core and from IRQ handlers.
+ *
+ * The record is dropped, and counted, when every staging page waits for
+ * core1.
+ *
+ * @param event Event.
+ * @param arg0  First argument.
+ * @param arg1  Second argument.
+ */
+void event_log_write(event_log_event_t event, uint16_t arg0, uint32_t arg1);
+
+/**
+ * @brief Programs the staged records. Runs on core1.
+ *
+ * Never erases: records that need a sector not yet erased wait for
+ * `event_log_erase_ahead()`.
+ */
+void event_log_flush(void);
+
+/**
+ * @brief Programs every staged record, erasing in place if needed. Call before a planned reboot.
+ */
+void event_log_flush_all(void);
+
+/**
+ * @brief Erases the spare sector ahead of the records, or the sector they wait for. Runs on core1.
+ */
+void event_log_erase_ahead(void);
+
+/**
+ * @brief Erases the log. Records written later keep counting their sequence.
+ */
+void event_log_clear(void);
+
+/**
+ * @brief Prints the log, oldest first, for host decoding.
+ *
+ * Line formats (hexadecimal fields): `EVENTS <next_sequence> <dropped>`,
+ * then `EVENT <sequence> <time_ms> <event> <arg0> <arg1>` per record.
+ */
+void event_log_print_machine(void);
+
+#endif
@@ -0,0 +1,113 @@
+/**
+ * @file flash_telemetry.h
+ * @brief Flash wear and commit telemetry for the server's persistence layer.
+ *
+ * Tracks, across reboots:
+ * - Erases per flash sector
+ * - Pages programmed and bytes written
+ * - Number and duration of state commits
+ *
+ * Every sector of the server's flash layout has its own erase counter: the
+ * state sector, the preset library banks, the schedule and interlock
+ * tables, the event log ring and the telemetry sector itself. The client
+ * image staging area is erased a `FIRMWARE_BLOCK_SIZE` block at a time and
+ * is counted per block. The counters live in RAM and are appended as one
+ * page to their own sector after every erase, so an erase is never lost to
+ * a reboot; the sector is only erased once all its pages are used.
+ * Remaining endurance is estimated from the most-worn sector against
+ * `FLASH_RATED_ERASE_CYCLES` and the erase rate since boot.
+ */
+
+#ifndef FLASH_TELEMETRY_H
+#define FLASH_TELEMETRY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "config.h"
+
+/// Guaranteed program/erase cycles per sector of the on-board QSPI flash.
+#ifndef FLASH_RATED_ERASE_CYCLES
+#define FLASH_RATED_ERASE_CYCLES 100000u
+#endif
+
+/// Erase blocks of the client image staging area on the server.
+#define FLASH_TELEMETRY_STAGING_BLOCKS ((FIRMWARE_IMAGE_MAX_BYTES + FIRMWARE_BLOCK_SIZE - 1) / FIRMWARE_BLOCK_SIZE)
+
+/// Erase counters: one per sector of the flash layout, one per block of the client image staging area.
+#define FLASH_TELEMETRY_SECTORS (1 + 2 * PRESET_LIBRARY_BANK_SECTORS + 1 + 1 + \
+    FLASH_TELEMETRY_STAGING_BLOCKS + EVENT_LOG_SECTORS + 1)
+
+#ifndef FLASH_TELEMETRY_MAGIC
+#define FLASH_TELEMETRY_MAGIC 0x32574C46u  ///< "FLW2"
+#endif
+
+/**
+ * @brief Persistent flash telemetry, one page of the telemetry sector.
+ */
+typedef struct{
+    uint32_t magic;
+    uint32_t generation;        ///< Incremented on every store, the newest page is loaded at boot
+    uint32_t commits;           ///< Commits of the state, preset library, schedule and interlock sectors
+    uint32_t page_programs;     ///< SERVER_PAGE_SIZE pages programmed
+    uint32_t untracked_erases;  ///< Erases outside the flash layout
+    uint64_t bytes_written;
+    uint64_t total_commit_us;
+    uint32_t last_commit_us;
+    uint32_t max_commit_us;
+    uint32_t erases[FLASH_TELEMETRY_SECTORS];   ///< One per counted unit, state sector first
+    uint32_t crc;
+}flash_telemetry_t;
+
+_Static_assert(sizeof(flash_telemetry_t) <= SERVER_PAGE_SIZE, "flash telemetry must fit in one flash page");
+
+/**
+ * @brief Loads the telemetry from flash and claims its spinlock. Call once at boot.
+ *
+ * Loads the newest valid page of the telemetry sector. Without one, the
+ * counters an older image kept in the last page of the state sector are
+ * carried over, or counting starts from zero.
+ */
+void flash_telemetry_init(void);
+
+/**
+ * @brief Counts an erase of every sector in a flash range.
+ *
+ * @param offset Flash offset of the erased range (sector aligned).
+ * @param length Length of the erased range in bytes.
+ */
+void flash_telemetry_record_erase(uint32_t offset, uint32_t length);
+
+/**
+ * @brief Counts programmed pages and bytes.
+ *
+ * @param length Number of bytes programmed (multiple of SERVER_PAGE_SIZE).
+ */
+void flash_telemetry_record_program(uint32_t length);
+
+/**
+ * @brief Counts a completed state commit and its duration.
+ *
+ * @param elapsed_us Commit duration in microseconds.
+ */
+void flash_telemetry_record_commit(uint32_t elapsed_us);
+
+/**
+ * @brief Programs the current telemetry into the next page of the telemetry sector.
+ *
+ * Erases the sector first when no erased page is left. Call after every
+ * erase, outside the caller's own flash lockout.
+ */
+void flash_telemetry_store(void);
+
+/**
+ * @brief Prints the telemetry and endurance estimate to the USB CLI.
+ */
+void flash_telemetry_print(void);
+
+/**
+ * @brief Prints the telemetry as `FLASH` / `FLASH_SECTOR` lines for the machine interface.
+ */
+void flash_telemetry_print_machine(void);
+
+#endif
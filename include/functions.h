@@ -5,7 +5,8 @@
  * Provides helpers to:
  * - Initialize and blink the onboard LED
  * - Configure UART with specific TX/RX pins
- * - Receive UART data into buffers
+ * - Receive UART data into buffers, as text frames or raw bytes
+ * - Checksum binary blocks and firmware images
  * - Parse UART messages for TX/RX pin pairs
  * - Reset GPIO pins to default SIO mode
  */
@@ -56,6 +57,19 @@ void uart_init_with_single_pin(uart_inst_t* uart, uint8_t pin_number, uint32_t b
  */
 void get_number_pair(uint8_t *result_array, char *message);
 
+/**
+ * @brief Extracts a comma-separated list of numbers from a UART message.
+ *
+ * Parses strings in the format "[a,b,c,...]". The caller must zero the
+ * result array. Numbers beyond `max_numbers` are ignored.
+ *
+ * @param numbers     Array receiving the parsed numbers.
+ * @param max_numbers Capacity of the array.
+ * @param message     Input string containing the UART message (e.g., "[33,1,2,4096]").
+ * @return Number of fields found (at most `max_numbers`), 0 if the message has no digits.
+ */
+uint8_t get_number_list(uint32_t *numbers, uint8_t max_numbers, const char *message);
+
 /**
  * @brief Reads UART data into a buffer until ']', buffer size reached or timeout.
  *
@@ -71,6 +85,42 @@ void get_number_pair(uint8_t *result_array, char *message);
  */
 void get_uart_buffer(uart_inst_t *uart, char *buffer, uint8_t buffer_size, uint32_t timeout_ms);
 
+/**
+ * @brief Reads a fixed number of raw bytes from the UART.
+ *
+ * Used for the binary blocks that follow a text frame. Unlike
+ * `get_uart_buffer()`, no byte is discarded first.
+ *
+ * @param uart       UART instance to read from.
+ * @param buffer     Buffer receiving the bytes.
+ * @param length     Number of bytes to read.
+ * @param timeout_ms Timeout for the whole read in milliseconds.
+ * @return Number of bytes read, less than `length` on timeout.
+ */
+uint32_t get_uart_bytes(uart_inst_t *uart, uint8_t *buffer, uint32_t length, uint32_t timeout_ms);
+
+/**
+ * @brief Computes the Fletcher-16 checksum of a binary block.
+ *
+ * @param data   Bytes to check.
+ * @param length Number of bytes.
+ * @return Checksum, second sum in the high byte.
+ */
+uint16_t fletcher16(const uint8_t *data, uint32_t length);
+
+/**
+ * @brief Continues a CRC-32 (IEEE 802.3, as zlib) over more bytes.
+ *
+ * Uses a 16-entry table, fast enough for a client at 12 MHz to check an
+ * image sector per frame at full UART speed.
+ *
+ * @param crc    CRC of the bytes so far, 0 to start.
+ * @param data   Bytes to add.
+ * @param length Number of bytes.
+ * @return CRC of all the bytes.
+ */
+uint32_t crc32_update(uint32_t crc, const void *data, uint32_t length);
+
 /**
  * @brief Turns the onboard LED on or off.
  * 
@@ -109,13 +159,16 @@ void init_onboard_led_and_usb(void);
 /**
  * @brief Resets the TX and RX pins to default SIO mode.
  *
- * Used to return the pins to GPIO after UART communication is used.
+ * Used to return the pins to GPIO after UART communication is used. Edges
+ * the exchange left on the RX pin are cleared, so the server does not take
+ * them for an input doorbell.
  *
  * @param pin_pair TX/RX pin pair to reset.
  */
 static inline void reset_gpio_pins(uart_pin_pair_t pin_pair){
     gpio_set_function(pin_pair.tx, GPIO_FUNC_SIO);
     gpio_set_function(pin_pair.rx, GPIO_FUNC_SIO);
+    gpio_acknowledge_irq(pin_pair.rx, GPIO_IRQ_EDGE_FALL);
 }
 
 #endif
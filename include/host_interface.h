@@ -0,0 +1,28 @@
+/**
+ * @file host_interface.h
+ * @brief Line-based machine interface for host tools over USB.
+ *
+ * Selected from the CLI menu, the machine interface replaces the interactive
+ * prompts with a simple request/response protocol that scripts can drive:
+ * - The host sends one command per line (e.g. `STATS`, `STATS RESET`).
+ * - The server answers with zero or more data lines followed by `OK`,
+ *   or with a single `ERR <reason>` line.
+ * - `EXIT` returns to the interactive menu.
+ *
+ * Output is written with plain `printf()` and is not copied into the
+ * reconnection buffer.
+ */
+
+#ifndef HOST_INTERFACE_H
+#define HOST_INTERFACE_H
+
+#ifndef HOST_INTERFACE_LINE_SIZE
+#define HOST_INTERFACE_LINE_SIZE 64
+#endif
+
+/**
+ * @brief Runs the machine interface until the host sends `EXIT`.
+ */
+void host_interface_run(void);
+
+#endif
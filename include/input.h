@@ -20,7 +20,7 @@
 #endif
 
 #ifndef MAXIMUM_MENU_OPTION_INDEX_INPUT
-#define MAXIMUM_MENU_OPTION_INDEX_INPUT 9
+#define MAXIMUM_MENU_OPTION_INDEX_INPUT 14
 #endif
 
 #ifndef MINIMUM_SAVING_OPTION_INPUT 
@@ -59,6 +59,94 @@
 #define MAXIMUM_DEVICE_STATE_INPUT 2
 #endif
 
+#ifndef MINIMUM_DIAGNOSTICS_OPTION_INPUT 
+#define MINIMUM_DIAGNOSTICS_OPTION_INPUT 0
+#endif
+
+#ifndef MAXIMUM_DIAGNOSTICS_OPTION_INPUT 
+#define MAXIMUM_DIAGNOSTICS_OPTION_INPUT 6
+#endif
+
+#ifndef MINIMUM_PULSE_COUNT_INPUT 
+#define MINIMUM_PULSE_COUNT_INPUT 0
+#endif
+
+#ifndef MAXIMUM_PULSE_COUNT_INPUT 
+#define MAXIMUM_PULSE_COUNT_INPUT TIMED_OUTPUT_MAX_PULSES
+#endif
+
+#ifndef MINIMUM_PULSE_TIME_MS_INPUT 
+#define MINIMUM_PULSE_TIME_MS_INPUT 0
+#endif
+
+#ifndef MAXIMUM_PULSE_TIME_MS_INPUT 
+#define MAXIMUM_PULSE_TIME_MS_INPUT TIMED_OUTPUT_MAX_MS
+#endif
+
+#ifndef MINIMUM_SCHEDULE_OPTION_INPUT 
+#define MINIMUM_SCHEDULE_OPTION_INPUT 0
+#endif
+
+#ifndef MAXIMUM_SCHEDULE_OPTION_INPUT 
+#define MAXIMUM_SCHEDULE_OPTION_INPUT 3
+#endif
+
+#ifndef MINIMUM_SCHEDULE_ACTION_INPUT 
+#define MINIMUM_SCHEDULE_ACTION_INPUT 0
+#endif
+
+#ifndef MAXIMUM_SCHEDULE_ACTION_INPUT 
+#define MAXIMUM_SCHEDULE_ACTION_INPUT (SCHEDULE_ACTION_COUNT - 1)
+#endif
+
+#ifndef MINIMUM_SCHEDULE_TIME_S_INPUT 
+#define MINIMUM_SCHEDULE_TIME_S_INPUT 0
+#endif
+
+#ifndef MAXIMUM_SCHEDULE_TIME_S_INPUT 
+#define MAXIMUM_SCHEDULE_TIME_S_INPUT 31536000  ///< One year
+#endif
+
+#ifndef MINIMUM_SCHEDULE_REPEAT_INPUT 
+#define MINIMUM_SCHEDULE_REPEAT_INPUT 0
+#endif
+
+#ifndef MAXIMUM_SCHEDULE_REPEAT_INPUT 
+#define MAXIMUM_SCHEDULE_REPEAT_INPUT 2
+#endif
+
+#ifndef MINIMUM_SCHEDULE_INDEX_INPUT 
+#define MINIMUM_SCHEDULE_INDEX_INPUT 0
+#endif
+
+#ifndef MAXIMUM_SCHEDULE_INDEX_INPUT 
+#define MAXIMUM_SCHEDULE_INDEX_INPUT SCHEDULE_MAX_ENTRIES
+#endif
+
+#ifndef MINIMUM_INPUT_OPTION_INPUT 
+#define MINIMUM_INPUT_OPTION_INPUT 0
+#endif
+
+#ifndef MAXIMUM_INPUT_OPTION_INPUT 
+#define MAXIMUM_INPUT_OPTION_INPUT 2
+#endif
+
+#ifndef MINIMUM_INPUT_MODE_INPUT 
+#define MINIMUM_INPUT_MODE_INPUT 0
+#endif
+
+#ifndef MAXIMUM_INPUT_MODE_INPUT 
+#define MAXIMUM_INPUT_MODE_INPUT INPUT_MODE_COUNT
+#endif
+
+#ifndef MINIMUM_DEBOUNCE_MS_INPUT 
+#define MINIMUM_DEBOUNCE_MS_INPUT 0
+#endif
+
+#ifndef MAXIMUM_DEBOUNCE_MS_INPUT 
+#define MAXIMUM_DEBOUNCE_MS_INPUT INPUT_DEBOUNCE_MAX_MS
+#endif
+
 #ifndef MINIMUM_RESET_VARIANT_INPUT 
 #define MINIMUM_RESET_VARIANT_INPUT 0
 #endif
@@ -83,7 +171,7 @@ bool read_user_choice_in_range(const char* message, uint32_t* out, uint32_t min,
  * @brief Prompts the user to select a menu option from the main CLI.
  *
  * This function displays a message prompting the user to pick a number
- * between 1 and 9, representing the available menu options.
+ * between 1 and 13, representing the available menu options.
  * It reads and validates the input, and stores the selected option in `menu_option`.
  *
  * The valid range is:
@@ -96,6 +184,10 @@ bool read_user_choice_in_range(const char* message, uint32_t* out, uint32_t min,
  * - 7: Reset configuration
  * - 8: Clear Screen
  * - 9. Restart System
+ * - 10. Diagnostics
+ * - 11. Machine Interface
+ * - 12. Pulse client's device
+ * - 13. Schedules
  *
  * @param[out] menu_option Pointer to store the selected menu option.
  * @return true if a valid input was received, false otherwise.
@@ -129,7 +221,7 @@ bool choose_flash_configuration_index(uint32_t *flash_configuration_index);
 /**
  * @brief Repeatedly prompts the user to select a valid preset configuration index.
  *
- * - Displays the list of available preset configuration slots.
+ * - Displays the range of available preset configuration slots.
  * - Loops until a valid selection is made via `choose_flash_configuration_index()`.
  * - Stores the final selection in `flash_configuration_index`.
  *
@@ -225,4 +317,121 @@ bool read_client_data(input_client_data_t *client_data, client_input_flags_t cli
  */
 void read_reset_variant(uint32_t *reset_variant);
 
+/**
+ * @brief Prompts the user to choose a diagnostics tool.
+ *
+ * - Displays the available diagnostics tools:
+ *     1. Event trace dump (Chrome trace JSON)
+ *     2. Runtime statistics
+ *     3. Runtime statistics, reset after reading
+ *     4. Profile dump (PC samples and annotated function cycles)
+ *     5. Log records, formatted as text
+ *     6. Flash wear and commit telemetry
+ * - Uses range-validated input to ensure a valid selection.
+ *
+ * @param diagnostics_option Pointer to the output variable for the selected option.
+ * @return true if a valid option was selected, false otherwise.
+ */
+bool choose_diagnostics_option(uint32_t *diagnostics_option);
+
+/**
+ * @brief Reads a diagnostics tool option from the user.
+ *
+ * Keeps asking until a valid input is provided or the user cancels with 0.
+ *
+ * @param diagnostics_option Pointer to store the selected option (0 = cancel).
+ */
+void read_diagnostics_option(uint32_t *diagnostics_option);
+
+/**
+ * @brief Reads the pulse count and ON/OFF times of a timed output.
+ *
+ * Asks for the number of pulses first; the OFF time is only asked for when
+ * more than one pulse is requested. Each prompt repeats until a valid
+ * number is entered.
+ *
+ * @param pulse_count Output: number of pulses (1 = single ON period).
+ * @param on_ms       Output: ON time of each pulse in milliseconds.
+ * @param off_ms      Output: OFF time between pulses in milliseconds (0 for a single pulse).
+ * @return false if the user cancelled with 0.
+ */
+bool read_timed_output_parameters(uint32_t *pulse_count, uint32_t *on_ms, uint32_t *off_ms);
+
+/**
+ * @brief Prompts the user to choose a schedule command.
+ *
+ * - Displays the available commands:
+ *     1. Show schedules
+ *     2. Add schedule
+ *     3. Delete schedule
+ * - Uses range-validated input to ensure a valid selection.
+ *
+ * @param schedule_option Pointer to the output variable for the selected option.
+ * @return true if a valid option was selected, false otherwise.
+ */
+bool choose_schedule_option(uint32_t *schedule_option);
+
+/**
+ * @brief Reads a schedule command from the user.
+ *
+ * Keeps asking until a valid input is provided or the user cancels with 0.
+ *
+ * @param schedule_option Pointer to store the selected option (0 = cancel).
+ */
+void read_schedule_option(uint32_t *schedule_option);
+
+/**
+ * @brief Reads the action of a new schedule entry.
+ *
+ * @param action Output: a schedule_action_t value, 0 if the user cancelled.
+ */
+void read_schedule_action(uint32_t *action);
+
+/**
+ * @brief Reads when a new schedule entry runs and whether it repeats.
+ *
+ * @param delay_s  Output: seconds from now until the first run.
+ * @param period_s Output: repeat period in seconds, 0 to run once.
+ * @return false if the user cancelled with 0.
+ */
+bool read_schedule_timing(uint32_t *delay_s, uint32_t *period_s);
+
+/**
+ * @brief Reads the number of a schedule entry, as listed by `scheduler_print()`.
+ *
+ * @param schedule_index Output: entry number (1-based), 0 if the user cancelled.
+ */
+void read_schedule_index(uint32_t *schedule_index);
+
+/**
+ * @brief Prompts the user to choose a client input command.
+ *
+ * - Displays the available commands:
+ *     1. Show inputs
+ *     2. Configure input
+ * - Uses range-validated input to ensure a valid selection.
+ *
+ * @param input_option Pointer to the output variable for the selected option.
+ * @return true if a valid option was selected, false otherwise.
+ */
+bool choose_input_option(uint32_t *input_option);
+
+/**
+ * @brief Reads a client input command from the user.
+ *
+ * Keeps asking until a valid input is provided or the user cancels with 0.
+ *
+ * @param input_option Pointer to store the selected option (0 = cancel).
+ */
+void read_input_option(uint32_t *input_option);
+
+/**
+ * @brief Reads the mode and debounce time of a client input.
+ *
+ * @param mode        Output: an input_mode_t value.
+ * @param debounce_ms Output: debounce time in milliseconds (0 when releasing).
+ * @return false if the user cancelled with 0.
+ */
+bool read_input_parameters(uint32_t *mode, uint32_t *debounce_ms);
+
 #endif 
@@ -0,0 +1,216 @@
+/**
+ * @file log.h
+ * @brief Leveled binary logging with per-module compile-time thresholds.
+ *
+ * Each log call stores a fixed-size record (timestamp, level, module,
+ * message ID and two numeric arguments) in a RAM ring. No text is
+ * formatted when a record is written. Records are turned into text only on
+ * demand (Diagnostics menu), or dumped raw through the machine interface
+ * and decoded on the host with the message table below.
+ *
+ * Usage in a source file:
+ * @code
+ * #define LOG_MODULE HANDSHAKE
+ * #include "log.h"
+ *
+ * LOG_INFO(HANDSHAKE_ACCEPTED, pin_pair.tx, pin_pair.rx);
+ * @endcode
+ *
+ * A level is compiled in when it is at or below the module's threshold
+ * `LOG_THRESHOLD_<module>`, which defaults to `LOG_LEVEL`. Disabled levels
+ * are removed by the preprocessor, arguments included.
+ */
+
+#ifndef LOG_H
+#define LOG_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define LOG_LEVEL_NONE  0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN  2
+#define LOG_LEVEL_INFO  3
+#define LOG_LEVEL_DEBUG 4
+#define LOG_LEVEL_TRACE 5
+
+/// Default threshold for all modules (e.g. `-DLOG_LEVEL=4` for debug builds).
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_WARN
+#endif
+
+#ifndef LOG_THRESHOLD_HANDSHAKE
+#define LOG_THRESHOLD_HANDSHAKE LOG_LEVEL
+#endif
+
+#ifndef LOG_THRESHOLD_UART
+#define LOG_THRESHOLD_UART LOG_LEVEL
+#endif
+
+#ifndef LOG_THRESHOLD_STATE
+#define LOG_THRESHOLD_STATE LOG_LEVEL
+#endif
+
+#ifndef LOG_THRESHOLD_FLASH
+#define LOG_THRESHOLD_FLASH LOG_LEVEL
+#endif
+
+/// Records kept in RAM. Must be a power of two.
+#ifndef LOG_RING_SIZE
+#define LOG_RING_SIZE 128
+#endif
+
+/**
+ * @brief Modules that emit log records.
+ */
+typedef enum{
+    LOG_MODULE_ID_HANDSHAKE,    ///< server_side_handshake.c
+    LOG_MODULE_ID_UART,         ///< client_communication.c, time_sync.c, stream.c
+    LOG_MODULE_ID_STATE,        ///< state_handling.c, state_apply.c, preset_sync.c, timed_output.c, scheduler.c
+    LOG_MODULE_ID_FLASH,        ///< state_flash.c, preset_store.c, schedule_store.c
+    LOG_MODULE_ID_COUNT
+}log_module_t;
+
+/**
+ * @brief Log messages: ID and printf format for the two arguments.
+ *
+ * Formats receive both arguments as `unsigned long`. New messages go at the
+ * end so that IDs decoded by host tools stay stable.
+ */
+#define LOG_MESSAGES(X) \
+    X(HANDSHAKE_ACCEPTED,   "client accepted on server pins [%lu,%lu]") \
+    X(HANDSHAKE_NO_CLIENT,  "no client on server pins [%lu,%lu]") \
+    X(HANDSHAKE_TABLE_FULL, "connection table full, dropping pins [%lu,%lu]") \
+    X(UART_WAKE_PULSE,      "wake pulse on pin %lu (%lu us)") \
+    X(UART_STATE_SENT,      "client state sent on pin %lu (%lu bytes)") \
+    X(STATE_CRC_INVALID,    "stored state invalid, defaults written for %lu clients (%lu bytes)") \
+    X(STATE_PRESET_SAVED,   "preset %lu saved for client %lu") \
+    X(STATE_PRESET_LOADED,  "preset %lu loaded for client %lu") \
+    X(FLASH_COMMIT,         "flash commit at 0x%08lx took %lu us") \
+    X(STATE_PRESET_SYNCED,  "preset %lu sent to client before recall (version %lu)") \
+    X(STATE_TIMED_OUTPUT_STARTED,   "timed output on gpio %lu, %lu pulses") \
+    X(STATE_TIMED_OUTPUT_REPORTED,  "client %lu reported timed outputs done, gpio mask 0x%08lx") \
+    X(STATE_TIMED_OUTPUT_MISMATCH,  "client %lu has finished outputs still ON, gpio mask 0x%08lx") \
+    X(STATE_TIMED_OUTPUT_NO_REPORT, "client %lu did not report timed outputs, gpio mask 0x%08lx") \
+    X(STATE_SCHEDULE_RAN,           "schedule %lu ran, action %lu") \
+    X(STATE_SCHEDULE_CLIENT_MISSING, "schedule %lu skipped, client %lu not connected") \
+    X(UART_TIME_SYNC_FAILED,        "no time sync reply on pin %lu (%lu samples)") \
+    X(UART_TIME_SYNCED,             "client %lu clock synced, drift %ld ppb") \
+    X(STATE_SCENE_LOADED,           "preset %lu loaded as a scene on %lu clients") \
+    X(STATE_LATCH_MISSED,           "client %lu did not apply latch commit %lu, preset recalled") \
+    X(UART_STREAM_ENDED,            "stream ended, %lu frames sent, %lu underruns") \
+    X(STATE_SEQUENCE_STARTED,       "client %lu sequence started, %lu steps") \
+    X(STATE_INPUT_CHANGED,          "client %lu inputs changed, levels 0x%08lx") \
+    X(STATE_INPUT_NO_REPORT,        "client %lu rang but sent no input report, pin %lu") \
+    X(STATE_RULE_FIRED,             "client %lu local rules fired, rule mask 0x%08lx") \
+    X(STATE_INTERLOCK_FIRED,        "interlock %lu fired, reaction %lu us") \
+    X(STATE_INTERLOCK_CLIENT_MISSING, "interlock %lu target client %lu not connected") \
+    X(STATE_ADC_BLOCK_BAD,          "client %lu sent %lu damaged ADC blocks") \
+    X(STATE_ADC_BLOCKS_DROPPED,     "client %lu dropped %lu ADC blocks, ring full") \
+    X(STATE_LOGIC_CHUNK_BAD,        "client %lu sent %lu damaged logic capture chunks") \
+    X(STATE_FIRMWARE_STAGED,        "client %lu received the new image in %lu ms") \
+    X(STATE_FIRMWARE_FAILED,        "client %lu image transfer failed at sector %lu") \
+    X(STATE_AUDIT_REPAIRED,         "client %lu outputs differed from the stored state, repaired gpio mask 0x%08lx") \
+    X(UART_STREAM_REFUSED,          "stream at %lu Hz refused, the UART links carry at most %lu Hz") \
+    X(STATE_CORE1_DROPPED,          "core1 queue full, %lu wakeup messages dropped since boot (%lu new)") \
+    X(STATE_INPUT_RESTORED,         "client %lu input configuration sent again, inputs 0x%08lx") \
+    X(STATE_RULES_RESTORED,         "client %lu local rules sent again, rules 0x%08lx")
+
+#define LOG_MESSAGE_ENUM(name, format) LOG_MSG_##name,
+typedef enum{
+    LOG_MESSAGES(LOG_MESSAGE_ENUM)
+    LOG_MESSAGE_COUNT
+}log_message_t;
+#undef LOG_MESSAGE_ENUM
+
+/**
+ * @brief A single binary log record.
+ */
+typedef struct{
+    uint32_t timestamp_us;
+    uint16_t message;           ///< log_message_t
+    uint8_t level;              ///< LOG_LEVEL_ERROR .. LOG_LEVEL_TRACE
+    uint8_t module;             ///< log_module_t
+    uint32_t arg0;
+    uint32_t arg1;
+}log_record_t;
+
+/**
+ * @brief Claims the spinlock protecting the log ring. Call once at boot.
+ *
+ * Records written before this call are dropped.
+ */
+void log_init(void);
+
+/**
+ * @brief Appends a record to the log ring, overwriting the oldest one.
+ *
+ * Use the `LOG_<LEVEL>()` macros instead of calling this directly.
+ *
+ * @param level   Record level.
+ * @param module  Emitting module.
+ * @param message Message ID.
+ * @param arg0    First message argument.
+ * @param arg1    Second message argument.
+ */
+void log_write(uint8_t level, log_module_t module, log_message_t message, uint32_t arg0, uint32_t arg1);
+
+/**
+ * @brief Formats the logged records as text over USB.
+ *
+ * @param reset true to clear the log after it is printed.
+ */
+void log_dump(bool reset);
+
+/**
+ * @brief Prints the logged records as raw `LOG` lines for host decoding.
+ *
+ * Line format (hexadecimal fields):
+ * `LOG <timestamp_us> <level> <module> <message> <arg0> <arg1>`
+ *
+ * @param reset true to clear the log after it is printed.
+ */
+void log_dump_machine(bool reset);
+
+#define LOG_CONCAT_(a, b) a##b
+#define LOG_CONCAT(a, b) LOG_CONCAT_(a, b)
+
+#ifdef LOG_MODULE
+
+#define LOG_MODULE_THRESHOLD LOG_CONCAT(LOG_THRESHOLD_, LOG_MODULE)
+#define LOG_WRITE(level, message, arg0, arg1) \
+    log_write((level), LOG_CONCAT(LOG_MODULE_ID_, LOG_MODULE), LOG_MSG_##message, (uint32_t)(arg0), (uint32_t)(arg1))
+
+#if LOG_MODULE_THRESHOLD >= LOG_LEVEL_ERROR
+#define LOG_ERROR(message, arg0, arg1) LOG_WRITE(LOG_LEVEL_ERROR, message, arg0, arg1)
+#else
+#define LOG_ERROR(message, arg0, arg1) ((void)0)
+#endif
+
+#if LOG_MODULE_THRESHOLD >= LOG_LEVEL_WARN
+#define LOG_WARN(message, arg0, arg1) LOG_WRITE(LOG_LEVEL_WARN, message, arg0, arg1)
+#else
+#define LOG_WARN(message, arg0, arg1) ((void)0)
+#endif
+
+#if LOG_MODULE_THRESHOLD >= LOG_LEVEL_INFO
+#define LOG_INFO(message, arg0, arg1) LOG_WRITE(LOG_LEVEL_INFO, message, arg0, arg1)
+#else
+#define LOG_INFO(message, arg0, arg1) ((void)0)
+#endif
+
+#if LOG_MODULE_THRESHOLD >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(message, arg0, arg1) LOG_WRITE(LOG_LEVEL_DEBUG, message, arg0, arg1)
+#else
+#define LOG_DEBUG(message, arg0, arg1) ((void)0)
+#endif
+
+#if LOG_MODULE_THRESHOLD >= LOG_LEVEL_TRACE
+#define LOG_TRACE(message, arg0, arg1) LOG_WRITE(LOG_LEVEL_TRACE, message, arg0, arg1)
+#else
+#define LOG_TRACE(message, arg0, arg1) ((void)0)
+#endif
+
+#endif
+
+#endif
@@ -25,6 +25,42 @@
 #define BLINK_LED_WAKEUP_MESSAGE 0xEDEDEDED
 #endif
 
+#ifndef TIMED_OUTPUT_POLL_WAKEUP_MESSAGE
+#define TIMED_OUTPUT_POLL_WAKEUP_MESSAGE 0xC0C0C0C0
+#endif
+
+#ifndef SCHEDULER_TICK_WAKEUP_MESSAGE
+#define SCHEDULER_TICK_WAKEUP_MESSAGE 0x5C5C5C5C
+#endif
+
+#ifndef SCHEDULER_RELOAD_WAKEUP_MESSAGE
+#define SCHEDULER_RELOAD_WAKEUP_MESSAGE 0x5D5D5D5D
+#endif
+
+#ifndef INPUT_DOORBELL_WAKEUP_MESSAGE
+#define INPUT_DOORBELL_WAKEUP_MESSAGE 0x1D1D1D1D
+#endif
+
+#ifndef INTERLOCK_RELOAD_WAKEUP_MESSAGE
+#define INTERLOCK_RELOAD_WAKEUP_MESSAGE 0x1C1C1C1C
+#endif
+
+#ifndef AUDIT_TICK_WAKEUP_MESSAGE
+#define AUDIT_TICK_WAKEUP_MESSAGE 0xA0A0A0A0
+#endif
+
+#ifndef EVENT_LOG_FLUSH_WAKEUP_MESSAGE
+#define EVENT_LOG_FLUSH_WAKEUP_MESSAGE 0xE1E1E1E1
+#endif
+
+#ifndef EVENT_LOG_ERASE_WAKEUP_MESSAGE
+#define EVENT_LOG_ERASE_WAKEUP_MESSAGE 0xE2E2E2E2
+#endif
+
+#ifndef STREAM_ENDED_WAKEUP_MESSAGE
+#define STREAM_ENDED_WAKEUP_MESSAGE 0x42424242
+#endif
+
 extern volatile char reconnection_buffer[BUFFER_MAX_NUMBER_OF_STRINGS][BUFFER_MAX_STRING_SIZE];
 extern volatile uint32_t reconnection_buffer_len;
 extern volatile uint32_t reconnection_buffer_index;
@@ -0,0 +1,169 @@
+/**
+ * @file profiler.h
+ * @brief Opt-in sampling and cycle-counting profiler for server and client builds.
+ *
+ * Built only when `PROFILING_BUILD` is set (e.g. `-DPROFILING_BUILD=1` on the
+ * CMake command line). It provides two complementary views:
+ * - PC sampling: a hardware timer alarm interrupts each profiled core every
+ *   `PROFILER_SAMPLE_PERIOD_US` and records the interrupted program counter
+ *   into a per-core histogram. Symbolise the dumped addresses on the host
+ *   with `arm-none-eabi-addr2line -f -e server.elf` (or `client.elf`).
+ * - Annotated functions: `PROFILE_ENTER()` / `PROFILE_EXIT()` count calls and
+ *   CPU cycles spent in selected hot functions.
+ *
+ * Cycles come from SysTick, extended to 32 bits in software. The recorders
+ * are inlined and touch only RAM, so they can be used from
+ * `__not_in_flash_func` code. PC samples are not taken while interrupts are
+ * disabled (e.g. during flash erase/program); such time is attributed to the
+ * instruction that re-enables interrupts.
+ *
+ * When `PROFILING_BUILD` is 0 every macro expands to nothing.
+ */
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "pico/stdlib.h"
+#include "hardware/structs/systick.h"
+#include "hardware/structs/scb.h"
+
+#ifndef PROFILING_BUILD
+#define PROFILING_BUILD 0
+#endif
+
+#ifndef PROFILER_SAMPLE_PERIOD_US
+#define PROFILER_SAMPLE_PERIOD_US 997      ///< Prime period avoids locking onto 1 ms periodic work
+#endif
+
+/// Entries in each core's PC histogram. Must be a power of two.
+#ifndef PROFILER_PC_TABLE_SIZE
+#define PROFILER_PC_TABLE_SIZE 256
+#endif
+
+/// Sampled PCs are grouped into buckets of 2^N bytes to keep the table small.
+#ifndef PROFILER_PC_GRANULARITY_SHIFT
+#define PROFILER_PC_GRANULARITY_SHIFT 4
+#endif
+
+#ifndef PROFILER_PC_MAX_PROBES
+#define PROFILER_PC_MAX_PROBES 8
+#endif
+
+#ifndef PROFILER_SYSTICK_RELOAD
+#define PROFILER_SYSTICK_RELOAD 0x00FFFFFFu
+#endif
+
+#ifndef PROFILER_ICSR_PENDSTSET_BITS
+#define PROFILER_ICSR_PENDSTSET_BITS (1u << 26)
+#endif
+
+/**
+ * @brief Functions instrumented with explicit enter/exit cycle counters.
+ */
+typedef enum{
+    PROFILE_SAVE_SERVER_STATE,
+    PROFILE_COMPUTE_CRC32,
+    PROFILE_SERVER_SEND_CLIENT_STATE,
+    PROFILE_PRINTF_AND_UPDATE_BUFFER,
+    PROFILE_GET_UART_BUFFER,
+    PROFILE_FUNCTION_COUNT
+}profiler_function_t;
+
+/**
+ * @brief Cycle totals for one annotated function on one core.
+ */
+typedef struct{
+    uint32_t calls;
+    uint64_t total_cycles;
+    uint32_t max_cycles;
+}profiler_function_stats_t;
+
+/**
+ * @brief One bucket of the PC sample histogram.
+ */
+typedef struct{
+    uint32_t pc_bucket;     ///< PC >> PROFILER_PC_GRANULARITY_SHIFT, 0 = empty slot
+    uint32_t samples;
+}profiler_pc_entry_t;
+
+#if PROFILING_BUILD
+
+extern volatile uint32_t profiler_systick_wraps[NUM_CORES];
+extern profiler_function_stats_t profiler_functions[NUM_CORES][PROFILE_FUNCTION_COUNT];
+
+/**
+ * @brief Returns the calling core's 32-bit cycle count.
+ *
+ * Combines the 24-bit SysTick down-counter with the software wrap count.
+ * A wrap that is pending because interrupts are disabled is accounted for,
+ * so intervals spanning short interrupt-free sections remain correct.
+ *
+ * @return Elapsed CPU cycles since `profiler_init_core()` (wraps at 2^32).
+ */
+static inline uint32_t profiler_cycles(void){
+    uint core = get_core_num();
+    uint32_t wraps;
+    uint32_t current;
+    do{
+        wraps = profiler_systick_wraps[core];
+        current = systick_hw->cvr;
+    }while (wraps != profiler_systick_wraps[core]);
+
+    if (scb_hw->icsr & PROFILER_ICSR_PENDSTSET_BITS){
+        current = systick_hw->cvr;
+        wraps++;
+    }
+
+    return (wraps << 24) | (PROFILER_SYSTICK_RELOAD - current);
+}
+
+/**
+ * @brief Accounts one call of an annotated function.
+ *
+ * @param function     Annotated function ID.
+ * @param start_cycles Value of `profiler_cycles()` at function entry.
+ */
+static inline void profiler_account(profiler_function_t function, uint32_t start_cycles){
+    uint32_t elapsed = profiler_cycles() - start_cycles;
+    profiler_function_stats_t *stats = &profiler_functions[get_core_num()][function];
+    stats->calls++;
+    stats->total_cycles += elapsed;
+    if (elapsed > stats->max_cycles){
+        stats->max_cycles = elapsed;
+    }
+}
+
+#define PROFILE_ENTER(function) uint32_t profile_start_##function = profiler_cycles()
+#define PROFILE_EXIT(function)  profiler_account((function), profile_start_##function)
+
+#else
+
+#define PROFILE_ENTER(function) ((void)0)
+#define PROFILE_EXIT(function)  ((void)0)
+
+#endif
+
+/**
+ * @brief Starts the cycle counter and PC sampling on the calling core.
+ *
+ * Must be called once from each core that should be profiled. Does nothing
+ * unless `PROFILING_BUILD` is set.
+ */
+void profiler_init_core(void);
+
+/**
+ * @brief Prints the flat profile of all cores over USB.
+ *
+ * Output lines:
+ * - `PROFILE core=<n> samples=<total> dropped=<n> period_us=<n>`
+ * - `PC 0x<address> <samples>` for each sampled bucket
+ * - `FUNC <name> core=<n> calls=<n> total_cycles=<n> max_cycles=<n>`
+ *
+ * @param reset true to clear the profile after it is printed.
+ */
+void profiler_dump(bool reset);
+
+#endif
@@ -35,97 +35,1495 @@
 
 extern spin_lock_t *uart_lock;
 
+/**
+ * @brief Acquires the shared UART spinlock.
+ *
+ * Disables interrupts on the calling core until `uart_lock_release()` is called.
+ * All UART sessions with clients must be wrapped in this pair. While an
+ * output stream runs, this waits until the stream ends, which is why core1
+ * holds back its UART work during a stream. Boosts clk_sys
+ * first, see `server_clock_governor_boost()`.
+ *
+ * @return Saved interrupt state, to be passed to `uart_lock_release()`.
+ */
+uint32_t uart_lock_acquire(void);
+
+/**
+ * @brief Releases the shared UART spinlock and restores interrupts.
+ *
+ * @param irq Interrupt state returned by `uart_lock_acquire()`.
+ */
+void uart_lock_release(uint32_t irq);
+
+/**
+ * @brief Returns the time since the UART lock was last released.
+ *
+ * Background tasks use it to stay out of the way of interactive traffic.
+ *
+ * @return Microseconds since the last `uart_lock_release()`.
+ */
+uint32_t uart_lock_idle_us(void);
+
 /**
  * @brief Active UART server connections detected at runtime.
  *
- * Filled after a successful scan in `server_find_connections()`.
+ * Filled after a successful scan in `server_find_connections()`.
+ */
+extern server_uart_connection_t active_uart_server_connections[MAX_SERVER_CONNECTIONS];
+
+/**
+ * @brief Number of active connections found and stored in `active_uart_server_connections`.
+ */
+extern uint8_t active_server_connections_number;
+
+/**
+ * @brief Sends a UART message safely using spinlock protection.
+ *
+ * This function first wakes up the client by sending a pulse on its RX pin.
+ * Then it initializes the UART peripheral with the specified TX/RX pins and baudrate,
+ * sends the message, waits for the transmission to complete, and resets the GPIO pins.
+ * All UART operations are protected by a spinlock to ensure thread/core safety.
+ *
+ * @param uart Pointer to the UART instance to use (e.g., uart0 or uart1).
+ * @param pins Struct containing the TX and RX GPIO pin numbers.
+ * @param msg Null-terminated string to be sent via UART.
+ */
+void send_uart_message_safe(uart_inst_t* uart, uart_pin_pair_t pins, const char* msg);
+
+/**
+ * @brief Wakes up a dormant client if needed, based on its persistent state.
+ *
+ * Checks whether the client at the specified index is dormant. If so, it
+ * sends a wake-up pulse via UART to ensure the client is active before communication.
+ *
+ * @param flash_client_index Index of the client in the persistent state table.
+ * @param state              Pointer to the global persistent state structure.
+ * @param pin_pair           UART TX/RX pins used to wake up the client.
+ * @param uart               Pointer to the UART instance used for transmission.
+ *
+ * @see wake_up_client()
+ */
+void send_wakeup_if_dormant(uint32_t flash_client_index, server_persistent_state_t *const state, uart_pin_pair_t pin_pair, uart_inst_t *const uart);
+
+/**
+ * @brief Sends a dormant flag message to a specific client over UART.
+ *
+ * Constructs a message with the dormant flag number and sends it
+ * via the UART instance and pin pair assigned to the specified client.
+ * The client's clock offset is dropped, as its timer stops while dormant.
+ * Its RX pin is then pulled down, see `set_rx_pin_as_input_for_client()`.
+ *
+ * @param client_index Index of the client in the active server connections.
+ */
+void send_dormant_flag_to_client(uint8_t client_index);
+
+/**
+ * @brief Leaves the RX pin of a client as an input pulled to the level the client holds.
+ *
+ * An awake client keeps its TX pin high, the UART idle level, so the RX
+ * pin is pulled up and the start bit of a doorbell is a clean falling
+ * edge. A dormant client only pulls its TX pin down, so the RX pin is
+ * pulled down as well rather than fighting it. The server drives the RX
+ * pin only for the wake pulse.
+ *
+ * @param pin_pair     TX/RX pin pair of the client.
+ * @param client_awake false right after the client was sent to dormant mode.
+ */
+void set_rx_pin_as_input_for_client(uart_pin_pair_t pin_pair, bool client_awake);
+
+/**
+ * @brief Sends a reset trigger message to all clients.
+ *
+ * This causes each connected client to perform a full reset of its internal state.
+ */
+void signal_reset_for_all_clients();
+
+/**
+ * @brief Sends a fast onboard LED blink signal to all clients.
+ *
+ * Triggers a visual blink (e.g., heartbeat) on each client device.
+ */
+void send_fast_blink_onboard_led_to_clients();
+
+/**
+ * @brief Sends a dormant message to all clients marked as dormant.
+ *
+ * Iterates through all active UART connections and sends a predefined
+ * dormant flag message to each client with the `is_dormant` flag set.
+ */
+void send_dormant_to_standby_clients(void);
+
+/**
+ * @brief Sends the entire current client state over UART.
+ *
+ * @param pin_pair UART TX/RX pin pair to use.
+ * @param uart UART instance.
+ * @param state Pointer to the client_state_t to send.
+ */
+void server_send_client_state(uart_pin_pair_t pin_pair, uart_inst_t* uart, const client_state_t* state);
+
+/**
+ * @brief Stores a preset on an awake client with a single frame.
+ *
+ * Sends "[PRESET_STORE_FLAG_NUMBER,preset,version,gpio_mask]".
+ *
+ * @param pin_pair     UART TX/RX pin pair to use.
+ * @param uart         UART instance.
+ * @param preset_index Preset slot (0-based).
+ * @param preset       Version and GPIO mask to store.
+ */
+void server_send_preset(uart_pin_pair_t pin_pair, uart_inst_t* uart, uint8_t preset_index, const client_preset_t *preset);
+
+/**
+ * @brief Wakes a client and makes it apply one of its stored presets.
+ *
+ * @param pin_pair     UART TX/RX pin pair to use.
+ * @param uart         UART instance.
+ * @param preset_index Preset slot (0-based).
+ * @param stale_preset If not NULL, sent with `server_send_preset()` before the
+ *                     recall because the client's copy is out of date.
+ */
+void server_send_preset_recall(uart_pin_pair_t pin_pair, uart_inst_t* uart, uint8_t preset_index, const client_preset_t *stale_preset);
+
+/**
+ * @brief Starts a timed output or pulse train on a client.
+ *
+ * Sends "[35,gpio,on_ms]" for a single pulse, otherwise
+ * "[36,gpio,on_ms,off_ms,count]". The client must be awake.
+ *
+ * @param pin_pair    UART TX/RX pin pair to use.
+ * @param uart        UART instance.
+ * @param gpio_number Client GPIO to drive.
+ * @param on_ms       ON time of each pulse in milliseconds.
+ * @param off_ms      OFF time between pulses in milliseconds.
+ * @param pulse_count Number of pulses.
+ */
+void server_send_timed_output(uart_pin_pair_t pin_pair, uart_inst_t* uart, uint8_t gpio_number, uint32_t on_ms, uint32_t off_ms, uint32_t pulse_count);
+
+/**
+ * @brief Wakes a client and asks which timed outputs have finished.
+ *
+ * Sends "[37,37]" and listens up to `OUTPUT_REPORT_TIMEOUT_MS` for the
+ * "[37,completed_mask,on_mask]" reply while holding the UART lock.
+ *
+ * @param pin_pair       UART TX/RX pin pair to use.
+ * @param uart           UART instance.
+ * @param completed_mask Set to the GPIOs whose timed output finished since the last poll.
+ * @param gpio_on_mask   Set to the client's current GPIO on-mask.
+ * @return true if a valid reply was received.
+ */
+bool server_poll_output_report(uart_pin_pair_t pin_pair, uart_inst_t* uart, uint32_t *completed_mask, uint32_t *gpio_on_mask);
+
+/**
+ * @brief Reads a client's clock with `TIME_SYNC_SAMPLES` sync requests.
+ *
+ * Sends "[38,38]" and listens up to `TIME_SYNC_TIMEOUT_MS` for each
+ * "[38,time_us_hi,time_us_lo]" reply while holding the UART lock. The
+ * client must be awake.
+ *
+ * @param pin_pair     UART TX/RX pin pair to use.
+ * @param uart         UART instance.
+ * @param offset_us    Set to the smallest client time minus server time measured.
+ * @param synced_at_us Set to the server time of that measurement.
+ * @return true if at least one valid reply was received.
+ */
+bool server_time_sync_exchange(uart_pin_pair_t pin_pair, uart_inst_t* uart, int64_t *offset_us, uint64_t *synced_at_us);
+
+/**
+ * @brief Makes a client apply a command when its clock reaches a given time.
+ *
+ * Sends "[39,client_time_lo,command,argument]". The client must be awake.
+ *
+ * @param pin_pair       UART TX/RX pin pair to use.
+ * @param uart           UART instance.
+ * @param client_time_us Client time to apply at, see `time_sync_client_time()`.
+ * @param command        `PRESET_RECALL_FLAG_NUMBER` or a GPIO number.
+ * @param argument       Preset slot (0-based) or GPIO level.
+ */
+void server_send_apply_at(uart_pin_pair_t pin_pair, uart_inst_t* uart, uint64_t client_time_us, uint32_t command, uint32_t argument);
+
+/**
+ * @brief Stages an on-mask on a client, applied on the next latch line edge.
+ *
+ * Sends "[40,gpio_mask,sequence]". The client must be awake.
+ *
+ * @param pin_pair  UART TX/RX pin pair to use.
+ * @param uart      UART instance.
+ * @param gpio_mask Bit `n` set when GPIO `n` must be ON.
+ * @param sequence  Commit sequence number from `server_latch_next_sequence()`.
+ */
+void server_send_latch_stage(uart_pin_pair_t pin_pair, uart_inst_t* uart, uint32_t gpio_mask, uint32_t sequence);
+
+/**
+ * @brief Asks a client which latch commit it applied last.
+ *
+ * Sends "[41,41]" and listens up to `LATCH_REPORT_TIMEOUT_MS` for the
+ * "[41,applied_sequence,missed_edges]" reply while holding the UART lock.
+ * The client must be awake.
+ *
+ * @param pin_pair         UART TX/RX pin pair to use.
+ * @param uart             UART instance.
+ * @param applied_sequence Set to the sequence of the last applied commit.
+ * @param missed_edges     Set to the latch edges that found nothing staged since the last poll.
+ * @return true if a valid reply was received.
+ */
+bool server_poll_latch_report(uart_pin_pair_t pin_pair, uart_inst_t* uart, uint32_t *applied_sequence, uint32_t *missed_edges);
+
+/**
+ * @brief Clears the sequence of a client and sets its length and loop count.
+ *
+ * Sends "[45,step_count,loop_count]". The client must be awake.
+ *
+ * @param pin_pair   UART TX/RX pin pair to use.
+ * @param uart       UART instance.
+ * @param step_count Number of steps (1..SEQUENCE_MAX_STEPS).
+ * @param loop_count Number of times to play the steps, 0 for ever.
+ */
+void server_send_sequence_define(uart_pin_pair_t pin_pair, uart_inst_t* uart, uint32_t step_count, uint32_t loop_count);
+
+/**
+ * @brief Sets one step of a client's sequence.
+ *
+ * Sends "[46,step,gpio_mask,duration_us]". The client must be awake.
+ *
+ * @param pin_pair    UART TX/RX pin pair to use.
+ * @param uart        UART instance.
+ * @param step        Step index (0-based).
+ * @param gpio_mask   Bit `n` set when GPIO `n` must be ON during the step.
+ * @param duration_us Step duration in microseconds.
+ */
+void server_send_sequence_step(uart_pin_pair_t pin_pair, uart_inst_t* uart, uint32_t step, uint32_t gpio_mask, uint32_t duration_us);
+
+/**
+ * @brief Starts, stops or seeks a client's sequence.
+ *
+ * Sends "[47,control,step]". The client must be awake.
+ *
+ * @param pin_pair UART TX/RX pin pair to use.
+ * @param uart     UART instance.
+ * @param control  Playback command.
+ * @param step     Step to play from, for START and SEEK.
+ */
+void server_send_sequence_control(uart_pin_pair_t pin_pair, uart_inst_t* uart, sequence_control_t control, uint32_t step);
+
+/**
+ * @brief Asks a client where its sequence is.
+ *
+ * Sends "[48,48]" and listens up to `OUTPUT_REPORT_TIMEOUT_MS` for the
+ * "[48,playing,step,loops_done]" reply while holding the UART lock.
+ * The client must be awake.
+ *
+ * @param pin_pair   UART TX/RX pin pair to use.
+ * @param uart       UART instance.
+ * @param playing    Set to true if the sequence plays.
+ * @param step       Set to the current step.
+ * @param loops_done Set to the number of completed loops.
+ * @return true if a valid reply was received.
+ */
+bool server_poll_sequence_report(uart_pin_pair_t pin_pair, uart_inst_t* uart, bool *playing, uint32_t *step, uint32_t *loops_done);
+
+/**
+ * @brief Makes a client GPIO an input, changes its pull or releases it.
+ *
+ * Sends "[49,gpio,mode,debounce_ms]". The client must be awake.
+ *
+ * @param pin_pair    UART TX/RX pin pair to use.
+ * @param uart        UART instance.
+ * @param gpio_number Client GPIO.
+ * @param mode        Input mode, `INPUT_MODE_OFF` to release the GPIO.
+ * @param debounce_ms Time the level must be stable on the client.
+ */
+void server_send_input_config(uart_pin_pair_t pin_pair, uart_inst_t* uart, uint8_t gpio_number, input_mode_t mode, uint32_t debounce_ms);
+
+/**
+ * @brief Collects the input changes of a client.
+ *
+ * Sends "[50,50]" and listens up to `INPUT_REPORT_TIMEOUT_MS` for the
+ * "[50,levels,rise_mask,fall_mask,age_us,changes,fired_rules,adc_blocks,logic_ready]"
+ * reply while holding the UART lock. The client must be awake.
+ *
+ * @param pin_pair     UART TX/RX pin pair to use.
+ * @param uart         UART instance.
+ * @param levels       Set to the stable levels of the client's inputs.
+ * @param rise_mask    Set to the inputs that rose since the last collect.
+ * @param fall_mask    Set to the inputs that fell since the last collect.
+ * @param age_us       Set to the time since the last change.
+ * @param changes      Set to the number of changes since the last collect.
+ * @param fired_rules  Set to the local rules that fired since the last collect.
+ * @param adc_blocks   Set to the number of ADC blocks waiting on the client.
+ * @param logic_ready  Set when a full logic capture waits on the client.
+ * @return true if a valid reply was received.
+ */
+bool server_poll_input_report(uart_pin_pair_t pin_pair, uart_inst_t* uart, uint32_t *levels, uint32_t *rise_mask, uint32_t *fall_mask, uint32_t *age_us, uint32_t *changes, uint32_t *fired_rules, uint32_t *adc_blocks, bool *logic_ready);
+
+/**
+ * @brief Starts, restarts or stops ADC sampling on a client.
+ *
+ * Sends "[56,channel_mask,rate_hz,decimation]". The client must be awake.
+ *
+ * @param pin_pair     UART TX/RX pin pair to use.
+ * @param uart         UART instance.
+ * @param channel_mask ADC inputs to sample, 0 to stop.
+ * @param rate_hz      Samples per second and channel.
+ * @param decimation   Conversions averaged into one sample.
+ */
+void server_send_adc_config(uart_pin_pair_t pin_pair, uart_inst_t* uart, uint32_t channel_mask, uint32_t rate_hz, uint32_t decimation);
+
+/**
+ * @brief Collects waiting ADC blocks from a client.
+ *
+ * Sends "[57,max_blocks]" and reads the "[57,blocks,dropped]" reply and the
+ * binary blocks that follow while holding the UART lock. Blocks with a bad
+ * checksum are skipped. The client must be awake.
+ *
+ * @param pin_pair   UART TX/RX pin pair to use.
+ * @param uart       UART instance.
+ * @param max_blocks Most blocks to read, at most `ADC_COLLECT_MAX_BLOCKS`.
+ * @param blocks     Filled with the valid blocks.
+ * @param dropped    Set to the blocks the client dropped since the last collect.
+ * @param bad_blocks Set to the blocks that were sent but not received intact.
+ * @return Number of valid blocks.
+ */
+uint32_t server_collect_adc_blocks(uart_pin_pair_t pin_pair, uart_inst_t* uart, uint32_t max_blocks, adc_block_t *blocks, uint32_t *dropped, uint32_t *bad_blocks);
+
+/**
+ * @brief Sets up a logic capture on a client, or releases it.
+ *
+ * Sends "[58,first_gpio,pin_count,rate_hz]". The client must be awake.
+ *
+ * @param pin_pair   UART TX/RX pin pair to use.
+ * @param uart       UART instance.
+ * @param first_gpio First captured GPIO.
+ * @param pin_count  Consecutive GPIOs captured, 0 to release.
+ * @param rate_hz    Samples per second.
+ */
+void server_send_logic_config(uart_pin_pair_t pin_pair, uart_inst_t* uart, uint8_t first_gpio, uint8_t pin_count, uint32_t rate_hz);
+
+/**
+ * @brief Arms the logic capture of a client.
+ *
+ * Sends "[59,trigger_mask,trigger_value]". The client must be awake.
+ *
+ * @param pin_pair      UART TX/RX pin pair to use.
+ * @param uart          UART instance.
+ * @param trigger_mask  Captured GPIOs compared for the trigger, 0 to start at once.
+ * @param trigger_value Levels of the trigger GPIOs that start the capture.
+ */
+void server_send_logic_arm(uart_pin_pair_t pin_pair, uart_inst_t* uart, uint32_t trigger_mask, uint32_t trigger_value);
+
+/**
+ * @brief Collects the next chunks of a full logic capture from a client.
+ *
+ * Sends "[60,max_chunks,next_sequence]" and reads the "[60,chunks,samples]"
+ * reply and the binary chunks that follow while holding the UART lock.
+ * Chunks are kept in order from `next_sequence`: after a damaged chunk the
+ * following ones are dropped, and the client sends them again on the next
+ * collect. The client must be awake.
+ *
+ * @param pin_pair      UART TX/RX pin pair to use.
+ * @param uart          UART instance.
+ * @param max_chunks    Most chunks to read, at most `LOGIC_COLLECT_MAX_CHUNKS`.
+ * @param next_sequence First chunk not received yet.
+ * @param pin_count     Captured GPIOs, sets the size of run values.
+ * @param runs          Filled with the runs of the accepted chunks, room for `max_chunks * LOGIC_CHUNK_RUNS`.
+ * @param run_count     Set to the number of runs.
+ * @param samples       Set to the samples of the whole capture, 0 if it is not full.
+ * @param bad_chunks    Set to the chunks that were sent but not received intact.
+ * @return Number of chunks accepted.
+ */
+uint32_t server_collect_logic_chunks(uart_pin_pair_t pin_pair, uart_inst_t* uart, uint32_t max_chunks, uint32_t next_sequence, uint8_t pin_count,
+    logic_run_t *runs, uint32_t *run_count, uint32_t *samples, uint32_t *bad_chunks);
+
+/**
+ * @brief Starts an image transfer to a client.
+ *
+ * Sends "[61,size,crc32]" and reads the "[61,max_baudrate]" reply. The
+ * client must be awake.
+ *
+ * @param pin_pair UART TX/RX pin pair to use.
+ * @param uart     UART instance.
+ * @param size     Image size in bytes.
+ * @param crc32    CRC-32 of the image.
+ * @return Fastest baud rate the client can receive at, 0 if it refused or did not reply.
+ */
+uint32_t server_send_firmware_begin(uart_pin_pair_t pin_pair, uart_inst_t* uart, uint32_t size, uint32_t crc32);
+
+/**
+ * @brief Switches a client to the transfer baud rate.
+ *
+ * Sends "[62,baudrate]" and reads the "[62,baudrate]" reply; the client
+ * then stays at that rate until the image is in or the transfer times out.
+ *
+ * @param pin_pair UART TX/RX pin pair to use.
+ * @param uart     UART instance.
+ * @param baudrate Transfer baud rate.
+ * @return true if the client switched.
+ */
+bool server_send_firmware_baud(uart_pin_pair_t pin_pair, uart_inst_t* uart, uint32_t baudrate);
+
+/**
+ * @brief Sends a window of image frames and reads their acks.
+ *
+ * Holds the UART lock for the whole window. Each frame carries one sector
+ * of the image, padded with 0xFF past its end. Acks are read in order and
+ * reading stops at the first missing or negative one.
+ *
+ * @param pin_pair     UART TX/RX pin pair to use.
+ * @param uart         UART instance.
+ * @param baudrate     Transfer baud rate.
+ * @param image        Image, in flash or RAM.
+ * @param image_size   Image size in bytes.
+ * @param first_sector First sector of the window.
+ * @param count        Frames in the window, at most `FIRMWARE_WINDOW_FRAMES`.
+ * @return Number of frames acked from `first_sector`.
+ */
+uint32_t server_send_firmware_window(uart_pin_pair_t pin_pair, uart_inst_t* uart, uint32_t baudrate, const uint8_t *image, uint32_t image_size,
+    uint32_t first_sector, uint32_t count);
+
+/**
+ * @brief Asks a client to swap in its staged image.
+ *
+ * Sends "[64,crc32]" and reads the "[64,ok]" reply. A client that accepts
+ * restarts once the image is copied.
+ *
+ * @param pin_pair UART TX/RX pin pair to use.
+ * @param uart     UART instance.
+ * @param crc32    CRC-32 of the image.
+ * @return true if the client checked the image and is swapping it in.
+ */
+bool server_send_firmware_commit(uart_pin_pair_t pin_pair, uart_inst_t* uart, uint32_t crc32);
+
+/**
+ * @brief Reads back the outputs of an awake client for the audit.
+ *
+ * Sends "[65,65]" and listens up to `AUDIT_REPLY_TIMEOUT_MS` for the
+ * "[65,audited_mask,on_mask,busy]" reply while holding the UART lock.
+ * The client is not woken up.
+ *
+ * @param pin_pair     UART TX/RX pin pair to use.
+ * @param uart         UART instance.
+ * @param audited_mask Set to the GPIOs the client reads back as plain outputs.
+ * @param on_mask      Set to those of them driven high.
+ * @param busy         Set when local activity may still change the client's outputs.
+ * @return true if a valid reply was received.
+ */
+bool server_poll_audit(uart_pin_pair_t pin_pair, uart_inst_t* uart, uint32_t *audited_mask, uint32_t *on_mask, bool *busy);
+
+/**
+ * @brief Sends one "[gpio,value]" frame for each GPIO of a mask, in one UART lock hold.
+ *
+ * @param pin_pair  UART TX/RX pin pair to use.
+ * @param uart      UART instance.
+ * @param gpio_mask GPIOs to set.
+ * @param on_mask   Bit `n` set when GPIO `n` turns ON.
+ */
+void server_send_output_delta(uart_pin_pair_t pin_pair, uart_inst_t* uart, uint32_t gpio_mask, uint32_t on_mask);
+
+/**
+ * @brief Sets or clears a local rule on a client.
+ *
+ * Sends "[51,rule,trigger_gpio,edges,gpio_mask,on_ms]". The client must be awake.
+ *
+ * @param pin_pair     UART TX/RX pin pair to use.
+ * @param uart         UART instance.
+ * @param rule_index   Rule slot (0-based).
+ * @param trigger_gpio Client input that triggers the rule.
+ * @param edges        `rule_edge_t` bits, 0 to clear the rule.
+ * @param gpio_mask    GPIOs turned ON when the rule fires.
+ * @param on_ms        Time before they turn OFF again, 0 to leave them ON.
+ */
+void server_send_rule(uart_pin_pair_t pin_pair, uart_inst_t* uart, uint32_t rule_index, uint8_t trigger_gpio, uint32_t edges, uint32_t gpio_mask, uint32_t on_ms);
+
+/**
+ * @brief Selects the PWM outputs of a client.
+ *
+ * Sends "[52,pwm_mask]". The client must be awake.
+ *
+ * @param pin_pair UART TX/RX pin pair to use.
+ * @param uart     UART instance.
+ * @param pwm_mask GPIOs that are PWM outputs, the others are digital.
+ */
+void server_send_pwm_mode(uart_pin_pair_t pin_pair, uart_inst_t* uart, uint32_t pwm_mask);
+
+/**
+ * @brief Sets the duties of consecutive PWM channels of a client.
+ *
+ * Sends "[53,first_channel,low,high]" with 8 duties of 8 bits, or
+ * "[54,first_channel,low,high]" with 4 duties of 16 bits. The client must be awake.
+ *
+ * @param pin_pair      UART TX/RX pin pair to use.
+ * @param uart          UART instance.
+ * @param bits          8 or 16.
+ * @param first_channel Channel of the lowest packed duty.
+ * @param packed_low    Low 32 bits of the packed duties.
+ * @param packed_high   High 32 bits of the packed duties.
+ */
+void server_send_pwm_duties(uart_pin_pair_t pin_pair, uart_inst_t* uart, uint32_t bits, uint32_t first_channel, uint32_t packed_low, uint32_t packed_high);
+
+/**
+ * @brief Returns the GPIO on-mask of a client state.
+ *
+ * @param client_state State to convert.
+ * @return Bit `n` set when GPIO `n` is ON. UART connection entries are skipped.
+ */
+uint32_t client_state_gpio_mask(const client_state_t *client_state);
+
+/**
+ * @brief Selects the active preset library bank. Call once at boot.
+ *
+ * Writes an empty library if neither bank holds a valid one.
+ */
+void preset_store_init(void);
+
+/**
+ * @brief Returns the active preset library, read directly from flash.
+ *
+ * @return Active library. Stays valid until the next `preset_store_commit()`.
+ */
+const preset_library_t *preset_store_library(void);
+
+/**
+ * @brief Returns a RAM copy of the active library for modification.
+ *
+ * Changes take effect with `preset_store_commit()`.
+ *
+ * @return Library to modify.
+ */
+preset_library_t *preset_store_edit(void);
+
+/**
+ * @brief Writes the library returned by `preset_store_edit()` to the inactive bank and activates it.
+ *
+ * Only the preset library sectors are erased; the state sector is not touched.
+ */
+void preset_store_commit(void);
+
+/**
+ * @brief Returns the preset pool key of a GPIO on-mask.
+ *
+ * The mix is bijective, so equal hashes mean equal presets. Only the
+ * all-OFF mask hashes to 0.
+ *
+ * @param gpio_mask GPIO on-mask.
+ * @return 32-bit hash.
+ */
+uint32_t preset_store_hash(uint32_t gpio_mask);
+
+/**
+ * @brief Returns the GPIO on-mask of a client preset.
+ *
+ * @param library            Preset library (see `preset_store_library()`).
+ * @param flash_client_index Index of the client in the persistent state table.
+ * @param preset_index       Preset slot (0-based).
+ * @return GPIO on-mask, 0 for an empty (all-OFF) preset.
+ */
+uint32_t preset_store_get_mask(const preset_library_t *library, uint32_t flash_client_index, uint32_t preset_index);
+
+/**
+ * @brief Returns the hash of a client preset, for equality checks.
+ *
+ * @param library            Preset library (see `preset_store_library()`).
+ * @param flash_client_index Index of the client in the persistent state table.
+ * @param preset_index       Preset slot (0-based).
+ * @return Hash of the preset, 0 for an empty (all-OFF) preset.
+ */
+uint32_t preset_store_get_hash(const preset_library_t *library, uint32_t flash_client_index, uint32_t preset_index);
+
+/**
+ * @brief Points a client preset slot at the pool entry of a GPIO on-mask.
+ *
+ * Reuses an existing entry with the same content, or claims a free one.
+ * The reference to the previous content is dropped.
+ *
+ * @param library            Preset library (see `preset_store_library()`).
+ * @param flash_client_index Index of the client in the persistent state table.
+ * @param preset_index       Preset slot (0-based).
+ * @param gpio_mask          New GPIO on-mask of the preset.
+ * @return false if the pool is full; the preset is then left unchanged.
+ */
+bool preset_store_set_mask(preset_library_t *library, uint32_t flash_client_index, uint32_t preset_index, uint32_t gpio_mask);
+
+/**
+ * @brief Same as `preset_store_set_mask()` with the on-mask and PWM duties of a client state.
+ *
+ * @return false if a pool is full; the preset is then left unchanged.
+ */
+bool preset_store_set_state(preset_library_t *library, uint32_t flash_client_index, uint32_t preset_index, const client_state_t *client_state);
+
+/**
+ * @brief Checks whether a client preset holds the on-mask and PWM duties of a client state.
+ *
+ * @param library            Preset library (see `preset_store_library()`).
+ * @param flash_client_index Index of the client in the persistent state table.
+ * @param preset_index       Preset slot (0-based).
+ * @param client_state       State to compare.
+ * @return true if saving the state into the preset would not change it.
+ */
+bool preset_store_matches_state(const preset_library_t *library, uint32_t flash_client_index, uint32_t preset_index, const client_state_t *client_state);
+
+/**
+ * @brief Empties a client preset slot (all devices OFF).
+ *
+ * @param library            Preset library (see `preset_store_library()`).
+ * @param flash_client_index Index of the client in the persistent state table.
+ * @param preset_index       Preset slot (0-based).
+ */
+void preset_store_clear(preset_library_t *library, uint32_t flash_client_index, uint32_t preset_index);
+
+/**
+ * @brief Sets the devices of a client state to the ON/OFF values and PWM duties of a preset.
+ *
+ * GPIO numbers and UART connection entries of `client_state` are kept.
+ *
+ * @param library            Preset library (see `preset_store_library()`).
+ * @param flash_client_index Index of the client in the persistent state table.
+ * @param preset_index       Preset slot (0-based).
+ * @param client_state       State to update, usually a copy of the running state.
+ */
+void preset_store_apply_to_state(const preset_library_t *library, uint32_t flash_client_index, uint32_t preset_index, client_state_t *client_state);
+
+/**
+ * @brief Empties every preset slot of every client and the preset pool.
+ *
+ * @param library Library to reset.
+ */
+void preset_store_reset(preset_library_t *library);
+
+/**
+ * @brief Marks a preset as changed so it is sent to the client again before its next recall.
+ *
+ * @param flash_client_index Index of the client in the persistent state table.
+ * @param preset_index       Preset slot (0-based).
+ */
+void preset_sync_mark_modified(uint32_t flash_client_index, uint32_t preset_index);
+
+/**
+ * @brief Marks all presets of a client as changed.
+ *
+ * @param flash_client_index Index of the client in the persistent state table.
+ */
+void preset_sync_mark_all_modified(uint32_t flash_client_index);
+
+/**
+ * @brief Forgets which preset versions a client has, after it (re)connected with empty RAM.
+ *
+ * @param flash_client_index Index of the client in the persistent state table.
+ */
+void preset_sync_forget_client(uint32_t flash_client_index);
+
+/**
+ * @brief Sends every non-empty preset whose version the client does not have yet.
+ *
+ * Empty presets are left out; they are sent on their first recall.
+ * The client must be awake.
+ *
+ * @param flash_client_index Index of the client in the persistent state table.
+ * @param client             Persistent data of the client.
+ */
+void preset_sync_client(uint32_t flash_client_index, const client_t *client);
+
+/**
+ * @brief Wakes a client and recalls one of its presets with a single frame.
+ *
+ * If the client's copy of the preset is out of date, the preset is sent
+ * first.
+ *
+ * @param flash_client_index Index of the client in the persistent state table.
+ * @param preset_index       Preset slot (0-based).
+ * @param client             Persistent data of the client.
+ */
+void preset_sync_recall(uint32_t flash_client_index, uint32_t preset_index, const client_t *client);
+
+/**
+ * @brief Sends a preset to a client if the client's copy is out of date, without recalling it.
+ *
+ * The client must be awake.
+ *
+ * @param flash_client_index Index of the client in the persistent state table.
+ * @param preset_index       Preset slot (0-based).
+ * @param client             Persistent data of the client.
+ */
+void preset_sync_prepare(uint32_t flash_client_index, uint32_t preset_index, const client_t *client);
+
+/**
+ * @brief Drives the latch line low. Does nothing unless `LATCH_LINE_ENABLED`. Call once at boot.
+ */
+void server_latch_init(void);
+
+/**
+ * @brief Returns the sequence number of a new latch commit.
+ *
+ * @return Sequence number, never 0.
+ */
+uint32_t server_latch_next_sequence(void);
+
+/**
+ * @brief Pulses the latch line, making every client apply its staged on-mask.
+ */
+void server_latch_pulse(void);
+
+/**
+ * @brief Starts forwarding streamed output masks to every connected client.
+ *
+ * Each client is woken and given its stream address. Both UART instances
+ * are then kept set up and a repeating timer sends the newest masks at
+ * `rate_hz` with DMA. Other UART traffic waits until `stream_stop()`.
+ * The rate must leave room on every UART instance for a full-length frame
+ * per client and tick.
+ *
+ * @param rate_hz Ticks per second (1..STREAM_MAX_RATE_HZ).
+ * @return false if a stream already runs, the rate is out of range or the UART links cannot carry it.
+ */
+bool stream_start(uint32_t rate_hz);
+
+/**
+ * @brief Queues the output mask of a client for the next stream tick.
+ *
+ * A mask that was not sent yet is replaced. Nothing is written to flash.
+ *
+ * @param flash_client_index Index of the client in the persistent state table.
+ * @param gpio_mask          Bit `n` set when GPIO `n` must be ON.
+ * @return false if no stream runs or the client is not connected.
+ */
+bool stream_set_mask(uint32_t flash_client_index, uint32_t gpio_mask);
+
+/**
+ * @brief Ends the stream and sets every client back to its stored running state.
+ */
+void stream_stop(void);
+
+/**
+ * @brief Returns true while an output stream runs.
+ *
+ * @return true if streaming.
+ */
+bool stream_is_active(void);
+
+/**
+ * @brief Prints the counters of the current or last stream as `STREAM` lines for host tools.
+ *
+ * Line format: `STREAM <client> <frames> <underruns> <overruns> <frames_per_second>`.
+ */
+void stream_print_machine(void);
+
+/**
+ * @brief Claims the spinlock protecting the client clock models. Call once at boot.
+ */
+void time_sync_init(void);
+
+/**
+ * @brief Measures a client's clock offset and updates its drift estimate.
+ *
+ * The client must be awake.
+ *
+ * @param active_client_index Index of the client in the active connections.
+ * @return false if the client did not reply; its offset is then invalid.
+ */
+bool time_sync_client(uint8_t active_client_index);
+
+/**
+ * @brief Resyncs a client whose clock offset is missing or too old.
+ *
+ * The offset is kept for `TIME_SYNC_MAX_AGE_MS` once the drift is known,
+ * otherwise for `TIME_SYNC_MAX_AGE_UNCOMPENSATED_MS`. The client must be awake.
+ *
+ * @param active_client_index Index of the client in the active connections.
+ * @return true if the client has a valid offset.
+ */
+bool time_sync_ensure(uint8_t active_client_index);
+
+/**
+ * @brief Drops a client's clock offset. Called when the client is sent to dormant mode.
+ *
+ * @param active_client_index Index of the client in the active connections.
+ */
+void time_sync_invalidate(uint8_t active_client_index);
+
+/**
+ * @brief Converts a server time into the client's time with the client's clock model.
+ *
+ * @param active_client_index Index of the client in the active connections.
+ * @param server_us           Server time_us_64() value.
+ * @param client_us           Set to the matching client time_us_64() value.
+ * @return false if the client has no valid offset.
+ */
+bool time_sync_client_time(uint8_t active_client_index, uint64_t server_us, uint64_t *client_us);
+
+/**
+ * @brief Claims the spinlock protecting the timed output table. Call once at boot.
+ */
+void server_timed_output_init(void);
+
+/**
+ * @brief Starts a timed output or pulse train on a client GPIO.
+ *
+ * Wakes the client if needed and sends the command. The flash state is
+ * updated right away with the final value (OFF), and a report poll is
+ * scheduled for the expected end of the output. If no device of the client
+ * stays ON, the client is sent to dormant mode; it goes dormant once the
+ * output has finished.
+ *
+ * @param flash_client_index  Index of the client in the persistent state table.
+ * @param active_client_index Index of the client in the active connections.
+ * @param gpio_number         Client GPIO to drive.
+ * @param on_ms               ON time of each pulse in milliseconds.
+ * @param off_ms              OFF time between pulses in milliseconds.
+ * @param pulse_count         Number of pulses, 1 for a single ON period.
+ */
+void server_timed_output_start(uint32_t flash_client_index, uint8_t active_client_index, uint8_t gpio_number, uint32_t on_ms, uint32_t off_ms, uint32_t pulse_count);
+
+/**
+ * @brief Stops waiting for the report of timed outputs that were overridden.
+ *
+ * Call when GPIOs are set by another command, which stops their timed
+ * output on the client.
+ *
+ * @param flash_client_index Index of the client in the persistent state table.
+ * @param gpio_mask          GPIOs to forget.
+ */
+void server_timed_output_forget(uint32_t flash_client_index, uint32_t gpio_mask);
+
+/**
+ * @brief Polls every client whose timed output report is due. Runs on core1.
+ */
+void server_timed_output_poll(void);
+
+/**
+ * @brief Uploads the length and loop count of a client's sequence, clearing its steps.
+ *
+ * The client is woken if needed and sent back to dormant mode afterwards.
+ *
+ * @param flash_client_index Index of the client in the persistent state table.
+ * @param step_count         Number of steps (1..SEQUENCE_MAX_STEPS).
+ * @param loop_count         Number of times to play the steps, 0 for ever.
+ * @return false if the arguments are invalid or the client is not connected.
+ */
+bool server_sequence_define(uint32_t flash_client_index, uint32_t step_count, uint32_t loop_count);
+
+/**
+ * @brief Uploads one step of a client's sequence.
+ *
+ * @param flash_client_index Index of the client in the persistent state table.
+ * @param step               Step index, below the defined step count.
+ * @param gpio_mask          Bit `n` set when GPIO `n` must be ON during the step.
+ * @param duration_us        Step duration, raised to `SEQUENCE_MIN_STEP_US` by the client.
+ * @return false if the step is out of range or the client is not connected.
+ */
+bool server_sequence_set_step(uint32_t flash_client_index, uint32_t step, uint32_t gpio_mask, uint32_t duration_us);
+
+/**
+ * @brief Starts, stops or seeks a client's sequence.
+ *
+ * On START the GPIOs used by the sequence are written OFF to the flash
+ * state, their final value, and their timed outputs are forgotten. If no
+ * device of the client stays ON, the client is sent to dormant mode; it
+ * goes dormant once the sequence has finished.
+ *
+ * @param flash_client_index Index of the client in the persistent state table.
+ * @param control            Playback command.
+ * @param step               Step to play from, for START and SEEK.
+ * @return false if the step is out of range or the client is not connected.
+ */
+bool server_sequence_control(uint32_t flash_client_index, sequence_control_t control, uint32_t step);
+
+/**
+ * @brief Polls the playback position of a client's sequence.
+ *
+ * @param flash_client_index Index of the client in the persistent state table.
+ * @param playing            Set to true if the sequence plays.
+ * @param step               Set to the current step.
+ * @param loops_done         Set to the number of completed loops.
+ * @return false if the client is not connected or did not reply.
+ */
+bool server_sequence_status(uint32_t flash_client_index, bool *playing, uint32_t *step, uint32_t *loops_done);
+
+/**
+ * @brief Claims the input model spinlock and installs the doorbell IRQ handler. Call once at boot on core0.
+ */
+void server_input_init(void);
+
+/**
+ * @brief Configures an input on a client and reads its level.
+ *
+ * A GPIO that becomes an input is written OFF to the flash state. The
+ * input configuration is saved in the flash state too, and sent again by
+ * `server_input_restore()` when the client or the server restarts. The
+ * client's RX pin is armed as a doorbell while it has inputs.
+ *
+ * @param flash_client_index Index of the client in the persistent state table.
+ * @param gpio_number        Client GPIO.
+ * @param mode               Input mode, `INPUT_MODE_OFF` to release the GPIO.
+ * @param debounce_ms        Debounce time, at most `INPUT_DEBOUNCE_MAX_MS`.
+ * @return false if the arguments are invalid or the client is not connected.
+ */
+bool server_input_configure(uint32_t flash_client_index, uint8_t gpio_number, input_mode_t mode, uint32_t debounce_ms);
+
+/**
+ * @brief Sends the saved input configuration to a client that just (re)started.
+ *
+ * Rebuilds the input model of the client, arms its doorbell and reads its
+ * levels. The client must be awake. Call with the state lock held.
+ *
+ * @param flash_client_index  Index of the client in the persistent state table.
+ * @param active_client_index Active connection of the client.
+ * @param inputs              Saved input configuration of the client.
+ */
+void server_input_restore(uint32_t flash_client_index, uint8_t active_client_index, const client_inputs_t *inputs);
+
+/**
+ * @brief Collects the changes of every client that rang the input doorbell. Runs on core1.
+ */
+void server_input_collect(void);
+
+/**
+ * @brief Reads the input model of a client.
+ *
+ * @param flash_client_index Index of the client in the persistent state table.
+ * @param input_mask         Set to the client's inputs.
+ * @param levels             Set to their last collected levels.
+ * @param changes            Set to the number of changes seen since configuration.
+ * @param changed_at_us      Set to the server time of the last change, 0 if none.
+ * @return false if the client has no inputs.
+ */
+bool server_input_get(uint32_t flash_client_index, uint32_t *input_mask, uint32_t *levels, uint32_t *changes, uint64_t *changed_at_us);
+
+/**
+ * @brief Prints the inputs of every client to the CLI.
+ */
+void server_input_print(void);
+
+/**
+ * @brief Prints one `INPUT` line per client with inputs for host tools.
+ *
+ * Line format: `INPUT <client> <input_mask> <levels> <changes> <age_ms>`, masks in hex.
+ */
+void server_input_print_machine(void);
+
+#define INPUT_BULK_ADC 0x01u         ///< The client rings for ADC blocks
+#define INPUT_BULK_LOGIC 0x02u       ///< The client rings for a full logic capture
+
+/**
+ * @brief Arms or disarms the doorbell of a client for bulk transfers.
+ *
+ * The RX pin of the client stays armed while it has inputs or any bulk
+ * transfer source.
+ *
+ * @param flash_client_index  Index of the client in the persistent state table.
+ * @param active_client_index Active connection of the client.
+ * @param source              `INPUT_BULK_ADC` or `INPUT_BULK_LOGIC`.
+ * @param enabled             true while the client uses that source.
+ */
+void server_input_set_bulk(uint32_t flash_client_index, uint8_t active_client_index, uint8_t source, bool enabled);
+
+/**
+ * @brief Claims the spinlock protecting the ADC models. Call once at boot.
+ */
+void server_adc_init(void);
+
+/**
+ * @brief Starts, restarts or stops ADC sampling on a client.
+ *
+ * GPIOs that become ADC inputs are written OFF to the flash state. Starting
+ * clears the blocks and counters of the client.
+ *
+ * @param flash_client_index Index of the client in the persistent state table.
+ * @param channel_mask       ADC inputs to sample (`ADC_CHANNEL_MASK`), 0 to stop.
+ * @param rate_hz            Samples per second and channel.
+ * @param decimation         Conversions averaged into one sample, at most `ADC_DECIMATION_MAX`.
+ * @return false if the arguments are invalid, exceed `ADC_MAX_CONVERSIONS_HZ`
+ *         or the client is not connected.
+ */
+bool server_adc_configure(uint32_t flash_client_index, uint32_t channel_mask, uint32_t rate_hz, uint32_t decimation);
+
+/**
+ * @brief Collects the waiting ADC blocks of a client after its input report. Runs on core1.
+ *
+ * @param flash_client_index  Index of the client in the persistent state table.
+ * @param active_client_index Active connection of the client.
+ */
+void server_adc_collect(uint32_t flash_client_index, uint8_t active_client_index);
+
+/**
+ * @brief Prints one `ADC` line per client that samples or has samples for host tools.
+ *
+ * Line format: `ADC <client> <channel_mask> <rate_hz> <decimation> <received> <lost> <bad> <waiting>`, mask in hex.
+ */
+void server_adc_print_machine(void);
+
+/**
+ * @brief Prints the waiting ADC blocks of a client and releases them.
+ *
+ * Line format: `ADCBLOCK <client> <sequence> <channel_mask> <samples> <data>`,
+ * where the data holds 3 hex digits per 12-bit sample, channels interleaved.
+ *
+ * @param flash_client_index Index of the client in the persistent state table.
+ * @return false if the client index is invalid.
+ */
+bool server_adc_print_blocks(uint32_t flash_client_index);
+
+/**
+ * @brief Claims the spinlock protecting the logic capture. Call once at boot.
+ */
+void server_logic_init(void);
+
+/**
+ * @brief Sets up a logic capture on a client, or releases it.
+ *
+ * One client captures at a time; it keeps the capture until it is released
+ * with a `pin_count` of 0.
+ *
+ * @param flash_client_index Index of the client in the persistent state table.
+ * @param first_gpio         First captured GPIO.
+ * @param pin_count          Consecutive GPIOs captured, 0 to release.
+ * @param rate_hz            Samples per second, at most `LOGIC_MAX_RATE_HZ`.
+ * @return false if the arguments are invalid, another client holds the
+ *         capture or the client is not connected.
+ */
+bool server_logic_configure(uint32_t flash_client_index, uint8_t first_gpio, uint8_t pin_count, uint32_t rate_hz);
+
+/**
+ * @brief Arms the logic capture of a client and clears the previous one.
+ *
+ * @param flash_client_index Index of the client in the persistent state table.
+ * @param trigger_mask       Captured GPIOs compared for the trigger, relative
+ *                           to the first GPIO and consecutive, 0 to start at once.
+ * @param trigger_value      Levels of the trigger GPIOs that start the capture.
+ * @return false if the client does not hold the capture or the mask is invalid.
+ */
+bool server_logic_arm(uint32_t flash_client_index, uint32_t trigger_mask, uint32_t trigger_value);
+
+/**
+ * @brief Collects the next chunks of a full logic capture. Runs on core1.
+ *
+ * Only as many chunks as the run buffer can hold are requested; the client
+ * rings again for the rest once the host has read the runs.
+ *
+ * @param flash_client_index  Index of the client in the persistent state table.
+ * @param active_client_index Active connection of the client.
  */
-extern server_uart_connection_t active_uart_server_connections[MAX_SERVER_CONNECTIONS];
+void server_logic_collect(uint32_t flash_client_index, uint8_t active_client_index);
 
 /**
- * @brief Number of active connections found and stored in `active_uart_server_connections`.
+ * @brief Prints the `LOGIC` line of the capture for host tools.
+ *
+ * Line format: `LOGIC <client> <first_gpio> <pin_count> <rate_hz> <state> <samples> <received> <bad> <waiting>`,
+ * state one of `ready`, `armed`, `collecting` and `done`.
  */
-extern uint8_t active_server_connections_number;
+void server_logic_print_machine(void);
 
 /**
- * @brief Sends a UART message safely using spinlock protection.
+ * @brief Prints the collected runs of the capture and releases them.
  *
- * This function first wakes up the client by sending a pulse on its RX pin.
- * Then it initializes the UART peripheral with the specified TX/RX pins and baudrate,
- * sends the message, waits for the transmission to complete, and resets the GPIO pins.
- * All UART operations are protected by a spinlock to ensure thread/core safety.
+ * Line format: `LOGICRUNS <client> <first_sample> <value>:<length> ...`, values
+ * in hex with bit 0 for the first GPIO, up to 16 runs per line.
  *
- * @param uart Pointer to the UART instance to use (e.g., uart0 or uart1).
- * @param pins Struct containing the TX and RX GPIO pin numbers.
- * @param msg Null-terminated string to be sent via UART.
+ * @param flash_client_index Index of the client in the persistent state table.
+ * @return false if the client does not hold the capture.
  */
-void send_uart_message_safe(uart_inst_t* uart, uart_pin_pair_t pins, const char* msg);
+bool server_logic_print_runs(uint32_t flash_client_index);
 
 /**
- * @brief Wakes up a dormant client if needed, based on its persistent state.
+ * @brief Receives a client image from the host into the server staging area.
  *
- * Checks whether the client at the specified index is dormant. If so, it
- * sends a wake-up pulse via UART to ensure the client is active before communication.
+ * Replies `OK`, then reads exactly `size` raw bytes from USB and programs
+ * them sector by sector, and checks the CRC of what was programmed.
+ * Forgets any image loaded before and the clients it was pushed to.
+ *
+ * @param size  Image size in bytes, at most `FIRMWARE_IMAGE_MAX_BYTES`.
+ * @param crc32 CRC-32 of the image.
+ * @return false if the size is invalid, the host stopped sending or the CRC does not match.
+ */
+bool server_firmware_load(uint32_t size, uint32_t crc32);
+
+/**
+ * @brief Transfers the loaded image to the staging area of a client.
+ *
+ * Blocks until every sector is acked or `FIRMWARE_MAX_RETRIES` windows
+ * failed. Other clients are served between windows.
  *
  * @param flash_client_index Index of the client in the persistent state table.
- * @param state              Pointer to the global persistent state structure.
- * @param pin_pair           UART TX/RX pins used to wake up the client.
- * @param uart               Pointer to the UART instance used for transmission.
+ * @return false if no image is loaded, the client is not connected, refused or the transfer failed.
+ */
+bool server_firmware_push(uint32_t flash_client_index);
+
+/**
+ * @brief Asks every client holding the image to swap it in.
  *
- * @see wake_up_client()
+ * @return Number of clients swapping the image in.
  */
-void send_wakeup_if_dormant(uint32_t flash_client_index, server_persistent_state_t *const state, uart_pin_pair_t pin_pair, uart_inst_t *const uart);
+uint32_t server_firmware_commit(void);
 
 /**
- * @brief Sends a dormant flag message to a specific client over UART.
+ * @brief Waits for committing clients to copy their image, then restarts the server and every client.
  *
- * Constructs a message with the dormant flag number and sends it
- * via the UART instance and pin pair assigned to the specified client.
+ * The server only finds clients at boot, so it restarts to reconnect the
+ * clients running the new image. Never returns.
+ */
+void server_firmware_restart(void);
+
+/**
+ * @brief Prints the `FIRMWARE` lines of the loaded image and of the clients it was pushed to.
  *
- * @param client_index Index of the client in the active server connections.
+ * Line formats: `FIRMWARE IMAGE <size> <crc32>`, CRC in hex, and
+ * `FIRMWARE <client> <state> <baudrate> <frames_sent> <retries> <ms>`,
+ * state one of `failed`, `staged` and `committed`.
  */
-void send_dormant_flag_to_client(uint8_t client_index);
+void server_firmware_print_machine(void);
 
 /**
- * @brief Sends a reset trigger message to all clients.
+ * @brief Claims the audit spinlock and starts the audit tick. Call once core1 runs.
+ */
+void server_audit_init(void);
+
+/**
+ * @brief Audits the next awake client unless the UART links are busy. Runs on core1.
  *
- * This causes each connected client to perform a full reset of its internal state.
+ * Reads back the client's outputs, compares them with its running state
+ * and sets the GPIOs that differ again.
  */
-void signal_reset_for_all_clients();
+void server_audit_tick(void);
 
 /**
- * @brief Sends a fast onboard LED blink signal to all clients.
+ * @brief Prints the `AUDIT` lines for host tools.
  *
- * Triggers a visual blink (e.g., heartbeat) on each client device.
+ * Line formats: `AUDIT TICKS <ticks> <deferred>` and, for every audited
+ * client, `AUDIT <client> <audits> <silent> <busy> <divergences> <repaired_gpios>`.
  */
-void send_fast_blink_onboard_led_to_clients();
+void server_audit_print_machine(void);
 
 /**
- * @brief Sends a dormant message to all clients marked as dormant.
+ * @brief Moves clk_peri to the USB PLL and starts the clock governor. Call once stdio runs.
  *
- * Iterates through all active UART connections and sends a predefined
- * dormant flag message to each client with the `is_dormant` flag set.
+ * Does nothing unless `CLOCK_GOVERNOR_ENABLED`.
  */
-void send_dormant_to_standby_clients(void);
+void server_clock_governor_init(void);
 
 /**
- * @brief Sends the entire current client state over UART.
+ * @brief Switches clk_sys to the system PLL, if it was dropped, and restarts the idle time.
+ *
+ * Safe from either core and from IRQ handlers. Called on USB input, before
+ * UART exchanges and before flash commits.
+ */
+void server_clock_governor_boost(void);
+
+/**
+ * @brief Prints the `GOVERNOR` line for host tools.
+ *
+ * Line format: `GOVERNOR <boosted|idle> <clk_sys_hz> <clk_peri_hz> <boosts> <drops> <boosted_ms> <idle_ms>`.
+ * Transition times are in the `clock_boost` and `clock_drop` statistics.
+ */
+void server_clock_governor_print_machine(void);
+
+/**
+ * @brief Claims the spinlock protecting the client rule tables. Call once at boot.
+ */
+void server_client_rules_init(void);
+
+/**
+ * @brief Downloads a local rule to a client.
+ *
+ * @param flash_client_index Index of the client in the persistent state table.
+ * @param rule_index         Rule slot (0-based, below `RULE_MAX_RULES`).
+ * @param trigger_gpio       Client input that triggers the rule.
+ * @param edges              `rule_edge_t` bits, 0 to clear the rule.
+ * @param gpio_mask          GPIOs turned ON when the rule fires.
+ * @param on_ms              Time before they turn OFF again, 0 to leave them ON.
+ * @return false if the arguments are invalid or the client is not connected.
+ */
+bool server_client_rule_set(uint32_t flash_client_index, uint32_t rule_index, uint8_t trigger_gpio, uint32_t edges, uint32_t gpio_mask, uint32_t on_ms);
+
+/**
+ * @brief Downloads every rule of the server copy again to a client that restarted.
+ *
+ * The client must be awake and have its inputs configured again. Call
+ * with the state lock held.
+ *
+ * @param flash_client_index  Index of the client in the persistent state table.
+ * @param active_client_index Active connection of the client.
+ */
+void server_client_rules_restore(uint32_t flash_client_index, uint8_t active_client_index);
+
+/**
+ * @brief Records the local rules a client reported as fired. Runs on core1.
+ *
+ * Outputs that a fired rule leaves ON are written ON to the flash state,
+ * and outputs of a fired timed rule are written OFF, as the rule forces
+ * them OFF when its time ends.
+ *
+ * @param flash_client_index Index of the client in the persistent state table.
+ * @param fired_rules        Bit `n` set when rule `n` fired.
+ */
+void server_client_rules_fired(uint32_t flash_client_index, uint32_t fired_rules);
+
+/**
+ * @brief Prints one `RULE` line per client rule for host tools.
+ *
+ * Line format: `RULE <client> <rule> <trigger_gpio> <edges> <gpio_mask> <on_ms> <fires>`, mask in hex.
+ */
+void server_client_rules_print_machine(void);
+
+/**
+ * @brief Selects the schedule table in flash. Call once at boot.
+ *
+ * Writes an empty table if the stored one is not valid.
+ */
+void schedule_store_init(void);
+
+/**
+ * @brief Returns the schedule table, read directly from flash.
+ *
+ * @return Active table. Stays valid until the next `schedule_store_commit()`.
+ */
+const schedule_table_t *schedule_store_table(void);
+
+/**
+ * @brief Returns a RAM copy of the schedule table for modification.
+ *
+ * Changes take effect with `schedule_store_commit()`.
+ *
+ * @return Table to modify.
+ */
+schedule_table_t *schedule_store_edit(void);
+
+/**
+ * @brief Writes the table returned by `schedule_store_edit()` to its flash sector.
+ */
+void schedule_store_commit(void);
+
+/**
+ * @brief Starts the scheduler tick. Call after core1 has been launched.
+ */
+void scheduler_init(void);
+
+/**
+ * @brief Returns the server clock in seconds.
+ *
+ * The clock counts from 0 at boot until it is set with `scheduler_clock_set()`.
+ *
+ * @return Current server clock time.
+ */
+uint32_t scheduler_clock_now(void);
+
+/**
+ * @brief Sets the server clock and reschedules all entries.
+ *
+ * @param now_s New current time in seconds (e.g. Unix time).
+ */
+void scheduler_clock_set(uint32_t now_s);
+
+/**
+ * @brief Returns the first run of a schedule entry after a given time.
+ *
+ * @param entry   Schedule entry.
+ * @param after_s Time in server clock seconds.
+ * @return Time of the next run, or 0 if the entry never runs again.
+ */
+uint32_t scheduler_next_run(const schedule_entry_t *entry, uint32_t after_s);
+
+/**
+ * @brief Stores a new schedule entry in flash and schedules it.
+ *
+ * @param entry Entry to add.
+ * @return Table index of the entry, or -1 if the table is full.
+ */
+int32_t scheduler_add(const schedule_entry_t *entry);
+
+/**
+ * @brief Removes a schedule entry from flash and from the timer wheel.
+ *
+ * @param index Table index of the entry.
+ * @return false if there is no such entry.
+ */
+bool scheduler_remove(uint32_t index);
+
+/**
+ * @brief Advances the timer wheel to the server clock and runs due actions. Runs on core1.
+ */
+void scheduler_tick(void);
+
+/**
+ * @brief Rebuilds the timer wheel from the schedule table. Runs on core1.
+ */
+void scheduler_reload(void);
+
+/**
+ * @brief Prints the pending schedule entries to the CLI.
+ */
+void scheduler_print(void);
+
+/**
+ * @brief Prints the pending schedule entries as `SCHEDULE` lines for host tools.
+ */
+void scheduler_print_machine(void);
+
+/**
+ * @brief Selects the interlock table in flash. Call once at boot.
+ *
+ * Writes an empty table if the stored one is not valid.
+ */
+void interlock_store_init(void);
+
+/**
+ * @brief Returns the interlock table, read directly from flash.
+ *
+ * @return Active table. Stays valid until the next `interlock_store_commit()`.
+ */
+const interlock_table_t *interlock_store_table(void);
+
+/**
+ * @brief Returns a RAM copy of the interlock table for modification.
+ *
+ * Changes take effect with `interlock_store_commit()`.
+ *
+ * @return Table to modify.
+ */
+interlock_table_t *interlock_store_edit(void);
+
+/**
+ * @brief Writes the table returned by `interlock_store_edit()` to its flash sector.
+ */
+void interlock_store_commit(void);
+
+/**
+ * @brief Builds the interlock index from flash. Call once at boot, before core1 is launched.
+ */
+void server_interlock_init(void);
+
+/**
+ * @brief Stores a new interlock in flash and adds it to the index.
+ *
+ * @param entry Interlock to add.
+ * @return Table index of the interlock, or -1 if it is invalid or the table is full.
+ */
+int32_t server_interlock_add(const interlock_entry_t *entry);
+
+/**
+ * @brief Removes an interlock from flash and from the index.
+ *
+ * @param index Table index of the interlock.
+ * @return false if there is no such interlock.
+ */
+bool server_interlock_remove(uint32_t index);
+
+/**
+ * @brief Rebuilds the interlock index from the table in flash. Runs on core1.
+ */
+void server_interlock_reload(void);
+
+/**
+ * @brief Runs the interlocks triggered by collected input edges. Runs on core1.
+ *
+ * An interlock runs once when any of its edges was reported. Output frames
+ * are sent right away, while the flash state write waits for
+ * `server_interlock_flush()`; the state lock is held until then.
+ *
+ * @param flash_client_index Index of the source client in the persistent state table.
+ * @param rise_mask          Inputs that rose since the last collect.
+ * @param fall_mask          Inputs that fell since the last collect.
+ * @param trigger_us         time_us_64() of the last change, start of the reaction time.
+ */
+void server_interlock_dispatch(uint32_t flash_client_index, uint32_t rise_mask, uint32_t fall_mask, uint64_t trigger_us);
+
+/**
+ * @brief Writes the outputs switched by interlocks to the flash state. Runs on core1.
+ *
+ * Called once the collected input reports have all been dispatched, so a
+ * burst costs one flash write. Target clients left without active devices
+ * are sent back to dormant mode.
+ */
+void server_interlock_flush(void);
+
+/**
+ * @brief Prints one `INTERLOCK` line per interlock for host tools.
+ *
+ * Line format: `INTERLOCK <index> <source_client> <source_gpio> <edges> <target_client> <target_gpio> <action> <fires>`.
+ */
+void server_interlock_print_machine(void);
+
+/**
+ * @brief Returns the GPIOs of a client state that are PWM outputs.
+ *
+ * @param client_state State to read.
+ * @return Bit `n` set when GPIO `n` has a PWM duty.
+ */
+uint32_t client_state_pwm_mask(const client_state_t *client_state);
+
+/**
+ * @brief Sends the PWM mode and duties of a client state that differ from another.
+ *
+ * The client must be awake.
  *
  * @param pin_pair UART TX/RX pin pair to use.
- * @param uart UART instance.
- * @param state Pointer to the client_state_t to send.
+ * @param uart     UART instance.
+ * @param previous State the client has, or NULL to send everything.
+ * @param next     State to send.
  */
-void server_send_client_state(uart_pin_pair_t pin_pair, uart_inst_t* uart, const client_state_t* state);
+void server_pwm_send_state(uart_pin_pair_t pin_pair, uart_inst_t *uart, const client_state_t *previous, const client_state_t *next);
+
+/**
+ * @brief Brings the PWM outputs of a client to its running state.
+ *
+ * Does nothing when neither state has a PWM output. Wakes the client if needed.
+ *
+ * @param flash_client_index Index of the client in the persistent state table.
+ * @param state              Persistent state holding the new running state.
+ * @param previous           Running state before the change.
+ */
+void server_pwm_sync(uint32_t flash_client_index, server_persistent_state_t *state, const client_state_t *previous);
+
+/**
+ * @brief Sets the PWM duty of client GPIOs and saves the state.
+ *
+ * A duty of 0 makes the GPIO a digital output again. The ON/OFF state is kept.
+ *
+ * @param flash_client_index Index of the client in the persistent state table.
+ * @param count              Number of GPIOs.
+ * @param gpio_numbers       GPIOs to set.
+ * @param duties             16-bit duty of each GPIO.
+ * @return false if the client is not connected, a GPIO is invalid or two
+ *         PWM outputs would share a PWM channel.
+ */
+bool server_pwm_set(uint32_t flash_client_index, uint32_t count, const uint8_t *gpio_numbers, const uint16_t *duties);
+
+/**
+ * @brief Prints one `PWM` line per PWM output for host tools.
+ *
+ * Line format: `PWM <client> <gpio> <duty> <is_on>`.
+ */
+void server_pwm_print_machine(void);
 
 /**
  * @brief Core1 wakeup handler triggered by inter-core messages.
  *
- * Handles two commands:
+ * Waits on the core1 message queue and handles:
  * - `DUMP_BUFFER_WAKEUP_MESSAGE`: Reprints stored output to CLI.
  * - `BLINK_LED_WAKEUP_MESSAGE`: Triggers fast onboard LED blink and mirrors to clients.
+ * - `TIMED_OUTPUT_POLL_WAKEUP_MESSAGE`: Collects due timed output reports.
+ * - `SCHEDULER_TICK_WAKEUP_MESSAGE`: Advances the scheduler timer wheel.
+ * - `SCHEDULER_RELOAD_WAKEUP_MESSAGE`: Rebuilds the timer wheel from flash.
+ * - `INTERLOCK_RELOAD_WAKEUP_MESSAGE`: Rebuilds the interlock index from flash.
+ *
+ * Input changes of clients that rang (`INPUT_DOORBELL_WAKEUP_MESSAGE`) are
+ * collected before every message and between the lines of a buffer dump,
+ * so interlocks do not wait behind queued work.
+ *
+ * While a stream runs, messages that need the UART links are held back,
+ * repeats merged, and run once the stream ends, so core1 keeps draining its
+ * queue instead of waiting for the UART lock. Messages lost to a full queue
+ * are counted and logged.
+ *
+ * The inter-core FIFO is left to the multicore lockout used by flash writes.
  */
 void periodic_wakeup(void);
 
+/**
+ * @brief Queues a wakeup message for core1. Safe from IRQ handlers.
+ *
+ * @param message One of the `*_WAKEUP_MESSAGE` values.
+ * @return false if the queue is full and the message was dropped.
+ */
+bool server_post_core1_message(uint32_t message);
+
 /**
  * @brief Scans all possible UART pin pairs to detect connected clients.
  *
@@ -136,6 +1534,17 @@ void periodic_wakeup(void);
  */
 bool server_find_connections(void);
 
+/**
+ * @brief Listens for a restarted client on the pin pair of an active connection.
+ *
+ * Holds the UART lock for up to `SERVER_RECONNECT_LISTEN_MS`, which covers
+ * one full pass of the client's handshake over its pin pairs.
+ *
+ * @param connection_index Index into `active_uart_server_connections`.
+ * @return true if the client completed the handshake again.
+ */
+bool server_reconnect_client(uint8_t connection_index);
+
 /**
  * @brief Sets the state of a single device and updates flash accordingly.
  *
@@ -167,17 +1576,40 @@ void save_running_configuration_into_preset_configuration(uint32_t flash_configu
  * @brief Loads a saved preset configuration into a client's running state.
  *
  * Copies the selected preset configuration into the client's current state,
- * sends the new state to the client via UART, and updates the persistent flash.
+ * recalls the preset on the client with a single frame (sending the preset
+ * first if the client's copy is out of date), and updates the persistent flash.
  * If the loaded configuration results in all devices being OFF, the client is
  * marked as dormant.
  *
- * A confirmation message is printed to the USB CLI.
+ * Nothing is printed, so the scheduler can also use it from core1.
  *
  * @param flash_configuration_index Index of the preset configuration to load.
  * @param flash_client_index Index of the target client in the persistent flash state.
  */
 void load_configuration_into_running_state(uint32_t flash_configuration_index, uint32_t flash_client_index);
 
+/**
+ * @brief Loads a preset on every connected client so that they all switch at the same time.
+ *
+ * With `LATCH_LINE_ENABLED`, each client is woken and the preset's on-mask
+ * is staged on it, then the latch line is pulsed. Clients that report they
+ * did not apply the commit recall the preset directly.
+ *
+ * Otherwise each client is woken, its clock is synced if needed and a stale
+ * copy of the preset is sent. A common apply time is then chosen far enough
+ * ahead to send one "apply at" frame to every client, and each client
+ * recalls the preset from a hardware alarm at that time. Clients without a
+ * clock sync recall the preset on receipt.
+ *
+ * Dormant handling and the flash state are updated as in
+ * `load_configuration_into_running_state()`.
+ *
+ * Nothing is printed, so the scheduler can also use it from core1.
+ *
+ * @param flash_configuration_index Index of the preset configuration to load.
+ */
+void load_scene_into_running_states(uint32_t flash_configuration_index);
+
 /**
  * @brief Configures the devices for a given client and preset configuration index.
  *
@@ -252,6 +1684,37 @@ void server_configure_persistent_state(server_persistent_state_t *server_persist
  */
 void server_reset_configuration(client_state_t *client_state);
 
+/**
+ * @brief Computes CRC32 checksum over a block of memory.
+ *
+ * @param data Pointer to the data block.
+ * @param length Number of bytes to process.
+ * @return uint32_t CRC32 checksum.
+ */
+uint32_t compute_crc32(const void *data, uint32_t length);
+
+/**
+ * @brief Creates the state lock. Call once at boot, before core1 starts.
+ */
+void server_state_lock_init(void);
+
+/**
+ * @brief Takes the state lock, blocking until the other core releases it.
+ *
+ * Both cores change the persistent state and the `is_dormant` flags. Every
+ * load-modify-save of the state, together with the frames that go with it,
+ * runs under this lock so that no save overwrites the other core's change.
+ * The lock is recursive, so locked functions may call each other. It is
+ * never taken while the UART lock is held, and never held while waiting for
+ * USB input.
+ */
+void server_state_lock(void);
+
+/**
+ * @brief Releases the state lock taken with `server_state_lock()`.
+ */
+void server_state_unlock(void);
+
 /**
  * @brief Loads the server state from flash and validates it using CRC32.
  *
@@ -264,12 +1727,30 @@ bool load_server_state(server_persistent_state_t *out_state);
  * @brief Saves the persistent server state structure to flash memory.
  *
  * - Computes CRC
- * - Erases and programs the flash sector
+ * - Erases and programs the flash sector, together with the flash telemetry
  *
  * @param state_in Pointer to the server_persistent_state_t structure to save.
  */
 void __not_in_flash_func(save_server_state)(const server_persistent_state_t *state_in);
 
+/**
+ * @brief Pauses the other core before a flash erase or program.
+ *
+ * The other core may be executing from flash, which is not readable while
+ * it is written. Nothing is paused while the other core has not started.
+ * Boosts clk_sys first, so the commit runs at full speed.
+ *
+ * @return true if the other core was paused.
+ */
+bool flash_lockout_begin(void);
+
+/**
+ * @brief Resumes the other core after a flash write.
+ *
+ * @param locked_out Value returned by `flash_lockout_begin()`.
+ */
+void flash_lockout_end(bool locked_out);
+
 /**
  * @brief Retrieves the index of an active client connection matching a flash-stored client.
  *
@@ -291,6 +1772,18 @@ uint32_t get_active_client_connection_index_from_flash_client_index(uint32_t fla
  */
 void server_load_running_states_to_active_clients(void);
 
+/**
+ * @brief Sends a client that (re)connected everything it keeps in RAM.
+ *
+ * The client starts from empty RAM, so its running state, presets,
+ * input configuration and local rules are sent in full. Used at boot and after
+ * `server_reconnect_client()`. The
+ * client is put back to dormant if it has no active devices.
+ *
+ * @param connection_index Index into `active_uart_server_connections`.
+ */
+void server_restore_client(uint8_t connection_index);
+
 /**
  * @brief Prints the state of all devices from a given client state structure.
  *
@@ -312,21 +1805,24 @@ void server_print_running_client_state(const client_t * client);
 /**
  * @brief Prints a saved preset configuration for a given client.
  *
- * @param client Pointer to the client_t.
+ * @param state Persistent state holding the client and the preset pool.
+ * @param flash_client_index Index of the client in the persistent state table.
  * @param client_preset_index Preset index to print (0 to NUMBER_OF_POSSIBLE_PRESETS - 1).
  */
-void server_print_client_preset_configuration(const client_t * client, uint8_t client_preset_index);
+void server_print_client_preset_configuration(const server_persistent_state_t *state, uint32_t flash_client_index, uint8_t client_preset_index);
 
 /**
  * @brief Prints all preset configurations for a client.
  *
  * - Iterates through each preset slot of the client.
- * - Prints each configuration using `server_print_client_preset_configuration()`.
+ * - Prints each non-empty configuration using `server_print_client_preset_configuration()`.
+ * - Ends with the number of stored presets.
  * - Adds spacing between configurations for clarity.
  *
- * @param client Pointer to the client_t structure containing the preset configurations.
+ * @param state Persistent state holding the client and the preset pool.
+ * @param flash_client_index Index of the client in the persistent state table.
  */
-void server_print_client_preset_configurations(const client_t * client);
+void server_print_client_preset_configurations(const server_persistent_state_t *state, uint32_t flash_client_index);
 
 /**
  * @brief Checks if a client has any active (ON) devices.
@@ -0,0 +1,135 @@
+/**
+ * @file statistics.h
+ * @brief Runtime counters and latency histograms for the UART server.
+ *
+ * Tracks how long the server spends on its main operations and how much
+ * traffic each client receives:
+ * - Command end-to-end time (from confirmed CLI input to completion)
+ * - Flash commit time (`save_server_state()`)
+ * - Client wake time (wake pulse + wake-up flag)
+ * - Handshake time per scanned UART pin pair
+ * - Frames and bytes sent per client
+ *
+ * Latencies go into log2-bucketed histograms: bucket `n` counts samples in
+ * `[2^(n-1), 2^n)` microseconds, bucket 0 counts zero-length samples and the
+ * last bucket is open-ended. Recording is O(1) and safe from both cores.
+ *
+ * The values are shown in the Diagnostics menu and through the machine
+ * interface, optionally resetting them after they are read.
+ */
+
+#ifndef STATISTICS_H
+#define STATISTICS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "types.h"
+#include "config.h"
+
+#ifndef STATISTICS_HISTOGRAM_BUCKETS
+#define STATISTICS_HISTOGRAM_BUCKETS 24
+#endif
+
+/**
+ * @brief Latency metrics recorded by the server.
+ */
+typedef enum{
+    STATISTICS_LATENCY_COMMAND,
+    STATISTICS_LATENCY_FLASH_COMMIT,
+    STATISTICS_LATENCY_WAKE,
+    STATISTICS_LATENCY_SYNC_ERROR,
+    STATISTICS_LATENCY_INTERLOCK,
+    STATISTICS_LATENCY_CLOCK_BOOST,
+    STATISTICS_LATENCY_CLOCK_DROP,
+    STATISTICS_LATENCY_COUNT
+}statistics_latency_t;
+
+/**
+ * @brief Log2-bucketed latency histogram with summary values.
+ */
+typedef struct{
+    uint32_t count;
+    uint32_t min_us;
+    uint32_t max_us;
+    uint64_t total_us;
+    uint32_t buckets[STATISTICS_HISTOGRAM_BUCKETS];
+}latency_histogram_t;
+
+/**
+ * @brief Handshake results for one scanned UART pin pair.
+ */
+typedef struct{
+    uint32_t attempts;
+    uint32_t successes;
+    latency_histogram_t latency;
+}handshake_statistics_t;
+
+/**
+ * @brief Traffic sent to one client.
+ */
+typedef struct{
+    uint32_t frames;
+    uint32_t bytes;
+}client_traffic_statistics_t;
+
+/**
+ * @brief All runtime statistics kept by the server.
+ *
+ * Pin pair slots follow the scan order: UART0 pairs first, then UART1 pairs.
+ */
+typedef struct{
+    latency_histogram_t latencies[STATISTICS_LATENCY_COUNT];
+    handshake_statistics_t handshakes[MAX_SERVER_CONNECTIONS];
+    client_traffic_statistics_t traffic[MAX_SERVER_CONNECTIONS];
+}server_statistics_t;
+
+/**
+ * @brief Claims the spinlock protecting the statistics. Call once at boot.
+ */
+void statistics_init(void);
+
+/**
+ * @brief Records one latency sample.
+ *
+ * @param metric     Metric to update.
+ * @param elapsed_us Measured duration in microseconds.
+ */
+void statistics_record_latency(statistics_latency_t metric, uint32_t elapsed_us);
+
+/**
+ * @brief Records the outcome of a handshake attempt on a scanned pin pair.
+ *
+ * @param pin_pair   Server-side TX/RX pin pair that was scanned.
+ * @param success    true if the handshake completed.
+ * @param elapsed_us Time spent on the attempt in microseconds.
+ */
+void statistics_record_handshake(uart_pin_pair_t pin_pair, bool success, uint32_t elapsed_us);
+
+/**
+ * @brief Records frames and bytes sent to a client.
+ *
+ * @param pin_pair Server-side TX/RX pin pair of the client.
+ * @param frames   Number of frames sent.
+ * @param bytes    Number of bytes sent.
+ */
+void statistics_record_traffic(uart_pin_pair_t pin_pair, uint32_t frames, uint32_t bytes);
+
+/**
+ * @brief Prints all statistics to the USB CLI.
+ *
+ * @param reset true to clear the statistics after they are printed.
+ */
+void statistics_print(bool reset);
+
+/**
+ * @brief Prints all statistics as `STAT` lines for the machine interface.
+ *
+ * Each line holds a metric name followed by `key=value` fields. Histogram
+ * buckets are printed as a comma-separated list.
+ *
+ * @param reset true to clear the statistics after they are printed.
+ */
+void statistics_print_machine(bool reset);
+
+#endif
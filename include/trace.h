@@ -0,0 +1,129 @@
+/**
+ * @file trace.h
+ * @brief Low-overhead hot-path event tracing for the UART server.
+ *
+ * Events are written into one ring per core, so the two cores never contend
+ * for the same memory. Each record holds a microsecond timestamp, an event ID
+ * with its begin/end phase and two small arguments.
+ *
+ * Tracing is removed at compile time unless `SERVER_TRACE_ENABLED` is set
+ * (e.g. `-DSERVER_TRACE_ENABLED=1` on the CMake command line). When disabled,
+ * the `TRACE_BEGIN()` / `TRACE_END()` macros expand to nothing.
+ *
+ * The recorder is fully inlined and touches only RAM, so it is safe to call
+ * from `__not_in_flash_func` code while flash is being erased or programmed.
+ *
+ * @see trace_dump_chrome_json()
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "pico/stdlib.h"
+#include "hardware/sync.h"
+
+#ifndef SERVER_TRACE_ENABLED
+#define SERVER_TRACE_ENABLED 0
+#endif
+
+/// Number of events kept per core. Must be a power of two.
+#ifndef TRACE_RING_SIZE
+#define TRACE_RING_SIZE 256
+#endif
+
+#ifndef TRACE_PHASE_END_BIT
+#define TRACE_PHASE_END_BIT 0x8000u
+#endif
+
+/**
+ * @brief Traced spans on the server hot path.
+ *
+ * Every span is recorded as a begin event and an end event with the same ID.
+ */
+typedef enum{
+    TRACE_SPAN_UART_SEND,       ///< arg0 = server TX pin, arg1 = bytes or frames sent
+    TRACE_SPAN_WAKE_PULSE,      ///< arg0 = server RX pin used as wake line
+    TRACE_SPAN_FLASH_ERASE,     ///< arg1 = flash offset
+    TRACE_SPAN_FLASH_PROGRAM,   ///< arg1 = flash offset
+    TRACE_SPAN_CRC,             ///< arg1 = length in bytes
+    TRACE_SPAN_UART_LOCK,       ///< held between acquire and release
+    TRACE_SPAN_CLI_DISPATCH,    ///< arg0 = menu option
+    TRACE_SPAN_COUNT
+}trace_span_t;
+
+/**
+ * @brief A single trace record.
+ */
+typedef struct{
+    uint32_t timestamp_us;
+    uint16_t event;             ///< trace_span_t, OR-ed with TRACE_PHASE_END_BIT for end events
+    uint16_t arg0;
+    uint32_t arg1;
+}trace_event_t;
+
+/**
+ * @brief Per-core event ring. Only the owning core writes to it.
+ */
+typedef struct{
+    volatile uint32_t head;     ///< Total number of events written (wraps the ring)
+    trace_event_t events[TRACE_RING_SIZE];
+}trace_ring_t;
+
+#if SERVER_TRACE_ENABLED
+
+extern trace_ring_t trace_rings[NUM_CORES];
+extern volatile bool trace_paused;
+
+/**
+ * @brief Appends one event to the calling core's ring.
+ *
+ * Interrupts are masked only for the few stores needed to claim and fill
+ * the slot, so a nested IRQ on the same core cannot interleave with it.
+ *
+ * @param event Span ID, optionally OR-ed with `TRACE_PHASE_END_BIT`.
+ * @param arg0  First argument.
+ * @param arg1  Second argument.
+ */
+static inline void trace_record(uint16_t event, uint16_t arg0, uint32_t arg1){
+    if (trace_paused){
+        return;
+    }
+
+    trace_ring_t *ring = &trace_rings[get_core_num()];
+    uint32_t ints = save_and_disable_interrupts();
+    uint32_t head = ring->head;
+    trace_event_t *slot = &ring->events[head & (TRACE_RING_SIZE - 1)];
+    slot->timestamp_us = time_us_32();
+    slot->event = event;
+    slot->arg0 = arg0;
+    slot->arg1 = arg1;
+    ring->head = head + 1;
+    restore_interrupts(ints);
+}
+
+#define TRACE_BEGIN(span, arg0, arg1) trace_record((uint16_t)(span), (uint16_t)(arg0), (uint32_t)(arg1))
+#define TRACE_END(span, arg0, arg1)   trace_record((uint16_t)((span) | TRACE_PHASE_END_BIT), (uint16_t)(arg0), (uint32_t)(arg1))
+
+#else
+
+#define TRACE_BEGIN(span, arg0, arg1) ((void)0)
+#define TRACE_END(span, arg0, arg1)   ((void)0)
+
+#endif
+
+/**
+ * @brief Prints both trace rings over USB as Chrome trace JSON.
+ *
+ * Recording is paused while the rings are read. Events from both cores
+ * are merged in timestamp order and each core is shown as its own thread.
+ * The output can be saved to a `.json` file and opened in `chrome://tracing`
+ * or Perfetto. The rings are cleared after the dump.
+ *
+ * Prints a short notice instead when tracing is compiled out.
+ */
+void trace_dump_chrome_json(void);
+
+#endif
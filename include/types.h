@@ -63,11 +63,13 @@ typedef struct{
 /**
  * @brief Represents a single controllable GPIO device on a client.
  *
- * Each device corresponds to a GPIO number and an ON/OFF state.
+ * Each device corresponds to a GPIO number and an ON/OFF state. A device
+ * with a PWM duty is a PWM output that runs at that duty while ON.
  */
 typedef struct{
     uint8_t gpio_number;
     bool is_on;
+    uint16_t pwm_duty;          ///< 16-bit duty while ON, 0 = plain digital output
 }device_t;
 
 /**
@@ -79,22 +81,208 @@ typedef struct{
     device_t devices[MAX_NUMBER_OF_GPIOS];  ///< Array of GPIO devices
 }client_state_t;
 
+/**
+ * @brief Input configuration of a client, kept to send it again when the client restarts.
+ */
+typedef struct{
+    uint8_t modes[32];              ///< `input_mode_t` of every GPIO, `INPUT_MODE_OFF` if not an input
+    uint16_t debounce_ms[32];       ///< Debounce time of every input
+}client_inputs_t;
+
 /**
  * @brief Represents a complete client entry in the system.
  *
- * Contains both live (running) GPIO state and a number of preset configurations.
+ * Contains the live (running) GPIO state of the client. Its presets are
+ * kept separately in the preset library (see preset_library_t).
  * Also stores the UART connection information and whether the client is active.
  */
 typedef struct{
     client_state_t running_client_state;
-    client_state_t preset_configs[NUMBER_OF_POSSIBLE_PRESETS];
     uart_connection_t uart_connection;
+    client_inputs_t inputs;
 }client_t;
 
+/**
+ * @brief One deduplicated preset in the shared preset pool.
+ *
+ * Bit `n` of the mask is set when GPIO `n` is ON. The entry is free when
+ * `refcount` is 0; a free entry with a non-zero hash is a deleted entry
+ * that keeps hash probe chains intact.
+ */
+typedef struct{
+    uint32_t hash;              ///< preset_store_hash(gpio_mask), 0 = never used
+    uint32_t gpio_mask;
+    uint16_t refcount;          ///< Number of client preset slots referencing the entry
+    uint16_t reserved;
+}preset_pool_entry_t;
+
+/**
+ * @brief One deduplicated set of PWM duties in the preset library.
+ *
+ * `duties` is indexed like `client_state_t.devices`. The entry is free
+ * when `refcount` is 0.
+ */
+typedef struct{
+    uint16_t refcount;          ///< Number of client preset slots referencing the entry
+    uint16_t duties[MAX_NUMBER_OF_GPIOS];
+}preset_pwm_entry_t;
+
+/**
+ * @brief Preset library stored in its own flash region.
+ *
+ * `preset_slots[client][preset]` is the pool index of a preset, so any
+ * preset is found with one lookup directly in flash. PWM duties are kept
+ * apart in `preset_pwm_slots`, as few presets have PWM outputs. The library is
+ * written alternately to two banks; the valid bank with the newer
+ * sequence number is the active one.
+ */
+typedef struct{
+    uint32_t magic;             ///< PRESET_LIBRARY_MAGIC
+    uint32_t sequence;          ///< Incremented on every commit
+    uint16_t preset_slots[MAX_SERVER_CONNECTIONS][NUMBER_OF_POSSIBLE_PRESETS];  ///< PRESET_SLOT_EMPTY = all OFF
+    preset_pool_entry_t preset_pool[PRESET_POOL_SIZE];
+    uint8_t preset_pwm_slots[MAX_SERVER_CONNECTIONS][NUMBER_OF_POSSIBLE_PRESETS];      ///< PRESET_PWM_SLOT_EMPTY = no PWM output
+    preset_pwm_entry_t preset_pwm_pool[PRESET_PWM_POOL_SIZE];
+    uint32_t crc;
+}preset_library_t;
+
+/**
+ * @brief Action run by a schedule entry.
+ */
+typedef enum{
+    SCHEDULE_ACTION_NONE = 0,       ///< Unused table entry
+    SCHEDULE_ACTION_SET,            ///< Set GPIO `target` of the client to `value`
+    SCHEDULE_ACTION_TOGGLE,         ///< Toggle GPIO `target` of the client
+    SCHEDULE_ACTION_LOAD_PRESET,    ///< Load preset `target` into the client's running state
+    SCHEDULE_ACTION_LOAD_SCENE,     ///< Load preset `target` on every connected client
+    SCHEDULE_ACTION_COUNT
+}schedule_action_t;
+
+/**
+ * @brief Control code of a `SEQUENCE_CONTROL_FLAG_NUMBER` frame.
+ */
+typedef enum{
+    SEQUENCE_CONTROL_STOP = 0,      ///< Stop and turn the sequence's GPIOs OFF
+    SEQUENCE_CONTROL_START,         ///< Play from step `step`, counting loops from 0
+    SEQUENCE_CONTROL_SEEK           ///< Jump to step `step` of a playing sequence
+}sequence_control_t;
+
+/**
+ * @brief Mode of a client GPIO set with `INPUT_CONFIG_FLAG_NUMBER`.
+ */
+typedef enum{
+    INPUT_MODE_OFF = 0,             ///< Not an input, the GPIO can be driven again
+    INPUT_MODE_FLOATING,            ///< Input without pull
+    INPUT_MODE_PULL_UP,             ///< Input with pull-up
+    INPUT_MODE_PULL_DOWN,           ///< Input with pull-down
+    INPUT_MODE_COUNT
+}input_mode_t;
+
+/**
+ * @brief Edges that trigger a local rule, as bits.
+ */
+typedef enum{
+    RULE_EDGE_RISE = 1u << 0,
+    RULE_EDGE_FALL = 1u << 1
+}rule_edge_t;
+
+/**
+ * @brief One scheduled action.
+ *
+ * The action runs at `time_s` on the server clock and then every
+ * `period_s` seconds. A one-shot entry whose time has passed is free.
+ */
+typedef struct{
+    uint32_t time_s;            ///< First run, in server clock seconds
+    uint32_t period_s;          ///< Repeat period in seconds, 0 = run once
+    uint8_t action;             ///< schedule_action_t
+    uint8_t flash_client_index; ///< Unused for SCHEDULE_ACTION_LOAD_SCENE
+    uint8_t target;             ///< GPIO number, or preset index (0-based)
+    uint8_t value;              ///< SCHEDULE_ACTION_SET: 1 = ON, 0 = OFF
+}schedule_entry_t;
+
+/**
+ * @brief Schedule table stored in its own flash sector.
+ */
+typedef struct{
+    uint32_t magic;             ///< SCHEDULE_TABLE_MAGIC
+    schedule_entry_t entries[SCHEDULE_MAX_ENTRIES];
+    uint32_t crc;
+}schedule_table_t;
+
+/**
+ * @brief Output action of an interlock rule.
+ */
+typedef enum{
+    INTERLOCK_ACTION_OFF = 0,       ///< Turn the target GPIO OFF
+    INTERLOCK_ACTION_ON,            ///< Turn the target GPIO ON
+    INTERLOCK_ACTION_TOGGLE,        ///< Toggle the target GPIO
+    INTERLOCK_ACTION_COUNT
+}interlock_action_t;
+
+/**
+ * @brief One interlock rule: an input edge on one client drives an output of another.
+ *
+ * Clients are flash client indexes. An entry without edges is free.
+ */
+typedef struct{
+    uint8_t source_client;
+    uint8_t source_gpio;
+    uint8_t edges;              ///< `rule_edge_t` bits, 0 = unused entry
+    uint8_t target_client;
+    uint8_t target_gpio;
+    uint8_t action;             ///< interlock_action_t
+    uint16_t reserved;
+}interlock_entry_t;
+
+/**
+ * @brief Interlock table stored in its own flash sector.
+ */
+typedef struct{
+    uint32_t magic;             ///< INTERLOCK_TABLE_MAGIC
+    interlock_entry_t entries[INTERLOCK_MAX_ENTRIES];
+    uint32_t crc;
+}interlock_table_t;
+
+/**
+ * @brief One block of ADC samples.
+ *
+ * Samples are 12-bit and interleaved in ascending channel order, one per
+ * channel of `channel_mask` in turn. A block always ends on a whole round
+ * of channels.
+ */
+typedef struct{
+    uint32_t sequence;          ///< Block number since sampling started
+    uint8_t channel_mask;       ///< ADC inputs sampled
+    uint8_t sample_count;
+    uint16_t samples[ADC_BLOCK_SAMPLES];
+}adc_block_t;
+
+/**
+ * @brief A run of identical logic capture samples.
+ *
+ * Bit `n` of the value is GPIO `first_gpio + n` of the capture.
+ */
+typedef struct{
+    uint32_t value;
+    uint32_t length;            ///< Samples in the run
+}logic_run_t;
+
+/**
+ * @brief A preset replicated to a client.
+ *
+ * The client keeps one entry per preset slot in RAM. Bit `n` of the mask
+ * is set when GPIO `n` is ON in the preset.
+ */
+typedef struct{
+    uint32_t version;           ///< Version received from the server, 0 = empty
+    uint32_t gpio_mask;
+}client_preset_t;
+
 /**
  * @brief Full persistent state saved in flash.
  *
- * Holds all known clients and their saved configurations.
+ * Holds all known clients and their running states.
  * Includes a CRC32 checksum for integrity verification.
  */
 typedef struct {
@@ -113,6 +301,7 @@ typedef struct {
  * - Setting a desired GPIO state (ON/OFF/TOGGLE)
  * - Selecting a configuration preset
  * - Selecting a reset type (e.g., running, preset, all)
+ * - Choosing the pulse count and ON/OFF times of a timed output
  *
  * It also includes pointers to the current runtime client state and the persistent server state.
  */
@@ -123,6 +312,9 @@ typedef struct{
     uint32_t device_state;
     uint32_t flash_configuration_index;
     uint32_t reset_choice;
+    uint32_t pulse_count;
+    uint32_t pulse_on_ms;
+    uint32_t pulse_off_ms;
     const client_state_t *client_state;
     const server_persistent_state_t *flash_state;
 }input_client_data_t;
@@ -143,6 +335,7 @@ typedef struct {
     bool is_building_preset;
     bool need_reset_choice;
     bool is_load;
+    bool need_timed_output;
 }client_input_flags_t;
 
 #endif
\ No newline at end of file
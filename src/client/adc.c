@@ -0,0 +1,307 @@
+/**
+ * @file adc.c
+ * @brief Batched ADC sampling with DMA, collected by the server in blocks.
+ *
+ * "[56,channel_mask,rate_hz,decimation]" starts the round-robin sampler
+ * on the channels of the mask, `rate_hz` samples per second per channel.
+ * Each sample is the average of `decimation` conversions, so the ADC runs
+ * at `rate_hz * channels * decimation` conversions per second.
+ *
+ * Two chained DMA channels fill two conversion buffers in turn, so the
+ * ADC never waits for the CPU. The DMA IRQ averages a full buffer into
+ * 12-bit samples and packs them into blocks of `ADC_BLOCK_SAMPLES`, kept
+ * in a ring of `ADC_CLIENT_BLOCKS`. When the ring is full the newest block
+ * is dropped and counted; its sequence number is still used, so the server
+ * sees the gap.
+ *
+ * Waiting blocks ring the input doorbell (see input_sense.c), and the
+ * server collects them with "[57,max_blocks]": the client replies with
+ * "[57,blocks,dropped]" followed by the blocks in binary, two samples in
+ * three bytes. No UART frame is sent per sample.
+ *
+ * The ADC clock is stopped at boot to save power. Sampling runs it from
+ * the crystal at 12 MHz and stops it again afterwards; the client stays
+ * awake while it samples.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "hardware/adc.h"
+#include "hardware/clocks.h"
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+#include "hardware/sync.h"
+
+#include "client.h"
+#include "functions.h"
+
+#ifdef CYW43_WL_GPIO_LED_PIN
+#define ADC_USABLE_CHANNEL_MASK (ADC_CHANNEL_MASK & ~(1u << 3))   ///< GPIO 29 belongs to the wireless chip
+#else
+#define ADC_USABLE_CHANNEL_MASK ADC_CHANNEL_MASK
+#endif
+
+#define ADC_TEMPERATURE_CHANNEL 4
+
+static uint16_t adc_dma_buffers[2][ADC_DMA_BUFFER_SAMPLES];
+static int adc_dma_channels[2] = {-1, -1};
+static uint32_t adc_dma_length = 0;
+static bool adc_clock_started = false;
+
+static uint32_t adc_channel_mask = 0;
+static uint8_t adc_channel_count = 0;
+static uint32_t adc_decimation = 1;
+static uint32_t adc_sums[5];
+static uint8_t adc_position = 0;            ///< Rank of the channel of the next conversion
+static uint32_t adc_rounds = 0;             ///< Rounds of conversions summed so far
+static uint8_t adc_block_capacity = 0;      ///< Whole rounds of channels that fit in a block
+
+static adc_block_t adc_blocks[ADC_CLIENT_BLOCKS];
+static uint32_t adc_head = 0;               ///< Block being filled
+static volatile uint32_t adc_ready_count = 0;   ///< Full blocks before the head
+static volatile uint32_t adc_dropped = 0;
+static uint32_t adc_next_sequence = 0;
+
+/**
+ * @brief Starts a new block at the head of the ring.
+ */
+static void adc_open_block(void){
+    adc_block_t *block = &adc_blocks[adc_head];
+    block->sequence = adc_next_sequence++;
+    block->channel_mask = (uint8_t)adc_channel_mask;
+    block->sample_count = 0;
+}
+
+/**
+ * @brief Hands the head block over to the server, or drops it if the ring is full.
+ */
+static void adc_close_block(void){
+    if (adc_ready_count < ADC_CLIENT_BLOCKS - 1){
+        adc_ready_count++;
+        adc_head = (adc_head + 1) % ADC_CLIENT_BLOCKS;
+    }else{
+        adc_dropped++;
+    }
+    adc_open_block();
+}
+
+/**
+ * @brief Averages a buffer of conversions into samples.
+ *
+ * @param conversions Raw conversions in round-robin order.
+ * @param count       Number of conversions.
+ */
+static void adc_process(const uint16_t *conversions, uint32_t count){
+    for (uint32_t index = 0; index < count; index++){
+        adc_sums[adc_position] += conversions[index] & 0x0FFF;
+        if (++adc_position < adc_channel_count){
+            continue;
+        }
+        adc_position = 0;
+        if (++adc_rounds < adc_decimation){
+            continue;
+        }
+        adc_rounds = 0;
+
+        adc_block_t *block = &adc_blocks[adc_head];
+        for (uint8_t channel = 0; channel < adc_channel_count; channel++){
+            block->samples[block->sample_count++] = (uint16_t)((adc_sums[channel] + adc_decimation / 2) / adc_decimation);
+            adc_sums[channel] = 0;
+        }
+        if (block->sample_count >= adc_block_capacity){
+            adc_close_block();
+        }
+    }
+}
+
+/**
+ * @brief DMA IRQ handler: processes the buffer that was just filled and re-arms its channel.
+ */
+static void adc_dma_irq_handler(void){
+    for (uint8_t buffer = 0; buffer < 2; buffer++){
+        int channel = adc_dma_channels[buffer];
+        if (channel < 0 || !dma_channel_get_irq0_status((uint)channel)){
+            continue;
+        }
+        dma_channel_acknowledge_irq0((uint)channel);
+        dma_channel_set_write_addr((uint)channel, adc_dma_buffers[buffer], false);
+        adc_process(adc_dma_buffers[buffer], adc_dma_length);
+    }
+}
+
+/**
+ * @brief Configures one of the two chained DMA channels.
+ *
+ * @param buffer Buffer written by the channel, 0 or 1.
+ */
+static void adc_dma_configure(uint8_t buffer){
+    uint channel = (uint)adc_dma_channels[buffer];
+    dma_channel_config config = dma_channel_get_default_config(channel);
+    channel_config_set_transfer_data_size(&config, DMA_SIZE_16);
+    channel_config_set_read_increment(&config, false);
+    channel_config_set_write_increment(&config, true);
+    channel_config_set_dreq(&config, DREQ_ADC);
+    channel_config_set_chain_to(&config, (uint)adc_dma_channels[buffer ^ 1]);
+    dma_channel_configure(channel, &config, adc_dma_buffers[buffer], &adc_hw->fifo, adc_dma_length, false);
+    dma_channel_set_irq0_enabled(channel, true);
+}
+
+/**
+ * @brief Stops the sampler, frees the DMA channels and the ADC clock.
+ */
+static void adc_sampling_stop(void){
+    if (!adc_channel_mask){
+        return;
+    }
+    adc_run(false);
+    for (uint8_t buffer = 0; buffer < 2; buffer++){
+        uint channel = (uint)adc_dma_channels[buffer];
+        dma_channel_set_irq0_enabled(channel, false);
+        dma_channel_abort(channel);
+        dma_channel_acknowledge_irq0(channel);
+        dma_channel_unclaim(channel);
+        adc_dma_channels[buffer] = -1;
+    }
+    irq_remove_handler(DMA_IRQ_0, adc_dma_irq_handler);
+    adc_fifo_drain();
+    adc_set_round_robin(0);
+    adc_set_temp_sensor_enabled(false);
+
+    uint32_t irq = save_and_disable_interrupts();
+    adc_channel_mask = 0;
+    adc_ready_count = 0;
+    adc_dropped = 0;
+    restore_interrupts(irq);
+
+    if (adc_clock_started){
+        clock_stop(clk_adc);
+        adc_clock_started = false;
+    }
+}
+
+void adc_sampling_configure(uint32_t channel_mask, uint32_t rate_hz, uint32_t decimation){
+    adc_sampling_stop();
+    channel_mask &= ADC_USABLE_CHANNEL_MASK;
+    if (!channel_mask || !rate_hz || !decimation || decimation > ADC_DECIMATION_MAX){
+        return;
+    }
+    uint8_t channel_count = (uint8_t)__builtin_popcount(channel_mask);
+    uint64_t conversions_hz = (uint64_t)rate_hz * channel_count * decimation;
+    if (conversions_hz > ADC_MAX_CONVERSIONS_HZ){
+        return;
+    }
+
+    if (!(clocks_hw->clk[clk_adc].ctrl & CLOCKS_CLK_ADC_CTRL_ENABLE_BITS)){
+        clock_configure(clk_adc, 0, CLOCKS_CLK_ADC_CTRL_AUXSRC_VALUE_XOSC_CLKSRC, 12 * MHZ, 12 * MHZ);
+        adc_clock_started = true;
+    }
+    adc_init();
+    for (uint8_t channel = 0; channel < ADC_TEMPERATURE_CHANNEL; channel++){
+        if (channel_mask & (1u << channel)){
+            adc_gpio_init(ADC_FIRST_GPIO + channel);
+        }
+    }
+    adc_set_temp_sensor_enabled(channel_mask & (1u << ADC_TEMPERATURE_CHANNEL));
+    adc_select_input((uint)__builtin_ctz(channel_mask));
+    adc_set_round_robin(channel_count > 1 ? channel_mask : 0);
+    adc_fifo_setup(true, true, 1, false, false);
+    float clkdiv = (float)clock_get_hz(clk_adc) / (float)conversions_hz - 1.0f;
+    adc_set_clkdiv(clkdiv < 96.0f ? 0.0f : clkdiv);
+
+    adc_channel_mask = channel_mask;
+    adc_channel_count = channel_count;
+    adc_decimation = decimation;
+    adc_block_capacity = (uint8_t)(ADC_BLOCK_SAMPLES / channel_count * channel_count);
+    memset(adc_sums, 0, sizeof(adc_sums));
+    adc_position = 0;
+    adc_rounds = 0;
+    adc_head = 0;
+    adc_next_sequence = 0;
+    adc_open_block();
+
+    uint32_t conversions_per_block = (uint32_t)adc_block_capacity * decimation;
+    adc_dma_length = conversions_per_block < ADC_DMA_BUFFER_SAMPLES ? conversions_per_block : ADC_DMA_BUFFER_SAMPLES;
+    adc_dma_channels[0] = dma_claim_unused_channel(true);
+    adc_dma_channels[1] = dma_claim_unused_channel(true);
+    adc_dma_configure(0);
+    adc_dma_configure(1);
+    irq_add_shared_handler(DMA_IRQ_0, adc_dma_irq_handler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+    irq_set_enabled(DMA_IRQ_0, true);
+
+    dma_channel_start((uint)adc_dma_channels[0]);
+    adc_run(true);
+}
+
+uint32_t adc_sampling_gpio_mask(void){
+    return (adc_channel_mask & ~(1u << ADC_TEMPERATURE_CHANNEL)) << ADC_FIRST_GPIO;
+}
+
+bool adc_sampling_active(void){
+    return adc_channel_mask != 0;
+}
+
+uint32_t adc_sampling_blocks_ready(void){
+    return adc_ready_count;
+}
+
+/**
+ * @brief Packs a block for the wire.
+ *
+ * Layout: sequence (4 bytes, little-endian), channel mask, sample count,
+ * the samples two in three bytes (a low byte, a high nibble and b low
+ * nibble, b high byte), then the Fletcher-16 checksum of all previous bytes.
+ *
+ * @param block  Block to pack.
+ * @param buffer At least `ADC_BLOCK_MAX_BYTES` bytes.
+ * @return Number of bytes written.
+ */
+static uint32_t adc_block_encode(const adc_block_t *block, uint8_t *buffer){
+    uint32_t length = 0;
+    for (uint8_t shift = 0; shift < 32; shift += 8){
+        buffer[length++] = (uint8_t)(block->sequence >> shift);
+    }
+    buffer[length++] = block->channel_mask;
+    buffer[length++] = block->sample_count;
+    for (uint8_t index = 0; index < block->sample_count; index += 2){
+        uint16_t first = block->samples[index];
+        buffer[length++] = (uint8_t)first;
+        if (index + 1 < block->sample_count){
+            uint16_t second = block->samples[index + 1];
+            buffer[length++] = (uint8_t)((first >> 8) | (second << 4));
+            buffer[length++] = (uint8_t)(second >> 4);
+        }else{
+            buffer[length++] = (uint8_t)(first >> 8);
+        }
+    }
+    uint16_t checksum = fletcher16(buffer, length);
+    buffer[length++] = (uint8_t)checksum;
+    buffer[length++] = (uint8_t)(checksum >> 8);
+    return length;
+}
+
+void adc_sampling_send_blocks(uint32_t max_blocks){
+    uint32_t irq = save_and_disable_interrupts();
+    uint32_t block_count = adc_ready_count < max_blocks ? adc_ready_count : max_blocks;
+    uint32_t first = (adc_head + ADC_CLIENT_BLOCKS - adc_ready_count) % ADC_CLIENT_BLOCKS;
+    uint32_t dropped = adc_dropped;
+    adc_dropped = 0;
+    restore_interrupts(irq);
+
+    uart_inst_t *uart = active_uart_client_connection.uart_instance;
+    char msg[CLIENT_COMMAND_BUFFER_SIZE];
+    snprintf(msg, sizeof(msg), "[%d,%lu,%lu]", ADC_COLLECT_FLAG_NUMBER, (unsigned long)block_count, (unsigned long)dropped);
+    uart_puts(uart, msg);
+
+    for (uint32_t sent = 0; sent < block_count; sent++){
+        uint8_t buffer[ADC_BLOCK_MAX_BYTES];
+        uint32_t length = adc_block_encode(&adc_blocks[(first + sent) % ADC_CLIENT_BLOCKS], buffer);
+        uart_write_blocking(uart, buffer, length);
+    }
+    uart_tx_wait_blocking(uart);
+
+    irq = save_and_disable_interrupts();
+    adc_ready_count -= block_count;
+    restore_interrupts(irq);
+}
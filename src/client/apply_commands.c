@@ -4,8 +4,20 @@
  *
  * This module:
  * - Listens for UART messages from the server
- * - Parses commands of the form "[gpio, value]"
+ * - Parses commands of the form "[gpio, value]" or "[flag, arg, ...]"
  * - Applies the commands by controlling GPIO pins
+ * - Keeps a RAM copy of the presets so a preset can be recalled with one frame
+ * - Starts timed outputs and answers report polls
+ * - Answers clock sync requests and defers commands to an apply time
+ * - Stages on-masks that are applied on the next latch line edge
+ * - Applies streamed on-masks addressed to this client
+ * - Stores and controls the output sequence played by sequence.c
+ * - Configures input GPIOs and replies with their changes (input_sense.c)
+ * - Stores the local input rules run by rules.c
+ * - Selects PWM outputs and sets their duties (pwm.c)
+ * - Starts ADC sampling and sends the sample blocks (adc.c)
+ * - Arms logic captures and sends the captured chunks (logic_capture.c)
+ * - Receives and swaps in new client images (firmware_update.c)
  */
 
 #include <stdio.h>
@@ -18,51 +30,220 @@
 #include "client.h"
 #include "types.h"
 #include "functions.h"
+#include "profiler.h"
 
-/**
- * @brief Sets or clears a GPIO pin based on a number and logic level.
- *
- * Behavior:
- * - If logic level is `1` (HIGH):
- *   - Initializes the specified GPIO pin
- *   - Sets it as output and drives it HIGH
- *
- * - If logic level is `0` (LOW):
- *   - Drives the pin LOW
- *   - Then deinitializes the pin (returns to high-impedance input)
- *
- * This allows toggling pins **and** releasing unused ones to save power.
- *
- * @param gpio_number GPIO pin number (0–22 and 26-28).
- * @param gpio_state  Logic level: 0 = LOW, 1 = HIGH.
- */
-static void change_gpio(uint8_t gpio_number, uint8_t gpio_state){
-    if (gpio_state){
+static client_preset_t client_presets[NUMBER_OF_POSSIBLE_PRESETS];
+static volatile uint32_t client_gpio_on_mask = 0;
+static uint64_t frame_received_us = 0;
+static uint32_t stream_address = 0;
+
+void change_gpio(uint8_t gpio_number, uint8_t gpio_state){
+    uint32_t irq = save_and_disable_interrupts();
+    if (pwm_output_mask() & (1u << gpio_number)){
+        pwm_output_enable_masked(1u << gpio_number, gpio_state ? 1u << gpio_number : 0);
+        if (gpio_state){
+            client_gpio_on_mask |= 1u << gpio_number;
+        }else{
+            client_gpio_on_mask &= ~(1u << gpio_number);
+        }
+    }else if (gpio_state){
         gpio_init(gpio_number);
         gpio_set_dir(gpio_number, GPIO_OUT); 
         gpio_put(gpio_number, gpio_state);
+        client_gpio_on_mask |= 1u << gpio_number;
     }else{
         gpio_put(gpio_number, gpio_state);
         gpio_deinit(gpio_number);
+        client_gpio_on_mask &= ~(1u << gpio_number);
+    }
+    restore_interrupts(irq);
+}
+
+/**
+ * @brief Stores a preset received from the server.
+ *
+ * @param preset_index Preset slot (0-based).
+ * @param version      Preset version assigned by the server.
+ * @param gpio_mask    Bit `n` set when GPIO `n` is ON in the preset.
+ */
+static void store_preset(uint32_t preset_index, uint32_t version, uint32_t gpio_mask){
+    if (preset_index >= NUMBER_OF_POSSIBLE_PRESETS){
+        return;
+    }
+    client_presets[preset_index].version = version;
+    client_presets[preset_index].gpio_mask = gpio_mask;
+}
+
+/**
+ * @brief Returns the GPIOs that commands from the server may drive.
+ *
+ * The pins of the UART connection to the server, the latch line,
+ * GPIOs configured as inputs and sampled ADC inputs are never touched.
+ *
+ * @return Bit `n` set when GPIO `n` is controllable.
+ */
+static uint32_t controllable_gpio_mask(void){
+    uint32_t reserved_mask = (1u << active_uart_client_connection.pin_pair.tx) | (1u << active_uart_client_connection.pin_pair.rx);
+    #if LATCH_LINE_ENABLED
+        reserved_mask |= 1u << LATCH_LINE_GPIO;
+    #endif
+    return GPIO_DEVICE_MASK & ~reserved_mask & ~input_sense_mask() & ~adc_sampling_gpio_mask();
+}
+
+void apply_gpio_mask(uint32_t gpio_mask){
+    apply_gpio_mask_masked(GPIO_DEVICE_MASK, gpio_mask);
+}
+
+void apply_gpio_mask_masked(uint32_t affected_mask, uint32_t gpio_mask){
+    uint32_t controllable_mask = controllable_gpio_mask() & affected_mask;
+    uint32_t target_mask = gpio_mask & controllable_mask;
+
+    uint32_t irq = save_and_disable_interrupts();
+    uint32_t turn_on_mask = target_mask & ~client_gpio_on_mask;
+    uint32_t turn_off_mask = client_gpio_on_mask & ~target_mask & controllable_mask;
+    client_gpio_on_mask = (client_gpio_on_mask | turn_on_mask) & ~turn_off_mask;
+
+    uint32_t pwm_mask = pwm_output_mask();
+    pwm_output_enable_masked(turn_on_mask | turn_off_mask, target_mask);
+    turn_on_mask &= ~pwm_mask;
+    turn_off_mask &= ~pwm_mask;
+
+    gpio_init_mask(turn_on_mask);
+    gpio_set_dir_out_masked(turn_on_mask);
+    gpio_put_masked(turn_on_mask | turn_off_mask, target_mask);
+
+    while (turn_off_mask){
+        gpio_deinit((uint8_t)__builtin_ctz(turn_off_mask));
+        turn_off_mask &= turn_off_mask - 1;
+    }
+    restore_interrupts(irq);
+}
+
+/**
+ * @brief Applies a stored preset to the GPIOs.
+ *
+ * All changed GPIOs switch together with `apply_gpio_mask()`. Empty preset
+ * slots are ignored. Running timed outputs and sequences are stopped, as
+ * the preset defines every output.
+ *
+ * @param preset_index Preset slot (0-based).
+ */
+static void recall_preset(uint32_t preset_index){
+    if (preset_index >= NUMBER_OF_POSSIBLE_PRESETS || !client_presets[preset_index].version){
+        return;
+    }
+    timed_output_cancel_all();
+    sequence_cancel();
+    apply_gpio_mask(client_presets[preset_index].gpio_mask);
+}
+
+/**
+ * @brief Releases the outputs on the ADC inputs of a channel mask and starts sampling.
+ *
+ * The frame is ignored when an ADC input is a UART, latch or input GPIO.
+ *
+ * @param channel_mask ADC inputs to sample, 0 to stop.
+ * @param rate_hz      Samples per second and channel.
+ * @param decimation   Conversions averaged into one sample.
+ */
+static void configure_adc(uint32_t channel_mask, uint32_t rate_hz, uint32_t decimation){
+    uint32_t gpio_mask = (channel_mask & ADC_CHANNEL_MASK & ~(1u << 4)) << ADC_FIRST_GPIO;
+    uint32_t device_mask = gpio_mask & GPIO_DEVICE_MASK;
+    if (device_mask & ~(controllable_gpio_mask() | adc_sampling_gpio_mask())){
+        return;
+    }
+    for (uint32_t remaining_mask = device_mask & controllable_gpio_mask(); remaining_mask; remaining_mask &= remaining_mask - 1){
+        timed_output_cancel((uint8_t)__builtin_ctz(remaining_mask));
+    }
+    apply_gpio_mask_masked(device_mask, 0);
+    pwm_output_configure(pwm_output_mask() & ~device_mask, client_gpio_on_mask);
+    adc_sampling_configure(channel_mask, rate_hz, decimation);
+}
+
+void apply_output_command(uint32_t command, uint32_t argument){
+    if (command == PRESET_RECALL_FLAG_NUMBER){
+        recall_preset(argument);
+    }else if (command < 32 && (controllable_gpio_mask() & (1u << command))){
+        timed_output_cancel((uint8_t)command);
+        change_gpio((uint8_t)command, (uint8_t)argument);
     }
 }
 
+/**
+ * @brief Replies to an output audit with "[65,audited_mask,on_mask,busy]".
+ *
+ * The ON state is read back from the SIO output registers rather than
+ * taken from `client_gpio_on_mask`, so pins that were changed behind the
+ * client's back show up. `audited_mask` holds the controllable GPIOs that
+ * are plain outputs or released; PWM outputs and GPIOs taken over by
+ * another peripheral are left out. `busy` is 1 while local activity may
+ * change outputs without the server knowing yet.
+ */
+static void send_audit_readback(void){
+    uint32_t audited_mask = 0;
+    for (uint32_t remaining_mask = controllable_gpio_mask() & ~pwm_output_mask(); remaining_mask; remaining_mask &= remaining_mask - 1){
+        uint32_t gpio_number = (uint32_t)__builtin_ctz(remaining_mask);
+        uint32_t function = gpio_get_function(gpio_number);
+        if (function == GPIO_FUNC_SIO || function == GPIO_FUNC_NULL){
+            audited_mask |= 1u << gpio_number;
+        }
+    }
+    uint32_t on_mask = sio_hw->gpio_out & sio_hw->gpio_oe & audited_mask;
+    bool busy = timed_output_pending() || apply_at_pending() || latch_pending() || sequence_pending() || rules_pending();
+
+    char msg[CLIENT_COMMAND_BUFFER_SIZE];
+    snprintf(msg, sizeof(msg), "[%d,%lu,%lu,%d]", AUDIT_FLAG_NUMBER, (unsigned long)audited_mask, (unsigned long)on_mask, busy);
+    uart_puts(active_uart_client_connection.uart_instance, msg);
+    uart_tx_wait_blocking(active_uart_client_connection.uart_instance);
+}
+
 /**
  * @brief Applies a command based on a received UART message.
  *
- * Interprets the first byte of the received number pair as a command flag
- * and performs the corresponding action, such as resetting the device,
- * blinking the onboard LED, toggling the power state, or changing GPIO state.
+ * Interprets the first received number as a command flag and performs the
+ * corresponding action, such as resetting the device, blinking the onboard
+ * LED, toggling the power state, storing or recalling a preset, or
+ * changing GPIO state.
  *
- * @param received_number_pair Pointer to a read-only array of two `uint8_t` values.
- *        The first element is interpreted as a command flag.
+ * @param received_numbers Numbers parsed from the frame. The first element
+ *        is interpreted as a command flag.
+ * @param count            Number of parsed numbers.
  *
  * Supported command flags:
  * - `TRIGGER_RESET_FLAG_NUMBER` → Soft reset using watchdog
  * - `BLINK_ONBOARD_LED_FLAG_NUMBER` → Blink onboard LED (blocking)
  * - `WAKE_UP_FLAG_NUMBER` → Set `go_dormant_flag = false`
  * - `DORMANT_FLAG_NUMBER` → Set `go_dormant_flag = true`
- * - Any other value → Delegated to `change_gpio()`
+ * - `PRESET_STORE_FLAG_NUMBER` → Store `[flag,preset,version,mask]` in RAM
+ * - `PRESET_RECALL_FLAG_NUMBER` → Apply stored preset `[flag,preset]`
+ * - `TIMED_ON_FLAG_NUMBER` → `[flag,gpio,on_ms]` via `timed_output_start()`
+ * - `PULSE_TRAIN_FLAG_NUMBER` → `[flag,gpio,on_ms,off_ms,count]` via `timed_output_start()`
+ * - `OUTPUT_REPORT_FLAG_NUMBER` → Reply with `timed_output_send_report()`
+ * - `TIME_SYNC_FLAG_NUMBER` → Reply with `time_sync_send_reply()`
+ * - `APPLY_AT_FLAG_NUMBER` → `[flag,time_lo,command,argument]` via `apply_at_schedule()`
+ * - `LATCH_STAGE_FLAG_NUMBER` → `[flag,gpio_mask,sequence]` via `latch_stage()`
+ * - `LATCH_REPORT_FLAG_NUMBER` → Reply with `latch_send_report()`
+ * - `STREAM_ADDRESS_FLAG_NUMBER` → Set the stream address `[flag,address]`
+ * - `STREAM_FRAME_FLAG_NUMBER` → `[flag,address,gpio_mask]` via `apply_gpio_mask()` if the address is ours
+ * - `SEQUENCE_DEFINE_FLAG_NUMBER` → `[flag,step_count,loop_count]` via `sequence_define()`
+ * - `SEQUENCE_STEP_FLAG_NUMBER` → `[flag,step,gpio_mask,duration_us]` via `sequence_set_step()`
+ * - `SEQUENCE_CONTROL_FLAG_NUMBER` → `[flag,control,step]` via `sequence_control()`
+ * - `SEQUENCE_REPORT_FLAG_NUMBER` → Reply with `sequence_send_report()`
+ * - `INPUT_CONFIG_FLAG_NUMBER` → `[flag,gpio,mode,debounce_ms]` via `input_sense_configure()`
+ * - `INPUT_REPORT_FLAG_NUMBER` → Reply with `input_sense_send_report()`
+ * - `RULE_SET_FLAG_NUMBER` → `[flag,rule,trigger_gpio,edges,gpio_mask,on_ms]` via `rules_set()`
+ * - `PWM_MODE_FLAG_NUMBER` → `[flag,pwm_mask]` via `pwm_output_configure()`
+ * - `PWM_DUTY8_FLAG_NUMBER` / `PWM_DUTY16_FLAG_NUMBER` → `[flag,first_channel,packed,packed]` via `pwm_output_set_duties()`
+ * - `ADC_CONFIG_FLAG_NUMBER` → `[flag,channel_mask,rate_hz,decimation]` via `configure_adc()`
+ * - `ADC_COLLECT_FLAG_NUMBER` → Reply with `adc_sampling_send_blocks()`
+ * - `LOGIC_CONFIG_FLAG_NUMBER` → `[flag,first_gpio,pin_count,rate_hz]` via `logic_capture_configure()`
+ * - `LOGIC_ARM_FLAG_NUMBER` → `[flag,trigger_mask,trigger_value]` via `logic_capture_arm()`
+ * - `LOGIC_COLLECT_FLAG_NUMBER` → Reply with `logic_capture_send_chunks()`
+ * - `FIRMWARE_BEGIN_FLAG_NUMBER` → `[flag,size,crc32]` via `firmware_update_begin()`
+ * - `FIRMWARE_BAUD_FLAG_NUMBER` → `[flag,baudrate]` via `firmware_update_receive()`, blocking until the image is in
+ * - `FIRMWARE_COMMIT_FLAG_NUMBER` → `[flag,crc32]` via `firmware_update_commit()`
+ * - `AUDIT_FLAG_NUMBER` → Reply with `send_audit_readback()`
+ * - Any other value → Delegated to `apply_output_command()`
  *
  * @note This function includes debug output via `printf()` for logging purposes.
  *
@@ -70,9 +251,9 @@ static void change_gpio(uint8_t gpio_number, uint8_t gpio_state){
  * @see watchdog_reboot()
  * @see fast_blink_onboard_led_blocking()
  */
-static void apply_command(const uint8_t *received_number_pair){
-    uint8_t number1 = received_number_pair[0];
-    uint8_t number2 = received_number_pair[1];
+static void apply_command(const uint32_t *received_numbers, uint8_t count){
+    uint32_t number1 = received_numbers[0];
+    uint32_t number2 = received_numbers[1];
 
     switch(number1){
         case TRIGGER_RESET_FLAG_NUMBER: watchdog_reboot(0, 0, 0);
@@ -83,10 +264,129 @@ static void apply_command(const uint8_t *received_number_pair){
             break;
         case DORMANT_FLAG_NUMBER: go_dormant_flag = true;
             break;
+        case PRESET_STORE_FLAG_NUMBER:
+            if (count >= 4){
+                store_preset(number2, received_numbers[2], received_numbers[3]);
+            }
+            break;
+        case PRESET_RECALL_FLAG_NUMBER: apply_output_command(number1, number2);
+            break;
+        case TIMED_ON_FLAG_NUMBER:
+            if (count >= 3 && number2 < 32){
+                timed_output_start((uint8_t)number2, received_numbers[2], 0, 1);
+            }
+            break;
+        case PULSE_TRAIN_FLAG_NUMBER:
+            if (count >= 5 && number2 < 32){
+                timed_output_start((uint8_t)number2, received_numbers[2], received_numbers[3], received_numbers[4]);
+            }
+            break;
+        case OUTPUT_REPORT_FLAG_NUMBER: timed_output_send_report(client_gpio_on_mask);
+            break;
+        case TIME_SYNC_FLAG_NUMBER: time_sync_send_reply(frame_received_us);
+            break;
+        case APPLY_AT_FLAG_NUMBER:
+            if (count >= 4){
+                apply_at_schedule(number2, received_numbers[2], received_numbers[3]);
+            }
+            break;
+        case STREAM_ADDRESS_FLAG_NUMBER: stream_address = number2;
+            break;
+        case STREAM_FRAME_FLAG_NUMBER:
+            if (count >= 3 && stream_address && number2 == stream_address){
+                timed_output_cancel_all();
+                sequence_cancel();
+                apply_gpio_mask(received_numbers[2]);
+            }
+            break;
+        case SEQUENCE_DEFINE_FLAG_NUMBER:
+            if (count >= 3){
+                sequence_define(number2, received_numbers[2]);
+            }
+            break;
+        case SEQUENCE_STEP_FLAG_NUMBER:
+            if (count >= 4){
+                sequence_set_step(number2, received_numbers[2], received_numbers[3]);
+            }
+            break;
+        case SEQUENCE_CONTROL_FLAG_NUMBER:
+            if (count >= 3){
+                sequence_control(number2, received_numbers[2]);
+            }
+            break;
+        case SEQUENCE_REPORT_FLAG_NUMBER: sequence_send_report();
+            break;
+        case INPUT_CONFIG_FLAG_NUMBER:
+            if (count >= 4 && number2 < 32 && received_numbers[2] < INPUT_MODE_COUNT &&
+                ((controllable_gpio_mask() | input_sense_mask()) & (1u << number2))){
+                if (received_numbers[2] != INPUT_MODE_OFF){
+                    timed_output_cancel((uint8_t)number2);
+                    apply_gpio_mask_masked(1u << number2, 0);
+                    pwm_output_configure(pwm_output_mask() & ~(1u << number2), client_gpio_on_mask);
+                }
+                input_sense_configure((uint8_t)number2, received_numbers[2], received_numbers[3]);
+            }
+            break;
+        case INPUT_REPORT_FLAG_NUMBER: input_sense_send_report();
+            break;
+        case RULE_SET_FLAG_NUMBER:
+            if (count >= 6 && received_numbers[2] < 32){
+                rules_set(number2, (uint8_t)received_numbers[2], received_numbers[3], received_numbers[4], received_numbers[5]);
+            }
+            break;
+        case PWM_MODE_FLAG_NUMBER: pwm_output_configure(number2 & controllable_gpio_mask(), client_gpio_on_mask);
+            break;
+        case PWM_DUTY8_FLAG_NUMBER:
+        case PWM_DUTY16_FLAG_NUMBER:
+            if (count >= 3){
+                pwm_output_set_duties(number2, received_numbers[2], count >= 4 ? received_numbers[3] : 0,
+                    number1 == PWM_DUTY8_FLAG_NUMBER ? 8 : 16, client_gpio_on_mask);
+            }
+            break;
+        case ADC_CONFIG_FLAG_NUMBER:
+            if (count >= 4){
+                configure_adc(number2, received_numbers[2], received_numbers[3]);
+            }
+            break;
+        case ADC_COLLECT_FLAG_NUMBER: adc_sampling_send_blocks(number2);
+            break;
+        case LOGIC_CONFIG_FLAG_NUMBER:
+            if (count >= 4 && number2 < 32 && received_numbers[2] <= 32){
+                logic_capture_configure((uint8_t)number2, (uint8_t)received_numbers[2], received_numbers[3]);
+            }
+            break;
+        case LOGIC_ARM_FLAG_NUMBER:
+            if (count >= 3){
+                logic_capture_arm(number2, received_numbers[2]);
+            }
+            break;
+        case LOGIC_COLLECT_FLAG_NUMBER:
+            if (count >= 3){
+                logic_capture_send_chunks(number2, received_numbers[2]);
+            }
+            break;
+        case FIRMWARE_BEGIN_FLAG_NUMBER:
+            if (count >= 3){
+                firmware_update_begin(number2, received_numbers[2]);
+            }
+            break;
+        case FIRMWARE_BAUD_FLAG_NUMBER: firmware_update_receive(number2);
+            break;
+        case FIRMWARE_COMMIT_FLAG_NUMBER: firmware_update_commit(number2);
+            break;
+        case AUDIT_FLAG_NUMBER: send_audit_readback();
+            break;
+        #if LATCH_LINE_ENABLED
+        case LATCH_STAGE_FLAG_NUMBER:
+            if (count >= 3){
+                latch_stage(number2, received_numbers[2]);
+            }
+            break;
+        case LATCH_REPORT_FLAG_NUMBER: latch_send_report();
+            break;
+        #endif
 
-        default: 
-            if ((0 <= number1 && 22 >= number1) || (26 <= number1 && 28 >= number1))
-                change_gpio(number1, number2);
+        default: apply_output_command(number1, number2);
             break;
     }
 }
@@ -96,25 +396,36 @@ static void apply_command(const uint8_t *received_number_pair){
  *
  * This function attempts to read a UART message into a buffer and parse it
  * into a numeric command. If the buffer is not empty, it applies the
- * corresponding command using the parsed number pair.
+ * corresponding command using the parsed numbers.
  */
 static void receive_data(void){
-    char buf[8] = {0};
-    uint8_t received_number_pair[2] = {0};
+    char buf[CLIENT_COMMAND_BUFFER_SIZE] = {0};
+    uint32_t received_numbers[CLIENT_COMMAND_MAX_NUMBERS] = {0};
 
     get_uart_buffer(active_uart_client_connection.uart_instance, buf, sizeof(buf), CLIENT_TIMEOUT_MS);
-    get_number_pair(received_number_pair, buf);
+    frame_received_us = time_us_64();
+    uint8_t count = get_number_list(received_numbers, CLIENT_COMMAND_MAX_NUMBERS, buf);
 
-    if (buf[0] != '\0'){
-        apply_command(received_number_pair);
+    if (buf[0] != '\0' && count){
+        apply_command(received_numbers, count);
+        burst_clock_frame_handled();
     }
 }
 
 void client_listen_for_commands(void){
     while(true){
         receive_data();
-        #ifndef CYW43_WL_GPIO_LED_PIN
-            if (go_dormant_flag){
+        input_sense_service();
+        burst_clock_service();
+        #if PROFILING_BUILD
+            // USB stays up in profiling builds; 'p' dumps the profile.
+            int ch = getchar_timeout_us(0);
+            if (ch == 'p' || ch == 'P'){
+                profiler_dump(ch == 'P');
+            }
+        #endif
+        #if !defined(CYW43_WL_GPIO_LED_PIN) && !PROFILING_BUILD
+            if (go_dormant_flag && !timed_output_pending() && !apply_at_pending() && !latch_pending() && !sequence_pending() && !input_sense_mask() && !adc_sampling_active() && !logic_capture_active() && !burst_clock_active()){
                 enter_dormant_mode();
                 wake_up();
                 woke_up_from_dormant = true;
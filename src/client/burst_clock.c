@@ -0,0 +1,161 @@
+/**
+ * @file burst_clock.c
+ * @brief Runs the client from the system PLL while commands pile up.
+ *
+ * Clients run at 12 MHz from the XOSC, which is plenty for a frame now and
+ * then but falls behind a dense command stream. When a frame has been
+ * handled and the next one already waits in the UART FIFO, the command
+ * queue is busy: the system PLL is started and clk_sys switched to it at
+ * `CLIENT_BURST_CLOCK_KHZ`. After `CLIENT_BURST_IDLE_MS` without a frame,
+ * clk_sys goes back to the XOSC and the PLL is stopped, after which the
+ * client may go dormant again.
+ *
+ * clk_peri, which clocks the UART, runs from the XOSC rather than from
+ * clk_sys (see `client_turn_off_unused_power_consumers()`), so these
+ * transitions may happen while a frame is on the line. A high-baud
+ * firmware transfer needs a faster clk_peri as well: it is moved to the
+ * PLL at the baud switch, where both ends wait for each other, and back
+ * when the transfer ends. Whenever clk_peri changes, the UART divider is
+ * derived again for the baud rate in use. Every transition also rescales
+ * the PWM slices, whose counters run from clk_sys. Nothing switches while
+ * a logic capture runs, as its PIO divider is set from clk_sys at start.
+ *
+ * The default burst clock is a multiple of 12 MHz, so the PWM dividers
+ * scale exactly.
+ */
+
+#include "pico/stdlib.h"
+#include "hardware/clocks.h"
+#include "hardware/pll.h"
+#include "hardware/uart.h"
+
+#include "client.h"
+
+#if !defined(CYW43_WL_GPIO_LED_PIN) && !PROFILING_BUILD && CLIENT_BURST_CLOCK_KHZ
+#define BURST_CLOCK_AVAILABLE 1
+#else
+#define BURST_CLOCK_AVAILABLE 0
+#endif
+
+static bool burst_active = false;           ///< clk_sys runs from the system PLL
+static bool burst_uart = false;             ///< clk_peri runs from the system PLL too
+static uint32_t burst_last_frame_us = 0;    ///< time_us_32() of the last handled frame
+
+#if BURST_CLOCK_AVAILABLE
+/**
+ * @brief Derives the UART divider again after clk_peri changed, keeping the baud rate.
+ *
+ * The baud rate is recovered from the divider registers, which hold
+ * 64 * clk_peri / (16 * baudrate).
+ *
+ * @param old_peri_hz clk_peri the current divider was derived from.
+ */
+static void burst_clock_rederive_uart(uint32_t old_peri_hz){
+    uart_inst_t *uart = active_uart_client_connection.uart_instance;
+    uint32_t divider = (uart_get_hw(uart)->ibrd << 6) | uart_get_hw(uart)->fbrd;
+    if (uart_is_enabled(uart) && divider){
+        uart_set_baudrate(uart, (uint32_t)(4ull * old_peri_hz / divider));
+    }
+}
+
+/**
+ * @brief Moves clk_sys, and clk_peri, between the XOSC and the system PLL.
+ *
+ * clk_peri only runs from the PLL while clk_sys does.
+ *
+ * @param active true for clk_sys from the PLL.
+ * @param uart   true for clk_peri from the PLL as well.
+ */
+static void burst_clock_switch(bool active, bool uart){
+    const uint32_t burst_hz = CLIENT_BURST_CLOCK_KHZ * KHZ;
+    uint32_t old_peri_hz = clock_get_hz(clk_peri);
+    uart = uart && active;
+
+    if (active && !burst_active){
+        uint vco_hz;
+        uint postdiv1;
+        uint postdiv2;
+        if (!check_sys_clock_khz(CLIENT_BURST_CLOCK_KHZ, &vco_hz, &postdiv1, &postdiv2)){
+            return;
+        }
+        pll_init(pll_sys, 1, vco_hz, postdiv1, postdiv2);
+        clock_configure(clk_sys,
+            CLOCKS_CLK_SYS_CTRL_SRC_VALUE_CLKSRC_CLK_SYS_AUX,
+            CLOCKS_CLK_SYS_CTRL_AUXSRC_VALUE_CLKSRC_PLL_SYS,
+            burst_hz, burst_hz);
+    }
+    if (uart != burst_uart){
+        if (uart){
+            clock_configure(clk_peri, 0, CLOCKS_CLK_PERI_CTRL_AUXSRC_VALUE_CLKSRC_PLL_SYS, burst_hz, burst_hz);
+        }else{
+            clock_configure(clk_peri, 0, CLOCKS_CLK_PERI_CTRL_AUXSRC_VALUE_XOSC_CLKSRC, XOSC_HZ, XOSC_HZ);
+        }
+        burst_clock_rederive_uart(old_peri_hz);
+    }
+    if (!active && burst_active){
+        clock_configure(clk_sys,
+            CLOCKS_CLK_SYS_CTRL_SRC_VALUE_CLK_REF,
+            0, XOSC_HZ, XOSC_HZ);
+        pll_deinit(pll_sys);
+    }
+
+    burst_active = active;
+    burst_uart = uart;
+    pwm_output_clock_changed();
+}
+#endif
+
+void burst_clock_frame_handled(void){
+    #if BURST_CLOCK_AVAILABLE
+        burst_last_frame_us = time_us_32();
+        if (!burst_active && !logic_capture_active() && uart_is_readable(active_uart_client_connection.uart_instance)){
+            burst_clock_switch(true, false);
+        }
+    #endif
+}
+
+void burst_clock_service(void){
+    #if BURST_CLOCK_AVAILABLE
+        if (burst_active && !burst_uart && !logic_capture_active() &&
+            time_us_32() - burst_last_frame_us >= CLIENT_BURST_IDLE_MS * MS_TO_US_MULTIPLIER){
+            burst_clock_switch(false, false);
+        }
+    #endif
+}
+
+bool burst_clock_active(void){
+    return burst_active;
+}
+
+uint32_t burst_clock_base_hz(void){
+    return burst_active ? XOSC_HZ : clock_get_hz(clk_sys);
+}
+
+uint32_t burst_clock_max_baudrate(void){
+    #if BURST_CLOCK_AVAILABLE
+        uint vco_hz;
+        uint postdiv1;
+        uint postdiv2;
+        if (!logic_capture_active() && check_sys_clock_khz(CLIENT_BURST_CLOCK_KHZ, &vco_hz, &postdiv1, &postdiv2)){
+            return CLIENT_BURST_CLOCK_KHZ * KHZ / 16;
+        }
+    #endif
+    return clock_get_hz(clk_peri) / 16;
+}
+
+void burst_clock_uart_begin(void){
+    #if BURST_CLOCK_AVAILABLE
+        if (!logic_capture_active()){
+            burst_clock_switch(true, true);
+        }
+    #endif
+}
+
+void burst_clock_uart_end(void){
+    #if BURST_CLOCK_AVAILABLE
+        if (burst_uart){
+            burst_clock_switch(true, false);
+        }
+        burst_last_frame_us = time_us_32();
+    #endif
+}
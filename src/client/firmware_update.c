@@ -0,0 +1,284 @@
+/**
+ * @file firmware_update.c
+ * @brief Receives a new client image from the server and swaps it in.
+ *
+ * "[61,size,crc32]" starts a transfer, and the client replies with the
+ * fastest baud rate its peripheral clock allows in a clock burst (see
+ * burst_clock.c). "[62,baudrate]" starts the burst and switches the link
+ * to the agreed rate, then the server sends the image as binary frames of
+ * one flash sector: a sync byte, the sector index, the sector and a CRC-32
+ * of index and sector. It sends `FIRMWARE_WINDOW_FRAMES`
+ * frames before it reads their acks.
+ *
+ * A DMA channel moves every received byte into a ring buffer, so the line
+ * keeps being read while the core is stalled by flash erase and program.
+ * Each frame is checked and programmed into the staging area at the top of
+ * flash, which is erased one block at a time as the image reaches it, and
+ * acked with "[63,sector,1]". A damaged or unexpected frame is answered
+ * with "[63,expected_sector,0]"; the rest of the window is dropped once the
+ * line goes idle, and the server sends again from the expected sector.
+ *
+ * "[64,crc32]" checks the whole staged image, then copies it over the
+ * running image from RAM and restarts through the watchdog. The copy only
+ * starts from a complete, checked image, but it is not power-fail safe:
+ * an outage during it leaves the client to be reflashed over USB.
+ */
+
+#include <stdio.h>
+
+#include "pico/stdlib.h"
+#include "hardware/clocks.h"
+#include "hardware/dma.h"
+#include "hardware/flash.h"
+#include "hardware/sync.h"
+#include "hardware/watchdog.h"
+
+#include "client.h"
+#include "functions.h"
+
+#define FIRMWARE_RING_SIZE (1u << FIRMWARE_RING_BITS)
+#define FIRMWARE_RING_TRANSFERS 0x0FFFFFFFu     ///< DMA count of a transfer, never reached at UART speed
+#define FIRMWARE_SECTOR_INDEX 1                 ///< Offset of the sector index in a frame
+#define FIRMWARE_SECTOR_DATA 5                  ///< Offset of the sector in a frame
+
+_Static_assert(FIRMWARE_WINDOW_FRAMES * FIRMWARE_FRAME_BYTES < FIRMWARE_RING_SIZE, "a window of image frames does not fit the receive ring");
+_Static_assert(FIRMWARE_IMAGE_MAX_BYTES <= FIRMWARE_CLIENT_STAGING_OFFSET, "the staging area overlaps the image it replaces");
+_Static_assert(FIRMWARE_CLIENT_STAGING_OFFSET % FIRMWARE_BLOCK_SIZE == 0, "the staging area is not block aligned");
+
+extern char __flash_binary_end;
+
+static uint8_t firmware_ring[FIRMWARE_RING_SIZE] __attribute__((aligned(FIRMWARE_RING_SIZE)));
+static uint8_t firmware_frame[FIRMWARE_FRAME_BYTES];
+static uint32_t firmware_size = 0;              ///< Size of the image being transferred, 0 without transfer
+static uint32_t firmware_crc = 0;
+static uint32_t firmware_sectors = 0;
+static uint32_t firmware_erased_end = 0;        ///< Staging offset erased up to
+static bool firmware_staged = false;            ///< Every sector of the image is programmed
+
+/**
+ * @brief Reads a little-endian 32-bit value.
+ */
+static uint32_t firmware_read_u32(const uint8_t *bytes){
+    return (uint32_t)bytes[0] | ((uint32_t)bytes[1] << 8) | ((uint32_t)bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+}
+
+/**
+ * @brief Erases staging blocks until `end` is erased.
+ *
+ * @param end Flash offset that must be erased up to.
+ */
+static void firmware_erase_to(uint32_t end){
+    while (firmware_erased_end < end){
+        uint32_t ints = save_and_disable_interrupts();
+        flash_range_erase(firmware_erased_end, FIRMWARE_BLOCK_SIZE);
+        restore_interrupts(ints);
+        firmware_erased_end += FIRMWARE_BLOCK_SIZE;
+    }
+}
+
+/**
+ * @brief Programs one image sector into the staging area.
+ *
+ * @param sector Sector index in the image.
+ * @param data   Sector bytes, in RAM.
+ */
+static void firmware_program(uint32_t sector, const uint8_t *data){
+    uint32_t offset = FIRMWARE_CLIENT_STAGING_OFFSET + sector * FIRMWARE_SECTOR_SIZE;
+    firmware_erase_to(offset + FIRMWARE_SECTOR_SIZE);
+    uint32_t ints = save_and_disable_interrupts();
+    flash_range_program(offset, data, FIRMWARE_SECTOR_SIZE);
+    restore_interrupts(ints);
+}
+
+/**
+ * @brief Returns the ring position the DMA writes next.
+ */
+static uint32_t firmware_ring_head(uint channel){
+    return (uint32_t)(dma_channel_hw_addr(channel)->write_addr - (uintptr_t)firmware_ring);
+}
+
+/**
+ * @brief Waits for the line to go idle and drops everything received.
+ *
+ * @param channel Receiving DMA channel.
+ * @return Ring position to read from.
+ */
+static uint32_t firmware_resync(uint channel){
+    uint32_t head = firmware_ring_head(channel);
+    absolute_time_t idle_since = get_absolute_time();
+    while (absolute_time_diff_us(idle_since, get_absolute_time()) < FIRMWARE_RESYNC_IDLE_MS * MS_TO_US_MULTIPLIER){
+        uint32_t now = firmware_ring_head(channel);
+        if (now != head){
+            head = now;
+            idle_since = get_absolute_time();
+        }
+    }
+    return head;
+}
+
+/**
+ * @brief Sends a frame ack.
+ *
+ * @param uart   Client UART.
+ * @param sector Sector acked, or expected when `ok` is false.
+ * @param ok     The sector is programmed.
+ */
+static void firmware_send_ack(uart_inst_t *uart, uint32_t sector, bool ok){
+    char msg[CLIENT_COMMAND_BUFFER_SIZE];
+    snprintf(msg, sizeof(msg), "[%d,%lu,%d]", FIRMWARE_ACK_FLAG_NUMBER, (unsigned long)sector, ok);
+    uart_puts(uart, msg);
+}
+
+/**
+ * @brief Receives frames until every sector is programmed or the server goes quiet.
+ *
+ * @param uart    Client UART, at the transfer baud rate.
+ * @param channel DMA channel filling the ring from `uart`.
+ */
+static void firmware_session(uart_inst_t *uart, uint channel){
+    uint32_t tail = 0;
+    uint32_t expected = 0;
+    absolute_time_t last_frame = get_absolute_time();
+
+    while (expected < firmware_sectors){
+        if (absolute_time_diff_us(last_frame, get_absolute_time()) > FIRMWARE_SESSION_TIMEOUT_MS * MS_TO_US_MULTIPLIER){
+            return;
+        }
+        uint32_t available = (firmware_ring_head(channel) - tail) & (FIRMWARE_RING_SIZE - 1);
+        // Line noise between windows is skipped up to the next sync byte.
+        while (available && firmware_ring[tail] != FIRMWARE_FRAME_SYNC){
+            tail = (tail + 1) & (FIRMWARE_RING_SIZE - 1);
+            available--;
+        }
+        if (available < FIRMWARE_FRAME_BYTES){
+            continue;
+        }
+        for (uint32_t index = 0; index < FIRMWARE_FRAME_BYTES; index++){
+            firmware_frame[index] = firmware_ring[(tail + index) & (FIRMWARE_RING_SIZE - 1)];
+        }
+        tail = (tail + FIRMWARE_FRAME_BYTES) & (FIRMWARE_RING_SIZE - 1);
+        last_frame = get_absolute_time();
+
+        uint32_t sector = firmware_read_u32(&firmware_frame[FIRMWARE_SECTOR_INDEX]);
+        uint32_t crc = firmware_read_u32(&firmware_frame[FIRMWARE_SECTOR_DATA + FIRMWARE_SECTOR_SIZE]);
+        if (sector > expected || crc != crc32_update(0, &firmware_frame[FIRMWARE_SECTOR_INDEX], 4 + FIRMWARE_SECTOR_SIZE)){
+            firmware_send_ack(uart, expected, false);
+            tail = firmware_resync(channel);
+            continue;
+        }
+        // A sector sent again because its ack was lost is acked again only.
+        if (sector == expected){
+            firmware_program(sector, &firmware_frame[FIRMWARE_SECTOR_DATA]);
+            expected++;
+        }
+        firmware_send_ack(uart, sector, true);
+    }
+    firmware_staged = true;
+}
+
+void firmware_update_begin(uint32_t size, uint32_t crc32){
+    uint32_t binary_end = (uint32_t)((uintptr_t)&__flash_binary_end - XIP_BASE);
+    uint32_t max_baudrate = burst_clock_max_baudrate();
+    if (!size || size > FIRMWARE_IMAGE_MAX_BYTES || binary_end > FIRMWARE_CLIENT_STAGING_OFFSET ||
+        adc_sampling_active() || logic_capture_active()){
+        max_baudrate = 0;
+    }
+    firmware_size = max_baudrate ? size : 0;
+    firmware_crc = crc32;
+    firmware_sectors = (firmware_size + FIRMWARE_SECTOR_SIZE - 1) / FIRMWARE_SECTOR_SIZE;
+    firmware_staged = false;
+    firmware_erased_end = FIRMWARE_CLIENT_STAGING_OFFSET;
+    if (firmware_size){
+        firmware_erase_to(FIRMWARE_CLIENT_STAGING_OFFSET + 1);
+    }
+
+    uart_inst_t *uart = active_uart_client_connection.uart_instance;
+    char msg[CLIENT_COMMAND_BUFFER_SIZE];
+    snprintf(msg, sizeof(msg), "[%d,%lu]", FIRMWARE_BEGIN_FLAG_NUMBER, (unsigned long)max_baudrate);
+    uart_puts(uart, msg);
+    uart_tx_wait_blocking(uart);
+}
+
+void firmware_update_receive(uint32_t baudrate){
+    uart_inst_t *uart = active_uart_client_connection.uart_instance;
+    int channel = -1;
+    if (firmware_size && !firmware_staged && baudrate){
+        // The server waits for the reply, so the UART clock can move now.
+        burst_clock_uart_begin();
+        if (baudrate <= clock_get_hz(clk_peri) / 16){
+            channel = dma_claim_unused_channel(false);
+        }
+    }
+    char msg[CLIENT_COMMAND_BUFFER_SIZE];
+    snprintf(msg, sizeof(msg), "[%d,%lu]", FIRMWARE_BAUD_FLAG_NUMBER, (unsigned long)(channel >= 0 ? baudrate : 0));
+    uart_puts(uart, msg);
+    uart_tx_wait_blocking(uart);
+    if (channel < 0){
+        burst_clock_uart_end();
+        return;
+    }
+
+    while (uart_is_readable(uart)){
+        uart_getc(uart);
+    }
+    uart_set_baudrate(uart, baudrate);
+    dma_channel_config dma_config = dma_channel_get_default_config((uint)channel);
+    channel_config_set_transfer_data_size(&dma_config, DMA_SIZE_8);
+    channel_config_set_read_increment(&dma_config, false);
+    channel_config_set_write_increment(&dma_config, true);
+    channel_config_set_ring(&dma_config, true, FIRMWARE_RING_BITS);
+    channel_config_set_dreq(&dma_config, uart_get_dreq(uart, false));
+    dma_channel_configure((uint)channel, &dma_config, firmware_ring, &uart_get_hw(uart)->dr, FIRMWARE_RING_TRANSFERS, true);
+
+    firmware_session(uart, (uint)channel);
+
+    dma_channel_abort((uint)channel);
+    dma_channel_unclaim((uint)channel);
+    uart_tx_wait_blocking(uart);
+    uart_set_baudrate(uart, DEFAULT_BAUDRATE);
+    burst_clock_uart_end();
+    while (uart_is_readable(uart)){
+        uart_getc(uart);
+    }
+}
+
+/**
+ * @brief Copies the staged image over the running one and restarts.
+ *
+ * Runs from RAM with interrupts off: once the first sector is erased, no
+ * code in flash may run. The receive ring, no longer in use, holds each
+ * sector while its destination is erased.
+ *
+ * @param sectors Sectors of the staged image.
+ */
+static void __no_inline_not_in_flash_func(firmware_swap_and_restart)(uint32_t sectors){
+    uint32_t *copy = (uint32_t *)firmware_ring;
+    save_and_disable_interrupts();
+    for (uint32_t sector = 0; sector < sectors; sector++){
+        uint32_t offset = sector * FIRMWARE_SECTOR_SIZE;
+        const volatile uint32_t *staged = (const volatile uint32_t *)(XIP_BASE + FIRMWARE_CLIENT_STAGING_OFFSET + offset);
+        for (uint32_t word = 0; word < FIRMWARE_SECTOR_SIZE / 4; word++){
+            copy[word] = staged[word];
+        }
+        flash_range_erase(offset, FIRMWARE_SECTOR_SIZE);
+        flash_range_program(offset, (const uint8_t *)copy, FIRMWARE_SECTOR_SIZE);
+    }
+    hw_set_bits(&watchdog_hw->ctrl, WATCHDOG_CTRL_TRIGGER_BITS);
+    while (true){
+        tight_loop_contents();
+    }
+}
+
+void firmware_update_commit(uint32_t crc32){
+    bool ok = firmware_staged && crc32 == firmware_crc &&
+        crc32_update(0, (const void *)(XIP_BASE + FIRMWARE_CLIENT_STAGING_OFFSET), firmware_size) == firmware_crc;
+
+    uart_inst_t *uart = active_uart_client_connection.uart_instance;
+    char msg[CLIENT_COMMAND_BUFFER_SIZE];
+    snprintf(msg, sizeof(msg), "[%d,%d]", FIRMWARE_COMMIT_FLAG_NUMBER, ok);
+    uart_puts(uart, msg);
+    uart_tx_wait_blocking(uart);
+    if (ok){
+        firmware_swap_and_restart(firmware_sectors);
+    }
+}
@@ -0,0 +1,235 @@
+/**
+ * @file input_sense.c
+ * @brief Debounced input sensing on client GPIOs.
+ *
+ * GPIOs configured with "[49,gpio,mode,debounce_ms]" become inputs. Every
+ * edge restarts the debounce time of its GPIO from the GPIO IRQ, and one
+ * alarm samples the GPIOs whose debounce time has passed. A sampled level
+ * that differs from the last stable level is a change.
+ *
+ * Changes are batched: the client only keeps the stable levels, the GPIOs
+ * that rose and those that fell, and the time of the last change. A GPIO
+ * that bounced back before the collect is in both masks, so the server
+ * sees every edge kind even when the final level did not change. When
+ * something changed it
+ * rings the server by sending a single zero byte, whose start bit the
+ * server catches on its RX pin, and the server collects the batch with
+ * "[50,50]". A burst of changes between two collects costs one frame.
+ *
+ * The leading edge of a stable input also runs the local rules of
+ * rules.c right in the IRQ. Rules that fired are reported with the
+ * changes.
+ *
+ * The same doorbell announces ADC blocks (see adc.c) and full logic
+ * captures (see logic_capture.c). Both are flagged in the report, and the
+ * server collects them right after.
+ */
+
+#include <stdio.h>
+
+#include "pico/stdlib.h"
+#include "pico/time.h"
+#include "hardware/gpio.h"
+#include "hardware/irq.h"
+#include "hardware/sync.h"
+
+#include "client.h"
+
+#define INPUT_EDGES (GPIO_IRQ_EDGE_RISE | GPIO_IRQ_EDGE_FALL)
+
+static volatile uint32_t input_mask = 0;
+static uint16_t input_debounce_ms[32];
+static uint64_t input_settle_at_us[32];
+static volatile uint32_t input_unsettled_mask = 0;
+static volatile uint32_t input_stable_levels = 0;
+static volatile uint32_t input_rise_mask = 0;      ///< Inputs that rose since the last collect
+static volatile uint32_t input_fall_mask = 0;      ///< Inputs that fell since the last collect
+static volatile uint32_t input_change_count = 0;
+static volatile uint64_t input_last_change_us = 0;
+static volatile bool input_report_ready = false;
+static uint64_t input_doorbell_sent_us = 0;
+static alarm_id_t input_alarm_id = 0;
+static uint64_t input_alarm_at_us = 0;
+static bool input_irq_installed = false;
+
+/**
+ * @brief Alarm callback: takes the level of every GPIO whose debounce time has passed.
+ *
+ * @param id        Alarm ID.
+ * @param user_data Unused.
+ * @return 0 when no GPIO is still bouncing, else the delay until the next one settles.
+ */
+static int64_t input_settle_alarm_callback(alarm_id_t id, void *user_data){
+    uint64_t now_us = time_us_64();
+    uint64_t next_at_us = UINT64_MAX;
+    uint32_t levels = gpio_get_all();
+    uint32_t unsettled_mask = input_unsettled_mask;
+
+    while (unsettled_mask){
+        uint8_t gpio_number = (uint8_t)__builtin_ctz(unsettled_mask);
+        uint32_t gpio_bit = 1u << gpio_number;
+        unsettled_mask &= unsettled_mask - 1;
+
+        if (input_settle_at_us[gpio_number] > now_us){
+            if (input_settle_at_us[gpio_number] < next_at_us){
+                next_at_us = input_settle_at_us[gpio_number];
+            }
+            continue;
+        }
+        input_unsettled_mask &= ~gpio_bit;
+        if ((levels ^ input_stable_levels) & gpio_bit){
+            input_stable_levels ^= gpio_bit;
+            if (levels & gpio_bit){
+                input_rise_mask |= gpio_bit;
+            }else{
+                input_fall_mask |= gpio_bit;
+            }
+            input_change_count++;
+            input_last_change_us = now_us;
+            input_report_ready = true;
+        }
+    }
+
+    if (next_at_us == UINT64_MAX){
+        input_alarm_id = 0;
+        return 0;
+    }
+    input_alarm_at_us = next_at_us;
+    return -(int64_t)(next_at_us - now_us);
+}
+
+/**
+ * @brief Makes sure the settle alarm fires no later than a given time. Call with interrupts disabled.
+ *
+ * @param settle_at_us time_us_64() at which a GPIO settles.
+ */
+static void input_schedule_settle(uint64_t settle_at_us){
+    if (input_alarm_id > 0){
+        if (input_alarm_at_us <= settle_at_us){
+            return;
+        }
+        cancel_alarm(input_alarm_id);
+    }
+    input_alarm_at_us = settle_at_us;
+    input_alarm_id = add_alarm_at(from_us_since_boot(settle_at_us), input_settle_alarm_callback, NULL, true);
+    if (input_alarm_id < 0){
+        input_alarm_id = 0;
+    }
+}
+
+/**
+ * @brief GPIO IRQ handler: restarts the debounce time of every input with an edge.
+ */
+static void input_irq_handler(void){
+    uint32_t pending_mask = input_mask;
+    uint64_t now_us = time_us_64();
+    uint64_t first_settle_us = UINT64_MAX;
+
+    while (pending_mask){
+        uint8_t gpio_number = (uint8_t)__builtin_ctz(pending_mask);
+        pending_mask &= pending_mask - 1;
+
+        uint32_t events = gpio_get_irq_event_mask(gpio_number) & INPUT_EDGES;
+        if (!events){
+            continue;
+        }
+        gpio_acknowledge_irq(gpio_number, events);
+        uint32_t gpio_bit = 1u << gpio_number;
+        if (!(input_unsettled_mask & gpio_bit) && rules_on_edge(gpio_number, !(input_stable_levels & gpio_bit))){
+            input_report_ready = true;
+        }
+        input_settle_at_us[gpio_number] = now_us + input_debounce_ms[gpio_number] * 1000u;
+        input_unsettled_mask |= gpio_bit;
+        if (input_settle_at_us[gpio_number] < first_settle_us){
+            first_settle_us = input_settle_at_us[gpio_number];
+        }
+    }
+
+    if (first_settle_us != UINT64_MAX){
+        input_schedule_settle(first_settle_us);
+    }
+}
+
+void input_sense_configure(uint8_t gpio_number, uint32_t mode, uint32_t debounce_ms){
+    uint32_t gpio_bit = 1u << gpio_number;
+
+    if (mode == INPUT_MODE_OFF){
+        uint32_t irq = save_and_disable_interrupts();
+        gpio_set_irq_enabled(gpio_number, INPUT_EDGES, false);
+        input_mask &= ~gpio_bit;
+        input_unsettled_mask &= ~gpio_bit;
+        input_rise_mask &= ~gpio_bit;
+        input_fall_mask &= ~gpio_bit;
+        input_stable_levels &= ~gpio_bit;
+        restore_interrupts(irq);
+        gpio_disable_pulls(gpio_number);
+        gpio_deinit(gpio_number);
+        return;
+    }
+
+    gpio_init(gpio_number);
+    gpio_set_pulls(gpio_number, mode == INPUT_MODE_PULL_UP, mode == INPUT_MODE_PULL_DOWN);
+    busy_wait_us(10);
+
+    uint32_t irq = save_and_disable_interrupts();
+    input_debounce_ms[gpio_number] = (uint16_t)(debounce_ms <= INPUT_DEBOUNCE_MAX_MS ? debounce_ms : INPUT_DEBOUNCE_MAX_MS);
+    input_unsettled_mask &= ~gpio_bit;
+    input_stable_levels = (input_stable_levels & ~gpio_bit) | (gpio_get(gpio_number) ? gpio_bit : 0);
+    input_mask |= gpio_bit;
+    restore_interrupts(irq);
+
+    if (!input_irq_installed){
+        gpio_add_raw_irq_handler_masked(GPIO_DEVICE_MASK, input_irq_handler);
+        irq_set_enabled(IO_IRQ_BANK0, true);
+        input_irq_installed = true;
+    }
+    gpio_acknowledge_irq(gpio_number, INPUT_EDGES);
+    gpio_set_irq_enabled(gpio_number, INPUT_EDGES, true);
+}
+
+uint32_t input_sense_mask(void){
+    return input_mask;
+}
+
+void input_sense_service(void){
+    if (!input_report_ready && !adc_sampling_blocks_ready() && !logic_capture_ready()){
+        return;
+    }
+    uint64_t now_us = time_us_64();
+    if (input_doorbell_sent_us && now_us - input_doorbell_sent_us < INPUT_DOORBELL_RETRY_MS * 1000u){
+        return;
+    }
+    uart_putc_raw(active_uart_client_connection.uart_instance, 0);
+    uart_tx_wait_blocking(active_uart_client_connection.uart_instance);
+    input_doorbell_sent_us = now_us;
+}
+
+void input_sense_send_report(void){
+    uint32_t irq = save_and_disable_interrupts();
+    uint32_t levels = input_stable_levels & input_mask;
+    uint32_t rise_mask = input_rise_mask;
+    uint32_t fall_mask = input_fall_mask;
+    uint32_t change_count = input_change_count;
+    uint64_t age_us = change_count ? time_us_64() - input_last_change_us : 0;
+    uint32_t fired_rule_mask = rules_take_fired();
+    input_rise_mask = 0;
+    input_fall_mask = 0;
+    input_change_count = 0;
+    input_report_ready = false;
+    input_doorbell_sent_us = 0;
+    restore_interrupts(irq);
+
+    char msg[INPUT_REPORT_BUFFER_SIZE];
+    snprintf(msg, sizeof(msg), "[%d,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%u]",
+        INPUT_REPORT_FLAG_NUMBER,
+        (unsigned long)levels,
+        (unsigned long)rise_mask,
+        (unsigned long)fall_mask,
+        (unsigned long)(age_us > UINT32_MAX ? UINT32_MAX : age_us),
+        (unsigned long)change_count,
+        (unsigned long)fired_rule_mask,
+        (unsigned long)adc_sampling_blocks_ready(),
+        logic_capture_ready() ? 1u : 0u);
+    uart_puts(active_uart_client_connection.uart_instance, msg);
+    uart_tx_wait_blocking(active_uart_client_connection.uart_instance);
+}
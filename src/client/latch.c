@@ -0,0 +1,89 @@
+/**
+ * @file latch.c
+ * @brief Client side of the shared latch line.
+ *
+ * With `LATCH_LINE_ENABLED`, the server and every client share one GPIO,
+ * `LATCH_LINE_GPIO`. The server stages a new on-mask on each client with
+ * "[40,gpio_mask,sequence]" and then pulses the line. Every client applies
+ * its staged mask from the rising edge IRQ with `apply_gpio_mask()`, so the
+ * whole installation switches within the IRQ latency of the clients,
+ * however long the UART frames took to send.
+ *
+ * An edge that finds nothing staged is counted as missed. The server reads
+ * the last applied sequence and the missed count with "[41,41]" to find
+ * clients that did not get their staged frame.
+ */
+
+#include <stdio.h>
+
+#include "pico/stdlib.h"
+#include "hardware/gpio.h"
+#include "hardware/irq.h"
+#include "hardware/sync.h"
+
+#include "client.h"
+
+static volatile uint32_t latch_staged_mask = 0;
+static volatile uint32_t latch_staged_sequence = 0;
+static volatile bool latch_staged = false;
+static volatile uint32_t latch_applied_sequence = 0;
+static volatile uint32_t latch_missed_edges = 0;
+
+/**
+ * @brief GPIO IRQ handler: applies the staged mask on a rising latch edge.
+ */
+static void latch_irq_handler(void){
+    if (!(gpio_get_irq_event_mask(LATCH_LINE_GPIO) & GPIO_IRQ_EDGE_RISE)){
+        return;
+    }
+    gpio_acknowledge_irq(LATCH_LINE_GPIO, GPIO_IRQ_EDGE_RISE);
+
+    if (!latch_staged){
+        latch_missed_edges++;
+        return;
+    }
+    apply_gpio_mask(latch_staged_mask);
+    latch_applied_sequence = latch_staged_sequence;
+    latch_staged = false;
+    timed_output_cancel_all();
+    sequence_cancel();
+}
+
+void latch_init(void){
+    #if LATCH_LINE_ENABLED
+        gpio_init(LATCH_LINE_GPIO);
+        gpio_set_dir(LATCH_LINE_GPIO, GPIO_IN);
+        gpio_pull_down(LATCH_LINE_GPIO);
+        gpio_add_raw_irq_handler(LATCH_LINE_GPIO, latch_irq_handler);
+        gpio_set_irq_enabled(LATCH_LINE_GPIO, GPIO_IRQ_EDGE_RISE, true);
+        irq_set_enabled(IO_IRQ_BANK0, true);
+    #endif
+}
+
+void latch_stage(uint32_t gpio_mask, uint32_t sequence){
+    uint32_t irq = save_and_disable_interrupts();
+    latch_staged_mask = gpio_mask;
+    latch_staged_sequence = sequence;
+    latch_staged = true;
+    restore_interrupts(irq);
+}
+
+bool latch_pending(void){
+    return latch_staged;
+}
+
+void latch_send_report(void){
+    uint32_t irq = save_and_disable_interrupts();
+    uint32_t applied_sequence = latch_applied_sequence;
+    uint32_t missed_edges = latch_missed_edges;
+    latch_missed_edges = 0;
+    restore_interrupts(irq);
+
+    char msg[CLIENT_COMMAND_BUFFER_SIZE];
+    snprintf(msg, sizeof(msg), "[%d,%lu,%lu]",
+        LATCH_REPORT_FLAG_NUMBER,
+        (unsigned long)applied_sequence,
+        (unsigned long)missed_edges);
+    uart_puts(active_uart_client_connection.uart_instance, msg);
+    uart_tx_wait_blocking(active_uart_client_connection.uart_instance);
+}
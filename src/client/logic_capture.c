@@ -0,0 +1,329 @@
+/**
+ * @file logic_capture.c
+ * @brief Logic analyser on client GPIOs with a PIO state machine and DMA.
+ *
+ * "[58,first_gpio,pin_count,rate_hz]" sets up a capture of `pin_count`
+ * consecutive GPIOs from `first_gpio`. PIO reads the pad inputs whatever
+ * the GPIO function, so outputs, inputs and even the UART pins can be
+ * captured without disturbing them.
+ *
+ * "[59,trigger_mask,trigger_value]" arms the capture. The state machine
+ * compares the GPIOs of the trigger mask, bits relative to `first_gpio`,
+ * with the trigger value, then takes one sample per period. The trigger
+ * mask must be a run of consecutive bits; 0 starts at once. Autopush packs
+ * 32 / pin_count samples per word, and DMA moves the words into a buffer of
+ * `LOGIC_CAPTURE_WORDS` until it is full. The state machine takes at most
+ * one sample per clk_sys cycle, so a rate above clk_sys is refused when the
+ * capture is set up and again when it is armed, rather than captured slower.
+ *
+ * A full capture rings the input doorbell (see input_sense.c). The server
+ * collects it with "[60,max_chunks,next_sequence]", and the client replies
+ * with "[60,chunks,samples]" followed by the chunks in binary. Chunks are
+ * run-length encoded from the buffer when they are sent, so lines that do
+ * not change cost a few bytes per run. `next_sequence` acknowledges the
+ * chunks received so far; chunks the server did not get are sent again.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "hardware/clocks.h"
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+#include "hardware/pio.h"
+#include "hardware/pio_instructions.h"
+#include "hardware/sync.h"
+
+#include "client.h"
+#include "functions.h"
+
+#define LOGIC_PIO pio0
+#define LOGIC_MAX_INSTRUCTIONS 5
+#define LOGIC_SLOW_CYCLES 32        ///< Cycles per sample when the clock divider alone cannot reach the rate
+#define LOGIC_LAST_CHUNK 0x01       ///< Chunk flag: the chunk ends the capture
+
+/**
+ * @brief Capture states.
+ */
+typedef enum{
+    LOGIC_IDLE,                 ///< No capture set up
+    LOGIC_READY,                ///< Set up, not armed or fully collected
+    LOGIC_ARMED,                ///< Waiting for the trigger or capturing
+    LOGIC_CAPTURED,             ///< Buffer full, chunks waiting
+}logic_state_t;
+
+static uint32_t logic_buffer[LOGIC_CAPTURE_WORDS];
+static volatile logic_state_t logic_state = LOGIC_IDLE;
+static uint8_t logic_first_gpio = 0;
+static uint8_t logic_pin_count = 0;
+static uint8_t logic_samples_per_word = 0;
+static uint32_t logic_rate_hz = 0;
+
+static uint16_t logic_instructions[LOGIC_MAX_INSTRUCTIONS];
+static pio_program_t logic_program = {
+    .instructions = logic_instructions,
+    .length = 0,
+    .origin = -1,
+};
+static int logic_program_offset = -1;
+static int logic_sm = -1;
+static int logic_dma_channel = -1;
+
+static uint32_t logic_base_sequence = 0;    ///< First chunk not acknowledged by the server
+static uint32_t logic_base_offset = 0;      ///< First sample of that chunk
+static uint32_t logic_sent_offsets[LOGIC_COLLECT_MAX_CHUNKS + 1];   ///< First samples of the chunks sent last
+static uint32_t logic_sent_chunks = 0;
+
+/**
+ * @brief DMA IRQ handler: the buffer is full, stops the state machine.
+ */
+static void logic_dma_irq_handler(void){
+    if (logic_dma_channel < 0 || !dma_channel_get_irq0_status((uint)logic_dma_channel)){
+        return;
+    }
+    dma_channel_acknowledge_irq0((uint)logic_dma_channel);
+    pio_sm_set_enabled(LOGIC_PIO, (uint)logic_sm, false);
+    logic_base_sequence = 0;
+    logic_base_offset = 0;
+    logic_sent_chunks = 0;
+    logic_state = LOGIC_CAPTURED;
+}
+
+/**
+ * @brief Stops the state machine and frees the PIO program and DMA channel.
+ */
+static void logic_stop_machine(void){
+    if (logic_dma_channel >= 0){
+        uint channel = (uint)logic_dma_channel;
+        dma_channel_set_irq0_enabled(channel, false);
+        dma_channel_abort(channel);
+        dma_channel_acknowledge_irq0(channel);
+        dma_channel_unclaim(channel);
+        irq_remove_handler(DMA_IRQ_0, logic_dma_irq_handler);
+        logic_dma_channel = -1;
+    }
+    if (logic_sm >= 0){
+        pio_sm_set_enabled(LOGIC_PIO, (uint)logic_sm, false);
+        pio_sm_unclaim(LOGIC_PIO, (uint)logic_sm);
+        logic_sm = -1;
+    }
+    if (logic_program_offset >= 0){
+        pio_remove_program(LOGIC_PIO, &logic_program, (uint)logic_program_offset);
+        logic_program_offset = -1;
+    }
+    if (logic_state != LOGIC_IDLE){
+        logic_state = LOGIC_READY;
+    }
+}
+
+void logic_capture_configure(uint8_t first_gpio, uint8_t pin_count, uint32_t rate_hz){
+    logic_stop_machine();
+    logic_state = LOGIC_IDLE;
+    if (!pin_count || pin_count > 32 || first_gpio + pin_count > 32 || first_gpio + pin_count > NUM_BANK0_GPIOS ||
+        !rate_hz || rate_hz > LOGIC_MAX_RATE_HZ || rate_hz > clock_get_hz(clk_sys)){
+        return;
+    }
+    for (uint8_t gpio_number = first_gpio; gpio_number < first_gpio + pin_count; gpio_number++){
+        gpio_set_input_enabled(gpio_number, true);
+        #if HAS_PADS_BANK0_ISOLATION
+        hw_clear_bits(&pads_bank0_hw->io[gpio_number], PADS_BANK0_GPIO0_ISO_BITS);
+        #endif
+    }
+    logic_first_gpio = first_gpio;
+    logic_pin_count = pin_count;
+    logic_samples_per_word = (uint8_t)(32 / pin_count);
+    logic_rate_hz = rate_hz;
+    logic_state = LOGIC_READY;
+}
+
+void logic_capture_arm(uint32_t trigger_mask, uint32_t trigger_value){
+    if (logic_state == LOGIC_IDLE){
+        return;
+    }
+    logic_stop_machine();
+
+    uint32_t window_mask = logic_pin_count == 32 ? 0xFFFFFFFFu : (1u << logic_pin_count) - 1;
+    trigger_mask &= window_mask;
+    uint8_t trigger_shift = trigger_mask ? (uint8_t)__builtin_ctz(trigger_mask) : 0;
+    uint32_t trigger_run = trigger_mask >> trigger_shift;
+    if (trigger_run & (trigger_run + 1)){
+        return;
+    }
+
+    uint32_t clk_hz = clock_get_hz(clk_sys);
+    if (logic_rate_hz > clk_hz){
+        return;
+    }
+    uint32_t cycles = clk_hz / logic_rate_hz > 0xFFFF ? LOGIC_SLOW_CYCLES : 1;
+    float clkdiv = (float)clk_hz / ((float)logic_rate_hz * cycles);
+    if (clkdiv > 65535.0f){
+        return;
+    }
+
+    uint8_t length = 0;
+    if (trigger_mask){
+        logic_instructions[length++] = pio_encode_mov(pio_osr, pio_pins);
+        if (trigger_shift){
+            logic_instructions[length++] = pio_encode_out(pio_null, trigger_shift);
+        }
+        logic_instructions[length++] = pio_encode_out(pio_x, (uint)__builtin_popcount(trigger_mask));
+        logic_instructions[length++] = pio_encode_jmp_x_ne_y(0);
+    }
+    uint8_t capture_address = length;
+    logic_instructions[length++] = pio_encode_in(pio_pins, logic_pin_count) | pio_encode_delay(cycles - 1);
+    logic_program.length = length;
+
+    if (!pio_can_add_program(LOGIC_PIO, &logic_program)){
+        return;
+    }
+    logic_sm = pio_claim_unused_sm(LOGIC_PIO, false);
+    logic_dma_channel = dma_claim_unused_channel(false);
+    if (logic_sm < 0 || logic_dma_channel < 0){
+        logic_stop_machine();
+        return;
+    }
+    logic_program_offset = (int)pio_add_program(LOGIC_PIO, &logic_program);
+    uint sm = (uint)logic_sm;
+    uint offset = (uint)logic_program_offset;
+
+    pio_sm_config config = pio_get_default_sm_config();
+    sm_config_set_wrap(&config, offset + capture_address, offset + capture_address);
+    sm_config_set_in_pins(&config, logic_first_gpio);
+    #if PICO_PIO_VERSION > 0
+    sm_config_set_in_pin_count(&config, logic_pin_count);
+    #endif
+    sm_config_set_in_shift(&config, false, true, (uint)logic_samples_per_word * logic_pin_count);
+    sm_config_set_out_shift(&config, true, false, 32);
+    sm_config_set_clkdiv(&config, clkdiv);
+    pio_sm_init(LOGIC_PIO, sm, offset, &config);
+
+    // Y holds the trigger value for the whole capture.
+    pio_sm_put(LOGIC_PIO, sm, (trigger_value & trigger_mask) >> trigger_shift);
+    pio_sm_exec(LOGIC_PIO, sm, pio_encode_pull(false, true));
+    pio_sm_exec(LOGIC_PIO, sm, pio_encode_mov(pio_y, pio_osr));
+
+    uint channel = (uint)logic_dma_channel;
+    dma_channel_config dma_config = dma_channel_get_default_config(channel);
+    channel_config_set_transfer_data_size(&dma_config, DMA_SIZE_32);
+    channel_config_set_read_increment(&dma_config, false);
+    channel_config_set_write_increment(&dma_config, true);
+    channel_config_set_dreq(&dma_config, pio_get_dreq(LOGIC_PIO, sm, false));
+    irq_add_shared_handler(DMA_IRQ_0, logic_dma_irq_handler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+    irq_set_enabled(DMA_IRQ_0, true);
+    dma_channel_set_irq0_enabled(channel, true);
+    dma_channel_configure(channel, &dma_config, logic_buffer, &LOGIC_PIO->rxf[sm], LOGIC_CAPTURE_WORDS, true);
+
+    logic_state = LOGIC_ARMED;
+    pio_sm_set_enabled(LOGIC_PIO, sm, true);
+}
+
+bool logic_capture_active(void){
+    return logic_state == LOGIC_ARMED || logic_state == LOGIC_CAPTURED;
+}
+
+bool logic_capture_ready(void){
+    return logic_state == LOGIC_CAPTURED;
+}
+
+/**
+ * @brief Returns one sample of the capture buffer.
+ *
+ * Autopush shifts left, so the first sample of a word is in its highest bits.
+ *
+ * @param index Sample index from the trigger.
+ * @return Levels of the captured GPIOs, bit 0 for `first_gpio`.
+ */
+static uint32_t logic_sample(uint32_t index){
+    uint32_t word = logic_buffer[index / logic_samples_per_word];
+    if (logic_pin_count == 32){
+        return word;
+    }
+    uint32_t position = index % logic_samples_per_word;
+    return (word >> ((logic_samples_per_word - 1 - position) * logic_pin_count)) & ((1u << logic_pin_count) - 1);
+}
+
+/**
+ * @brief Run-length encodes one chunk for the wire.
+ *
+ * Layout: sequence (2 bytes, little-endian), run count, flags
+ * (`LOGIC_LAST_CHUNK`), then per run the value in (pin_count + 7) / 8
+ * little-endian bytes and the length as an unsigned LEB128, then the
+ * Fletcher-16 checksum of all previous bytes.
+ *
+ * @param sequence Chunk number from the start of the capture.
+ * @param offset   First sample of the chunk.
+ * @param end      Set to the sample after the chunk.
+ * @param buffer   At least `LOGIC_CHUNK_MAX_BYTES` bytes.
+ * @return Number of bytes written.
+ */
+static uint32_t logic_chunk_encode(uint32_t sequence, uint32_t offset, uint32_t *end, uint8_t *buffer){
+    uint32_t total_samples = LOGIC_CAPTURE_WORDS * logic_samples_per_word;
+    uint8_t value_bytes = (uint8_t)((logic_pin_count + 7) / 8);
+    uint32_t length = 4;
+    uint8_t run_count = 0;
+    uint32_t index = offset;
+    while (run_count < LOGIC_CHUNK_RUNS && index < total_samples){
+        uint32_t value = logic_sample(index);
+        uint32_t run_end = index + 1;
+        while (run_end < total_samples && logic_sample(run_end) == value){
+            run_end++;
+        }
+        for (uint8_t byte = 0; byte < value_bytes; byte++){
+            buffer[length++] = (uint8_t)(value >> (byte * 8));
+        }
+        for (uint32_t run_length = run_end - index; ; run_length >>= 7){
+            if (run_length < 0x80){
+                buffer[length++] = (uint8_t)run_length;
+                break;
+            }
+            buffer[length++] = (uint8_t)(run_length | 0x80);
+        }
+        run_count++;
+        index = run_end;
+    }
+    buffer[0] = (uint8_t)sequence;
+    buffer[1] = (uint8_t)(sequence >> 8);
+    buffer[2] = run_count;
+    buffer[3] = index == total_samples ? LOGIC_LAST_CHUNK : 0;
+    uint16_t checksum = fletcher16(buffer, length);
+    buffer[length++] = (uint8_t)checksum;
+    buffer[length++] = (uint8_t)(checksum >> 8);
+    *end = index;
+    return length;
+}
+
+void logic_capture_send_chunks(uint32_t max_chunks, uint32_t next_sequence){
+    uart_inst_t *uart = active_uart_client_connection.uart_instance;
+    char msg[CLIENT_COMMAND_BUFFER_SIZE];
+    if (logic_state != LOGIC_CAPTURED){
+        snprintf(msg, sizeof(msg), "[%d,0,0]", LOGIC_COLLECT_FLAG_NUMBER);
+        uart_puts(uart, msg);
+        uart_tx_wait_blocking(uart);
+        return;
+    }
+
+    if (next_sequence > logic_base_sequence && next_sequence - logic_base_sequence <= logic_sent_chunks){
+        logic_base_offset = logic_sent_offsets[next_sequence - logic_base_sequence];
+        logic_base_sequence = next_sequence;
+    }
+    logic_sent_chunks = 0;
+
+    uint32_t total_samples = LOGIC_CAPTURE_WORDS * logic_samples_per_word;
+    static uint8_t buffer[LOGIC_COLLECT_MAX_CHUNKS * LOGIC_CHUNK_MAX_BYTES];
+    uint32_t length = 0;
+    uint32_t offset = logic_base_offset;
+    logic_sent_offsets[0] = offset;
+    while (logic_sent_chunks < max_chunks && logic_sent_chunks < LOGIC_COLLECT_MAX_CHUNKS && offset < total_samples){
+        length += logic_chunk_encode(logic_base_sequence + logic_sent_chunks, offset, &offset, buffer + length);
+        logic_sent_offsets[++logic_sent_chunks] = offset;
+    }
+    if (logic_base_offset == total_samples){
+        logic_state = LOGIC_READY;
+    }
+
+    snprintf(msg, sizeof(msg), "[%d,%lu,%lu]", LOGIC_COLLECT_FLAG_NUMBER, (unsigned long)logic_sent_chunks, (unsigned long)total_samples);
+    uart_puts(uart, msg);
+    uart_write_blocking(uart, buffer, length);
+    uart_tx_wait_blocking(uart);
+}
@@ -12,6 +12,7 @@
 
 #include "client.h"
 #include "functions.h"
+#include "profiler.h"
 
 /**
  * @brief Entry point for the UART client application.
@@ -24,10 +25,12 @@
  */
 int main(void){
     init_onboard_led_and_usb();
+    profiler_init_core();
 
     while(!client_detect_uart_connection()) tight_loop_contents();
 
     power_saving_config();
+    latch_init();
     client_listen_for_commands();
 }
 
@@ -23,6 +23,7 @@
 
  #include "client.h"
 #include "functions.h"
+#include "profiler.h"
 
 #include "hardware/clocks.h"
 #include "hardware/structs/clocks.h"
@@ -69,8 +70,8 @@ void client_turn_off_unused_power_consumers(void){
         0, 12 * MHZ, 12 * MHZ);
 
     clock_configure(clk_peri,
-        0, CLOCKS_CLK_PERI_CTRL_AUXSRC_VALUE_CLK_SYS,
-        12 * MHZ, 12 * MHZ); 
+        0, CLOCKS_CLK_PERI_CTRL_AUXSRC_VALUE_XOSC_CLKSRC,
+        12 * MHZ, 12 * MHZ);
 
     pll_deinit(pll_sys);
     pll_deinit(pll_usb);
@@ -113,8 +114,10 @@ void client_turn_off_unused_power_consumers(void){
  * - Reinitializes it as a GPIO input.
  * - Enables pull-down resistor to detect future wakeup pulses.
  *
- * Used before entering dormant mode so that the client can wake up
- * when receiving a pulse on its TX pin from the server.
+ * Used right before entering dormant mode so that the client can wake up
+ * when receiving a pulse on its TX pin from the server. While awake, the
+ * TX pin belongs to the UART, so replies and input doorbells reach the
+ * server and the line idles high.
  */
 static void set_pin_as_input_for_dormant_wakeup(void){
     uint8_t pin = active_uart_client_connection.pin_pair.tx;
@@ -125,15 +128,13 @@ static void set_pin_as_input_for_dormant_wakeup(void){
 }
 
 void power_saving_config(void){
-    #ifndef CYW43_WL_GPIO_LED_PIN
+    #if !defined(CYW43_WL_GPIO_LED_PIN) && !PROFILING_BUILD
         client_turn_off_unused_power_consumers();
     #endif
 
-    uart_init_with_single_pin(active_uart_client_connection.uart_instance,
-        active_uart_client_connection.pin_pair.rx,
+    uart_init_with_pins(active_uart_client_connection.uart_instance,
+        active_uart_client_connection.pin_pair,
         DEFAULT_BAUDRATE);
-
-    set_pin_as_input_for_dormant_wakeup();
 }
 
 inline static void rosc_clear_bad_write(void) {
@@ -362,6 +363,7 @@ static void sleep_goto_dormant_until_pin(uint gpio_pin, bool edge, bool high) {
 }
 
 void enter_dormant_mode(void){
+    set_pin_as_input_for_dormant_wakeup();
     sleep_run_from_dormant_source(DORMANT_SOURCE_ROSC);
     sleep_goto_dormant_until_pin(active_uart_client_connection.pin_pair.tx, false, true);
 }
@@ -417,12 +419,10 @@ void wake_up(void){
         client_turn_off_unused_power_consumers();
     #endif
 
-    uart_init_with_single_pin(active_uart_client_connection.uart_instance,
-            active_uart_client_connection.pin_pair.rx,
+    uart_init_with_pins(active_uart_client_connection.uart_instance,
+            active_uart_client_connection.pin_pair,
             DEFAULT_BAUDRATE
     );
-
-    set_pin_as_input_for_dormant_wakeup();
 }
 
 
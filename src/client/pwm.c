@@ -0,0 +1,185 @@
+/**
+ * @file pwm.c
+ * @brief PWM outputs driven by the PWM slices.
+ *
+ * "[52,pwm_mask]" selects the GPIOs that are PWM outputs. They keep their
+ * ON/OFF state like any other output: while ON a PWM output runs at its
+ * duty, while OFF its level is 0. The slice holds the waveform, so the
+ * link only carries setpoint changes.
+ *
+ * Duties are 16-bit and are addressed by channel, the rank of the GPIO in
+ * the PWM mask, so a frame covers consecutive PWM outputs whatever their
+ * GPIO numbers. "[53,first_channel,packed,packed]" carries 8 duties of 8
+ * bits, "[54,first_channel,packed,packed]" 4 duties of 16 bits, lowest
+ * channel in the low bits.
+ *
+ * All slices run at `PWM_FREQUENCY_HZ`. The wrap is the largest that the
+ * system clock allows at that frequency, up to 16 bits, and duties are
+ * scaled to it; 0xFFFF is constantly high. The wrap is taken from the
+ * 12 MHz clock even during a clock burst, and only the slice dividers
+ * follow clk_sys. Two GPIOs that share a PWM
+ * channel cannot both be PWM outputs; the higher one is kept digital.
+ */
+
+#include <stdint.h>
+
+#include "pico/stdlib.h"
+#include "hardware/pwm.h"
+#include "hardware/clocks.h"
+#include "hardware/sync.h"
+
+#include "client.h"
+
+#define PWM_MAX_WRAP 0xFFFE
+
+static uint32_t pwm_mask = 0;
+static uint16_t pwm_duties[32];
+static uint32_t pwm_slice_mask = 0;         ///< Slices that run
+static uint32_t pwm_wrap = PWM_MAX_WRAP;
+
+/**
+ * @brief Converts a 16-bit duty to a counter level for the current wrap.
+ *
+ * @param duty 16-bit duty.
+ * @return Counter level, above the wrap for 0xFFFF.
+ */
+static uint16_t pwm_level(uint16_t duty){
+    if (duty == 0xFFFF){
+        return (uint16_t)(pwm_wrap + 1);
+    }
+    return (uint16_t)(((uint32_t)duty * (pwm_wrap + 1)) >> 16);
+}
+
+/**
+ * @brief Returns the slice divider that gives `PWM_FREQUENCY_HZ` with the current wrap and clk_sys.
+ *
+ * @return Divider, at least 1.
+ */
+static float pwm_clkdiv(void){
+    float clkdiv = (float)clock_get_hz(clk_sys) / ((float)PWM_FREQUENCY_HZ * (pwm_wrap + 1));
+    return clkdiv < 1.0f ? 1.0f : clkdiv;
+}
+
+/**
+ * @brief Starts the slice of a GPIO if it does not run yet.
+ *
+ * @param gpio_number GPIO on the slice.
+ */
+static void pwm_start_slice(uint8_t gpio_number){
+    uint32_t slice = pwm_gpio_to_slice_num(gpio_number);
+    if (pwm_slice_mask & (1u << slice)){
+        return;
+    }
+    if (!pwm_slice_mask){
+        uint32_t cycles = burst_clock_base_hz() / PWM_FREQUENCY_HZ;
+        pwm_wrap = cycles > PWM_MAX_WRAP + 1 ? PWM_MAX_WRAP : (cycles > 1 ? cycles - 1 : 1);
+    }
+    pwm_set_clkdiv(slice, pwm_clkdiv());
+    pwm_set_wrap(slice, (uint16_t)pwm_wrap);
+    pwm_set_chan_level(slice, PWM_CHAN_A, 0);
+    pwm_set_chan_level(slice, PWM_CHAN_B, 0);
+    pwm_set_enabled(slice, true);
+    pwm_slice_mask |= 1u << slice;
+}
+
+/**
+ * @brief Stops the slices that no PWM output uses any more.
+ */
+static void pwm_stop_unused_slices(void){
+    uint32_t used_mask = 0;
+    uint32_t remaining_mask = pwm_mask;
+    while (remaining_mask){
+        used_mask |= 1u << pwm_gpio_to_slice_num((uint8_t)__builtin_ctz(remaining_mask));
+        remaining_mask &= remaining_mask - 1;
+    }
+    uint32_t unused_mask = pwm_slice_mask & ~used_mask;
+    while (unused_mask){
+        pwm_set_enabled((uint32_t)__builtin_ctz(unused_mask), false);
+        unused_mask &= unused_mask - 1;
+    }
+    pwm_slice_mask = used_mask;
+}
+
+void pwm_output_configure(uint32_t gpio_mask, uint32_t on_mask){
+    uint32_t channel_mask = 0;
+    uint32_t accepted_mask = 0;
+    for (uint32_t remaining_mask = gpio_mask; remaining_mask; remaining_mask &= remaining_mask - 1){
+        uint8_t gpio_number = (uint8_t)__builtin_ctz(remaining_mask);
+        uint32_t channel_bit = 1u << (pwm_gpio_to_slice_num(gpio_number) * 2 + pwm_gpio_to_channel(gpio_number));
+        if (!(channel_mask & channel_bit)){
+            channel_mask |= channel_bit;
+            accepted_mask |= 1u << gpio_number;
+        }
+    }
+
+    uint32_t irq = save_and_disable_interrupts();
+    uint32_t leaving_mask = pwm_mask & ~accepted_mask;
+    uint32_t entering_mask = accepted_mask & ~pwm_mask;
+
+    while (leaving_mask){
+        uint8_t gpio_number = (uint8_t)__builtin_ctz(leaving_mask);
+        leaving_mask &= leaving_mask - 1;
+        pwm_set_gpio_level(gpio_number, 0);
+        pwm_duties[gpio_number] = 0;
+        if (on_mask & (1u << gpio_number)){
+            gpio_init(gpio_number);
+            gpio_set_dir(gpio_number, GPIO_OUT);
+            gpio_put(gpio_number, 1);
+        }else{
+            gpio_deinit(gpio_number);
+        }
+    }
+    while (entering_mask){
+        uint8_t gpio_number = (uint8_t)__builtin_ctz(entering_mask);
+        entering_mask &= entering_mask - 1;
+        pwm_start_slice(gpio_number);
+        pwm_set_gpio_level(gpio_number, (on_mask & (1u << gpio_number)) ? pwm_level(pwm_duties[gpio_number]) : 0);
+        gpio_set_function(gpio_number, GPIO_FUNC_PWM);
+    }
+    pwm_mask = accepted_mask;
+    pwm_stop_unused_slices();
+    restore_interrupts(irq);
+}
+
+void pwm_output_set_duties(uint32_t first_channel, uint32_t packed_low, uint32_t packed_high, uint32_t bits, uint32_t on_mask){
+    uint64_t packed = ((uint64_t)packed_high << 32) | packed_low;
+    uint32_t channel_count = 64 / bits;
+    uint32_t value_mask = (1u << bits) - 1;
+
+    uint32_t irq = save_and_disable_interrupts();
+    uint32_t remaining_mask = pwm_mask;
+    for (uint32_t channel = 0; remaining_mask && channel < first_channel + channel_count; channel++){
+        uint8_t gpio_number = (uint8_t)__builtin_ctz(remaining_mask);
+        remaining_mask &= remaining_mask - 1;
+        if (channel < first_channel){
+            continue;
+        }
+        uint32_t value = (uint32_t)(packed >> ((channel - first_channel) * bits)) & value_mask;
+        pwm_duties[gpio_number] = (uint16_t)(bits == 8 ? value * 257u : value);
+        if (on_mask & (1u << gpio_number)){
+            pwm_set_gpio_level(gpio_number, pwm_level(pwm_duties[gpio_number]));
+        }
+    }
+    restore_interrupts(irq);
+}
+
+void pwm_output_enable_masked(uint32_t affected_mask, uint32_t on_mask){
+    affected_mask &= pwm_mask;
+    while (affected_mask){
+        uint8_t gpio_number = (uint8_t)__builtin_ctz(affected_mask);
+        affected_mask &= affected_mask - 1;
+        pwm_set_gpio_level(gpio_number, (on_mask & (1u << gpio_number)) ? pwm_level(pwm_duties[gpio_number]) : 0);
+    }
+}
+
+uint32_t pwm_output_mask(void){
+    return pwm_mask;
+}
+
+void pwm_output_clock_changed(void){
+    uint32_t irq = save_and_disable_interrupts();
+    for (uint32_t remaining_mask = pwm_slice_mask; remaining_mask; remaining_mask &= remaining_mask - 1){
+        pwm_set_clkdiv((uint32_t)__builtin_ctz(remaining_mask), pwm_clkdiv());
+    }
+    restore_interrupts(irq);
+}
@@ -0,0 +1,125 @@
+/**
+ * @file rules.c
+ * @brief Local input-to-output rules evaluated in the GPIO IRQ.
+ *
+ * The server downloads up to `RULE_MAX_RULES` rules with
+ * "[51,rule,trigger_gpio,edges,gpio_mask,on_ms]": when the input
+ * `trigger_gpio` has one of `edges`, the GPIOs of `gpio_mask` turn ON, and
+ * OFF again after `on_ms` (0 leaves them ON). A new trigger restarts the
+ * ON time.
+ *
+ * Rules run in the input IRQ on the leading edge of a debounced input, so
+ * bounces that follow do not trigger them again. Each input keeps a mask
+ * of its rules, so an edge costs one check per rule on that input and one
+ * register write per rule that fires. Fired rules are reported to the
+ * server with the input changes.
+ */
+
+#include <stdint.h>
+
+#include "pico/stdlib.h"
+#include "pico/time.h"
+#include "hardware/sync.h"
+
+#include "client.h"
+
+/**
+ * @brief One local rule. An unused rule has no edges.
+ */
+typedef struct{
+    uint32_t gpio_mask;
+    uint32_t on_us;
+    uint8_t trigger_gpio;
+    uint8_t edges;      ///< `rule_edge_t` bits
+}rule_t;
+
+static rule_t rules[RULE_MAX_RULES];
+static uint32_t rules_by_gpio[32];          ///< Bit `n` set when rule `n` triggers on the GPIO
+static alarm_id_t rule_alarm_ids[RULE_MAX_RULES];
+static volatile uint32_t rules_fired_mask = 0;
+
+/**
+ * @brief Alarm callback: turns the outputs of a rule OFF at the end of its ON time.
+ *
+ * @param id        Alarm ID.
+ * @param user_data Rule index.
+ * @return 0, the alarm does not repeat.
+ */
+static int64_t rule_off_alarm_callback(alarm_id_t id, void *user_data){
+    uint32_t rule_index = (uint32_t)(uintptr_t)user_data;
+    rule_alarm_ids[rule_index] = 0;
+    apply_gpio_mask_masked(rules[rule_index].gpio_mask, 0);
+    return 0;
+}
+
+void rules_set(uint32_t rule_index, uint8_t trigger_gpio, uint32_t edges, uint32_t gpio_mask, uint32_t on_ms){
+    if (rule_index >= RULE_MAX_RULES || trigger_gpio >= 32 || on_ms > TIMED_OUTPUT_MAX_MS){
+        return;
+    }
+    uint32_t irq = save_and_disable_interrupts();
+    rule_t *rule = &rules[rule_index];
+    if (rule_alarm_ids[rule_index] > 0){
+        cancel_alarm(rule_alarm_ids[rule_index]);
+        rule_alarm_ids[rule_index] = 0;
+        apply_gpio_mask_masked(rule->gpio_mask, 0);
+    }
+    rules_by_gpio[rule->trigger_gpio] &= ~(1u << rule_index);
+
+    rule->trigger_gpio = trigger_gpio;
+    rule->edges = (uint8_t)(edges & (RULE_EDGE_RISE | RULE_EDGE_FALL));
+    rule->gpio_mask = gpio_mask & GPIO_DEVICE_MASK;
+    rule->on_us = on_ms * 1000u;
+    if (rule->edges && rule->gpio_mask){
+        rules_by_gpio[trigger_gpio] |= 1u << rule_index;
+    }
+    restore_interrupts(irq);
+}
+
+bool rules_on_edge(uint8_t gpio_number, bool rising){
+    uint32_t rule_mask = rules_by_gpio[gpio_number];
+    uint8_t edge = rising ? RULE_EDGE_RISE : RULE_EDGE_FALL;
+    bool fired = false;
+
+    while (rule_mask){
+        uint32_t rule_index = (uint32_t)__builtin_ctz(rule_mask);
+        rule_mask &= rule_mask - 1;
+
+        const rule_t *rule = &rules[rule_index];
+        if (!(rule->edges & edge)){
+            continue;
+        }
+        apply_gpio_mask_masked(rule->gpio_mask, rule->gpio_mask);
+        if (rule->on_us){
+            if (rule_alarm_ids[rule_index] > 0){
+                cancel_alarm(rule_alarm_ids[rule_index]);
+            }
+            rule_alarm_ids[rule_index] = add_alarm_in_us(rule->on_us, rule_off_alarm_callback, (void *)(uintptr_t)rule_index, true);
+            if (rule_alarm_ids[rule_index] < 0){
+                rule_alarm_ids[rule_index] = 0;
+            }
+        }
+        rules_fired_mask |= 1u << rule_index;
+        fired = true;
+    }
+    return fired;
+}
+
+uint32_t rules_take_fired(void){
+    uint32_t irq = save_and_disable_interrupts();
+    uint32_t fired_mask = rules_fired_mask;
+    rules_fired_mask = 0;
+    restore_interrupts(irq);
+    return fired_mask;
+}
+
+bool rules_pending(void){
+    if (rules_fired_mask){
+        return true;
+    }
+    for (uint32_t rule_index = 0; rule_index < RULE_MAX_RULES; rule_index++){
+        if (rule_alarm_ids[rule_index] > 0){
+            return true;
+        }
+    }
+    return false;
+}
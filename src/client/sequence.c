@@ -0,0 +1,177 @@
+/**
+ * @file sequence.c
+ * @brief Client-side output sequence player driven by a hardware alarm.
+ *
+ * A sequence is a list of up to `SEQUENCE_MAX_STEPS` steps, each an on-mask
+ * and a duration in microseconds, played a given number of times (0 loops
+ * forever). It is uploaded once and kept in RAM. Playback runs entirely
+ * from one alarm: each callback applies the next step and returns its
+ * duration relative to the previous deadline, so steps do not drift and
+ * the UART link stays idle.
+ *
+ * Only the GPIOs used by some step of the sequence are driven, and they
+ * are turned OFF when the sequence ends or is stopped.
+ */
+
+#include <stdio.h>
+
+#include "pico/stdlib.h"
+#include "pico/time.h"
+#include "hardware/sync.h"
+
+#include "client.h"
+
+/**
+ * @brief One step of the sequence.
+ */
+typedef struct{
+    uint32_t gpio_mask;
+    uint32_t duration_us;
+}sequence_step_t;
+
+static sequence_step_t sequence_steps[SEQUENCE_MAX_STEPS];
+static uint32_t sequence_step_count = 0;
+static uint32_t sequence_loop_count = 0;
+static uint32_t sequence_used_mask = 0;
+static alarm_id_t sequence_alarm_id = 0;
+static volatile uint32_t sequence_position = 0;
+static volatile uint32_t sequence_loops_done = 0;
+static volatile bool sequence_playing = false;
+
+/**
+ * @brief Alarm callback: moves to the next step of the sequence.
+ *
+ * @param id        Alarm ID.
+ * @param user_data Unused.
+ * @return Duration of the next step in microseconds, 0 when the sequence ends.
+ */
+static int64_t sequence_alarm_callback(alarm_id_t id, void *user_data){
+    uint32_t next_position = sequence_position + 1;
+    if (next_position >= sequence_step_count){
+        next_position = 0;
+        sequence_loops_done++;
+        if (sequence_loop_count && sequence_loops_done >= sequence_loop_count){
+            apply_gpio_mask_masked(sequence_used_mask, 0);
+            sequence_alarm_id = 0;
+            sequence_playing = false;
+            return 0;
+        }
+    }
+    sequence_position = next_position;
+    apply_gpio_mask_masked(sequence_used_mask, sequence_steps[next_position].gpio_mask);
+    return sequence_steps[next_position].duration_us;
+}
+
+void sequence_cancel(void){
+    uint32_t irq = save_and_disable_interrupts();
+    if (sequence_alarm_id > 0){
+        cancel_alarm(sequence_alarm_id);
+    }
+    sequence_alarm_id = 0;
+    sequence_playing = false;
+    restore_interrupts(irq);
+}
+
+/**
+ * @brief Stops playback and turns the sequence's GPIOs OFF.
+ */
+static void sequence_stop(void){
+    bool was_playing = sequence_playing;
+    sequence_cancel();
+    if (was_playing){
+        apply_gpio_mask_masked(sequence_used_mask, 0);
+    }
+}
+
+/**
+ * @brief Applies a step and plays on from it.
+ *
+ * @param position    Step to jump to.
+ * @param reset_loops true to start counting loops again.
+ */
+static void sequence_play_from(uint32_t position, bool reset_loops){
+    if (position >= sequence_step_count){
+        return;
+    }
+    sequence_cancel();
+
+    uint32_t used_mask = 0;
+    for (uint32_t step = 0; step < sequence_step_count; step++){
+        used_mask |= sequence_steps[step].gpio_mask;
+    }
+    sequence_used_mask = used_mask & GPIO_DEVICE_MASK;
+    while (used_mask){
+        timed_output_cancel((uint8_t)__builtin_ctz(used_mask));
+        used_mask &= used_mask - 1;
+    }
+
+    uint32_t irq = save_and_disable_interrupts();
+    sequence_position = position;
+    if (reset_loops){
+        sequence_loops_done = 0;
+    }
+    sequence_playing = true;
+    apply_gpio_mask_masked(sequence_used_mask, sequence_steps[position].gpio_mask);
+    sequence_alarm_id = add_alarm_in_us(sequence_steps[position].duration_us, sequence_alarm_callback, NULL, true);
+    if (sequence_alarm_id <= 0){
+        sequence_alarm_id = 0;
+        sequence_playing = false;
+        apply_gpio_mask_masked(sequence_used_mask, 0);
+    }
+    restore_interrupts(irq);
+}
+
+void sequence_define(uint32_t step_count, uint32_t loop_count){
+    sequence_stop();
+    sequence_step_count = step_count <= SEQUENCE_MAX_STEPS ? step_count : 0;
+    sequence_loop_count = loop_count;
+    for (uint32_t step = 0; step < SEQUENCE_MAX_STEPS; step++){
+        sequence_steps[step].gpio_mask = 0;
+        sequence_steps[step].duration_us = SEQUENCE_MIN_STEP_US;
+    }
+}
+
+void sequence_set_step(uint32_t step, uint32_t gpio_mask, uint32_t duration_us){
+    if (step >= sequence_step_count || sequence_playing){
+        return;
+    }
+    sequence_steps[step].gpio_mask = gpio_mask;
+    sequence_steps[step].duration_us = duration_us < SEQUENCE_MIN_STEP_US ? SEQUENCE_MIN_STEP_US : duration_us;
+}
+
+void sequence_control(uint32_t control, uint32_t step){
+    switch (control){
+        case SEQUENCE_CONTROL_STOP: sequence_stop();
+            break;
+        case SEQUENCE_CONTROL_START: sequence_play_from(step, true);
+            break;
+        case SEQUENCE_CONTROL_SEEK:
+            if (sequence_playing){
+                sequence_play_from(step, false);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+bool sequence_pending(void){
+    return sequence_playing;
+}
+
+void sequence_send_report(void){
+    uint32_t irq = save_and_disable_interrupts();
+    bool playing = sequence_playing;
+    uint32_t position = sequence_position;
+    uint32_t loops_done = sequence_loops_done;
+    restore_interrupts(irq);
+
+    char msg[CLIENT_COMMAND_BUFFER_SIZE];
+    snprintf(msg, sizeof(msg), "[%d,%u,%lu,%lu]",
+        SEQUENCE_REPORT_FLAG_NUMBER,
+        playing,
+        (unsigned long)position,
+        (unsigned long)loops_done);
+    uart_puts(active_uart_client_connection.uart_instance, msg);
+    uart_tx_wait_blocking(active_uart_client_connection.uart_instance);
+}
@@ -0,0 +1,101 @@
+/**
+ * @file time_sync.c
+ * @brief Client side of the clock sync and of commands applied at a set time.
+ *
+ * The server reads the client's microsecond timer with "[38,38]" and keeps a
+ * model of its offset and drift. The time in the reply is taken as soon as
+ * the request frame has been received, so the server and the client both
+ * refer to the end of the same stop bit.
+ *
+ * "[39,time_lo,command,argument]" holds the low 32 bits of the client time
+ * at which "[command,argument]" is applied. The command then runs from a
+ * hardware alarm, independent of UART traffic. Targets that have already
+ * passed run at once; targets further ahead than `APPLY_AT_MAX_DELAY_MS`
+ * are ignored, as they come from a stale clock model.
+ */
+
+#include <stdio.h>
+
+#include "pico/stdlib.h"
+#include "pico/time.h"
+#include "hardware/sync.h"
+
+#include "client.h"
+
+/**
+ * @brief Command waiting for its apply time.
+ */
+typedef struct{
+    alarm_id_t alarm_id;        ///< 0 when the slot is free
+    uint32_t command;
+    uint32_t argument;
+}apply_at_slot_t;
+
+static apply_at_slot_t apply_at_slots[APPLY_AT_MAX_PENDING];
+static volatile uint32_t apply_at_pending_mask = 0;
+
+_Static_assert(APPLY_AT_MAX_PENDING <= 32, "apply-at slots must fit in a 32-bit mask");
+
+void time_sync_send_reply(uint64_t received_us){
+    char msg[CLIENT_COMMAND_BUFFER_SIZE];
+    snprintf(msg, sizeof(msg), "[%d,%lu,%lu]",
+        TIME_SYNC_FLAG_NUMBER,
+        (unsigned long)(received_us >> 32),
+        (unsigned long)(received_us & 0xFFFFFFFFu));
+    uart_puts(active_uart_client_connection.uart_instance, msg);
+    uart_tx_wait_blocking(active_uart_client_connection.uart_instance);
+}
+
+/**
+ * @brief Alarm callback: applies the command of a slot and frees the slot.
+ *
+ * @param id        Alarm ID.
+ * @param user_data Slot index.
+ * @return 0, the alarm does not repeat.
+ */
+static int64_t apply_at_alarm_callback(alarm_id_t id, void *user_data){
+    uint32_t slot_index = (uint32_t)(uintptr_t)user_data;
+    apply_at_slot_t *slot = &apply_at_slots[slot_index];
+
+    apply_output_command(slot->command, slot->argument);
+    slot->alarm_id = 0;
+    apply_at_pending_mask &= ~(1u << slot_index);
+    return 0;
+}
+
+void apply_at_schedule(uint32_t client_time_lo, uint32_t command, uint32_t argument){
+    uint64_t now_us = time_us_64();
+    int32_t delay_us = (int32_t)(client_time_lo - (uint32_t)now_us);
+    if (delay_us <= 0){
+        apply_output_command(command, argument);
+        return;
+    }
+    if ((uint32_t)delay_us > APPLY_AT_MAX_DELAY_MS * 1000u){
+        return;
+    }
+
+    uint32_t irq = save_and_disable_interrupts();
+    uint32_t free_mask = ~apply_at_pending_mask & ((1ull << APPLY_AT_MAX_PENDING) - 1);
+    if (!free_mask){
+        restore_interrupts(irq);
+        apply_output_command(command, argument);
+        return;
+    }
+    uint32_t slot_index = (uint32_t)__builtin_ctz(free_mask);
+    apply_at_slot_t *slot = &apply_at_slots[slot_index];
+    slot->command = command;
+    slot->argument = argument;
+    apply_at_pending_mask |= 1u << slot_index;
+    restore_interrupts(irq);
+
+    slot->alarm_id = add_alarm_at(from_us_since_boot(now_us + (uint32_t)delay_us), apply_at_alarm_callback, (void *)(uintptr_t)slot_index, true);
+    if (slot->alarm_id <= 0){
+        slot->alarm_id = 0;
+        apply_at_pending_mask &= ~(1u << slot_index);
+        apply_output_command(command, argument);
+    }
+}
+
+bool apply_at_pending(void){
+    return apply_at_pending_mask != 0;
+}
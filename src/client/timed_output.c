@@ -0,0 +1,129 @@
+/**
+ * @file timed_output.c
+ * @brief Client-side timed outputs and pulse trains driven by hardware alarms.
+ *
+ * A timed output turns a GPIO ON and then toggles it from an alarm callback
+ * until its last pulse has ended, leaving the GPIO OFF. Each callback
+ * returns the length of the next phase relative to the previous deadline,
+ * so phases do not drift and are independent of UART, USB or server load.
+ *
+ * GPIOs whose timed output has finished are collected in a mask that the
+ * server reads with a report poll.
+ */
+
+#include <stdio.h>
+
+#include "pico/stdlib.h"
+#include "pico/time.h"
+#include "hardware/sync.h"
+
+#include "client.h"
+
+/**
+ * @brief Running timed output of one GPIO.
+ */
+typedef struct{
+    alarm_id_t alarm_id;        ///< 0 when no timed output runs on the GPIO
+    uint32_t on_us;
+    uint32_t off_us;
+    uint32_t remaining_edges;   ///< Level changes left, the last one turns the GPIO OFF
+    bool level;
+}timed_output_t;
+
+static timed_output_t timed_outputs[32];
+static volatile uint32_t timed_output_running_mask = 0;
+static volatile uint32_t timed_output_completed_mask = 0;
+
+/**
+ * @brief Alarm callback: switches the GPIO to its next phase.
+ *
+ * @param id        Alarm ID.
+ * @param user_data GPIO number.
+ * @return Length of the next phase in microseconds, 0 when the output is done.
+ */
+static int64_t timed_output_alarm_callback(alarm_id_t id, void *user_data){
+    uint8_t gpio_number = (uint8_t)(uintptr_t)user_data;
+    timed_output_t *output = &timed_outputs[gpio_number];
+
+    if (--output->remaining_edges == 0){
+        change_gpio(gpio_number, 0);
+        output->alarm_id = 0;
+        timed_output_running_mask &= ~(1u << gpio_number);
+        timed_output_completed_mask |= 1u << gpio_number;
+        return 0;
+    }
+
+    output->level = !output->level;
+    gpio_put(gpio_number, output->level);
+    return output->level ? output->on_us : output->off_us;
+}
+
+void timed_output_cancel(uint8_t gpio_number){
+    if (gpio_number >= 32){
+        return;
+    }
+    uint32_t irq = save_and_disable_interrupts();
+    if (timed_outputs[gpio_number].alarm_id > 0){
+        cancel_alarm(timed_outputs[gpio_number].alarm_id);
+    }
+    timed_outputs[gpio_number].alarm_id = 0;
+    timed_output_running_mask &= ~(1u << gpio_number);
+    restore_interrupts(irq);
+}
+
+void timed_output_cancel_all(void){
+    uint32_t running_mask = timed_output_running_mask;
+    while (running_mask){
+        timed_output_cancel((uint8_t)__builtin_ctz(running_mask));
+        running_mask &= running_mask - 1;
+    }
+}
+
+void timed_output_start(uint8_t gpio_number, uint32_t on_ms, uint32_t off_ms, uint32_t pulse_count){
+    if (gpio_number >= 32 || !(GPIO_DEVICE_MASK & (1u << gpio_number)) || !on_ms || !pulse_count){
+        return;
+    }
+    if (on_ms > TIMED_OUTPUT_MAX_MS || off_ms > TIMED_OUTPUT_MAX_MS || pulse_count > TIMED_OUTPUT_MAX_PULSES){
+        return;
+    }
+    timed_output_cancel(gpio_number);
+
+    timed_output_t *output = &timed_outputs[gpio_number];
+    output->on_us = on_ms * 1000u;
+    output->off_us = (off_ms ? off_ms : 1u) * 1000u;
+    output->remaining_edges = 2 * pulse_count - 1;
+    output->level = true;
+
+    change_gpio(gpio_number, 1);
+    uint32_t irq = save_and_disable_interrupts();
+    timed_output_running_mask |= 1u << gpio_number;
+    timed_output_completed_mask &= ~(1u << gpio_number);
+    restore_interrupts(irq);
+
+    output->alarm_id = add_alarm_in_us(output->on_us, timed_output_alarm_callback, (void *)(uintptr_t)gpio_number, true);
+    if (output->alarm_id <= 0){
+        output->alarm_id = 0;
+        change_gpio(gpio_number, 0);
+        timed_output_running_mask &= ~(1u << gpio_number);
+        timed_output_completed_mask |= 1u << gpio_number;
+    }
+}
+
+bool timed_output_pending(void){
+    return timed_output_running_mask != 0;
+}
+
+void timed_output_send_report(uint32_t gpio_on_mask){
+    uint32_t irq = save_and_disable_interrupts();
+    uint32_t completed_mask = timed_output_completed_mask;
+    timed_output_completed_mask = 0;
+    restore_interrupts(irq);
+
+    char msg[CLIENT_COMMAND_BUFFER_SIZE];
+    snprintf(msg, sizeof(msg), "[%d,%lu,%lu]",
+        OUTPUT_REPORT_FLAG_NUMBER,
+        (unsigned long)completed_mask,
+        (unsigned long)gpio_on_mask);
+    uart_puts(active_uart_client_connection.uart_instance, msg);
+    uart_tx_wait_blocking(active_uart_client_connection.uart_instance);
+}
@@ -12,6 +12,7 @@
 #include "client.h"
 #include "functions.h"
 #include "config.h"
+#include "profiler.h"
 
 #ifdef CYW43_WL_GPIO_LED_PIN
 #include "pico/cyw43_arch.h"
@@ -46,7 +47,29 @@ void get_number_pair(uint8_t *received_number_pair, char *buf){
     }
 }
 
+uint8_t get_number_list(uint32_t *numbers, uint8_t max_numbers, const char *message){
+    uint8_t number_index = 0;
+    bool has_digits = false;
+
+    for (const char *p = message; *p; p++) {
+        if (*p >= '0' && *p <= '9') {
+            if (number_index < max_numbers) {
+                numbers[number_index] = numbers[number_index] * 10 + (uint32_t)(*p - '0');
+            }
+            has_digits = true;
+        } else if (*p == ',') {
+            number_index++;
+        }
+    }
+
+    if (!has_digits) {
+        return 0;
+    }
+    return number_index < max_numbers ? number_index + 1 : max_numbers;
+}
+
 void get_uart_buffer(uart_inst_t* uart, char* buf, uint8_t buffer_size, uint32_t timeout_ms) {
+    PROFILE_ENTER(PROFILE_GET_UART_BUFFER);
     absolute_time_t start_time = get_absolute_time();
     uint8_t idx = 0;
     uint32_t timeout_us = timeout_ms * MS_TO_US_MULTIPLIER;
@@ -72,6 +95,47 @@ void get_uart_buffer(uart_inst_t* uart, char* buf, uint8_t buffer_size, uint32_t
     }
 
     buf[idx] = '\0';
+    PROFILE_EXIT(PROFILE_GET_UART_BUFFER);
+}
+
+uint32_t get_uart_bytes(uart_inst_t* uart, uint8_t* buffer, uint32_t length, uint32_t timeout_ms) {
+    absolute_time_t start_time = get_absolute_time();
+    uint32_t timeout_us = timeout_ms * MS_TO_US_MULTIPLIER;
+    uint32_t idx = 0;
+
+    while (idx < length && absolute_time_diff_us(start_time, get_absolute_time()) < timeout_us) {
+        if (uart_is_readable(uart)) {
+            buffer[idx++] = (uint8_t)uart_getc(uart);
+        }
+    }
+    return idx;
+}
+
+uint16_t fletcher16(const uint8_t *data, uint32_t length) {
+    uint32_t sum1 = 0;
+    uint32_t sum2 = 0;
+
+    for (uint32_t i = 0; i < length; i++) {
+        sum1 = (sum1 + data[i]) % 255;
+        sum2 = (sum2 + sum1) % 255;
+    }
+    return (uint16_t)((sum2 << 8) | sum1);
+}
+
+static const uint32_t crc32_nibble_table[16] = {
+    0x00000000u, 0x1DB71064u, 0x3B6E20C8u, 0x26D930ACu, 0x76DC4190u, 0x6B6B51F4u, 0x4DB26158u, 0x5005713Cu,
+    0xEDB88320u, 0xF00F9344u, 0xD6D6A3E8u, 0xCB61B38Cu, 0x9B64C2B0u, 0x86D3D2D4u, 0xA00AE278u, 0xBDBDF21Cu,
+};
+
+uint32_t crc32_update(uint32_t crc, const void *data, uint32_t length) {
+    const uint8_t *bytes = (const uint8_t *)data;
+    crc = ~crc;
+    for (uint32_t i = 0; i < length; i++) {
+        crc ^= bytes[i];
+        crc = (crc >> 4) ^ crc32_nibble_table[crc & 0x0F];
+        crc = (crc >> 4) ^ crc32_nibble_table[crc & 0x0F];
+    }
+    return ~crc;
 }
 
 static int pico_onboard_led_init(void) {
@@ -0,0 +1,174 @@
+/**
+ * @file profiler.c
+ * @brief SysTick cycle counter, PC sampler and USB dump for profiling builds.
+ *
+ * The PC sampler uses a dedicated hardware alarm per profiled core. Its
+ * interrupt vector points at a small naked trampoline that passes the
+ * exception stack frame to `profiler_record_sample()`, which reads the
+ * stacked PC and re-arms the alarm.
+ *
+ * @see profiler.h
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "hardware/exception.h"
+#include "hardware/irq.h"
+#include "hardware/sync.h"
+#include "hardware/timer.h"
+#include "hardware/structs/timer.h"
+
+#include "profiler.h"
+
+#if PROFILING_BUILD
+
+#ifndef PROFILER_SYSTICK_CSR_ENABLE
+#define PROFILER_SYSTICK_CSR_ENABLE 0x7u   ///< ENABLE | TICKINT | CLKSOURCE (processor clock)
+#endif
+
+#ifndef PROFILER_EXCEPTION_FRAME_PC_INDEX
+#define PROFILER_EXCEPTION_FRAME_PC_INDEX 6 ///< r0, r1, r2, r3, r12, lr, pc, xpsr
+#endif
+
+volatile uint32_t profiler_systick_wraps[NUM_CORES];
+profiler_function_stats_t profiler_functions[NUM_CORES][PROFILE_FUNCTION_COUNT];
+
+static profiler_pc_entry_t profiler_pc_table[NUM_CORES][PROFILER_PC_TABLE_SIZE];
+static uint32_t profiler_total_samples[NUM_CORES];
+static uint32_t profiler_dropped_samples[NUM_CORES];
+static uint8_t profiler_alarm[NUM_CORES];
+
+static const char *const profiler_function_names[PROFILE_FUNCTION_COUNT] = {
+    [PROFILE_SAVE_SERVER_STATE]         = "save_server_state",
+    [PROFILE_COMPUTE_CRC32]             = "compute_crc32",
+    [PROFILE_SERVER_SEND_CLIENT_STATE]  = "server_send_client_state",
+    [PROFILE_PRINTF_AND_UPDATE_BUFFER]  = "printf_and_update_buffer",
+    [PROFILE_GET_UART_BUFFER]           = "get_uart_buffer",
+};
+
+void profiler_record_sample(const uint32_t *exception_frame);
+
+/**
+ * @brief SysTick handler extending the 24-bit counter of the current core.
+ */
+static void profiler_systick_handler(void){
+    profiler_systick_wraps[get_core_num()]++;
+}
+
+/**
+ * @brief Records one PC sample and re-arms the sampling alarm.
+ *
+ * Called from `profiler_sample_isr()` with a pointer to the exception frame
+ * stacked on interrupt entry.
+ *
+ * @param exception_frame Hardware-stacked registers of the interrupted code.
+ */
+void profiler_record_sample(const uint32_t *exception_frame){
+    uint core = get_core_num();
+    uint8_t alarm = profiler_alarm[core];
+    timer_hw->intr = 1u << alarm;
+    timer_hw->alarm[alarm] = timer_hw->timerawl + PROFILER_SAMPLE_PERIOD_US;
+
+    uint32_t pc_bucket = exception_frame[PROFILER_EXCEPTION_FRAME_PC_INDEX] >> PROFILER_PC_GRANULARITY_SHIFT;
+    uint32_t hash = (pc_bucket ^ (pc_bucket >> 7)) & (PROFILER_PC_TABLE_SIZE - 1);
+    profiler_total_samples[core]++;
+
+    for (uint8_t probe = 0; probe < PROFILER_PC_MAX_PROBES; probe++){
+        profiler_pc_entry_t *entry = &profiler_pc_table[core][(hash + probe) & (PROFILER_PC_TABLE_SIZE - 1)];
+        if (entry->pc_bucket == pc_bucket){
+            entry->samples++;
+            return;
+        }
+        if (!entry->pc_bucket){
+            entry->pc_bucket = pc_bucket;
+            entry->samples = 1;
+            return;
+        }
+    }
+    profiler_dropped_samples[core]++;
+}
+
+/**
+ * @brief Alarm interrupt entry that forwards the stacked frame.
+ *
+ * On exception entry SP points at the hardware-stacked frame. The trampoline
+ * passes it as the first argument and tail-calls the C handler, which then
+ * returns from the exception with the original EXC_RETURN value in LR.
+ */
+static void __attribute__((naked)) profiler_sample_isr(void){
+    __asm volatile(
+        "mov r0, sp\n"
+        "ldr r1, =profiler_record_sample\n"
+        "bx r1\n"
+        ".ltorg\n"
+    );
+}
+
+void profiler_init_core(void){
+    uint core = get_core_num();
+
+    exception_set_exclusive_handler(SYSTICK_EXCEPTION, profiler_systick_handler);
+    systick_hw->rvr = PROFILER_SYSTICK_RELOAD;
+    systick_hw->cvr = 0;
+    systick_hw->csr = PROFILER_SYSTICK_CSR_ENABLE;
+
+    profiler_alarm[core] = (uint8_t)hardware_alarm_claim_unused(true);
+    uint irq_num = hardware_alarm_get_irq_num(profiler_alarm[core]);
+    irq_set_exclusive_handler(irq_num, profiler_sample_isr);
+    hw_set_bits(&timer_hw->inte, 1u << profiler_alarm[core]);
+    irq_set_enabled(irq_num, true);
+    timer_hw->alarm[profiler_alarm[core]] = timer_hw->timerawl + PROFILER_SAMPLE_PERIOD_US;
+}
+
+void profiler_dump(bool reset){
+    for (uint8_t core = 0; core < NUM_CORES; core++){
+        printf("PROFILE core=%u samples=%lu dropped=%lu period_us=%u\n",
+            core,
+            (unsigned long)profiler_total_samples[core],
+            (unsigned long)profiler_dropped_samples[core],
+            PROFILER_SAMPLE_PERIOD_US);
+
+        for (uint32_t index = 0; index < PROFILER_PC_TABLE_SIZE; index++){
+            const profiler_pc_entry_t *entry = &profiler_pc_table[core][index];
+            if (entry->pc_bucket){
+                printf("PC 0x%08lx %lu\n",
+                    (unsigned long)(entry->pc_bucket << PROFILER_PC_GRANULARITY_SHIFT),
+                    (unsigned long)entry->samples);
+            }
+        }
+
+        for (uint8_t function = 0; function < PROFILE_FUNCTION_COUNT; function++){
+            const profiler_function_stats_t *stats = &profiler_functions[core][function];
+            if (stats->calls){
+                printf("FUNC %s core=%u calls=%lu total_cycles=%llu max_cycles=%lu\n",
+                    profiler_function_names[function],
+                    core,
+                    (unsigned long)stats->calls,
+                    (unsigned long long)stats->total_cycles,
+                    (unsigned long)stats->max_cycles);
+            }
+        }
+    }
+
+    if (reset){
+        uint32_t ints = save_and_disable_interrupts();
+        memset(profiler_pc_table, 0, sizeof(profiler_pc_table));
+        memset(profiler_functions, 0, sizeof(profiler_functions));
+        memset(profiler_total_samples, 0, sizeof(profiler_total_samples));
+        memset(profiler_dropped_samples, 0, sizeof(profiler_dropped_samples));
+        restore_interrupts(ints);
+    }
+}
+
+#else
+
+void profiler_init_core(void){
+}
+
+void profiler_dump(bool reset){
+    printf("\nProfiling is disabled. Rebuild with -DPROFILING_BUILD=1.\n");
+}
+
+#endif
@@ -0,0 +1,225 @@
+/**
+ * @file adc.c
+ * @brief Client ADC sampling: configuration, block collection and host readout.
+ *
+ * Clients sample their ADC on their own (see adc.c on the client) and
+ * buffer the samples in blocks. A client with waiting blocks rings the
+ * input doorbell, and core1 collects up to `ADC_COLLECT_MAX_BLOCKS` blocks
+ * right after its input report, so samples never cost a frame each and
+ * clients are never polled.
+ *
+ * Collected blocks wait in a ring of `ADC_SERVER_BLOCKS` per client until
+ * the host reads them with `ADC READ`. When the ring is full the oldest
+ * block is overwritten. Missing sequence numbers, whether dropped by the
+ * client, damaged on the link or overwritten here, are counted as lost.
+ *
+ * The ADC GPIOs of a sampling client are written OFF to the flash state,
+ * as for inputs. Sampling settings live in RAM; clients forget them when
+ * they restart. Blocks not read yet stay readable after sampling stops,
+ * and are cleared when it starts again.
+ */
+
+#include <stdio.h>
+
+#include "pico/stdlib.h"
+#include "hardware/sync.h"
+
+#include "server.h"
+
+#define LOG_MODULE STATE
+#include "log.h"
+
+/**
+ * @brief ADC model of one client.
+ */
+typedef struct{
+    uint32_t channel_mask;      ///< Sampled ADC inputs, 0 when stopped
+    uint32_t rate_hz;
+    uint32_t decimation;
+    uint32_t next_sequence;     ///< Sequence expected from the next block
+    uint32_t received;          ///< Blocks collected
+    uint32_t lost;              ///< Blocks that never reached the host
+    uint32_t bad;               ///< Blocks damaged on the link
+    adc_block_t blocks[ADC_SERVER_BLOCKS];
+    uint8_t first;              ///< Oldest block not read by the host
+    uint8_t count;              ///< Blocks not read by the host
+}adc_client_t;
+
+static adc_client_t adc_clients[MAX_SERVER_CONNECTIONS];
+static spin_lock_t *adc_lock = NULL;
+
+void server_adc_init(void){
+    adc_lock = spin_lock_instance(spin_lock_claim_unused(true));
+}
+
+/**
+ * @brief Configures ADC sampling on a client. Call with the state lock held.
+ *
+ * See `server_adc_configure()`.
+ */
+static bool adc_configure_locked(uint32_t flash_client_index, uint32_t channel_mask, uint32_t rate_hz, uint32_t decimation){
+    if (!adc_lock || flash_client_index >= MAX_SERVER_CONNECTIONS || (channel_mask & ~ADC_CHANNEL_MASK)){
+        return false;
+    }
+    if (channel_mask && (!rate_hz || !decimation || decimation > ADC_DECIMATION_MAX ||
+        (uint64_t)rate_hz * (uint32_t)__builtin_popcount(channel_mask) * decimation > ADC_MAX_CONVERSIONS_HZ)){
+        return false;
+    }
+    server_persistent_state_t state;
+    load_server_state(&state);
+    uint32_t connection_index = get_active_client_connection_index_from_flash_client_index(flash_client_index, state);
+    if (connection_index == INVALID_CLIENT_INDEX){
+        return false;
+    }
+    uint8_t active_client_index = (uint8_t)connection_index;
+    server_uart_connection_t *connection = &active_uart_server_connections[active_client_index];
+
+    send_wakeup_if_dormant(flash_client_index, &state, connection->pin_pair, connection->uart_instance);
+    server_send_adc_config(connection->pin_pair, connection->uart_instance, channel_mask, rate_hz, decimation);
+
+    uint32_t gpio_mask = ((channel_mask & 0x0Fu) << ADC_FIRST_GPIO) & GPIO_DEVICE_MASK;
+    if (gpio_mask){
+        client_state_t *client_state = &state.clients[flash_client_index].running_client_state;
+        bool changed = false;
+        for (uint8_t device_index = 0; device_index < MAX_NUMBER_OF_GPIOS; device_index++){
+            device_t *device = &client_state->devices[device_index];
+            if (device->gpio_number < 32 && (gpio_mask & (1u << device->gpio_number)) && (device->is_on || device->pwm_duty)){
+                device->is_on = false;
+                device->pwm_duty = 0;
+                changed = true;
+            }
+        }
+        if (changed){
+            save_server_state(&state);
+        }
+        server_timed_output_forget(flash_client_index, gpio_mask);
+    }
+
+    uint32_t irq = spin_lock_blocking(adc_lock);
+    adc_client_t *client = &adc_clients[flash_client_index];
+    client->channel_mask = channel_mask;
+    client->rate_hz = channel_mask ? rate_hz : 0;
+    client->decimation = channel_mask ? decimation : 0;
+    if (channel_mask){
+        client->next_sequence = 0;
+        client->received = 0;
+        client->lost = 0;
+        client->bad = 0;
+        client->first = 0;
+        client->count = 0;
+    }
+    spin_unlock(adc_lock, irq);
+
+    server_input_set_bulk(flash_client_index, active_client_index, INPUT_BULK_ADC, channel_mask != 0);
+    if (connection->is_dormant){
+        send_dormant_flag_to_client(active_client_index);
+    }
+    return true;
+}
+
+bool server_adc_configure(uint32_t flash_client_index, uint32_t channel_mask, uint32_t rate_hz, uint32_t decimation){
+    server_state_lock();
+    bool configured = adc_configure_locked(flash_client_index, channel_mask, rate_hz, decimation);
+    server_state_unlock();
+    return configured;
+}
+
+/**
+ * @brief Adds a collected block to the ring of a client. Call with the ADC lock held.
+ *
+ * @param client Client model.
+ * @param block  Collected block.
+ */
+static void adc_store_block(adc_client_t *client, const adc_block_t *block){
+    if (block->sequence > client->next_sequence){
+        client->lost += block->sequence - client->next_sequence;
+    }
+    client->next_sequence = block->sequence + 1;
+    client->received++;
+
+    if (client->count == ADC_SERVER_BLOCKS){
+        client->first = (uint8_t)((client->first + 1) % ADC_SERVER_BLOCKS);
+        client->count--;
+        client->lost++;
+    }
+    client->blocks[(client->first + client->count) % ADC_SERVER_BLOCKS] = *block;
+    client->count++;
+}
+
+void server_adc_collect(uint32_t flash_client_index, uint8_t active_client_index){
+    if (!adc_lock || flash_client_index >= MAX_SERVER_CONNECTIONS || !adc_clients[flash_client_index].channel_mask){
+        return;
+    }
+    server_uart_connection_t *connection = &active_uart_server_connections[active_client_index];
+    adc_block_t blocks[ADC_COLLECT_MAX_BLOCKS];
+    uint32_t dropped = 0;
+    uint32_t bad_blocks = 0;
+    uint32_t received = server_collect_adc_blocks(connection->pin_pair, connection->uart_instance, ADC_COLLECT_MAX_BLOCKS, blocks, &dropped, &bad_blocks);
+
+    uint32_t irq = spin_lock_blocking(adc_lock);
+    adc_client_t *client = &adc_clients[flash_client_index];
+    for (uint32_t index = 0; index < received; index++){
+        if (blocks[index].channel_mask == client->channel_mask){
+            adc_store_block(client, &blocks[index]);
+        }
+    }
+    client->bad += bad_blocks;
+    spin_unlock(adc_lock, irq);
+
+    if (bad_blocks){
+        LOG_WARN(STATE_ADC_BLOCK_BAD, flash_client_index, bad_blocks);
+    }
+    if (dropped){
+        LOG_WARN(STATE_ADC_BLOCKS_DROPPED, flash_client_index, dropped);
+    }
+}
+
+void server_adc_print_machine(void){
+    if (!adc_lock){
+        return;
+    }
+    for (uint32_t flash_client_index = 0; flash_client_index < MAX_SERVER_CONNECTIONS; flash_client_index++){
+        uint32_t irq = spin_lock_blocking(adc_lock);
+        adc_client_t *client = &adc_clients[flash_client_index];
+        uint32_t channel_mask = client->channel_mask;
+        uint32_t rate_hz = client->rate_hz;
+        uint32_t decimation = client->decimation;
+        uint32_t received = client->received;
+        uint32_t lost = client->lost;
+        uint32_t bad = client->bad;
+        uint32_t waiting = client->count;
+        spin_unlock(adc_lock, irq);
+
+        if (!channel_mask && !received){
+            continue;
+        }
+        printf("ADC %lu %02lx %lu %lu %lu %lu %lu %lu\n",
+            (unsigned long)flash_client_index, (unsigned long)channel_mask, (unsigned long)rate_hz, (unsigned long)decimation,
+            (unsigned long)received, (unsigned long)lost, (unsigned long)bad, (unsigned long)waiting);
+    }
+}
+
+bool server_adc_print_blocks(uint32_t flash_client_index){
+    if (!adc_lock || flash_client_index >= MAX_SERVER_CONNECTIONS){
+        return false;
+    }
+    while (true){
+        adc_block_t block;
+        uint32_t irq = spin_lock_blocking(adc_lock);
+        adc_client_t *client = &adc_clients[flash_client_index];
+        if (!client->count){
+            spin_unlock(adc_lock, irq);
+            return true;
+        }
+        block = client->blocks[client->first];
+        client->first = (uint8_t)((client->first + 1) % ADC_SERVER_BLOCKS);
+        client->count--;
+        spin_unlock(adc_lock, irq);
+
+        printf("ADCBLOCK %lu %lu %02x %u ", (unsigned long)flash_client_index, (unsigned long)block.sequence, block.channel_mask, block.sample_count);
+        for (uint8_t index = 0; index < block.sample_count; index++){
+            printf("%03x", block.samples[index]);
+        }
+        printf("\n");
+    }
+}
@@ -0,0 +1,230 @@
+/**
+ * @file audit.c
+ * @brief Background audit of the client outputs against the stored running state.
+ *
+ * Noise, a lost frame or a client that browned out can leave a client's
+ * pins different from `running_client_state`, and nothing else would
+ * notice. Every `AUDIT_TICK_MS` a repeating timer wakes core1, which reads
+ * back the outputs of the next awake client in turn: the client answers
+ * with the ON mask taken from its SIO output registers (see
+ * `send_audit_readback()` on the client). GPIOs that differ from the
+ * stored state are set again with one "[gpio,value]" frame each, so a
+ * repair costs no more frames than GPIOs to fix.
+ *
+ * The audit stays out of the way of interactive traffic. A tick is
+ * deferred while a stream runs or if the UART lock was held within the
+ * last `AUDIT_IDLE_MS`, and one tick costs at most one short exchange.
+ * The comparison leaves out PWM outputs, inputs and every client that
+ * reports local activity (timed outputs, sequences, rules, latch or
+ * apply-at commands), since their pins may change before the server
+ * hears about it. Dormant clients are not woken up for the audit.
+ *
+ * A client that stops answering for `AUDIT_LOST_AFTER_SILENT` audits in a
+ * row, and one that answers again afterwards, is recorded in the event log.
+ * A lost client may have restarted and be requesting a connection again,
+ * so its following ticks listen for its handshake instead of reading it
+ * back. Once it is accepted, everything it kept in RAM is sent again (see
+ * `server_restore_client()`).
+ *
+ * Counters live in RAM.
+ */
+
+#include <stdio.h>
+
+#include "pico/stdlib.h"
+#include "pico/time.h"
+#include "hardware/sync.h"
+
+#include "server.h"
+#include "menu.h"
+#include "event_log.h"
+
+#define LOG_MODULE STATE
+#include "log.h"
+
+/**
+ * @brief Audit counters of one client.
+ */
+typedef struct{
+    uint32_t audits;            ///< Readbacks requested
+    uint32_t silent;            ///< Readbacks without a valid reply
+    uint32_t busy;              ///< Readbacks not compared because of local activity
+    uint32_t divergences;       ///< Readbacks that differed from the stored state
+    uint32_t repaired_gpios;    ///< GPIOs set again
+    uint32_t silent_run;        ///< Silent readbacks in a row
+    uint32_t reconnects;        ///< Handshakes accepted again after the client was lost
+    bool answered;              ///< Replied to a readback since boot
+}audit_client_t;
+
+static audit_client_t audit_clients[MAX_SERVER_CONNECTIONS];
+static uint32_t audit_ticks = 0;
+static uint32_t audit_deferred = 0;        ///< Ticks skipped for UART traffic
+static uint32_t audit_next_client = 0;     ///< Flash index tried first on the next tick, core1 only
+static spin_lock_t *audit_lock = NULL;
+static repeating_timer_t audit_timer;
+
+/**
+ * @brief Repeating timer callback: hands the audit tick over to core1.
+ *
+ * @param repeating_timer Unused.
+ * @return Always true to keep the timer running.
+ */
+static bool audit_tick_callback(repeating_timer_t *repeating_timer){
+    server_post_core1_message(AUDIT_TICK_WAKEUP_MESSAGE);
+    return true;
+}
+
+void server_audit_init(void){
+    audit_lock = spin_lock_instance(spin_lock_claim_unused(true));
+    add_repeating_timer_ms(-AUDIT_TICK_MS, audit_tick_callback, NULL, &audit_timer);
+}
+
+/**
+ * @brief Listens for the handshake of a lost client and restores it once it is accepted.
+ *
+ * @param flash_client_index Index of the client in the persistent state table.
+ * @param connection_index   Index of its active connection.
+ */
+static void audit_reconnect(uint32_t flash_client_index, uint8_t connection_index){
+    if (!server_reconnect_client(connection_index)){
+        return;
+    }
+    server_restore_client(connection_index);
+
+    uint32_t irq = spin_lock_blocking(audit_lock);
+    audit_client_t *client = &audit_clients[flash_client_index];
+    client->silent_run = 0;
+    client->reconnects++;
+    spin_unlock(audit_lock, irq);
+
+    event_log_write(EVENT_CLIENT_RECOVERED, (uint16_t)flash_client_index, 1);
+}
+
+/**
+ * @brief Reads back one client, compares it with the stored state and repairs the differences.
+ *
+ * A lost client is not read back; the tick listens for its handshake instead.
+ *
+ * @param flash_client_index Index of the client in the persistent state table.
+ * @param connection_index   Index of its active connection.
+ */
+static void audit_client(uint32_t flash_client_index, uint8_t connection_index){
+    server_uart_connection_t *connection = &active_uart_server_connections[connection_index];
+    uint32_t irq = spin_lock_blocking(audit_lock);
+    bool reconnect = audit_clients[flash_client_index].answered && audit_clients[flash_client_index].silent_run >= AUDIT_LOST_AFTER_SILENT;
+    spin_unlock(audit_lock, irq);
+    if (reconnect){
+        audit_reconnect(flash_client_index, connection_index);
+        return;
+    }
+
+    uint32_t audited_mask = 0;
+    uint32_t on_mask = 0;
+    bool busy = false;
+    bool replied = server_poll_audit(connection->pin_pair, connection->uart_instance, &audited_mask, &on_mask, &busy);
+    uint32_t polled_us = time_us_32();
+
+    // Read the state after the readback, so a command sent just before it is included.
+    server_persistent_state_t state;
+    load_server_state(&state);
+    const client_state_t *running_state = &state.clients[flash_client_index].running_client_state;
+    uint32_t expected_mask = client_state_gpio_mask(running_state);
+    uint32_t compared_mask = audited_mask & GPIO_DEVICE_MASK & ~client_state_pwm_mask(running_state);
+    uint32_t input_mask = 0;
+    uint32_t levels;
+    uint32_t changes;
+    uint64_t changed_at_us;
+    if (server_input_get(flash_client_index, &input_mask, &levels, &changes, &changed_at_us)){
+        compared_mask &= ~input_mask;
+    }
+    // Another command went out after the readback; compare on a later tick.
+    bool raced = uart_lock_idle_us() < time_us_32() - polled_us;
+    uint32_t diverged_mask = replied && !busy && !raced ? (expected_mask ^ on_mask) & compared_mask : 0;
+
+    irq = spin_lock_blocking(audit_lock);
+    audit_client_t *client = &audit_clients[flash_client_index];
+    client->audits++;
+    bool recovered = replied && client->answered && client->silent_run >= AUDIT_LOST_AFTER_SILENT;
+    bool lost = !replied && client->answered && client->silent_run + 1 == AUDIT_LOST_AFTER_SILENT;
+    if (!replied){
+        client->silent++;
+        client->silent_run++;
+    }else{
+        client->silent_run = 0;
+        client->answered = true;
+        if (busy){
+            client->busy++;
+        }
+    }
+    if (diverged_mask){
+        client->divergences++;
+        client->repaired_gpios += (uint32_t)__builtin_popcount(diverged_mask);
+    }
+    spin_unlock(audit_lock, irq);
+
+    if (lost){
+        event_log_write(EVENT_CLIENT_LOST, (uint16_t)flash_client_index, 0);
+    }else if (recovered){
+        event_log_write(EVENT_CLIENT_RECOVERED, (uint16_t)flash_client_index, 0);
+    }
+    if (diverged_mask){
+        server_send_output_delta(connection->pin_pair, connection->uart_instance, diverged_mask, expected_mask);
+        LOG_WARN(STATE_AUDIT_REPAIRED, flash_client_index, diverged_mask);
+    }
+}
+
+void server_audit_tick(void){
+    if (!audit_lock){
+        return;
+    }
+    bool deferred = stream_is_active() || uart_lock_idle_us() < AUDIT_IDLE_MS * MS_TO_US_MULTIPLIER;
+    uint32_t irq = spin_lock_blocking(audit_lock);
+    audit_ticks++;
+    if (deferred){
+        audit_deferred++;
+    }
+    spin_unlock(audit_lock, irq);
+    if (deferred){
+        return;
+    }
+
+    server_persistent_state_t state;
+    load_server_state(&state);
+    for (uint32_t attempt = 0; attempt < MAX_SERVER_CONNECTIONS; attempt++){
+        uint32_t flash_client_index = audit_next_client;
+        audit_next_client = (audit_next_client + 1) % MAX_SERVER_CONNECTIONS;
+
+        uint32_t connection_index = get_active_client_connection_index_from_flash_client_index(flash_client_index, state);
+        if (connection_index == INVALID_CLIENT_INDEX || active_uart_server_connections[connection_index].is_dormant){
+            continue;
+        }
+        audit_client(flash_client_index, (uint8_t)connection_index);
+        return;
+    }
+}
+
+void server_audit_print_machine(void){
+    if (!audit_lock){
+        return;
+    }
+    audit_client_t clients[MAX_SERVER_CONNECTIONS];
+    uint32_t irq = spin_lock_blocking(audit_lock);
+    uint32_t ticks = audit_ticks;
+    uint32_t deferred = audit_deferred;
+    for (uint32_t flash_client_index = 0; flash_client_index < MAX_SERVER_CONNECTIONS; flash_client_index++){
+        clients[flash_client_index] = audit_clients[flash_client_index];
+    }
+    spin_unlock(audit_lock, irq);
+
+    printf("AUDIT TICKS %lu %lu\n", (unsigned long)ticks, (unsigned long)deferred);
+    for (uint32_t flash_client_index = 0; flash_client_index < MAX_SERVER_CONNECTIONS; flash_client_index++){
+        const audit_client_t *client = &clients[flash_client_index];
+        if (!client->audits){
+            continue;
+        }
+        printf("AUDIT %lu %lu %lu %lu %lu %lu %lu\n",
+            (unsigned long)flash_client_index, (unsigned long)client->audits, (unsigned long)client->silent,
+            (unsigned long)client->busy, (unsigned long)client->divergences, (unsigned long)client->repaired_gpios,
+            (unsigned long)client->reconnects);
+    }
+}
@@ -7,6 +7,13 @@
  * - Waking up clients from dormant mode
  * - Sending predefined flag messages to specific or all clients
  * - Broadcasting client state information
+ * - Sending timed outputs and polling their completion reports
+ * - Reading client clocks and sending commands to apply at a set time
+ * - Staging on-masks for the latch line and polling the latch reports
+ * - Configuring client ADC sampling and collecting the binary sample blocks
+ * - Setting up and arming client logic captures and collecting the run-length chunks
+ * - Transferring client images in acknowledged frame windows
+ * - Reading back client outputs for the audit and sending repair deltas
  * - Coordinating dormant transitions
  *
  * All transmissions ensure UART reinitialization and GPIO reset for consistent operation.
@@ -19,37 +26,90 @@
 
 #include "hardware/uart.h"
 
+#include <string.h>
+
 #include "server.h"
 #include "functions.h"
+#include "statistics.h"
+#include "trace.h"
+#include "profiler.h"
 
-void send_uart_message_safe(uart_inst_t* uart, uart_pin_pair_t pins, const char* msg) {
+#define LOG_MODULE UART
+#include "log.h"
+
+static volatile uint32_t uart_lock_released_us = 0;   ///< time_us_32() at the last release
+
+uint32_t uart_lock_acquire(void){
+    server_clock_governor_boost();
     uint32_t irq = spin_lock_blocking(uart_lock);
+    while (stream_is_active()){
+        spin_unlock(uart_lock, irq);
+        tight_loop_contents();
+        irq = spin_lock_blocking(uart_lock);
+    }
+    TRACE_BEGIN(TRACE_SPAN_UART_LOCK, 0, 0);
+    return irq;
+}
+
+void uart_lock_release(uint32_t irq){
+    uart_lock_released_us = time_us_32();
+    TRACE_END(TRACE_SPAN_UART_LOCK, 0, 0);
+    spin_unlock(uart_lock, irq);
+}
+
+uint32_t uart_lock_idle_us(void){
+    return time_us_32() - uart_lock_released_us;
+}
+
+void send_uart_message_safe(uart_inst_t* uart, uart_pin_pair_t pins, const char* msg) {
+    uint32_t irq = uart_lock_acquire();
+    TRACE_BEGIN(TRACE_SPAN_UART_SEND, pins.tx, 0);
     uart_init_with_pins(uart, pins, DEFAULT_BAUDRATE);
     uart_puts(uart, msg);
     uart_tx_wait_blocking(uart);
     reset_gpio_pins(pins);
-    spin_unlock(uart_lock, irq);
+    TRACE_END(TRACE_SPAN_UART_SEND, pins.tx, strlen(msg));
+    uart_lock_release(irq);
+
+    statistics_record_traffic(pins, 1, strlen(msg));
+}
+
+void set_rx_pin_as_input_for_client(uart_pin_pair_t pin_pair, bool client_awake){
+    gpio_set_pulls(pin_pair.rx, client_awake, !client_awake);
+    gpio_set_dir(pin_pair.rx, GPIO_IN);
 }
 
 /**
- * @brief Wakes up a client device by toggling RX pin and sending a wake-up message.
+ * @brief Wakes up a client device by pulsing its RX pin and sending a wake-up message.
  *
  * This function:
- * - Drives the client's RX pin high for 5 ms, then low for 5 ms (to exit dormant mode)
+ * - Drives the client's RX pin high for 10 ms: the rising edge ends dormant
+ *   mode, and the level is held until the client's UART holds the line high
+ * - Releases the pin to an input pulled up, and clears any falling edge left
+ *   by the hand-over, so it is not taken for an input doorbell
  * - Sends a predefined wake-up flag message over UART to ensure proper synchronization
  *
  * @param pin_pair The TX/RX pin pair used for communication with the client.
  * @param uart     UART instance used to send the message.
  */
 static void wake_up_client(uart_pin_pair_t pin_pair, uart_inst_t* uart){
+    uint32_t start_us = time_us_32();
+    TRACE_BEGIN(TRACE_SPAN_WAKE_PULSE, pin_pair.rx, 0);
     gpio_put(pin_pair.rx, true);
-    sleep_ms(5);
-    gpio_put(pin_pair.rx, false);
-    sleep_ms(5);
+    gpio_set_dir(pin_pair.rx, GPIO_OUT);
+    sleep_ms(10);
+    set_rx_pin_as_input_for_client(pin_pair, true);
+    busy_wait_us(10);
+    gpio_acknowledge_irq(pin_pair.rx, GPIO_IRQ_EDGE_FALL);
+    TRACE_END(TRACE_SPAN_WAKE_PULSE, pin_pair.rx, 0);
 
     char msg[8];
     snprintf(msg, sizeof(msg), "[%d,%d]", WAKE_UP_FLAG_NUMBER, WAKE_UP_FLAG_NUMBER);
     send_uart_message_safe(uart, pin_pair, msg);
+
+    uint32_t elapsed_us = time_us_32() - start_us;
+    statistics_record_latency(STATISTICS_LATENCY_WAKE, elapsed_us);
+    LOG_TRACE(UART_WAKE_PULSE, pin_pair.rx, elapsed_us);
 }
 
 void send_wakeup_if_dormant(uint32_t flash_client_index, server_persistent_state_t *const state, uart_pin_pair_t pin_pair, uart_inst_t *const uart){
@@ -60,11 +120,14 @@ void send_wakeup_if_dormant(uint32_t flash_client_index, server_persistent_state
 }
 
 void send_dormant_flag_to_client(uint8_t client_index){
+    time_sync_invalidate(client_index);
+
     char msg[8];
     snprintf(msg, sizeof(msg), "[%d,%d]", DORMANT_FLAG_NUMBER, DORMANT_FLAG_NUMBER);
     send_uart_message_safe(active_uart_server_connections[client_index].uart_instance,
         active_uart_server_connections[client_index].pin_pair,
         msg);
+    set_rx_pin_as_input_for_client(active_uart_server_connections[client_index].pin_pair, false);
 }
 
 /**
@@ -134,18 +197,668 @@ void send_dormant_to_standby_clients(void){
 }
 
 void server_send_client_state(uart_pin_pair_t pin_pair, uart_inst_t* uart, const client_state_t* state){
+    PROFILE_ENTER(PROFILE_SERVER_SEND_CLIENT_STATE);
     wake_up_client(pin_pair, uart);
-    uint32_t irq = spin_lock_blocking(uart_lock);
+    server_pwm_send_state(pin_pair, uart, NULL, state);
+    uint32_t irq = uart_lock_acquire();
+    TRACE_BEGIN(TRACE_SPAN_UART_SEND, pin_pair.tx, 0);
     uart_init_with_pins(uart, pin_pair, DEFAULT_BAUDRATE);
 
+    uint32_t bytes_sent = 0;
     for (uint8_t i = 0; i < MAX_NUMBER_OF_GPIOS; i++) {
         char msg[8];
         snprintf(msg, sizeof(msg), "[%d,%d]", state->devices[i].gpio_number, state->devices[i].is_on);
         uart_puts(uart, msg);
+        bytes_sent += strlen(msg);
         uart_tx_wait_blocking(uart);
         sleep_us(500);
     }
 
     reset_gpio_pins(pin_pair);
-    spin_unlock(uart_lock, irq);
-}
\ No newline at end of file
+    TRACE_END(TRACE_SPAN_UART_SEND, pin_pair.tx, MAX_NUMBER_OF_GPIOS);
+    uart_lock_release(irq);
+
+    statistics_record_traffic(pin_pair, MAX_NUMBER_OF_GPIOS, bytes_sent);
+    LOG_DEBUG(UART_STATE_SENT, pin_pair.tx, bytes_sent);
+    PROFILE_EXIT(PROFILE_SERVER_SEND_CLIENT_STATE);
+}
+
+void server_send_preset(uart_pin_pair_t pin_pair, uart_inst_t* uart, uint8_t preset_index, const client_preset_t *preset){
+    char msg[CLIENT_COMMAND_BUFFER_SIZE];
+    snprintf(msg, sizeof(msg), "[%d,%u,%lu,%lu]",
+        PRESET_STORE_FLAG_NUMBER,
+        preset_index,
+        (unsigned long)preset->version,
+        (unsigned long)preset->gpio_mask);
+    send_uart_message_safe(uart, pin_pair, msg);
+}
+
+void server_send_preset_recall(uart_pin_pair_t pin_pair, uart_inst_t* uart, uint8_t preset_index, const client_preset_t *stale_preset){
+    wake_up_client(pin_pair, uart);
+    if (stale_preset){
+        server_send_preset(pin_pair, uart, preset_index, stale_preset);
+    }
+
+    char msg[CLIENT_COMMAND_BUFFER_SIZE];
+    snprintf(msg, sizeof(msg), "[%d,%u]", PRESET_RECALL_FLAG_NUMBER, preset_index);
+    send_uart_message_safe(uart, pin_pair, msg);
+}
+
+void server_send_timed_output(uart_pin_pair_t pin_pair, uart_inst_t* uart, uint8_t gpio_number, uint32_t on_ms, uint32_t off_ms, uint32_t pulse_count){
+    char msg[CLIENT_COMMAND_BUFFER_SIZE];
+    if (pulse_count == 1){
+        snprintf(msg, sizeof(msg), "[%d,%u,%lu]",
+            TIMED_ON_FLAG_NUMBER,
+            gpio_number,
+            (unsigned long)on_ms);
+    }else{
+        snprintf(msg, sizeof(msg), "[%d,%u,%lu,%lu,%lu]",
+            PULSE_TRAIN_FLAG_NUMBER,
+            gpio_number,
+            (unsigned long)on_ms,
+            (unsigned long)off_ms,
+            (unsigned long)pulse_count);
+    }
+    send_uart_message_safe(uart, pin_pair, msg);
+}
+
+bool server_poll_output_report(uart_pin_pair_t pin_pair, uart_inst_t* uart, uint32_t *completed_mask, uint32_t *gpio_on_mask){
+    wake_up_client(pin_pair, uart);
+
+    char msg[8];
+    snprintf(msg, sizeof(msg), "[%d,%d]", OUTPUT_REPORT_FLAG_NUMBER, OUTPUT_REPORT_FLAG_NUMBER);
+    char reply[CLIENT_COMMAND_BUFFER_SIZE] = {0};
+
+    uint32_t irq = uart_lock_acquire();
+    TRACE_BEGIN(TRACE_SPAN_UART_SEND, pin_pair.tx, 0);
+    uart_init_with_pins(uart, pin_pair, DEFAULT_BAUDRATE);
+    uart_puts(uart, msg);
+    uart_tx_wait_blocking(uart);
+    get_uart_buffer(uart, reply, sizeof(reply), OUTPUT_REPORT_TIMEOUT_MS);
+    reset_gpio_pins(pin_pair);
+    TRACE_END(TRACE_SPAN_UART_SEND, pin_pair.tx, strlen(msg));
+    uart_lock_release(irq);
+
+    statistics_record_traffic(pin_pair, 1, strlen(msg));
+
+    uint32_t numbers[3] = {0};
+    if (get_number_list(numbers, 3, reply) < 3 || numbers[0] != OUTPUT_REPORT_FLAG_NUMBER){
+        return false;
+    }
+    *completed_mask = numbers[1];
+    *gpio_on_mask = numbers[2];
+    return true;
+}
+
+bool server_time_sync_exchange(uart_pin_pair_t pin_pair, uart_inst_t* uart, int64_t *offset_us, uint64_t *synced_at_us){
+    char msg[8];
+    snprintf(msg, sizeof(msg), "[%d,%d]", TIME_SYNC_FLAG_NUMBER, TIME_SYNC_FLAG_NUMBER);
+    uint8_t replies = 0;
+
+    uint32_t irq = uart_lock_acquire();
+    TRACE_BEGIN(TRACE_SPAN_UART_SEND, pin_pair.tx, 0);
+    uart_init_with_pins(uart, pin_pair, DEFAULT_BAUDRATE);
+    for (uint8_t sample = 0; sample < TIME_SYNC_SAMPLES; sample++){
+        char reply[CLIENT_COMMAND_BUFFER_SIZE] = {0};
+        uart_puts(uart, msg);
+        uart_tx_wait_blocking(uart);
+        uint64_t sent_us = time_us_64();
+        get_uart_buffer(uart, reply, sizeof(reply), TIME_SYNC_TIMEOUT_MS);
+
+        uint32_t numbers[3] = {0};
+        if (get_number_list(numbers, 3, reply) < 3 || numbers[0] != TIME_SYNC_FLAG_NUMBER){
+            continue;
+        }
+        int64_t offset = (int64_t)((((uint64_t)numbers[1] << 32) | numbers[2]) - sent_us);
+        if (!replies || offset < *offset_us){
+            *offset_us = offset;
+            *synced_at_us = sent_us;
+        }
+        replies++;
+    }
+    reset_gpio_pins(pin_pair);
+    TRACE_END(TRACE_SPAN_UART_SEND, pin_pair.tx, TIME_SYNC_SAMPLES * strlen(msg));
+    uart_lock_release(irq);
+
+    statistics_record_traffic(pin_pair, TIME_SYNC_SAMPLES, TIME_SYNC_SAMPLES * strlen(msg));
+    return replies != 0;
+}
+
+void server_send_apply_at(uart_pin_pair_t pin_pair, uart_inst_t* uart, uint64_t client_time_us, uint32_t command, uint32_t argument){
+    char msg[CLIENT_COMMAND_BUFFER_SIZE];
+    snprintf(msg, sizeof(msg), "[%d,%lu,%lu,%lu]",
+        APPLY_AT_FLAG_NUMBER,
+        (unsigned long)(client_time_us & 0xFFFFFFFFu),
+        (unsigned long)command,
+        (unsigned long)argument);
+    send_uart_message_safe(uart, pin_pair, msg);
+}
+
+void server_send_latch_stage(uart_pin_pair_t pin_pair, uart_inst_t* uart, uint32_t gpio_mask, uint32_t sequence){
+    char msg[CLIENT_COMMAND_BUFFER_SIZE];
+    snprintf(msg, sizeof(msg), "[%d,%lu,%lu]",
+        LATCH_STAGE_FLAG_NUMBER,
+        (unsigned long)gpio_mask,
+        (unsigned long)sequence);
+    send_uart_message_safe(uart, pin_pair, msg);
+}
+
+bool server_poll_latch_report(uart_pin_pair_t pin_pair, uart_inst_t* uart, uint32_t *applied_sequence, uint32_t *missed_edges){
+    char msg[8];
+    snprintf(msg, sizeof(msg), "[%d,%d]", LATCH_REPORT_FLAG_NUMBER, LATCH_REPORT_FLAG_NUMBER);
+    char reply[CLIENT_COMMAND_BUFFER_SIZE] = {0};
+
+    uint32_t irq = uart_lock_acquire();
+    TRACE_BEGIN(TRACE_SPAN_UART_SEND, pin_pair.tx, 0);
+    uart_init_with_pins(uart, pin_pair, DEFAULT_BAUDRATE);
+    uart_puts(uart, msg);
+    uart_tx_wait_blocking(uart);
+    get_uart_buffer(uart, reply, sizeof(reply), LATCH_REPORT_TIMEOUT_MS);
+    reset_gpio_pins(pin_pair);
+    TRACE_END(TRACE_SPAN_UART_SEND, pin_pair.tx, strlen(msg));
+    uart_lock_release(irq);
+
+    statistics_record_traffic(pin_pair, 1, strlen(msg));
+
+    uint32_t numbers[3] = {0};
+    if (get_number_list(numbers, 3, reply) < 3 || numbers[0] != LATCH_REPORT_FLAG_NUMBER){
+        return false;
+    }
+    *applied_sequence = numbers[1];
+    *missed_edges = numbers[2];
+    return true;
+}
+
+void server_send_sequence_define(uart_pin_pair_t pin_pair, uart_inst_t* uart, uint32_t step_count, uint32_t loop_count){
+    char msg[CLIENT_COMMAND_BUFFER_SIZE];
+    snprintf(msg, sizeof(msg), "[%d,%lu,%lu]",
+        SEQUENCE_DEFINE_FLAG_NUMBER,
+        (unsigned long)step_count,
+        (unsigned long)loop_count);
+    send_uart_message_safe(uart, pin_pair, msg);
+}
+
+void server_send_sequence_step(uart_pin_pair_t pin_pair, uart_inst_t* uart, uint32_t step, uint32_t gpio_mask, uint32_t duration_us){
+    char msg[CLIENT_COMMAND_BUFFER_SIZE];
+    snprintf(msg, sizeof(msg), "[%d,%lu,%lu,%lu]",
+        SEQUENCE_STEP_FLAG_NUMBER,
+        (unsigned long)step,
+        (unsigned long)gpio_mask,
+        (unsigned long)duration_us);
+    send_uart_message_safe(uart, pin_pair, msg);
+}
+
+void server_send_sequence_control(uart_pin_pair_t pin_pair, uart_inst_t* uart, sequence_control_t control, uint32_t step){
+    char msg[CLIENT_COMMAND_BUFFER_SIZE];
+    snprintf(msg, sizeof(msg), "[%d,%u,%lu]",
+        SEQUENCE_CONTROL_FLAG_NUMBER,
+        (unsigned)control,
+        (unsigned long)step);
+    send_uart_message_safe(uart, pin_pair, msg);
+}
+
+bool server_poll_sequence_report(uart_pin_pair_t pin_pair, uart_inst_t* uart, bool *playing, uint32_t *step, uint32_t *loops_done){
+    char msg[8];
+    snprintf(msg, sizeof(msg), "[%d,%d]", SEQUENCE_REPORT_FLAG_NUMBER, SEQUENCE_REPORT_FLAG_NUMBER);
+    char reply[CLIENT_COMMAND_BUFFER_SIZE] = {0};
+
+    uint32_t irq = uart_lock_acquire();
+    TRACE_BEGIN(TRACE_SPAN_UART_SEND, pin_pair.tx, 0);
+    uart_init_with_pins(uart, pin_pair, DEFAULT_BAUDRATE);
+    uart_puts(uart, msg);
+    uart_tx_wait_blocking(uart);
+    get_uart_buffer(uart, reply, sizeof(reply), OUTPUT_REPORT_TIMEOUT_MS);
+    reset_gpio_pins(pin_pair);
+    TRACE_END(TRACE_SPAN_UART_SEND, pin_pair.tx, strlen(msg));
+    uart_lock_release(irq);
+
+    statistics_record_traffic(pin_pair, 1, strlen(msg));
+
+    uint32_t numbers[4] = {0};
+    if (get_number_list(numbers, 4, reply) < 4 || numbers[0] != SEQUENCE_REPORT_FLAG_NUMBER){
+        return false;
+    }
+    *playing = numbers[1] != 0;
+    *step = numbers[2];
+    *loops_done = numbers[3];
+    return true;
+}
+
+void server_send_input_config(uart_pin_pair_t pin_pair, uart_inst_t* uart, uint8_t gpio_number, input_mode_t mode, uint32_t debounce_ms){
+    char msg[CLIENT_COMMAND_BUFFER_SIZE];
+    snprintf(msg, sizeof(msg), "[%d,%u,%u,%lu]",
+        INPUT_CONFIG_FLAG_NUMBER,
+        gpio_number,
+        (unsigned)mode,
+        (unsigned long)debounce_ms);
+    send_uart_message_safe(uart, pin_pair, msg);
+}
+
+bool server_poll_input_report(uart_pin_pair_t pin_pair, uart_inst_t* uart, uint32_t *levels, uint32_t *rise_mask, uint32_t *fall_mask, uint32_t *age_us, uint32_t *changes, uint32_t *fired_rules, uint32_t *adc_blocks, bool *logic_ready){
+    char msg[8];
+    snprintf(msg, sizeof(msg), "[%d,%d]", INPUT_REPORT_FLAG_NUMBER, INPUT_REPORT_FLAG_NUMBER);
+    char reply[INPUT_REPORT_BUFFER_SIZE] = {0};
+
+    uint32_t irq = uart_lock_acquire();
+    TRACE_BEGIN(TRACE_SPAN_UART_SEND, pin_pair.tx, 0);
+    uart_init_with_pins(uart, pin_pair, DEFAULT_BAUDRATE);
+    uart_puts(uart, msg);
+    uart_tx_wait_blocking(uart);
+    get_uart_buffer(uart, reply, sizeof(reply), INPUT_REPORT_TIMEOUT_MS);
+    reset_gpio_pins(pin_pair);
+    TRACE_END(TRACE_SPAN_UART_SEND, pin_pair.tx, strlen(msg));
+    uart_lock_release(irq);
+
+    statistics_record_traffic(pin_pair, 1, strlen(msg));
+
+    uint32_t numbers[9] = {0};
+    if (get_number_list(numbers, 9, reply) < 9 || numbers[0] != INPUT_REPORT_FLAG_NUMBER){
+        return false;
+    }
+    *levels = numbers[1];
+    *rise_mask = numbers[2];
+    *fall_mask = numbers[3];
+    *age_us = numbers[4];
+    *changes = numbers[5];
+    *fired_rules = numbers[6];
+    *adc_blocks = numbers[7];
+    *logic_ready = numbers[8] != 0;
+    return true;
+}
+
+void server_send_rule(uart_pin_pair_t pin_pair, uart_inst_t* uart, uint32_t rule_index, uint8_t trigger_gpio, uint32_t edges, uint32_t gpio_mask, uint32_t on_ms){
+    char msg[CLIENT_COMMAND_BUFFER_SIZE];
+    snprintf(msg, sizeof(msg), "[%d,%lu,%u,%lu,%lu,%lu]",
+        RULE_SET_FLAG_NUMBER,
+        (unsigned long)rule_index,
+        trigger_gpio,
+        (unsigned long)edges,
+        (unsigned long)gpio_mask,
+        (unsigned long)on_ms);
+    send_uart_message_safe(uart, pin_pair, msg);
+}
+
+void server_send_pwm_mode(uart_pin_pair_t pin_pair, uart_inst_t* uart, uint32_t pwm_mask){
+    char msg[CLIENT_COMMAND_BUFFER_SIZE];
+    snprintf(msg, sizeof(msg), "[%d,%lu]", PWM_MODE_FLAG_NUMBER, (unsigned long)pwm_mask);
+    send_uart_message_safe(uart, pin_pair, msg);
+}
+
+void server_send_pwm_duties(uart_pin_pair_t pin_pair, uart_inst_t* uart, uint32_t bits, uint32_t first_channel, uint32_t packed_low, uint32_t packed_high){
+    char msg[CLIENT_COMMAND_BUFFER_SIZE];
+    snprintf(msg, sizeof(msg), "[%d,%lu,%lu,%lu]",
+        bits == 8 ? PWM_DUTY8_FLAG_NUMBER : PWM_DUTY16_FLAG_NUMBER,
+        (unsigned long)first_channel,
+        (unsigned long)packed_low,
+        (unsigned long)packed_high);
+    send_uart_message_safe(uart, pin_pair, msg);
+}
+
+void server_send_adc_config(uart_pin_pair_t pin_pair, uart_inst_t* uart, uint32_t channel_mask, uint32_t rate_hz, uint32_t decimation){
+    char msg[CLIENT_COMMAND_BUFFER_SIZE];
+    snprintf(msg, sizeof(msg), "[%d,%lu,%lu,%lu]",
+        ADC_CONFIG_FLAG_NUMBER,
+        (unsigned long)channel_mask,
+        (unsigned long)rate_hz,
+        (unsigned long)decimation);
+    send_uart_message_safe(uart, pin_pair, msg);
+}
+
+/**
+ * @brief Reads and unpacks one binary ADC block.
+ *
+ * See adc.c on the client for the layout.
+ *
+ * @param uart  UART instance, initialised and locked.
+ * @param block Filled with the block.
+ * @return 1 for a valid block, 0 for a checksum error, -1 if the stream is lost.
+ */
+static int adc_block_receive(uart_inst_t* uart, adc_block_t *block){
+    uint8_t buffer[ADC_BLOCK_MAX_BYTES];
+    if (get_uart_bytes(uart, buffer, 6, ADC_BLOCK_TIMEOUT_MS) < 6 || buffer[5] > ADC_BLOCK_SAMPLES){
+        return -1;
+    }
+    uint8_t sample_count = buffer[5];
+    uint32_t packed_length = ((uint32_t)sample_count * 3 + 1) / 2;
+    if (get_uart_bytes(uart, buffer + 6, packed_length + 2, ADC_BLOCK_TIMEOUT_MS) < packed_length + 2){
+        return -1;
+    }
+    uint32_t length = 6 + packed_length;
+    if (fletcher16(buffer, length) != (uint16_t)(buffer[length] | (buffer[length + 1] << 8))){
+        return 0;
+    }
+
+    block->sequence = (uint32_t)buffer[0] | ((uint32_t)buffer[1] << 8) | ((uint32_t)buffer[2] << 16) | ((uint32_t)buffer[3] << 24);
+    block->channel_mask = buffer[4];
+    block->sample_count = sample_count;
+    const uint8_t *packed = buffer + 6;
+    for (uint8_t index = 0; index < sample_count; index += 2){
+        block->samples[index] = (uint16_t)(packed[0] | ((packed[1] & 0x0F) << 8));
+        if (index + 1 < sample_count){
+            block->samples[index + 1] = (uint16_t)((packed[1] >> 4) | (packed[2] << 4));
+            packed += 3;
+        }
+    }
+    return 1;
+}
+
+uint32_t server_collect_adc_blocks(uart_pin_pair_t pin_pair, uart_inst_t* uart, uint32_t max_blocks, adc_block_t *blocks, uint32_t *dropped, uint32_t *bad_blocks){
+    char msg[CLIENT_COMMAND_BUFFER_SIZE];
+    snprintf(msg, sizeof(msg), "[%d,%lu]", ADC_COLLECT_FLAG_NUMBER, (unsigned long)max_blocks);
+    char reply[CLIENT_COMMAND_BUFFER_SIZE] = {0};
+    uint32_t received = 0;
+    *dropped = 0;
+    *bad_blocks = 0;
+
+    uint32_t irq = uart_lock_acquire();
+    TRACE_BEGIN(TRACE_SPAN_UART_SEND, pin_pair.tx, 0);
+    uart_init_with_pins(uart, pin_pair, DEFAULT_BAUDRATE);
+    uart_puts(uart, msg);
+    uart_tx_wait_blocking(uart);
+    get_uart_buffer(uart, reply, sizeof(reply), OUTPUT_REPORT_TIMEOUT_MS);
+
+    uint32_t numbers[3] = {0};
+    if (get_number_list(numbers, 3, reply) == 3 && numbers[0] == ADC_COLLECT_FLAG_NUMBER && numbers[1] <= max_blocks){
+        *dropped = numbers[2];
+        for (uint32_t index = 0; index < numbers[1]; index++){
+            int result = adc_block_receive(uart, &blocks[received]);
+            if (result < 0){
+                *bad_blocks += numbers[1] - index;
+                break;
+            }
+            if (result == 0){
+                (*bad_blocks)++;
+            }else{
+                received++;
+            }
+        }
+    }
+    reset_gpio_pins(pin_pair);
+    TRACE_END(TRACE_SPAN_UART_SEND, pin_pair.tx, strlen(msg));
+    uart_lock_release(irq);
+
+    statistics_record_traffic(pin_pair, 1, strlen(msg));
+    return received;
+}
+
+void server_send_logic_config(uart_pin_pair_t pin_pair, uart_inst_t* uart, uint8_t first_gpio, uint8_t pin_count, uint32_t rate_hz){
+    char msg[CLIENT_COMMAND_BUFFER_SIZE];
+    snprintf(msg, sizeof(msg), "[%d,%u,%u,%lu]",
+        LOGIC_CONFIG_FLAG_NUMBER,
+        first_gpio,
+        pin_count,
+        (unsigned long)rate_hz);
+    send_uart_message_safe(uart, pin_pair, msg);
+}
+
+void server_send_logic_arm(uart_pin_pair_t pin_pair, uart_inst_t* uart, uint32_t trigger_mask, uint32_t trigger_value){
+    char msg[CLIENT_COMMAND_BUFFER_SIZE];
+    snprintf(msg, sizeof(msg), "[%d,%lu,%lu]",
+        LOGIC_ARM_FLAG_NUMBER,
+        (unsigned long)trigger_mask,
+        (unsigned long)trigger_value);
+    send_uart_message_safe(uart, pin_pair, msg);
+}
+
+/**
+ * @brief Reads and decodes one binary logic capture chunk.
+ *
+ * See logic_capture.c on the client for the layout.
+ *
+ * @param uart        UART instance, initialised and locked.
+ * @param value_bytes Bytes of a run value, (pin_count + 7) / 8.
+ * @param sequence    Set to the chunk number.
+ * @param runs        Filled with up to `LOGIC_CHUNK_RUNS` runs.
+ * @param run_count   Set to the number of runs.
+ * @param last        Set when the chunk ends the capture.
+ * @return 1 for a valid chunk, 0 for a checksum error, -1 if the stream is lost.
+ */
+static int logic_chunk_receive(uart_inst_t* uart, uint8_t value_bytes, uint32_t *sequence, logic_run_t *runs, uint32_t *run_count, bool *last){
+    uint8_t buffer[LOGIC_CHUNK_MAX_BYTES];
+    if (get_uart_bytes(uart, buffer, 4, LOGIC_CHUNK_TIMEOUT_MS) < 4 || buffer[2] > LOGIC_CHUNK_RUNS){
+        return -1;
+    }
+    uint32_t length = 4;
+    for (uint8_t run = 0; run < buffer[2]; run++){
+        if (get_uart_bytes(uart, buffer + length, value_bytes, LOGIC_CHUNK_TIMEOUT_MS) < value_bytes){
+            return -1;
+        }
+        uint32_t value = 0;
+        for (uint8_t byte = 0; byte < value_bytes; byte++){
+            value |= (uint32_t)buffer[length++] << (byte * 8);
+        }
+        uint32_t run_length = 0;
+        for (uint8_t shift = 0; ; shift += 7){
+            if (shift > 28 || get_uart_bytes(uart, buffer + length, 1, LOGIC_CHUNK_TIMEOUT_MS) < 1){
+                return -1;
+            }
+            uint8_t byte = buffer[length++];
+            run_length |= (uint32_t)(byte & 0x7F) << shift;
+            if (!(byte & 0x80)){
+                break;
+            }
+        }
+        runs[run].value = value;
+        runs[run].length = run_length;
+    }
+    if (get_uart_bytes(uart, buffer + length, 2, LOGIC_CHUNK_TIMEOUT_MS) < 2){
+        return -1;
+    }
+    if (fletcher16(buffer, length) != (uint16_t)(buffer[length] | (buffer[length + 1] << 8))){
+        return 0;
+    }
+    *sequence = (uint32_t)buffer[0] | ((uint32_t)buffer[1] << 8);
+    *run_count = buffer[2];
+    *last = (buffer[3] & 0x01) != 0;
+    return 1;
+}
+
+uint32_t server_collect_logic_chunks(uart_pin_pair_t pin_pair, uart_inst_t* uart, uint32_t max_chunks, uint32_t next_sequence, uint8_t pin_count,
+    logic_run_t *runs, uint32_t *run_count, uint32_t *samples, uint32_t *bad_chunks){
+    char msg[CLIENT_COMMAND_BUFFER_SIZE];
+    snprintf(msg, sizeof(msg), "[%d,%lu,%lu]", LOGIC_COLLECT_FLAG_NUMBER, (unsigned long)max_chunks, (unsigned long)next_sequence);
+    char reply[CLIENT_COMMAND_BUFFER_SIZE] = {0};
+    uint8_t value_bytes = (uint8_t)((pin_count + 7) / 8);
+    uint32_t accepted = 0;
+    *run_count = 0;
+    *samples = 0;
+    *bad_chunks = 0;
+
+    uint32_t irq = uart_lock_acquire();
+    TRACE_BEGIN(TRACE_SPAN_UART_SEND, pin_pair.tx, 0);
+    uart_init_with_pins(uart, pin_pair, DEFAULT_BAUDRATE);
+    uart_puts(uart, msg);
+    uart_tx_wait_blocking(uart);
+    get_uart_buffer(uart, reply, sizeof(reply), OUTPUT_REPORT_TIMEOUT_MS);
+
+    uint32_t numbers[3] = {0};
+    if (get_number_list(numbers, 3, reply) == 3 && numbers[0] == LOGIC_COLLECT_FLAG_NUMBER && numbers[1] <= max_chunks){
+        *samples = numbers[2];
+        bool in_order = true;
+        for (uint32_t index = 0; index < numbers[1]; index++){
+            uint32_t sequence = 0;
+            uint32_t chunk_runs = 0;
+            bool last = false;
+            int result = logic_chunk_receive(uart, value_bytes, &sequence, runs + *run_count, &chunk_runs, &last);
+            if (result < 0){
+                *bad_chunks += numbers[1] - index;
+                break;
+            }
+            if (result == 0){
+                (*bad_chunks)++;
+            }
+            // Later chunks are only kept while none is missing before them.
+            in_order &= result == 1 && sequence == (next_sequence + accepted) % 0x10000;
+            if (in_order){
+                *run_count += chunk_runs;
+                accepted++;
+            }
+        }
+    }
+    reset_gpio_pins(pin_pair);
+    TRACE_END(TRACE_SPAN_UART_SEND, pin_pair.tx, strlen(msg));
+    uart_lock_release(irq);
+
+    statistics_record_traffic(pin_pair, 1, strlen(msg));
+    return accepted;
+}
+
+/**
+ * @brief Sends a firmware update frame at the default baud rate and reads the reply.
+ *
+ * @param pin_pair   UART TX/RX pin pair to use.
+ * @param uart       UART instance.
+ * @param msg        Frame to send.
+ * @param numbers    Filled with the numbers of the reply, room for 2.
+ * @param timeout_ms Time to wait for the reply.
+ * @return true if the reply has the flag of the frame sent and a value.
+ */
+static bool firmware_exchange(uart_pin_pair_t pin_pair, uart_inst_t* uart, const char *msg, uint32_t *numbers, uint32_t timeout_ms){
+    char reply[CLIENT_COMMAND_BUFFER_SIZE] = {0};
+    uint32_t flag = 0;
+    get_number_list(&flag, 1, msg);
+
+    uint32_t irq = uart_lock_acquire();
+    TRACE_BEGIN(TRACE_SPAN_UART_SEND, pin_pair.tx, 0);
+    uart_init_with_pins(uart, pin_pair, DEFAULT_BAUDRATE);
+    uart_puts(uart, msg);
+    uart_tx_wait_blocking(uart);
+    get_uart_buffer(uart, reply, sizeof(reply), timeout_ms);
+    reset_gpio_pins(pin_pair);
+    TRACE_END(TRACE_SPAN_UART_SEND, pin_pair.tx, strlen(msg));
+    uart_lock_release(irq);
+
+    statistics_record_traffic(pin_pair, 1, strlen(msg));
+    return get_number_list(numbers, 2, reply) == 2 && numbers[0] == flag;
+}
+
+uint32_t server_send_firmware_begin(uart_pin_pair_t pin_pair, uart_inst_t* uart, uint32_t size, uint32_t crc32){
+    char msg[CLIENT_COMMAND_BUFFER_SIZE];
+    snprintf(msg, sizeof(msg), "[%d,%lu,%lu]", FIRMWARE_BEGIN_FLAG_NUMBER, (unsigned long)size, (unsigned long)crc32);
+    uint32_t numbers[2] = {0};
+    return firmware_exchange(pin_pair, uart, msg, numbers, FIRMWARE_REPLY_TIMEOUT_MS) ? numbers[1] : 0;
+}
+
+bool server_send_firmware_baud(uart_pin_pair_t pin_pair, uart_inst_t* uart, uint32_t baudrate){
+    char msg[CLIENT_COMMAND_BUFFER_SIZE];
+    snprintf(msg, sizeof(msg), "[%d,%lu]", FIRMWARE_BAUD_FLAG_NUMBER, (unsigned long)baudrate);
+    uint32_t numbers[2] = {0};
+    return firmware_exchange(pin_pair, uart, msg, numbers, FIRMWARE_REPLY_TIMEOUT_MS) && numbers[1] == baudrate;
+}
+
+bool server_send_firmware_commit(uart_pin_pair_t pin_pair, uart_inst_t* uart, uint32_t crc32){
+    char msg[CLIENT_COMMAND_BUFFER_SIZE];
+    snprintf(msg, sizeof(msg), "[%d,%lu]", FIRMWARE_COMMIT_FLAG_NUMBER, (unsigned long)crc32);
+    uint32_t numbers[2] = {0};
+    return firmware_exchange(pin_pair, uart, msg, numbers, FIRMWARE_COMMIT_TIMEOUT_MS) && numbers[1] == 1;
+}
+
+/**
+ * @brief Writes one image frame: sync byte, sector index, sector and CRC-32.
+ *
+ * @param uart       UART instance, at the transfer baud rate.
+ * @param image      Image.
+ * @param image_size Image size in bytes.
+ * @param sector     Sector sent.
+ */
+static void firmware_write_frame(uart_inst_t* uart, const uint8_t *image, uint32_t image_size, uint32_t sector){
+    static const uint8_t padding = 0xFF;
+    uint8_t header[5] = {FIRMWARE_FRAME_SYNC, (uint8_t)sector, (uint8_t)(sector >> 8), (uint8_t)(sector >> 16), (uint8_t)(sector >> 24)};
+    uint32_t offset = sector * FIRMWARE_SECTOR_SIZE;
+    uint32_t length = image_size - offset < FIRMWARE_SECTOR_SIZE ? image_size - offset : FIRMWARE_SECTOR_SIZE;
+
+    uint32_t crc = crc32_update(0, &header[1], 4);
+    crc = crc32_update(crc, image + offset, length);
+    for (uint32_t index = length; index < FIRMWARE_SECTOR_SIZE; index++){
+        crc = crc32_update(crc, &padding, 1);
+    }
+    uint8_t trailer[4] = {(uint8_t)crc, (uint8_t)(crc >> 8), (uint8_t)(crc >> 16), (uint8_t)(crc >> 24)};
+
+    uart_write_blocking(uart, header, sizeof(header));
+    uart_write_blocking(uart, image + offset, length);
+    for (uint32_t index = length; index < FIRMWARE_SECTOR_SIZE; index++){
+        uart_putc_raw(uart, (char)padding);
+    }
+    uart_write_blocking(uart, trailer, sizeof(trailer));
+}
+
+uint32_t server_send_firmware_window(uart_pin_pair_t pin_pair, uart_inst_t* uart, uint32_t baudrate, const uint8_t *image, uint32_t image_size,
+    uint32_t first_sector, uint32_t count){
+    uint32_t acked = 0;
+
+    uint32_t irq = uart_lock_acquire();
+    TRACE_BEGIN(TRACE_SPAN_UART_SEND, pin_pair.tx, 0);
+    uart_init_with_pins(uart, pin_pair, baudrate);
+    // Acks of the first frames wait in the RX FIFO while the later ones are sent.
+    for (uint32_t index = 0; index < count; index++){
+        firmware_write_frame(uart, image, image_size, first_sector + index);
+    }
+    uart_tx_wait_blocking(uart);
+    while (acked < count){
+        char reply[CLIENT_COMMAND_BUFFER_SIZE] = {0};
+        get_uart_buffer(uart, reply, sizeof(reply), FIRMWARE_ACK_TIMEOUT_MS);
+        uint32_t numbers[3] = {0};
+        if (get_number_list(numbers, 3, reply) != 3 || numbers[0] != FIRMWARE_ACK_FLAG_NUMBER ||
+            numbers[1] != first_sector + acked || numbers[2] != 1){
+            break;
+        }
+        acked++;
+    }
+    reset_gpio_pins(pin_pair);
+    TRACE_END(TRACE_SPAN_UART_SEND, pin_pair.tx, count * FIRMWARE_FRAME_BYTES);
+    uart_lock_release(irq);
+
+    statistics_record_traffic(pin_pair, count, count * FIRMWARE_FRAME_BYTES);
+    return acked;
+}
+
+bool server_poll_audit(uart_pin_pair_t pin_pair, uart_inst_t* uart, uint32_t *audited_mask, uint32_t *on_mask, bool *busy){
+    char msg[8];
+    snprintf(msg, sizeof(msg), "[%d,%d]", AUDIT_FLAG_NUMBER, AUDIT_FLAG_NUMBER);
+    char reply[CLIENT_COMMAND_BUFFER_SIZE] = {0};
+
+    uint32_t irq = uart_lock_acquire();
+    TRACE_BEGIN(TRACE_SPAN_UART_SEND, pin_pair.tx, 0);
+    uart_init_with_pins(uart, pin_pair, DEFAULT_BAUDRATE);
+    uart_puts(uart, msg);
+    uart_tx_wait_blocking(uart);
+    get_uart_buffer(uart, reply, sizeof(reply), AUDIT_REPLY_TIMEOUT_MS);
+    reset_gpio_pins(pin_pair);
+    TRACE_END(TRACE_SPAN_UART_SEND, pin_pair.tx, strlen(msg));
+    uart_lock_release(irq);
+
+    statistics_record_traffic(pin_pair, 1, strlen(msg));
+
+    uint32_t numbers[4] = {0};
+    if (get_number_list(numbers, 4, reply) < 4 || numbers[0] != AUDIT_FLAG_NUMBER){
+        return false;
+    }
+    *audited_mask = numbers[1];
+    *on_mask = numbers[2];
+    *busy = numbers[3] != 0;
+    return true;
+}
+
+void server_send_output_delta(uart_pin_pair_t pin_pair, uart_inst_t* uart, uint32_t gpio_mask, uint32_t on_mask){
+    uint32_t frames = 0;
+    uint32_t bytes_sent = 0;
+
+    uint32_t irq = uart_lock_acquire();
+    TRACE_BEGIN(TRACE_SPAN_UART_SEND, pin_pair.tx, 0);
+    uart_init_with_pins(uart, pin_pair, DEFAULT_BAUDRATE);
+    for (uint32_t remaining_mask = gpio_mask; remaining_mask; remaining_mask &= remaining_mask - 1){
+        uint32_t gpio_number = (uint32_t)__builtin_ctz(remaining_mask);
+        char msg[8];
+        snprintf(msg, sizeof(msg), "[%lu,%d]", (unsigned long)gpio_number, (on_mask >> gpio_number) & 1u ? 1 : 0);
+        uart_puts(uart, msg);
+        bytes_sent += strlen(msg);
+        frames++;
+        uart_tx_wait_blocking(uart);
+        sleep_us(500);
+    }
+    reset_gpio_pins(pin_pair);
+    TRACE_END(TRACE_SPAN_UART_SEND, pin_pair.tx, frames);
+    uart_lock_release(irq);
+
+    statistics_record_traffic(pin_pair, frames, bytes_sent);
+}
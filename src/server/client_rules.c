@@ -0,0 +1,188 @@
+/**
+ * @file client_rules.c
+ * @brief Downloads local input rules to clients and records their outcome.
+ *
+ * A local rule runs on the client itself: when one of its inputs has the
+ * rule's edge, the client switches the rule's outputs from the GPIO IRQ,
+ * with no round trip to the server. The server only keeps a copy of each
+ * table and learns which rules fired from the input report (see
+ * input_sense.c). Once a rule is reported, its outcome is written to the
+ * flash state: a rule that turns its outputs ON for a time forces them all
+ * OFF when the time ends, whatever they were before, so they are stored
+ * OFF, like timed outputs; outputs a rule leaves ON are stored ON. When a
+ * timed and a latching rule share an output in one report, the timed rule
+ * ends last and the output is stored OFF.
+ *
+ * The client keeps its rules in RAM and loses them when it restarts. When
+ * the audit reconnects such a client, its rules are downloaded again from
+ * the server copy, right after its input configuration. The server copy
+ * lives in RAM too, so rules are lost when the server restarts.
+ */
+
+#include <stdio.h>
+
+#include "pico/stdlib.h"
+#include "hardware/sync.h"
+
+#include "server.h"
+
+#define LOG_MODULE STATE
+#include "log.h"
+
+/**
+ * @brief Server copy of one client rule. An unused rule has no edges.
+ */
+typedef struct{
+    uint32_t gpio_mask;
+    uint32_t on_ms;
+    uint32_t fires;         ///< Times the client reported the rule as fired
+    uint8_t trigger_gpio;
+    uint8_t edges;
+}client_rule_t;
+
+static client_rule_t client_rules[MAX_SERVER_CONNECTIONS][RULE_MAX_RULES];
+static spin_lock_t *client_rules_lock = NULL;
+
+void server_client_rules_init(void){
+    client_rules_lock = spin_lock_instance(spin_lock_claim_unused(true));
+}
+
+/**
+ * @brief Downloads one local rule to a client. Call with the state lock held.
+ *
+ * See `server_client_rule_set()`.
+ */
+static bool client_rule_set_locked(uint32_t flash_client_index, uint32_t rule_index, uint8_t trigger_gpio, uint32_t edges, uint32_t gpio_mask, uint32_t on_ms){
+    if (!client_rules_lock || flash_client_index >= MAX_SERVER_CONNECTIONS || rule_index >= RULE_MAX_RULES ||
+        trigger_gpio >= 32 || edges > (RULE_EDGE_RISE | RULE_EDGE_FALL) || on_ms > TIMED_OUTPUT_MAX_MS){
+        return false;
+    }
+    server_persistent_state_t state;
+    load_server_state(&state);
+    uint32_t active_client_index = get_active_client_connection_index_from_flash_client_index(flash_client_index, state);
+    if (active_client_index == INVALID_CLIENT_INDEX){
+        return false;
+    }
+    server_uart_connection_t *connection = &active_uart_server_connections[active_client_index];
+    gpio_mask &= GPIO_DEVICE_MASK;
+
+    send_wakeup_if_dormant(flash_client_index, &state, connection->pin_pair, connection->uart_instance);
+    server_send_rule(connection->pin_pair, connection->uart_instance, rule_index, trigger_gpio, edges, gpio_mask, on_ms);
+    if (connection->is_dormant){
+        send_dormant_flag_to_client((uint8_t)active_client_index);
+    }
+
+    uint32_t irq = spin_lock_blocking(client_rules_lock);
+    client_rule_t *rule = &client_rules[flash_client_index][rule_index];
+    rule->trigger_gpio = trigger_gpio;
+    rule->edges = (uint8_t)edges;
+    rule->gpio_mask = gpio_mask;
+    rule->on_ms = on_ms;
+    rule->fires = 0;
+    spin_unlock(client_rules_lock, irq);
+    return true;
+}
+
+bool server_client_rule_set(uint32_t flash_client_index, uint32_t rule_index, uint8_t trigger_gpio, uint32_t edges, uint32_t gpio_mask, uint32_t on_ms){
+    server_state_lock();
+    bool sent = client_rule_set_locked(flash_client_index, rule_index, trigger_gpio, edges, gpio_mask, on_ms);
+    server_state_unlock();
+    return sent;
+}
+
+void server_client_rules_restore(uint32_t flash_client_index, uint8_t active_client_index){
+    if (!client_rules_lock || flash_client_index >= MAX_SERVER_CONNECTIONS){
+        return;
+    }
+    server_uart_connection_t *connection = &active_uart_server_connections[active_client_index];
+    uint32_t restored_mask = 0;
+    for (uint32_t rule_index = 0; rule_index < RULE_MAX_RULES; rule_index++){
+        uint32_t irq = spin_lock_blocking(client_rules_lock);
+        client_rule_t rule = client_rules[flash_client_index][rule_index];
+        spin_unlock(client_rules_lock, irq);
+        if (!rule.edges){
+            continue;
+        }
+        server_send_rule(connection->pin_pair, connection->uart_instance, rule_index, rule.trigger_gpio, rule.edges, rule.gpio_mask, rule.on_ms);
+        restored_mask |= 1u << rule_index;
+    }
+    if (restored_mask){
+        LOG_INFO(STATE_RULES_RESTORED, flash_client_index, restored_mask);
+    }
+}
+
+void server_client_rules_fired(uint32_t flash_client_index, uint32_t fired_rules){
+    if (!client_rules_lock || flash_client_index >= MAX_SERVER_CONNECTIONS){
+        return;
+    }
+    uint32_t latched_mask = 0;
+    uint32_t timed_mask = 0;
+    uint32_t irq = spin_lock_blocking(client_rules_lock);
+    for (uint32_t rule_index = 0; rule_index < RULE_MAX_RULES; rule_index++){
+        client_rule_t *rule = &client_rules[flash_client_index][rule_index];
+        if (!(fired_rules & (1u << rule_index)) || !rule->edges){
+            continue;
+        }
+        rule->fires++;
+        if (rule->on_ms){
+            timed_mask |= rule->gpio_mask;
+        }else{
+            latched_mask |= rule->gpio_mask;
+        }
+    }
+    spin_unlock(client_rules_lock, irq);
+    LOG_INFO(STATE_RULE_FIRED, flash_client_index, fired_rules);
+
+    latched_mask &= ~timed_mask;
+    server_timed_output_forget(flash_client_index, latched_mask | timed_mask);
+    if (!(latched_mask | timed_mask)){
+        return;
+    }
+    server_persistent_state_t state;
+    server_state_lock();
+    load_server_state(&state);
+    bool changed = false;
+    client_state_t *client_state = &state.clients[flash_client_index].running_client_state;
+    for (uint8_t device_index = 0; device_index < MAX_NUMBER_OF_GPIOS; device_index++){
+        device_t *device = &client_state->devices[device_index];
+        if (device->gpio_number == UART_CONNECTION_FLAG_NUMBER){
+            continue;
+        }
+        uint32_t gpio_bit = 1u << device->gpio_number;
+        if ((latched_mask & gpio_bit) && !device->is_on){
+            device->is_on = true;
+            changed = true;
+        }else if ((timed_mask & gpio_bit) && device->is_on){
+            device->is_on = false;
+            changed = true;
+        }
+    }
+    if (changed){
+        save_server_state(&state);
+    }
+    server_state_unlock();
+}
+
+void server_client_rules_print_machine(void){
+    if (!client_rules_lock){
+        return;
+    }
+    for (uint32_t flash_client_index = 0; flash_client_index < MAX_SERVER_CONNECTIONS; flash_client_index++){
+        for (uint32_t rule_index = 0; rule_index < RULE_MAX_RULES; rule_index++){
+            uint32_t irq = spin_lock_blocking(client_rules_lock);
+            client_rule_t rule = client_rules[flash_client_index][rule_index];
+            spin_unlock(client_rules_lock, irq);
+            if (!rule.edges){
+                continue;
+            }
+            printf("RULE %lu %lu %u %u %08lx %lu %lu\n",
+                (unsigned long)flash_client_index,
+                (unsigned long)rule_index,
+                rule.trigger_gpio,
+                rule.edges,
+                (unsigned long)rule.gpio_mask,
+                (unsigned long)rule.on_ms,
+                (unsigned long)rule.fires);
+        }
+    }
+}
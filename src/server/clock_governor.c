@@ -0,0 +1,192 @@
+/**
+ * @file clock_governor.c
+ * @brief Drops clk_sys while the server is idle and boosts it when work begins.
+ *
+ * The server spends most of its time waiting for a key press, a timer or a
+ * client input. After `CLOCK_GOVERNOR_IDLE_MS` without USB input, UART
+ * exchanges or flash commits, clk_sys is switched from the system PLL to
+ * the 48 MHz USB PLL. USB input, the start of a UART exchange and the start
+ * of a flash commit switch it back before the work runs. Both PLLs keep
+ * running, so either transition is one glitchless mux switch and never
+ * waits for a PLL to lock.
+ *
+ * clk_peri is moved to the USB PLL at init, so the UART baud dividers no
+ * longer depend on clk_sys: `uart_init_with_pins()` derives the same
+ * dividers at either level, and a transition cannot change the bit timing
+ * of a frame in flight on the other core. UARTs already running when
+ * clk_peri moves get their dividers re-derived for the new clock.
+ *
+ * Transition times are recorded in the `clock_boost` and `clock_drop`
+ * statistics histograms. Counters live in RAM.
+ */
+
+#include <stdio.h>
+
+#include "pico/stdlib.h"
+#include "pico/stdio.h"
+#include "pico/time.h"
+#include "hardware/clocks.h"
+#include "hardware/sync.h"
+#include "hardware/uart.h"
+
+#include "server.h"
+#include "statistics.h"
+
+static spin_lock_t *governor_lock = NULL;
+static repeating_timer_t governor_timer;
+static uint32_t governor_boost_hz = 0;          ///< clk_sys from the system PLL, as set up at boot
+static uint32_t governor_idle_hz = 0;           ///< clk_sys from the USB PLL
+static bool governor_boosted = true;
+static uint32_t governor_activity_us = 0;       ///< time_us_32() of the last boost request
+static uint32_t governor_boosts = 0;
+static uint32_t governor_drops = 0;
+static uint64_t governor_level_since_us = 0;    ///< time_us_64() of the last transition
+static uint64_t governor_boosted_us = 0;        ///< Time spent boosted, up to the last transition
+static uint64_t governor_idle_us = 0;           ///< Time spent idle, up to the last transition
+
+/**
+ * @brief Re-derives the baud divider of a running UART after clk_peri changed.
+ *
+ * The baud rate is recovered from the divider registers, which hold
+ * 64 * clk_peri / (16 * baudrate).
+ *
+ * @param uart         UART instance.
+ * @param old_peri_hz  clk_peri the current divider was derived from.
+ */
+static void governor_rederive_uart(uart_inst_t *uart, uint32_t old_peri_hz){
+    if (!uart_is_enabled(uart)){
+        return;
+    }
+    uint32_t divider = (uart_get_hw(uart)->ibrd << 6) | uart_get_hw(uart)->fbrd;
+    if (!divider){
+        return;
+    }
+    uart_set_baudrate(uart, (uint32_t)(4ull * old_peri_hz / divider));
+}
+
+/**
+ * @brief Switches clk_sys to the boosted or idle source. Call with the governor lock held.
+ *
+ * @param boost true for the system PLL, false for the USB PLL.
+ * @return Transition time in us.
+ */
+static uint32_t governor_switch(bool boost){
+    uint32_t start_us = time_us_32();
+    if (boost){
+        clock_configure(clk_sys,
+            CLOCKS_CLK_SYS_CTRL_SRC_VALUE_CLKSRC_CLK_SYS_AUX,
+            CLOCKS_CLK_SYS_CTRL_AUXSRC_VALUE_CLKSRC_PLL_SYS,
+            governor_boost_hz, governor_boost_hz);
+    }else{
+        clock_configure(clk_sys,
+            CLOCKS_CLK_SYS_CTRL_SRC_VALUE_CLKSRC_CLK_SYS_AUX,
+            CLOCKS_CLK_SYS_CTRL_AUXSRC_VALUE_CLKSRC_PLL_USB,
+            governor_idle_hz, governor_idle_hz);
+    }
+    uint32_t elapsed_us = time_us_32() - start_us;
+
+    uint64_t now_us = time_us_64();
+    if (boost){
+        governor_idle_us += now_us - governor_level_since_us;
+        governor_boosts++;
+    }else{
+        governor_boosted_us += now_us - governor_level_since_us;
+        governor_drops++;
+    }
+    governor_level_since_us = now_us;
+    governor_boosted = boost;
+    return elapsed_us;
+}
+
+/**
+ * @brief Repeating timer callback: drops clk_sys once the server has been idle long enough.
+ *
+ * A running stream or a held UART lock keeps the boosted clock, and so
+ * does a UART exchange that ended within `CLOCK_GOVERNOR_IDLE_MS`.
+ *
+ * @param repeating_timer Unused.
+ * @return Always true to keep the timer running.
+ */
+static bool governor_tick_callback(repeating_timer_t *repeating_timer){
+    const uint32_t idle_us = CLOCK_GOVERNOR_IDLE_MS * MS_TO_US_MULTIPLIER;
+    if (stream_is_active() || is_spin_locked(uart_lock) || uart_lock_idle_us() < idle_us){
+        return true;
+    }
+    uint32_t irq = spin_lock_blocking(governor_lock);
+    bool drop = governor_boosted && time_us_32() - governor_activity_us >= idle_us;
+    uint32_t elapsed_us = drop ? governor_switch(false) : 0;
+    spin_unlock(governor_lock, irq);
+
+    if (drop){
+        statistics_record_latency(STATISTICS_LATENCY_CLOCK_DROP, elapsed_us);
+    }
+    return true;
+}
+
+/**
+ * @brief Boosts clk_sys as soon as USB input arrives. Runs in the USB IRQ.
+ *
+ * @param param Unused.
+ */
+static void governor_chars_available(void *param){
+    server_clock_governor_boost();
+}
+
+void server_clock_governor_init(void){
+#if CLOCK_GOVERNOR_ENABLED
+    governor_boost_hz = clock_get_hz(clk_sys);
+    governor_idle_hz = clock_get_hz(clk_usb);
+    if (!governor_idle_hz || governor_idle_hz >= governor_boost_hz){
+        return;
+    }
+
+    uint32_t old_peri_hz = clock_get_hz(clk_peri);
+    uint32_t irq = save_and_disable_interrupts();
+    clock_configure(clk_peri, 0, CLOCKS_CLK_PERI_CTRL_AUXSRC_VALUE_CLKSRC_PLL_USB, governor_idle_hz, governor_idle_hz);
+    governor_rederive_uart(uart0, old_peri_hz);
+    governor_rederive_uart(uart1, old_peri_hz);
+    restore_interrupts(irq);
+
+    governor_activity_us = time_us_32();
+    governor_level_since_us = time_us_64();
+    governor_lock = spin_lock_instance(spin_lock_claim_unused(true));
+    stdio_set_chars_available_callback(governor_chars_available, NULL);
+    add_repeating_timer_ms(-CLOCK_GOVERNOR_TICK_MS, governor_tick_callback, NULL, &governor_timer);
+#endif
+}
+
+void server_clock_governor_boost(void){
+    if (!governor_lock){
+        return;
+    }
+    uint32_t irq = spin_lock_blocking(governor_lock);
+    governor_activity_us = time_us_32();
+    bool boost = !governor_boosted;
+    uint32_t elapsed_us = boost ? governor_switch(true) : 0;
+    spin_unlock(governor_lock, irq);
+
+    if (boost){
+        statistics_record_latency(STATISTICS_LATENCY_CLOCK_BOOST, elapsed_us);
+    }
+}
+
+void server_clock_governor_print_machine(void){
+    if (!governor_lock){
+        return;
+    }
+    uint32_t irq = spin_lock_blocking(governor_lock);
+    bool boosted = governor_boosted;
+    uint32_t boosts = governor_boosts;
+    uint32_t drops = governor_drops;
+    uint64_t current_us = time_us_64() - governor_level_since_us;
+    uint64_t boosted_us = governor_boosted_us + (boosted ? current_us : 0);
+    uint64_t idle_us = governor_idle_us + (boosted ? 0 : current_us);
+    spin_unlock(governor_lock, irq);
+
+    printf("GOVERNOR %s %lu %lu %lu %lu %llu %llu\n",
+        boosted ? "boosted" : "idle",
+        (unsigned long)(boosted ? governor_boost_hz : governor_idle_hz),
+        (unsigned long)governor_idle_hz,
+        (unsigned long)boosts, (unsigned long)drops,
+        (unsigned long long)(boosted_us / 1000u), (unsigned long long)(idle_us / 1000u));
+}
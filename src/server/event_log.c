@@ -0,0 +1,505 @@
+/**
+ * @file event_log.c
+ * @brief Flash ring and RAM staging for the persistent event log.
+ *
+ * The log area holds `EVENT_LOG_SECTORS` sectors of 16-byte records,
+ * written as a ring: the oldest sector is erased when the log reaches it.
+ * Each record carries a sequence number and a check byte, so the end of
+ * the log is found at boot by the highest valid sequence, and records torn
+ * by a power cut are skipped.
+ *
+ * Writers only copy a record into a RAM staging page under a hardware
+ * spinlock. A full page, or a partly filled one after `EVENT_LOG_FLUSH_MS`,
+ * is programmed by core1. A partly filled page is programmed again as it
+ * fills; programming only clears bits, so the records already in flash
+ * are written with the same value.
+ *
+ * Erasing a sector stalls flash for tens of milliseconds, so it never
+ * happens in the flush that needs the sector. One spare sector ahead of
+ * the write pointer is kept erased. When the records enter it, core1 is
+ * asked to erase the next one as a separate message, which runs between
+ * flushes. The spare costs the log one sector of history. Only the boot
+ * record and a planned reboot, which cannot wait for core1, erase inline.
+ *
+ * @see event_log.h
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "hardware/flash.h"
+#include "hardware/sync.h"
+#include "hardware/watchdog.h"
+
+#include "event_log.h"
+#include "server.h"
+#include "functions.h"
+#include "menu.h"
+#include "trace.h"
+#include "flash_telemetry.h"
+
+#define EVENT_LOG_SIZE (EVENT_LOG_SECTORS * SERVER_SECTOR_SIZE)
+#define EVENT_LOG_SLOTS (EVENT_LOG_SIZE / sizeof(event_record_t))
+#define EVENT_LOG_RECORDS_PER_PAGE (SERVER_PAGE_SIZE / sizeof(event_record_t))
+
+_Static_assert(sizeof(event_record_t) == 16, "event records must stay 16 bytes");
+_Static_assert(EVENT_LOG_OFFSET % SERVER_SECTOR_SIZE == 0, "the event log is not sector aligned");
+_Static_assert(EVENT_LOG_SECTORS >= 2, "the event log needs a sector to erase while it keeps the others");
+_Static_assert(EVENT_LOG_STAGING_PAGES >= 2, "records need a staging page while the previous one is programmed");
+
+extern char __flash_binary_end;
+
+/**
+ * @brief One page of records on its way to flash.
+ */
+typedef struct{
+    event_record_t records[EVENT_LOG_RECORDS_PER_PAGE];
+    uint32_t offset;            ///< Flash offset of the page
+    uint32_t count;             ///< Records staged, including those already programmed
+    uint32_t programmed;        ///< Records already in flash
+}event_log_page_t;
+
+static event_log_page_t event_log_pages[EVENT_LOG_STAGING_PAGES];
+static uint32_t event_log_head = 0;        ///< Page receiving records, counts pages
+static uint32_t event_log_tail = 0;        ///< Oldest page with records not yet programmed
+static uint32_t event_log_sequence = 0;    ///< Sequence of the next record
+static uint32_t event_log_dropped = 0;
+static uint32_t event_log_erased_sector = UINT32_MAX;  ///< Sector erased for the records being written
+static uint32_t event_log_spare_sector = UINT32_MAX;   ///< Next sector, already erased ahead of the records
+static bool event_log_busy = false;        ///< A flush or clear is writing flash
+static volatile bool event_log_flush_posted = false;
+static volatile bool event_log_erase_posted = false;
+static spin_lock_t *event_log_lock = NULL;
+static repeating_timer_t event_log_timer;
+static uint8_t event_log_program_buffer[SERVER_PAGE_SIZE];
+
+/**
+ * @brief Returns the log area as mapped in XIP flash.
+ */
+static const event_record_t *event_log_flash_records(void){
+    return (const event_record_t *)(XIP_BASE + EVENT_LOG_OFFSET);
+}
+
+/**
+ * @brief Computes the check byte of a record.
+ *
+ * @param record Record.
+ * @return Low byte of the CRC-32 of the fields before `check`.
+ */
+static uint8_t event_log_check(const event_record_t *record){
+    return (uint8_t)crc32_update(0, record, offsetof(event_record_t, check));
+}
+
+/**
+ * @brief Tells whether a stored record is complete.
+ *
+ * @param record Record in flash.
+ * @return true unless the record is erased or torn.
+ */
+static bool event_log_record_is_valid(const event_record_t *record){
+    return record->event != 0xFF && record->check == event_log_check(record);
+}
+
+/**
+ * @brief Opens a staging page over a flash page, copying the records it already holds.
+ *
+ * @param page   Staging page.
+ * @param offset Flash offset of the page.
+ * @param count  Records of the page already in flash.
+ */
+static void event_log_open_page(event_log_page_t *page, uint32_t offset, uint32_t count){
+    memcpy(page->records, (const void *)(XIP_BASE + offset), SERVER_PAGE_SIZE);
+    memset(&page->records[count], 0xFF, (EVENT_LOG_RECORDS_PER_PAGE - count) * sizeof(event_record_t));
+    page->offset = offset;
+    page->count = count;
+    page->programmed = count;
+}
+
+/**
+ * @brief Claims the flash side of the log, waiting for a flush on the other core.
+ */
+static void event_log_claim(void){
+    while (true){
+        uint32_t irq = spin_lock_blocking(event_log_lock);
+        bool claimed = !event_log_busy;
+        event_log_busy = true;
+        spin_unlock(event_log_lock, irq);
+        if (claimed){
+            return;
+        }
+        tight_loop_contents();
+    }
+}
+
+/**
+ * @brief Releases the flash side of the log.
+ */
+static void event_log_release(void){
+    uint32_t irq = spin_lock_blocking(event_log_lock);
+    event_log_busy = false;
+    spin_unlock(event_log_lock, irq);
+}
+
+/**
+ * @brief Asks core1 to program the staged records, unless it was already asked.
+ */
+static void event_log_request_flush(void){
+    if (event_log_flush_posted){
+        return;
+    }
+    event_log_flush_posted = true;
+    if (!server_post_core1_message(EVENT_LOG_FLUSH_WAKEUP_MESSAGE)){
+        event_log_flush_posted = false;
+    }
+}
+
+/**
+ * @brief Asks core1 to erase the sector the records need next, unless it was already asked.
+ */
+static void event_log_request_erase(void){
+    if (event_log_erase_posted){
+        return;
+    }
+    event_log_erase_posted = true;
+    if (!server_post_core1_message(EVENT_LOG_ERASE_WAKEUP_MESSAGE)){
+        event_log_erase_posted = false;
+    }
+}
+
+/**
+ * @brief Repeating timer callback: has partly filled pages programmed and a missing spare sector erased.
+ *
+ * @param repeating_timer Unused.
+ * @return Always true to keep the timer running.
+ */
+static bool event_log_flush_callback(repeating_timer_t *repeating_timer){
+    uint32_t irq = spin_lock_blocking(event_log_lock);
+    const event_log_page_t *page = &event_log_pages[event_log_tail % EVENT_LOG_STAGING_PAGES];
+    bool pending = page->programmed < page->count || event_log_tail != event_log_head;
+    spin_unlock(event_log_lock, irq);
+
+    if (pending){
+        event_log_request_flush();
+    }
+    if (event_log_spare_sector == UINT32_MAX){
+        event_log_request_erase();
+    }
+    return true;
+}
+
+/**
+ * @brief Returns the sector that follows another one in the ring.
+ *
+ * @param sector Flash offset of a log sector.
+ * @return Flash offset of the next sector.
+ */
+static uint32_t event_log_next_sector(uint32_t sector){
+    sector += SERVER_SECTOR_SIZE;
+    return sector == EVENT_LOG_OFFSET + EVENT_LOG_SIZE ? EVENT_LOG_OFFSET : sector;
+}
+
+/**
+ * @brief Erases one sector and makes it the spare. Call with the log claimed.
+ *
+ * @param sector Flash offset of the sector.
+ */
+static void __not_in_flash_func(event_log_erase_sector)(uint32_t sector){
+    flash_telemetry_record_erase(sector, SERVER_SECTOR_SIZE);
+
+    bool locked_out = flash_lockout_begin();
+    uint32_t ints = save_and_disable_interrupts();
+    TRACE_BEGIN(TRACE_SPAN_FLASH_ERASE, 0, sector);
+    flash_range_erase(sector, SERVER_SECTOR_SIZE);
+    TRACE_END(TRACE_SPAN_FLASH_ERASE, 0, sector);
+    restore_interrupts(ints);
+    flash_lockout_end(locked_out);
+    flash_telemetry_store();
+
+    event_log_spare_sector = sector;
+}
+
+/**
+ * @brief Tells whether a page can be programmed without an erase. Call with the log claimed.
+ *
+ * A page in the spare sector moves the records into it, which leaves the
+ * log without a spare until core1 erases the next one.
+ *
+ * @param offset Flash offset of the page.
+ * @return false if the sector of the page still has to be erased.
+ */
+static bool event_log_page_ready(uint32_t offset){
+    uint32_t sector = offset & ~(SERVER_SECTOR_SIZE - 1u);
+    if (sector == event_log_erased_sector){
+        return true;
+    }
+    if (sector != event_log_spare_sector){
+        return false;
+    }
+    event_log_erased_sector = sector;
+    event_log_spare_sector = UINT32_MAX;
+    return true;
+}
+
+/**
+ * @brief Programs the staging copy into one flash page of an erased sector.
+ *
+ * @param offset Flash offset of the page.
+ */
+static void __not_in_flash_func(event_log_program_page)(uint32_t offset){
+    flash_telemetry_record_program(SERVER_PAGE_SIZE);
+
+    bool locked_out = flash_lockout_begin();
+    uint32_t ints = save_and_disable_interrupts();
+    TRACE_BEGIN(TRACE_SPAN_FLASH_PROGRAM, 0, offset);
+    flash_range_program(offset, event_log_program_buffer, SERVER_PAGE_SIZE);
+    TRACE_END(TRACE_SPAN_FLASH_PROGRAM, 0, offset);
+    restore_interrupts(ints);
+    flash_lockout_end(locked_out);
+}
+
+/**
+ * @brief Tells whether a whole sector reads as erased.
+ *
+ * @param sector Flash offset of the sector.
+ * @return true if every byte is 0xFF.
+ */
+static bool event_log_sector_is_erased(uint32_t sector){
+    const uint32_t *words = (const uint32_t *)(XIP_BASE + sector);
+    for (uint32_t index = 0; index < SERVER_SECTOR_SIZE / sizeof(uint32_t); index++){
+        if (words[index] != 0xFFFFFFFFu){
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Programs the staged records, oldest page first.
+ *
+ * @param erase_inline true to erase a sector that is not ready in place,
+ *                     false to stop there and leave the erase to core1.
+ */
+static void event_log_flush_pages(bool erase_inline){
+    if (!event_log_lock){
+        return;
+    }
+    event_log_claim();
+    event_log_flush_posted = false;
+    bool blocked = false;
+    while (true){
+        uint32_t irq = spin_lock_blocking(event_log_lock);
+        event_log_page_t *page = &event_log_pages[event_log_tail % EVENT_LOG_STAGING_PAGES];
+        uint32_t count = page->count;
+        uint32_t offset = page->offset;
+        bool pending = page->programmed < count;
+        if (pending){
+            memcpy(event_log_program_buffer, page->records, SERVER_PAGE_SIZE);
+        }
+        spin_unlock(event_log_lock, irq);
+
+        if (pending && !event_log_page_ready(offset)){
+            if (!erase_inline){
+                blocked = true;
+                break;
+            }
+            event_log_erase_sector(offset & ~(SERVER_SECTOR_SIZE - 1u));
+            event_log_page_ready(offset);
+        }
+        if (pending){
+            event_log_program_page(offset);
+        }
+
+        irq = spin_lock_blocking(event_log_lock);
+        page->programmed = count;
+        bool next = count == EVENT_LOG_RECORDS_PER_PAGE && event_log_tail != event_log_head;
+        if (next){
+            event_log_tail++;
+        }
+        spin_unlock(event_log_lock, irq);
+        if (!next){
+            break;
+        }
+    }
+    bool erase = blocked || event_log_spare_sector == UINT32_MAX;
+    event_log_release();
+
+    if (erase){
+        event_log_request_erase();
+    }
+}
+
+void event_log_init(void){
+    uint32_t binary_end = (uint32_t)((uintptr_t)&__flash_binary_end - XIP_BASE);
+    if (binary_end > EVENT_LOG_OFFSET){
+        return;
+    }
+
+    const event_record_t *stored = event_log_flash_records();
+    bool found = false;
+    uint32_t last_sequence = 0;
+    uint32_t next_slot = 0;
+    for (uint32_t slot = 0; slot < EVENT_LOG_SLOTS; slot++){
+        if (event_log_record_is_valid(&stored[slot]) && (!found || (int32_t)(stored[slot].sequence - last_sequence) > 0)){
+            found = true;
+            last_sequence = stored[slot].sequence;
+            next_slot = (slot + 1) % EVENT_LOG_SLOTS;
+        }
+    }
+    event_log_sequence = found ? last_sequence + 1 : 0;
+
+    // Records go after the last one only if the rest of its sector is still erased.
+    uint32_t slots_per_sector = SERVER_SECTOR_SIZE / sizeof(event_record_t);
+    uint32_t sector_end = (next_slot / slots_per_sector + 1) * slots_per_sector;
+    const uint8_t *bytes = (const uint8_t *)&stored[next_slot];
+    bool erased = true;
+    for (uint32_t index = 0; index < (sector_end - next_slot) * sizeof(event_record_t); index++){
+        erased = erased && bytes[index] == 0xFF;
+    }
+    if (erased){
+        event_log_erased_sector = EVENT_LOG_OFFSET + (next_slot / slots_per_sector) * SERVER_SECTOR_SIZE;
+    }else if (next_slot % slots_per_sector){
+        next_slot = sector_end % EVENT_LOG_SLOTS;
+    }
+    uint32_t spare = event_log_next_sector(EVENT_LOG_OFFSET + (next_slot / slots_per_sector) * SERVER_SECTOR_SIZE);
+    if (erased && event_log_sector_is_erased(spare)){
+        event_log_spare_sector = spare;
+    }
+
+    uint32_t page_offset = EVENT_LOG_OFFSET + (next_slot / EVENT_LOG_RECORDS_PER_PAGE) * SERVER_PAGE_SIZE;
+    event_log_open_page(&event_log_pages[0], page_offset, erased ? next_slot % EVENT_LOG_RECORDS_PER_PAGE : 0);
+    event_log_lock = spin_lock_instance(spin_lock_claim_unused(true));
+
+    event_log_write(EVENT_BOOT, watchdog_caused_reboot(), 0);
+    event_log_flush_all();
+    add_repeating_timer_ms(EVENT_LOG_FLUSH_MS, event_log_flush_callback, NULL, &event_log_timer);
+}
+
+void event_log_write(event_log_event_t event, uint16_t arg0, uint32_t arg1){
+    if (!event_log_lock){
+        return;
+    }
+    uint32_t time_ms = to_ms_since_boot(get_absolute_time());
+    uint32_t irq = spin_lock_blocking(event_log_lock);
+    event_log_page_t *page = &event_log_pages[event_log_head % EVENT_LOG_STAGING_PAGES];
+    if (page->count == EVENT_LOG_RECORDS_PER_PAGE){
+        if (event_log_head + 1 - event_log_tail >= EVENT_LOG_STAGING_PAGES){
+            event_log_dropped++;
+            spin_unlock(event_log_lock, irq);
+            return;
+        }
+        uint32_t offset = page->offset + SERVER_PAGE_SIZE;
+        if (offset == EVENT_LOG_OFFSET + EVENT_LOG_SIZE){
+            offset = EVENT_LOG_OFFSET;
+        }
+        event_log_head++;
+        page = &event_log_pages[event_log_head % EVENT_LOG_STAGING_PAGES];
+        memset(page->records, 0xFF, sizeof(page->records));
+        page->offset = offset;
+        page->count = 0;
+        page->programmed = 0;
+    }
+    event_record_t *record = &page->records[page->count++];
+    record->sequence = event_log_sequence++;
+    record->time_ms = time_ms;
+    record->arg1 = arg1;
+    record->arg0 = arg0;
+    record->event = (uint8_t)event;
+    record->check = event_log_check(record);
+    bool full = page->count == EVENT_LOG_RECORDS_PER_PAGE;
+    spin_unlock(event_log_lock, irq);
+
+    if (full){
+        event_log_request_flush();
+    }
+}
+
+void event_log_flush(void){
+    event_log_flush_pages(false);
+}
+
+void event_log_flush_all(void){
+    event_log_flush_pages(true);
+}
+
+void event_log_erase_ahead(void){
+    if (!event_log_lock){
+        return;
+    }
+    event_log_claim();
+    event_log_erase_posted = false;
+    uint32_t irq = spin_lock_blocking(event_log_lock);
+    const event_log_page_t *page = &event_log_pages[event_log_tail % EVENT_LOG_STAGING_PAGES];
+    uint32_t sector = page->offset & ~(SERVER_SECTOR_SIZE - 1u);
+    bool pending = page->programmed < page->count;
+    spin_unlock(event_log_lock, irq);
+
+    if (sector == event_log_erased_sector){
+        sector = event_log_next_sector(sector);
+    }
+    bool erase = sector != event_log_spare_sector;
+    if (erase){
+        event_log_erase_sector(sector);
+    }
+    event_log_release();
+
+    if (erase && pending){
+        event_log_request_flush();
+    }
+}
+
+void __not_in_flash_func(event_log_clear)(void){
+    if (!event_log_lock){
+        return;
+    }
+    event_log_claim();
+    flash_telemetry_record_erase(EVENT_LOG_OFFSET, EVENT_LOG_SIZE);
+
+    bool locked_out = flash_lockout_begin();
+    uint32_t ints = save_and_disable_interrupts();
+    TRACE_BEGIN(TRACE_SPAN_FLASH_ERASE, 0, EVENT_LOG_OFFSET);
+    flash_range_erase(EVENT_LOG_OFFSET, EVENT_LOG_SIZE);
+    TRACE_END(TRACE_SPAN_FLASH_ERASE, 0, EVENT_LOG_OFFSET);
+    restore_interrupts(ints);
+    flash_lockout_end(locked_out);
+    flash_telemetry_store();
+
+    uint32_t irq = spin_lock_blocking(event_log_lock);
+    event_log_head = 0;
+    event_log_tail = 0;
+    event_log_open_page(&event_log_pages[0], EVENT_LOG_OFFSET, 0);
+    event_log_erased_sector = EVENT_LOG_OFFSET;
+    event_log_spare_sector = event_log_next_sector(EVENT_LOG_OFFSET);
+    spin_unlock(event_log_lock, irq);
+    event_log_release();
+}
+
+void event_log_print_machine(void){
+    if (!event_log_lock){
+        return;
+    }
+    event_log_flush();
+
+    uint32_t irq = spin_lock_blocking(event_log_lock);
+    const event_log_page_t *page = &event_log_pages[event_log_head % EVENT_LOG_STAGING_PAGES];
+    uint32_t next_slot = (page->offset - EVENT_LOG_OFFSET) / sizeof(event_record_t) + page->count;
+    uint32_t sequence = event_log_sequence;
+    uint32_t dropped = event_log_dropped;
+    spin_unlock(event_log_lock, irq);
+
+    printf("EVENTS %08lx %lx\n", (unsigned long)sequence, (unsigned long)dropped);
+    const event_record_t *stored = event_log_flash_records();
+    for (uint32_t index = 0; index < EVENT_LOG_SLOTS; index++){
+        const event_record_t *record = &stored[(next_slot + index) % EVENT_LOG_SLOTS];
+        if (!event_log_record_is_valid(record)){
+            continue;
+        }
+        printf("EVENT %08lx %08lx %x %x %08lx\n",
+            (unsigned long)record->sequence,
+            (unsigned long)record->time_ms,
+            record->event,
+            record->arg0,
+            (unsigned long)record->arg1);
+    }
+}
@@ -0,0 +1,261 @@
+/**
+ * @file firmware_update.c
+ * @brief Client firmware update: image upload from the host, transfer to clients and swap.
+ *
+ * `FIRMWARE LOAD` receives a client image from the host into a staging
+ * area of server flash, below the interlock table, and checks its CRC.
+ * The image then stays there until the next load, so every client can be
+ * updated from it without the host sending it again.
+ *
+ * `FIRMWARE PUSH` sends the image to one client (see firmware_update.c on
+ * the client). Both ends switch to the fastest baud rate they share, and
+ * the image goes out in windows of `FIRMWARE_WINDOW_FRAMES` sector frames
+ * per UART lock hold. The client receives by DMA while it programs, so a
+ * window costs its time on the wire plus the programming of its last
+ * frame. After a damaged frame or a lost ack the window is sent again from
+ * the first sector the client has not acked.
+ *
+ * `FIRMWARE COMMIT` asks every client holding the image to check it and
+ * swap it in. Clients restart on the new image, and the server restarts
+ * too so that it finds them again. The swap is not power-fail safe: the
+ * whole fleet is transferred first, and only complete images that pass
+ * their CRC are swapped in.
+ *
+ * Pushes block the host interface; core1 keeps serving the other clients
+ * between windows. Transfer results live in RAM.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "hardware/clocks.h"
+#include "hardware/flash.h"
+#include "hardware/sync.h"
+#include "hardware/watchdog.h"
+
+#include "server.h"
+#include "functions.h"
+#include "trace.h"
+#include "flash_telemetry.h"
+#include "event_log.h"
+
+#define LOG_MODULE STATE
+#include "log.h"
+
+_Static_assert(FIRMWARE_SERVER_STAGING_OFFSET % FIRMWARE_BLOCK_SIZE == 0, "the server staging area is not block aligned");
+_Static_assert(FIRMWARE_IMAGE_MAX_BYTES % FIRMWARE_BLOCK_SIZE == 0, "the staging areas are not whole blocks");
+
+extern char __flash_binary_end;
+
+/**
+ * @brief Transfer states of a client.
+ */
+typedef enum{
+    FIRMWARE_CLIENT_NONE,
+    FIRMWARE_CLIENT_FAILED,
+    FIRMWARE_CLIENT_STAGED,     ///< Holds the whole image, ready to commit
+    FIRMWARE_CLIENT_COMMITTED,  ///< Swapping the image in
+}firmware_client_state_t;
+
+/**
+ * @brief Last transfer to one client.
+ */
+typedef struct{
+    firmware_client_state_t state;
+    uint32_t baudrate;
+    uint32_t frames_sent;
+    uint32_t retries;           ///< Windows sent again
+    uint32_t elapsed_ms;
+}firmware_client_t;
+
+static firmware_client_t firmware_clients[MAX_SERVER_CONNECTIONS];
+static uint32_t firmware_image_size = 0;    ///< Size of the loaded image, 0 without image
+static uint32_t firmware_image_crc = 0;
+static uint8_t firmware_sector[FIRMWARE_SECTOR_SIZE];
+
+static const char *firmware_state_names[] = {"none", "failed", "staged", "committed"};
+
+/**
+ * @brief Returns the loaded image as mapped in XIP flash.
+ */
+static const uint8_t *firmware_image(void){
+    return (const uint8_t *)(XIP_BASE + FIRMWARE_SERVER_STAGING_OFFSET);
+}
+
+/**
+ * @brief Programs one sector of the staging area, erasing its block first when the sector opens it.
+ *
+ * @param offset Flash offset of the sector.
+ */
+static void __not_in_flash_func(firmware_program_sector)(uint32_t offset){
+    bool erase = offset % FIRMWARE_BLOCK_SIZE == 0;
+    if (erase){
+        flash_telemetry_record_erase(offset, FIRMWARE_BLOCK_SIZE);
+    }
+    flash_telemetry_record_program(FIRMWARE_SECTOR_SIZE);
+
+    bool locked_out = flash_lockout_begin();
+    uint32_t ints = save_and_disable_interrupts();
+    if (erase){
+        TRACE_BEGIN(TRACE_SPAN_FLASH_ERASE, 0, offset);
+        flash_range_erase(offset, FIRMWARE_BLOCK_SIZE);
+        TRACE_END(TRACE_SPAN_FLASH_ERASE, 0, offset);
+    }
+    TRACE_BEGIN(TRACE_SPAN_FLASH_PROGRAM, 0, offset);
+    flash_range_program(offset, firmware_sector, FIRMWARE_SECTOR_SIZE);
+    TRACE_END(TRACE_SPAN_FLASH_PROGRAM, 0, offset);
+    restore_interrupts(ints);
+    flash_lockout_end(locked_out);
+
+    if (erase){
+        flash_telemetry_store();
+    }
+}
+
+bool server_firmware_load(uint32_t size, uint32_t crc32){
+    uint32_t binary_end = (uint32_t)((uintptr_t)&__flash_binary_end - XIP_BASE);
+    if (!size || size > FIRMWARE_IMAGE_MAX_BYTES || binary_end > FIRMWARE_SERVER_STAGING_OFFSET){
+        return false;
+    }
+    firmware_image_size = 0;
+    memset(firmware_clients, 0, sizeof(firmware_clients));
+    printf("OK\n");
+
+    for (uint32_t offset = 0; offset < size; offset += FIRMWARE_SECTOR_SIZE){
+        uint32_t length = size - offset < FIRMWARE_SECTOR_SIZE ? size - offset : FIRMWARE_SECTOR_SIZE;
+        for (uint32_t index = 0; index < length; index++){
+            int ch = getchar_timeout_us(FIRMWARE_LOAD_TIMEOUT_MS * MS_TO_US_MULTIPLIER);
+            if (ch == PICO_ERROR_TIMEOUT){
+                return false;
+            }
+            firmware_sector[index] = (uint8_t)ch;
+        }
+        memset(&firmware_sector[length], 0xFF, FIRMWARE_SECTOR_SIZE - length);
+        firmware_program_sector(FIRMWARE_SERVER_STAGING_OFFSET + offset);
+    }
+
+    if (crc32_update(0, firmware_image(), size) != crc32){
+        return false;
+    }
+    firmware_image_size = size;
+    firmware_image_crc = crc32;
+    return true;
+}
+
+bool server_firmware_push(uint32_t flash_client_index){
+    if (!firmware_image_size || flash_client_index >= MAX_SERVER_CONNECTIONS){
+        return false;
+    }
+    server_persistent_state_t state;
+    load_server_state(&state);
+    uint32_t connection_index = get_active_client_connection_index_from_flash_client_index(flash_client_index, state);
+    if (connection_index == INVALID_CLIENT_INDEX){
+        return false;
+    }
+    uint8_t active_client_index = (uint8_t)connection_index;
+    server_uart_connection_t *connection = &active_uart_server_connections[active_client_index];
+    firmware_client_t *client = &firmware_clients[flash_client_index];
+    memset(client, 0, sizeof(*client));
+    client->state = FIRMWARE_CLIENT_FAILED;
+    uint32_t start_ms = to_ms_since_boot(get_absolute_time());
+
+    send_wakeup_if_dormant(flash_client_index, &state, connection->pin_pair, connection->uart_instance);
+    uint32_t baudrate = server_send_firmware_begin(connection->pin_pair, connection->uart_instance, firmware_image_size, firmware_image_crc);
+    if (baudrate > clock_get_hz(clk_peri) / 16){
+        baudrate = clock_get_hz(clk_peri) / 16;
+    }
+    if (baudrate > FIRMWARE_MAX_BAUDRATE){
+        baudrate = FIRMWARE_MAX_BAUDRATE;
+    }
+    client->baudrate = baudrate;
+    bool receiving = baudrate && server_send_firmware_baud(connection->pin_pair, connection->uart_instance, baudrate);
+
+    uint32_t sectors = (firmware_image_size + FIRMWARE_SECTOR_SIZE - 1) / FIRMWARE_SECTOR_SIZE;
+    uint32_t next_sector = 0;
+    bool done = receiving;
+    while (done && next_sector < sectors){
+        uint32_t count = sectors - next_sector < FIRMWARE_WINDOW_FRAMES ? sectors - next_sector : FIRMWARE_WINDOW_FRAMES;
+        uint32_t acked = server_send_firmware_window(connection->pin_pair, connection->uart_instance, baudrate,
+            firmware_image(), firmware_image_size, next_sector, count);
+        client->frames_sent += count;
+        next_sector += acked;
+        if (acked < count){
+            // The client drops the rest of a damaged window once the line is idle.
+            done = ++client->retries <= FIRMWARE_MAX_RETRIES;
+            sleep_ms(3 * FIRMWARE_RESYNC_IDLE_MS);
+        }
+    }
+    client->elapsed_ms = to_ms_since_boot(get_absolute_time()) - start_ms;
+
+    if (done){
+        client->state = FIRMWARE_CLIENT_STAGED;
+        LOG_INFO(STATE_FIRMWARE_STAGED, flash_client_index, client->elapsed_ms);
+    }else{
+        LOG_WARN(STATE_FIRMWARE_FAILED, flash_client_index, next_sector);
+        if (receiving){
+            // Wait for the client to give up and return to the default baud rate.
+            sleep_ms(FIRMWARE_SESSION_TIMEOUT_MS);
+        }
+    }
+    if (connection->is_dormant){
+        send_dormant_flag_to_client(active_client_index);
+    }
+    return done;
+}
+
+uint32_t server_firmware_commit(void){
+    if (!firmware_image_size){
+        return 0;
+    }
+    server_persistent_state_t state;
+    load_server_state(&state);
+    uint32_t committed = 0;
+    for (uint32_t flash_client_index = 0; flash_client_index < MAX_SERVER_CONNECTIONS; flash_client_index++){
+        firmware_client_t *client = &firmware_clients[flash_client_index];
+        if (client->state != FIRMWARE_CLIENT_STAGED){
+            continue;
+        }
+        uint32_t connection_index = get_active_client_connection_index_from_flash_client_index(flash_client_index, state);
+        if (connection_index == INVALID_CLIENT_INDEX){
+            client->state = FIRMWARE_CLIENT_FAILED;
+            continue;
+        }
+        server_uart_connection_t *connection = &active_uart_server_connections[connection_index];
+        send_wakeup_if_dormant(flash_client_index, &state, connection->pin_pair, connection->uart_instance);
+        if (server_send_firmware_commit(connection->pin_pair, connection->uart_instance, firmware_image_crc)){
+            client->state = FIRMWARE_CLIENT_COMMITTED;
+            committed++;
+        }else{
+            client->state = FIRMWARE_CLIENT_FAILED;
+        }
+    }
+    return committed;
+}
+
+void server_firmware_restart(void){
+    uint32_t sectors = (firmware_image_size + FIRMWARE_SECTOR_SIZE - 1) / FIRMWARE_SECTOR_SIZE;
+    event_log_flush_all();
+    stdio_flush();
+    sleep_ms(sectors * FIRMWARE_COPY_MS_PER_SECTOR);
+    signal_reset_for_all_clients();
+    watchdog_reboot(0, 0, 0);
+    while (true){
+        tight_loop_contents();
+    }
+}
+
+void server_firmware_print_machine(void){
+    if (firmware_image_size){
+        printf("FIRMWARE IMAGE %lu %08lx\n", (unsigned long)firmware_image_size, (unsigned long)firmware_image_crc);
+    }
+    for (uint32_t flash_client_index = 0; flash_client_index < MAX_SERVER_CONNECTIONS; flash_client_index++){
+        const firmware_client_t *client = &firmware_clients[flash_client_index];
+        if (client->state == FIRMWARE_CLIENT_NONE){
+            continue;
+        }
+        printf("FIRMWARE %lu %s %lu %lu %lu %lu\n",
+            (unsigned long)flash_client_index, firmware_state_names[client->state], (unsigned long)client->baudrate,
+            (unsigned long)client->frames_sent, (unsigned long)client->retries, (unsigned long)client->elapsed_ms);
+    }
+}
@@ -0,0 +1,399 @@
+/**
+ * @file flash_telemetry.c
+ * @brief Flash wear counters, persistence and reporting.
+ *
+ * Counters are updated under a hardware spinlock. Every path that erases
+ * flash stores them afterwards as the next page of the telemetry sector,
+ * with a generation number; the newest valid page is loaded at boot. A
+ * page torn by a power cut fails its CRC and the previous one is used. The
+ * sector holds `SERVER_SECTOR_SIZE / SERVER_PAGE_SIZE` pages, so it is
+ * erased once per that many stores.
+ *
+ * @see flash_telemetry.h
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "hardware/flash.h"
+#include "hardware/sync.h"
+
+#include "flash_telemetry.h"
+#include "server.h"
+#include "menu.h"
+#include "trace.h"
+
+#define FLASH_TELEMETRY_PAGES (SERVER_SECTOR_SIZE / SERVER_PAGE_SIZE)
+#define FLASH_TELEMETRY_LEGACY_MAGIC 0x574C4654u   ///< "TFLW", older images
+#define FLASH_TELEMETRY_LEGACY_SECTORS 8
+
+extern char __flash_binary_end;
+
+/**
+ * @brief Region of the flash layout whose erase units are counted one by one.
+ */
+typedef struct{
+    uint32_t offset;
+    uint32_t length;
+    uint32_t unit;              ///< Bytes erased together, counted as one
+}flash_telemetry_region_t;
+
+static const flash_telemetry_region_t flash_telemetry_regions[] = {
+    {SERVER_FLASH_OFFSET, SERVER_SECTOR_SIZE, SERVER_SECTOR_SIZE},
+    {PRESET_LIBRARY_OFFSET, 2 * PRESET_LIBRARY_BANK_SIZE, SERVER_SECTOR_SIZE},
+    {SCHEDULE_TABLE_OFFSET, SERVER_SECTOR_SIZE, SERVER_SECTOR_SIZE},
+    {INTERLOCK_TABLE_OFFSET, SERVER_SECTOR_SIZE, SERVER_SECTOR_SIZE},
+    {FIRMWARE_SERVER_STAGING_OFFSET, FLASH_TELEMETRY_STAGING_BLOCKS * FIRMWARE_BLOCK_SIZE, FIRMWARE_BLOCK_SIZE},
+    {EVENT_LOG_OFFSET, EVENT_LOG_SECTORS * SERVER_SECTOR_SIZE, SERVER_SECTOR_SIZE},
+    {FLASH_TELEMETRY_OFFSET, SERVER_SECTOR_SIZE, SERVER_SECTOR_SIZE},
+};
+
+/**
+ * @brief Telemetry as older images stored it in the last page of the state sector.
+ */
+typedef struct{
+    uint32_t magic;
+    uint32_t commits;
+    uint32_t page_programs;
+    uint32_t untracked_erases;
+    uint64_t bytes_written;
+    uint64_t total_commit_us;
+    uint32_t last_commit_us;
+    uint32_t max_commit_us;
+    struct{
+        uint32_t offset;
+        uint32_t erases;
+    }sectors[FLASH_TELEMETRY_LEGACY_SECTORS];
+    uint32_t crc;
+}flash_telemetry_legacy_t;
+
+static flash_telemetry_t telemetry;
+static flash_telemetry_t telemetry_snapshot;
+static spin_lock_t *telemetry_lock = NULL;
+static uint32_t boot_erases = 0;
+static uint32_t telemetry_next_page = FLASH_TELEMETRY_PAGES;   ///< Page of the next store, the sector is erased first past the end
+static bool telemetry_in_flash = false;    ///< The telemetry sector lies above the program image
+
+/**
+ * @brief Returns the CRC of a telemetry block, excluding its CRC field.
+ *
+ * @param block Telemetry block.
+ * @return CRC32 of the block.
+ */
+static uint32_t flash_telemetry_crc(const flash_telemetry_t *block){
+    return compute_crc32(block, offsetof(flash_telemetry_t, crc));
+}
+
+/**
+ * @brief Returns one page of the telemetry sector as mapped in XIP flash.
+ *
+ * @param page Page index in the sector.
+ */
+static const flash_telemetry_t *flash_telemetry_page(uint32_t page){
+    return (const flash_telemetry_t *)(XIP_BASE + FLASH_TELEMETRY_OFFSET + page * SERVER_PAGE_SIZE);
+}
+
+/**
+ * @brief Tells whether a page of the telemetry sector can be programmed without an erase.
+ *
+ * @param page Page index in the sector.
+ * @return true if every byte of the page reads 0xFF.
+ */
+static bool flash_telemetry_page_is_erased(uint32_t page){
+    const uint32_t *words = (const uint32_t *)flash_telemetry_page(page);
+    for (uint32_t index = 0; index < SERVER_PAGE_SIZE / sizeof(uint32_t); index++){
+        if (words[index] != 0xFFFFFFFFu){
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Counts erases of every unit a flash range touches. Caller must hold the telemetry lock.
+ *
+ * Sectors outside the flash layout are counted as untracked.
+ *
+ * @param offset Flash offset of the erased range.
+ * @param length Length of the erased range in bytes.
+ * @param erases Number of erases to count.
+ */
+static void flash_telemetry_count_erases(uint32_t offset, uint32_t length, uint32_t erases){
+    uint32_t index = 0;
+    uint32_t tracked_length = 0;
+    for (uint8_t region_index = 0; region_index < count_of(flash_telemetry_regions); region_index++){
+        const flash_telemetry_region_t *region = &flash_telemetry_regions[region_index];
+        for (uint32_t unit_offset = region->offset; unit_offset < region->offset + region->length; unit_offset += region->unit, index++){
+            if (unit_offset < offset + length && offset < unit_offset + region->unit){
+                telemetry.erases[index] += erases;
+                tracked_length += region->unit;
+            }
+        }
+    }
+    if (length > tracked_length){
+        telemetry.untracked_erases += (length - tracked_length) / SERVER_SECTOR_SIZE * erases;
+    }
+}
+
+/**
+ * @brief Carries over the counters an older image kept in the state sector.
+ *
+ * @return false if no valid telemetry is stored there.
+ */
+static bool flash_telemetry_load_legacy(void){
+    const flash_telemetry_legacy_t *stored = (const flash_telemetry_legacy_t *)(SERVER_FLASH_ADDR + SERVER_TELEMETRY_SECTOR_OFFSET);
+    if (stored->magic != FLASH_TELEMETRY_LEGACY_MAGIC || stored->crc != compute_crc32(stored, offsetof(flash_telemetry_legacy_t, crc))){
+        return false;
+    }
+    telemetry.commits = stored->commits;
+    telemetry.page_programs = stored->page_programs;
+    telemetry.untracked_erases = stored->untracked_erases;
+    telemetry.bytes_written = stored->bytes_written;
+    telemetry.total_commit_us = stored->total_commit_us;
+    telemetry.last_commit_us = stored->last_commit_us;
+    telemetry.max_commit_us = stored->max_commit_us;
+    for (uint8_t index = 0; index < FLASH_TELEMETRY_LEGACY_SECTORS; index++){
+        if (stored->sectors[index].erases){
+            flash_telemetry_count_erases(stored->sectors[index].offset, SERVER_SECTOR_SIZE, stored->sectors[index].erases);
+        }
+    }
+    return true;
+}
+
+void flash_telemetry_init(void){
+    telemetry_lock = spin_lock_instance(spin_lock_claim_unused(true));
+    memset(&telemetry, 0, sizeof(telemetry));
+    telemetry.magic = FLASH_TELEMETRY_MAGIC;
+
+    uint32_t binary_end = (uint32_t)((uintptr_t)&__flash_binary_end - XIP_BASE);
+    telemetry_in_flash = binary_end <= FLASH_TELEMETRY_OFFSET;
+    if (!telemetry_in_flash){
+        return;
+    }
+
+    const flash_telemetry_t *newest = NULL;
+    for (uint32_t page = 0; page < FLASH_TELEMETRY_PAGES; page++){
+        const flash_telemetry_t *stored = flash_telemetry_page(page);
+        if (stored->magic != FLASH_TELEMETRY_MAGIC || stored->crc != flash_telemetry_crc(stored)){
+            continue;
+        }
+        if (!newest || (int32_t)(stored->generation - newest->generation) > 0){
+            newest = stored;
+            telemetry_next_page = page + 1;
+        }
+    }
+    if (newest){
+        memcpy(&telemetry, newest, sizeof(telemetry));
+    }else{
+        flash_telemetry_load_legacy();
+    }
+}
+
+void flash_telemetry_record_erase(uint32_t offset, uint32_t length){
+    if (!telemetry_lock){
+        return;
+    }
+    uint32_t irq = spin_lock_blocking(telemetry_lock);
+    flash_telemetry_count_erases(offset, length, 1);
+    boot_erases += length / SERVER_SECTOR_SIZE;
+    spin_unlock(telemetry_lock, irq);
+}
+
+void flash_telemetry_record_program(uint32_t length){
+    if (!telemetry_lock){
+        return;
+    }
+    uint32_t irq = spin_lock_blocking(telemetry_lock);
+    telemetry.page_programs += length / SERVER_PAGE_SIZE;
+    telemetry.bytes_written += length;
+    spin_unlock(telemetry_lock, irq);
+}
+
+void flash_telemetry_record_commit(uint32_t elapsed_us){
+    if (!telemetry_lock){
+        return;
+    }
+    uint32_t irq = spin_lock_blocking(telemetry_lock);
+    telemetry.commits++;
+    telemetry.total_commit_us += elapsed_us;
+    telemetry.last_commit_us = elapsed_us;
+    if (elapsed_us > telemetry.max_commit_us){
+        telemetry.max_commit_us = elapsed_us;
+    }
+    spin_unlock(telemetry_lock, irq);
+}
+
+void __not_in_flash_func(flash_telemetry_store)(void){
+    if (!telemetry_lock || !telemetry_in_flash){
+        return;
+    }
+    flash_telemetry_t block;
+    uint32_t irq = spin_lock_blocking(telemetry_lock);
+    uint32_t page = telemetry_next_page;
+    bool erase = page >= FLASH_TELEMETRY_PAGES || !flash_telemetry_page_is_erased(page);
+    if (erase){
+        page = 0;
+        flash_telemetry_count_erases(FLASH_TELEMETRY_OFFSET, SERVER_SECTOR_SIZE, 1);
+        boot_erases++;
+    }
+    telemetry_next_page = page + 1;
+    telemetry.generation++;
+    telemetry.page_programs++;
+    telemetry.bytes_written += SERVER_PAGE_SIZE;
+    memcpy(&block, &telemetry, sizeof(block));
+    spin_unlock(telemetry_lock, irq);
+
+    block.crc = flash_telemetry_crc(&block);
+    uint8_t buffer[SERVER_PAGE_SIZE];
+    memset(buffer, 0xFF, sizeof(buffer));
+    memcpy(buffer, &block, sizeof(block));
+    uint32_t offset = FLASH_TELEMETRY_OFFSET + page * SERVER_PAGE_SIZE;
+
+    bool locked_out = flash_lockout_begin();
+    uint32_t ints = save_and_disable_interrupts();
+    if (erase){
+        TRACE_BEGIN(TRACE_SPAN_FLASH_ERASE, 0, FLASH_TELEMETRY_OFFSET);
+        flash_range_erase(FLASH_TELEMETRY_OFFSET, SERVER_SECTOR_SIZE);
+        TRACE_END(TRACE_SPAN_FLASH_ERASE, 0, FLASH_TELEMETRY_OFFSET);
+    }
+    TRACE_BEGIN(TRACE_SPAN_FLASH_PROGRAM, 0, offset);
+    flash_range_program(offset, buffer, SERVER_PAGE_SIZE);
+    TRACE_END(TRACE_SPAN_FLASH_PROGRAM, 0, offset);
+    restore_interrupts(ints);
+    flash_lockout_end(locked_out);
+}
+
+/**
+ * @brief Returns where one erase counter sits in the flash layout.
+ *
+ * @param index  Counter index.
+ * @param offset Flash offset of the counted unit.
+ * @return Size of the counted unit in bytes.
+ */
+static uint32_t flash_telemetry_unit(uint32_t index, uint32_t *offset){
+    for (uint8_t region_index = 0; region_index < count_of(flash_telemetry_regions); region_index++){
+        const flash_telemetry_region_t *region = &flash_telemetry_regions[region_index];
+        uint32_t units = region->length / region->unit;
+        if (index < units){
+            *offset = region->offset + index * region->unit;
+            return region->unit;
+        }
+        index -= units;
+    }
+    *offset = 0;
+    return 0;
+}
+
+/**
+ * @brief Copies the live telemetry into the snapshot.
+ *
+ * @return Erase count of the most-worn tracked sector.
+ */
+static uint32_t flash_telemetry_take_snapshot(void){
+    uint32_t irq = spin_lock_blocking(telemetry_lock);
+    memcpy(&telemetry_snapshot, &telemetry, sizeof(telemetry));
+    spin_unlock(telemetry_lock, irq);
+
+    uint32_t max_erases = 0;
+    for (uint8_t index = 0; index < FLASH_TELEMETRY_SECTORS; index++){
+        if (telemetry_snapshot.erases[index] > max_erases){
+            max_erases = telemetry_snapshot.erases[index];
+        }
+    }
+    return max_erases;
+}
+
+/**
+ * @brief Returns the number of erases per hour since boot.
+ *
+ * @return Erase rate, 0 if no erase happened since boot.
+ */
+static uint32_t flash_telemetry_erases_per_hour(void){
+    uint64_t uptime_us = time_us_64();
+    return uptime_us ? (uint32_t)(((uint64_t)boot_erases * 3600000000ull) / uptime_us) : 0;
+}
+
+void flash_telemetry_print(void){
+    uint32_t max_erases = flash_telemetry_take_snapshot();
+    uint32_t remaining = max_erases < FLASH_RATED_ERASE_CYCLES ? FLASH_RATED_ERASE_CYCLES - max_erases : 0;
+    char string[BUFFER_MAX_STRING_SIZE];
+
+    printf_and_update_buffer("\nFlash Telemetry:\n");
+    snprintf(string, sizeof(string), "Commits: %lu\n", (unsigned long)telemetry_snapshot.commits);
+    printf_and_update_buffer(string);
+    snprintf(string, sizeof(string), "Commit Time: avg=%luus max=%luus last=%luus\n",
+        (unsigned long)(telemetry_snapshot.commits ? telemetry_snapshot.total_commit_us / telemetry_snapshot.commits : 0),
+        (unsigned long)telemetry_snapshot.max_commit_us,
+        (unsigned long)telemetry_snapshot.last_commit_us);
+    printf_and_update_buffer(string);
+
+    snprintf(string, sizeof(string), "Pages Programmed: %lu (%llu bytes)\n",
+        (unsigned long)telemetry_snapshot.page_programs,
+        (unsigned long long)telemetry_snapshot.bytes_written);
+    printf_and_update_buffer(string);
+
+    for (uint8_t index = 0; index < FLASH_TELEMETRY_SECTORS; index++){
+        uint32_t erases = telemetry_snapshot.erases[index];
+        if (erases){
+            uint32_t offset;
+            uint32_t size = flash_telemetry_unit(index, &offset);
+            snprintf(string, sizeof(string), "%s 0x%08lx: %lu erases (%lu.%02lu%% of rated)\n",
+                size > SERVER_SECTOR_SIZE ? "Block" : "Sector",
+                (unsigned long)offset,
+                (unsigned long)erases,
+                (unsigned long)(erases * 100ull / FLASH_RATED_ERASE_CYCLES),
+                (unsigned long)((erases * 10000ull / FLASH_RATED_ERASE_CYCLES) % 100));
+            printf_and_update_buffer(string);
+        }
+    }
+    if (telemetry_snapshot.untracked_erases){
+        snprintf(string, sizeof(string), "Other Sectors: %lu erases\n", (unsigned long)telemetry_snapshot.untracked_erases);
+        printf_and_update_buffer(string);
+    }
+
+    snprintf(string, sizeof(string), "Endurance Left: %lu erases on most-worn sector\n", (unsigned long)remaining);
+    printf_and_update_buffer(string);
+
+    uint32_t erases_per_hour = flash_telemetry_erases_per_hour();
+    if (erases_per_hour){
+        snprintf(string, sizeof(string), "Erase Rate: %lu/h since boot, ~%lu days left\n",
+            (unsigned long)erases_per_hour,
+            (unsigned long)(remaining / erases_per_hour / 24));
+    }else{
+        snprintf(string, sizeof(string), "Erase Rate: no erases since boot\n");
+    }
+    printf_and_update_buffer(string);
+}
+
+void flash_telemetry_print_machine(void){
+    uint32_t max_erases = flash_telemetry_take_snapshot();
+
+    printf("FLASH commits=%lu avg_commit_us=%lu max_commit_us=%lu last_commit_us=%lu "
+           "page_programs=%lu bytes_written=%llu untracked_erases=%lu "
+           "rated_cycles=%lu remaining_cycles=%lu boot_erases=%lu erases_per_hour=%lu\n",
+        (unsigned long)telemetry_snapshot.commits,
+        (unsigned long)(telemetry_snapshot.commits ? telemetry_snapshot.total_commit_us / telemetry_snapshot.commits : 0),
+        (unsigned long)telemetry_snapshot.max_commit_us,
+        (unsigned long)telemetry_snapshot.last_commit_us,
+        (unsigned long)telemetry_snapshot.page_programs,
+        (unsigned long long)telemetry_snapshot.bytes_written,
+        (unsigned long)telemetry_snapshot.untracked_erases,
+        (unsigned long)FLASH_RATED_ERASE_CYCLES,
+        (unsigned long)(max_erases < FLASH_RATED_ERASE_CYCLES ? FLASH_RATED_ERASE_CYCLES - max_erases : 0),
+        (unsigned long)boot_erases,
+        (unsigned long)flash_telemetry_erases_per_hour());
+
+    for (uint8_t index = 0; index < FLASH_TELEMETRY_SECTORS; index++){
+        uint32_t erases = telemetry_snapshot.erases[index];
+        if (erases){
+            uint32_t offset;
+            uint32_t size = flash_telemetry_unit(index, &offset);
+            printf("FLASH_SECTOR offset=0x%08lx erases=%lu size=%lu\n",
+                (unsigned long)offset,
+                (unsigned long)erases,
+                (unsigned long)size);
+        }
+    }
+}
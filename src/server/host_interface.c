@@ -0,0 +1,661 @@
+/**
+ * @file host_interface.c
+ * @brief Command table and line reader for the USB machine interface.
+ *
+ * Each command is a name plus a handler receiving the rest of the line.
+ * Handlers print their data lines and return true on success, after which
+ * `OK` is sent; on failure they print nothing and `ERR` is sent instead.
+ *
+ * @see host_interface.h
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+
+#include "host_interface.h"
+#include "server.h"
+#include "statistics.h"
+#include "profiler.h"
+#include "log.h"
+#include "flash_telemetry.h"
+#include "event_log.h"
+
+typedef struct{
+    const char *name;
+    bool (*handler)(const char *arguments);
+}host_command_t;
+
+/**
+ * @brief `STATS [RESET]` - prints all runtime statistics.
+ *
+ * @param arguments Empty, or `RESET` to clear the statistics after reading.
+ * @return true if the arguments were valid.
+ */
+static bool host_command_stats(const char *arguments){
+    bool reset = strcmp(arguments, "RESET") == 0;
+    if (!reset && arguments[0] != '\0'){
+        return false;
+    }
+    statistics_print_machine(reset);
+    return true;
+}
+
+/**
+ * @brief `PROFILE [RESET]` - prints the PC sample and function cycle profile.
+ *
+ * @param arguments Empty, or `RESET` to clear the profile after reading.
+ * @return true if the arguments were valid.
+ */
+static bool host_command_profile(const char *arguments){
+    bool reset = strcmp(arguments, "RESET") == 0;
+    if (!reset && arguments[0] != '\0'){
+        return false;
+    }
+    profiler_dump(reset);
+    return true;
+}
+
+/**
+ * @brief `LOG [RESET]` - prints the raw binary log records.
+ *
+ * @param arguments Empty, or `RESET` to clear the log after reading.
+ * @return true if the arguments were valid.
+ */
+static bool host_command_log(const char *arguments){
+    bool reset = strcmp(arguments, "RESET") == 0;
+    if (!reset && arguments[0] != '\0'){
+        return false;
+    }
+    log_dump_machine(reset);
+    return true;
+}
+
+/**
+ * @brief `EVENTS [CLEAR]` - prints the persistent event log.
+ *
+ * @param arguments Empty, or `CLEAR` to erase the log after reading.
+ * @return true if the arguments were valid.
+ */
+static bool host_command_events(const char *arguments){
+    bool clear = strcmp(arguments, "CLEAR") == 0;
+    if (!clear && arguments[0] != '\0'){
+        return false;
+    }
+    event_log_print_machine();
+    if (clear){
+        event_log_clear();
+    }
+    return true;
+}
+
+/**
+ * @brief `FLASH` - prints flash wear and commit telemetry.
+ *
+ * @param arguments Must be empty.
+ * @return true if the arguments were valid.
+ */
+static bool host_command_flash(const char *arguments){
+    if (arguments[0] != '\0'){
+        return false;
+    }
+    flash_telemetry_print_machine();
+    return true;
+}
+
+/**
+ * @brief `TIME [seconds]` - prints or sets the server clock.
+ *
+ * Prints `TIME <seconds>` with the current clock. Setting the clock
+ * reschedules all pending schedule entries.
+ *
+ * @param arguments Empty, or the new clock value in seconds (e.g. Unix time).
+ * @return true if the arguments were valid.
+ */
+static bool host_command_time(const char *arguments){
+    if (arguments[0] != '\0'){
+        char *end;
+        unsigned long now_s = strtoul(arguments, &end, 10);
+        if (*end != '\0' || now_s > UINT32_MAX){
+            return false;
+        }
+        scheduler_clock_set((uint32_t)now_s);
+    }
+    printf("TIME %lu\n", (unsigned long)scheduler_clock_now());
+    return true;
+}
+
+/**
+ * @brief `SCHEDULE [ADD ...|DELETE <index>]` - lists, adds or deletes schedule entries.
+ *
+ * - `SCHEDULE` prints one line per pending entry:
+ *   `SCHEDULE <index> <action> <client> <target> <value> <time_s> <period_s> <next_s>`
+ * - `SCHEDULE ADD <action> <client> <target> <value> <time_s> <period_s>`
+ *   stores an entry and prints `SCHEDULE <index>`. Times use the server clock.
+ * - `SCHEDULE DELETE <index>` removes an entry.
+ *
+ * @param arguments Subcommand and its decimal arguments.
+ * @return true if the arguments were valid and the table was updated.
+ */
+static bool host_command_schedule(const char *arguments){
+    if (arguments[0] == '\0'){
+        scheduler_print_machine();
+        return true;
+    }
+
+    unsigned long values[6];
+    int length = 0;
+    if (sscanf(arguments, "ADD %lu %lu %lu %lu %lu %lu%n",
+            &values[0], &values[1], &values[2], &values[3], &values[4], &values[5], &length) == 6 &&
+        arguments[length] == '\0'){
+        if (values[0] > UINT8_MAX || values[1] > UINT8_MAX || values[2] > UINT8_MAX || values[3] > UINT8_MAX ||
+            values[4] > UINT32_MAX || values[5] > UINT32_MAX){
+            return false;
+        }
+        schedule_entry_t entry = {
+            .time_s = (uint32_t)values[4],
+            .period_s = (uint32_t)values[5],
+            .action = (uint8_t)values[0],
+            .flash_client_index = (uint8_t)values[1],
+            .target = (uint8_t)values[2],
+            .value = (uint8_t)values[3],
+        };
+        int32_t schedule_index = scheduler_add(&entry);
+        if (schedule_index < 0){
+            return false;
+        }
+        printf("SCHEDULE %ld\n", (long)schedule_index);
+        return true;
+    }
+
+    if (sscanf(arguments, "DELETE %lu%n", &values[0], &length) == 1 && arguments[length] == '\0'){
+        return values[0] < SCHEDULE_MAX_ENTRIES && scheduler_remove((uint32_t)values[0]);
+    }
+    return false;
+}
+
+/**
+ * @brief Reads one line from USB without echo.
+ *
+ * @param line      Destination buffer.
+ * @param line_size Size of the destination buffer.
+ */
+static void host_interface_read_line(char *line, uint32_t line_size){
+    uint32_t len = 0;
+    while (true){
+        int ch = getchar();
+        if (ch == '\r' || ch == '\n'){
+            if (len > 0){
+                break;
+            }
+            continue;
+        }
+        if (len < line_size - 1){
+            line[len++] = (char)ch;
+        }
+    }
+    line[len] = '\0';
+}
+
+/**
+ * @brief Applies a `F <client> <mask> [<client> <mask> ...]` stream line.
+ *
+ * @param arguments Client indexes and hexadecimal GPIO masks, in pairs.
+ * @return true if every pair was valid and queued.
+ */
+static bool host_stream_frame(const char *arguments){
+    bool any = false;
+    while (*arguments){
+        char *end;
+        unsigned long flash_client_index = strtoul(arguments, &end, 10);
+        if (end == arguments || *end != ' '){
+            return false;
+        }
+        arguments = end;
+        unsigned long gpio_mask = strtoul(arguments, &end, 16);
+        if (end == arguments || !stream_set_mask((uint32_t)flash_client_index, (uint32_t)gpio_mask)){
+            return false;
+        }
+        arguments = end;
+        while (*arguments == ' ') arguments++;
+        any = true;
+    }
+    return any;
+}
+
+/**
+ * @brief `STREAM <rate_hz>` - forwards streamed output masks until `END`.
+ *
+ * Replies `OK` once streaming, then reads lines without replying to them:
+ * - `F <client> <mask> [...]` queues hexadecimal GPIO masks for clients;
+ *   only invalid lines are answered, with `ERR invalid frame`.
+ * - `S` prints the `STREAM` counter lines followed by `OK`.
+ * - `END` stops the stream and restores the stored client states; the
+ *   final `STREAM` lines are then printed before the closing `OK`.
+ *
+ * @param arguments Tick rate in Hz.
+ * @return true if the stream ran.
+ */
+static bool host_command_stream(const char *arguments){
+    unsigned long rate_hz;
+    int length = 0;
+    if (sscanf(arguments, "%lu%n", &rate_hz, &length) != 1 || arguments[length] != '\0' || !stream_start((uint32_t)rate_hz)){
+        return false;
+    }
+    printf("OK\n");
+
+    while (true){
+        char line[HOST_INTERFACE_LINE_SIZE];
+        host_interface_read_line(line, sizeof(line));
+
+        if (line[0] == 'F' && line[1] == ' '){
+            if (!host_stream_frame(line + 2)){
+                printf("ERR invalid frame\n");
+            }
+        }else if (strcmp(line, "S") == 0){
+            stream_print_machine();
+            printf("OK\n");
+        }else if (strcmp(line, "END") == 0){
+            break;
+        }else{
+            printf("ERR unknown command\n");
+        }
+    }
+    stream_stop();
+    stream_print_machine();
+    return true;
+}
+
+/**
+ * @brief `SEQUENCE <client> [<subcommand> ...]` - uploads and controls a client sequence.
+ *
+ * Subcommands:
+ * - none: prints `SEQUENCE <client> <playing> <step> <loops_done>`
+ * - `DEFINE <steps> <loops>`: clears the sequence, 0 loops plays for ever
+ * - `STEP <step> <mask> <duration_us>`: sets a step, mask in hexadecimal
+ * - `START [<step>]`, `STOP`, `SEEK <step>`: controls playback
+ *
+ * @param arguments Client index, subcommand and its arguments.
+ * @return true if the arguments were valid and the client was reached.
+ */
+static bool host_command_sequence(const char *arguments){
+    unsigned long flash_client_index;
+    int length = 0;
+    if (sscanf(arguments, "%lu%n", &flash_client_index, &length) != 1 || flash_client_index >= MAX_SERVER_CONNECTIONS){
+        return false;
+    }
+    arguments += length;
+    while (*arguments == ' ') arguments++;
+
+    unsigned long values[3];
+    if (arguments[0] == '\0'){
+        bool playing;
+        uint32_t step;
+        uint32_t loops_done;
+        if (!server_sequence_status((uint32_t)flash_client_index, &playing, &step, &loops_done)){
+            return false;
+        }
+        printf("SEQUENCE %lu %u %lu %lu\n", flash_client_index, playing, (unsigned long)step, (unsigned long)loops_done);
+        return true;
+    }
+    if (sscanf(arguments, "DEFINE %lu %lu%n", &values[0], &values[1], &length) == 2 && arguments[length] == '\0'){
+        return values[1] <= UINT32_MAX && server_sequence_define((uint32_t)flash_client_index, (uint32_t)values[0], (uint32_t)values[1]);
+    }
+    if (sscanf(arguments, "STEP %lu %lx %lu%n", &values[0], &values[1], &values[2], &length) == 3 && arguments[length] == '\0'){
+        return values[1] <= UINT32_MAX && values[2] <= UINT32_MAX &&
+            server_sequence_set_step((uint32_t)flash_client_index, (uint32_t)values[0], (uint32_t)values[1], (uint32_t)values[2]);
+    }
+    if (strcmp(arguments, "START") == 0){
+        return server_sequence_control((uint32_t)flash_client_index, SEQUENCE_CONTROL_START, 0);
+    }
+    if (sscanf(arguments, "START %lu%n", &values[0], &length) == 1 && arguments[length] == '\0'){
+        return server_sequence_control((uint32_t)flash_client_index, SEQUENCE_CONTROL_START, (uint32_t)values[0]);
+    }
+    if (strcmp(arguments, "STOP") == 0){
+        return server_sequence_control((uint32_t)flash_client_index, SEQUENCE_CONTROL_STOP, 0);
+    }
+    if (sscanf(arguments, "SEEK %lu%n", &values[0], &length) == 1 && arguments[length] == '\0'){
+        return server_sequence_control((uint32_t)flash_client_index, SEQUENCE_CONTROL_SEEK, (uint32_t)values[0]);
+    }
+    return false;
+}
+
+/**
+ * @brief `INPUT [<client> <gpio> <mode> <debounce_ms>]` - prints or configures client inputs.
+ *
+ * Without arguments, prints the `INPUT` lines of every client with inputs.
+ * Modes: 0 release, 1 floating, 2 pull-up, 3 pull-down.
+ *
+ * @param arguments Empty, or the input configuration in decimal.
+ * @return true if the arguments were valid and the client was reached.
+ */
+static bool host_command_input(const char *arguments){
+    if (arguments[0] == '\0'){
+        server_input_print_machine();
+        return true;
+    }
+
+    unsigned long values[4];
+    int length = 0;
+    if (sscanf(arguments, "%lu %lu %lu %lu%n", &values[0], &values[1], &values[2], &values[3], &length) != 4 ||
+        arguments[length] != '\0' || values[1] >= 32 || values[2] >= INPUT_MODE_COUNT){
+        return false;
+    }
+    return server_input_configure((uint32_t)values[0], (uint8_t)values[1], (input_mode_t)values[2], (uint32_t)values[3]);
+}
+
+/**
+ * @brief `RULE [<client> <rule> <gpio> <edges> <mask> <on_ms>]` - prints or sets client-local rules.
+ *
+ * Without arguments, prints the `RULE` lines of every rule. Edges are bits,
+ * 1 rising and 2 falling, and 0 clears the rule. The mask is hexadecimal,
+ * and an `on_ms` of 0 leaves the outputs ON.
+ *
+ * @param arguments Empty, or the rule.
+ * @return true if the arguments were valid and the client was reached.
+ */
+static bool host_command_rule(const char *arguments){
+    if (arguments[0] == '\0'){
+        server_client_rules_print_machine();
+        return true;
+    }
+
+    unsigned long values[6];
+    int length = 0;
+    if (sscanf(arguments, "%lu %lu %lu %lu %lx %lu%n", &values[0], &values[1], &values[2], &values[3], &values[4], &values[5], &length) != 6 ||
+        arguments[length] != '\0' || values[2] >= 32 || values[4] > UINT32_MAX || values[5] > UINT32_MAX){
+        return false;
+    }
+    return server_client_rule_set((uint32_t)values[0], (uint32_t)values[1], (uint8_t)values[2], (uint32_t)values[3], (uint32_t)values[4], (uint32_t)values[5]);
+}
+
+/**
+ * @brief `INTERLOCK [ADD ...|DELETE <index>]` - lists, adds or deletes cross-client interlocks.
+ *
+ * - `INTERLOCK` prints one line per interlock:
+ *   `INTERLOCK <index> <source_client> <source_gpio> <edges> <target_client> <target_gpio> <action> <fires>`
+ * - `INTERLOCK ADD <source_client> <source_gpio> <edges> <target_client> <target_gpio> <action>`
+ *   stores an interlock and prints `INTERLOCK <index>`. Edges are bits, 1
+ *   rising and 2 falling. Actions: 0 OFF, 1 ON, 2 toggle.
+ * - `INTERLOCK DELETE <index>` removes an interlock.
+ *
+ * @param arguments Subcommand and its decimal arguments.
+ * @return true if the arguments were valid and the table was updated.
+ */
+static bool host_command_interlock(const char *arguments){
+    if (arguments[0] == '\0'){
+        server_interlock_print_machine();
+        return true;
+    }
+
+    unsigned long values[6];
+    int length = 0;
+    if (sscanf(arguments, "ADD %lu %lu %lu %lu %lu %lu%n",
+            &values[0], &values[1], &values[2], &values[3], &values[4], &values[5], &length) == 6 &&
+        arguments[length] == '\0'){
+        for (uint32_t index = 0; index < count_of(values); index++){
+            if (values[index] > UINT8_MAX){
+                return false;
+            }
+        }
+        interlock_entry_t entry = {
+            .source_client = (uint8_t)values[0],
+            .source_gpio = (uint8_t)values[1],
+            .edges = (uint8_t)values[2],
+            .target_client = (uint8_t)values[3],
+            .target_gpio = (uint8_t)values[4],
+            .action = (uint8_t)values[5],
+        };
+        int32_t interlock_index = server_interlock_add(&entry);
+        if (interlock_index < 0){
+            return false;
+        }
+        printf("INTERLOCK %ld\n", (long)interlock_index);
+        return true;
+    }
+
+    if (sscanf(arguments, "DELETE %lu%n", &values[0], &length) == 1 && arguments[length] == '\0'){
+        return values[0] < INTERLOCK_MAX_ENTRIES && server_interlock_remove((uint32_t)values[0]);
+    }
+    return false;
+}
+
+/**
+ * @brief `PWM [<client> <bits> <gpio> <duty> [<gpio> <duty> ...]]` - prints or sets PWM duties.
+ *
+ * Without arguments, prints the `PWM` lines of every PWM output. Duties are
+ * 8-bit (0-255) or 16-bit (0-65535) as given by `bits`. A duty of 0 makes
+ * the GPIO a digital output again; the ON/OFF state is not changed.
+ *
+ * @param arguments Empty, or the client, the duty width and GPIO/duty pairs in decimal.
+ * @return true if the arguments were valid and the client was reached.
+ */
+static bool host_command_pwm(const char *arguments){
+    if (arguments[0] == '\0'){
+        server_pwm_print_machine();
+        return true;
+    }
+
+    unsigned long flash_client_index;
+    unsigned long bits;
+    int length = 0;
+    if (sscanf(arguments, "%lu %lu%n", &flash_client_index, &bits, &length) != 2 || (bits != 8 && bits != 16)){
+        return false;
+    }
+    uint8_t gpio_numbers[MAX_NUMBER_OF_GPIOS];
+    uint16_t duties[MAX_NUMBER_OF_GPIOS];
+    uint32_t count = 0;
+    arguments += length;
+    while (arguments[0] != '\0'){
+        unsigned long values[2];
+        if (count == MAX_NUMBER_OF_GPIOS || sscanf(arguments, " %lu %lu%n", &values[0], &values[1], &length) != 2 ||
+            values[0] >= 32 || values[1] > (bits == 8 ? UINT8_MAX : UINT16_MAX)){
+            return false;
+        }
+        gpio_numbers[count] = (uint8_t)values[0];
+        duties[count] = (uint16_t)(bits == 8 ? values[1] * 257u : values[1]);
+        count++;
+        arguments += length;
+    }
+    return server_pwm_set((uint32_t)flash_client_index, count, gpio_numbers, duties);
+}
+
+/**
+ * @brief `ADC [<client> <mask> <rate_hz> <decimation>|READ <client>]` - client ADC sampling.
+ *
+ * - `ADC` prints the `ADC` line of every client that samples.
+ * - `ADC <client> <mask> <rate_hz> <decimation>` starts sampling the ADC
+ *   inputs of the hexadecimal mask, or stops it with a mask of 0.
+ * - `ADC READ <client>` prints the waiting blocks as `ADCBLOCK` lines and
+ *   releases them.
+ *
+ * @param arguments Subcommand and its arguments.
+ * @return true if the arguments were valid and the client was reached.
+ */
+static bool host_command_adc(const char *arguments){
+    if (arguments[0] == '\0'){
+        server_adc_print_machine();
+        return true;
+    }
+
+    unsigned long values[4];
+    int length = 0;
+    if (sscanf(arguments, "READ %lu%n", &values[0], &length) == 1 && arguments[length] == '\0'){
+        return server_adc_print_blocks((uint32_t)values[0]);
+    }
+    if (sscanf(arguments, "%lu %lx %lu %lu%n", &values[0], &values[1], &values[2], &values[3], &length) == 4 &&
+        arguments[length] == '\0' && values[1] <= UINT32_MAX && values[2] <= UINT32_MAX && values[3] <= UINT32_MAX){
+        return server_adc_configure((uint32_t)values[0], (uint32_t)values[1], (uint32_t)values[2], (uint32_t)values[3]);
+    }
+    return false;
+}
+
+/**
+ * @brief `LOGIC [<client> <first_gpio> <pin_count> <rate_hz>|ARM <client> <mask> <value>|READ <client>]` - logic capture.
+ *
+ * - `LOGIC` prints the `LOGIC` line of the capture.
+ * - `LOGIC <client> <first_gpio> <pin_count> <rate_hz>` sets up a capture
+ *   of consecutive GPIOs, or releases it with a pin count of 0.
+ * - `LOGIC ARM <client> <mask> <value>` arms it; the hexadecimal trigger
+ *   mask and value are relative to the first GPIO, mask 0 starts at once.
+ * - `LOGIC READ <client>` prints the collected runs as `LOGICRUNS` lines
+ *   and releases them.
+ *
+ * @param arguments Subcommand and its arguments.
+ * @return true if the arguments were valid and the client was reached.
+ */
+static bool host_command_logic(const char *arguments){
+    if (arguments[0] == '\0'){
+        server_logic_print_machine();
+        return true;
+    }
+
+    unsigned long values[4];
+    int length = 0;
+    if (sscanf(arguments, "READ %lu%n", &values[0], &length) == 1 && arguments[length] == '\0'){
+        return server_logic_print_runs((uint32_t)values[0]);
+    }
+    if (sscanf(arguments, "ARM %lu %lx %lx%n", &values[0], &values[1], &values[2], &length) == 3 && arguments[length] == '\0' &&
+        values[1] <= UINT32_MAX && values[2] <= UINT32_MAX){
+        return server_logic_arm((uint32_t)values[0], (uint32_t)values[1], (uint32_t)values[2]);
+    }
+    if (sscanf(arguments, "%lu %lu %lu %lu%n", &values[0], &values[1], &values[2], &values[3], &length) == 4 &&
+        arguments[length] == '\0' && values[1] < 32 && values[2] <= 32 && values[3] <= UINT32_MAX){
+        return server_logic_configure((uint32_t)values[0], (uint8_t)values[1], (uint8_t)values[2], (uint32_t)values[3]);
+    }
+    return false;
+}
+
+/**
+ * @brief `FIRMWARE [LOAD <size> <crc32>|PUSH <client>|COMMIT]` - client firmware update.
+ *
+ * - `FIRMWARE` prints the `FIRMWARE` lines of the image and of the
+ *   clients it was pushed to.
+ * - `FIRMWARE LOAD <size> <crc32>` replies `OK`, then reads exactly
+ *   `size` raw image bytes; the hexadecimal CRC-32 is checked once they
+ *   are programmed, before the closing `OK`.
+ * - `FIRMWARE PUSH <client>` transfers the image to a client.
+ * - `FIRMWARE COMMIT` swaps the image in on every client holding it, prints
+ *   the `FIRMWARE` lines and `OK`, then restarts the server and the clients.
+ *
+ * @param arguments Subcommand and its arguments.
+ * @return true if the arguments were valid and the step succeeded.
+ */
+static bool host_command_firmware(const char *arguments){
+    if (arguments[0] == '\0'){
+        server_firmware_print_machine();
+        return true;
+    }
+
+    unsigned long values[2];
+    int length = 0;
+    if (sscanf(arguments, "LOAD %lu %lx%n", &values[0], &values[1], &length) == 2 && arguments[length] == '\0' &&
+        values[0] <= UINT32_MAX && values[1] <= UINT32_MAX){
+        return server_firmware_load((uint32_t)values[0], (uint32_t)values[1]);
+    }
+    if (sscanf(arguments, "PUSH %lu%n", &values[0], &length) == 1 && arguments[length] == '\0'){
+        return server_firmware_push((uint32_t)values[0]);
+    }
+    if (strcmp(arguments, "COMMIT") == 0){
+        if (!server_firmware_commit()){
+            return false;
+        }
+        server_firmware_print_machine();
+        printf("OK\n");
+        server_firmware_restart();
+    }
+    return false;
+}
+
+/**
+ * @brief `AUDIT` - prints the `AUDIT` lines of the background output audit.
+ *
+ * @param arguments Must be empty.
+ * @return true if the arguments were valid.
+ */
+static bool host_command_audit(const char *arguments){
+    if (arguments[0] != '\0'){
+        return false;
+    }
+    server_audit_print_machine();
+    return true;
+}
+
+/**
+ * @brief `GOVERNOR` - prints the `GOVERNOR` line of the clock governor.
+ *
+ * @param arguments Must be empty.
+ * @return true if the arguments were valid.
+ */
+static bool host_command_governor(const char *arguments){
+    if (arguments[0] != '\0'){
+        return false;
+    }
+    server_clock_governor_print_machine();
+    return true;
+}
+
+static const host_command_t host_commands[] = {
+    {"STATS", host_command_stats},
+    {"PROFILE", host_command_profile},
+    {"LOG", host_command_log},
+    {"EVENTS", host_command_events},
+    {"FLASH", host_command_flash},
+    {"TIME", host_command_time},
+    {"SCHEDULE", host_command_schedule},
+    {"STREAM", host_command_stream},
+    {"SEQUENCE", host_command_sequence},
+    {"INPUT", host_command_input},
+    {"RULE", host_command_rule},
+    {"INTERLOCK", host_command_interlock},
+    {"PWM", host_command_pwm},
+    {"ADC", host_command_adc},
+    {"LOGIC", host_command_logic},
+    {"FIRMWARE", host_command_firmware},
+    {"AUDIT", host_command_audit},
+    {"GOVERNOR", host_command_governor},
+};
+
+/**
+ * @brief Looks up and runs the command on a line.
+ *
+ * @param line Full command line.
+ */
+static void host_interface_dispatch(const char *line){
+    for (uint32_t index = 0; index < count_of(host_commands); index++){
+        size_t name_length = strlen(host_commands[index].name);
+        if (strncmp(line, host_commands[index].name, name_length) == 0 &&
+            (line[name_length] == '\0' || line[name_length] == ' ')){
+            const char *arguments = line + name_length;
+            while (*arguments == ' ') arguments++;
+
+            uint32_t packed_name = 0;
+            memcpy(&packed_name, line, name_length < sizeof(packed_name) ? name_length : sizeof(packed_name));
+            event_log_write(EVENT_COMMAND, 1, packed_name);
+
+            if (host_commands[index].handler(arguments)){
+                printf("OK\n");
+            }else{
+                printf("ERR invalid arguments\n");
+            }
+            return;
+        }
+    }
+    printf("ERR unknown command\n");
+}
+
+void host_interface_run(void){
+    printf("\nREADY\n");
+    while (true){
+        char line[HOST_INTERFACE_LINE_SIZE];
+        host_interface_read_line(line, sizeof(line));
+
+        if (strcmp(line, "EXIT") == 0){
+            printf("OK\n");
+            return;
+        }
+        host_interface_dispatch(line);
+    }
+}
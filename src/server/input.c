@@ -157,6 +157,167 @@ void read_reset_variant(uint32_t *reset_variant){
     }
 }
 
+bool choose_diagnostics_option(uint32_t *diagnostics_option){
+    printf_and_update_buffer("1. Dump Event Trace (Chrome JSON).\n2. Show Statistics.\n3. Show And Reset Statistics.\n4. Dump Profile.\n5. Show Log.\n6. Show Flash Telemetry.\n");
+
+    const char *MESSAGE = "\nWhat diagnostics do you want to run?";
+    print_cancel_message();
+    if (read_user_choice_in_range(MESSAGE, diagnostics_option, MINIMUM_DIAGNOSTICS_OPTION_INPUT, MAXIMUM_DIAGNOSTICS_OPTION_INPUT)){
+        return true;
+    }
+
+    return false;
+}
+
+void read_diagnostics_option(uint32_t *diagnostics_option){
+    bool correct_diagnostics_input = false;
+    while (!correct_diagnostics_input){
+        if (choose_diagnostics_option(diagnostics_option)){
+            correct_diagnostics_input = true;
+        }else{
+            print_input_error();
+            printf_and_update_buffer("\n");
+        }
+    }
+}
+
+/**
+ * @brief Repeats a prompt until a number in range is entered.
+ *
+ * @param message Prompt to display.
+ * @param out     Output number.
+ * @param min     Minimum allowed value (inclusive).
+ * @param max     Maximum allowed value (inclusive).
+ */
+static void read_number_until_valid(const char *message, uint32_t *out, uint32_t min, uint32_t max){
+    print_cancel_message();
+    while (!read_user_choice_in_range(message, out, min, max)){
+        print_input_error();
+        printf_and_update_buffer("\n");
+    }
+}
+
+bool read_timed_output_parameters(uint32_t *pulse_count, uint32_t *on_ms, uint32_t *off_ms){
+    printf_and_update_buffer("\n1 pulse = ON for a time, then OFF.\n");
+    read_number_until_valid("\nHow many pulses?", pulse_count, MINIMUM_PULSE_COUNT_INPUT, MAXIMUM_PULSE_COUNT_INPUT);
+    if (!*pulse_count){
+        return false;
+    }
+
+    read_number_until_valid("\nON time in ms?", on_ms, MINIMUM_PULSE_TIME_MS_INPUT, MAXIMUM_PULSE_TIME_MS_INPUT);
+    if (!*on_ms){
+        return false;
+    }
+
+    *off_ms = 0;
+    if (*pulse_count > 1){
+        read_number_until_valid("\nOFF time in ms?", off_ms, MINIMUM_PULSE_TIME_MS_INPUT, MAXIMUM_PULSE_TIME_MS_INPUT);
+        if (!*off_ms){
+            return false;
+        }
+    }
+    return true;
+}
+
+bool choose_schedule_option(uint32_t *schedule_option){
+    printf_and_update_buffer("1. Show Schedules.\n2. Add Schedule.\n3. Delete Schedule.\n");
+
+    const char *MESSAGE = "\nWhat do you want to do?";
+    print_cancel_message();
+    if (read_user_choice_in_range(MESSAGE, schedule_option, MINIMUM_SCHEDULE_OPTION_INPUT, MAXIMUM_SCHEDULE_OPTION_INPUT)){
+        return true;
+    }
+
+    return false;
+}
+
+void read_schedule_option(uint32_t *schedule_option){
+    bool correct_schedule_input = false;
+    while (!correct_schedule_input){
+        if (choose_schedule_option(schedule_option)){
+            correct_schedule_input = true;
+        }else{
+            print_input_error();
+            printf_and_update_buffer("\n");
+        }
+    }
+}
+
+void read_schedule_action(uint32_t *action){
+    printf_and_update_buffer("\n1. Set Device.\n2. Toggle Device.\n3. Load Preset.\n4. Load Preset On All Clients.\n");
+    read_number_until_valid("\nWhat should run?", action, MINIMUM_SCHEDULE_ACTION_INPUT, MAXIMUM_SCHEDULE_ACTION_INPUT);
+}
+
+bool read_schedule_timing(uint32_t *delay_s, uint32_t *period_s){
+    read_number_until_valid("\nRun in how many seconds?", delay_s, MINIMUM_SCHEDULE_TIME_S_INPUT, MAXIMUM_SCHEDULE_TIME_S_INPUT);
+    if (!*delay_s){
+        return false;
+    }
+
+    uint32_t repeat;
+    printf_and_update_buffer("\n1. Run Once.\n2. Repeat.\n");
+    read_number_until_valid("\nHow often?", &repeat, MINIMUM_SCHEDULE_REPEAT_INPUT, MAXIMUM_SCHEDULE_REPEAT_INPUT);
+    if (!repeat){
+        return false;
+    }
+
+    *period_s = 0;
+    if (repeat == 2){
+        read_number_until_valid("\nRepeat every how many seconds?", period_s, MINIMUM_SCHEDULE_TIME_S_INPUT, MAXIMUM_SCHEDULE_TIME_S_INPUT);
+        if (!*period_s){
+            return false;
+        }
+    }
+    return true;
+}
+
+void read_schedule_index(uint32_t *schedule_index){
+    read_number_until_valid("\nWhich schedule?", schedule_index, MINIMUM_SCHEDULE_INDEX_INPUT, MAXIMUM_SCHEDULE_INDEX_INPUT);
+}
+
+bool choose_input_option(uint32_t *input_option){
+    printf_and_update_buffer("1. Show Inputs.\n2. Configure Input.\n");
+
+    const char *MESSAGE = "\nWhat do you want to do?";
+    print_cancel_message();
+    if (read_user_choice_in_range(MESSAGE, input_option, MINIMUM_INPUT_OPTION_INPUT, MAXIMUM_INPUT_OPTION_INPUT)){
+        return true;
+    }
+
+    return false;
+}
+
+void read_input_option(uint32_t *input_option){
+    bool correct_input_option = false;
+    while (!correct_input_option){
+        if (choose_input_option(input_option)){
+            correct_input_option = true;
+        }else{
+            print_input_error();
+            printf_and_update_buffer("\n");
+        }
+    }
+}
+
+bool read_input_parameters(uint32_t *mode, uint32_t *debounce_ms){
+    uint32_t mode_choice;
+    printf_and_update_buffer("\n1. Release (Output Again).\n2. Input, No Pull.\n3. Input, Pull-Up.\n4. Input, Pull-Down.\n");
+    read_number_until_valid("\nWhich mode?", &mode_choice, MINIMUM_INPUT_MODE_INPUT, MAXIMUM_INPUT_MODE_INPUT);
+    if (!mode_choice){
+        return false;
+    }
+    *mode = mode_choice - 1;
+
+    *debounce_ms = 0;
+    if (*mode != INPUT_MODE_OFF){
+        read_number_until_valid("\nDebounce time in ms?", debounce_ms, MINIMUM_DEBOUNCE_MS_INPUT, MAXIMUM_DEBOUNCE_MS_INPUT);
+        if (!*debounce_ms){
+            return false;
+        }
+    }
+    return true;
+}
+
 bool choose_flash_configuration_index(uint32_t *flash_configuration_index){
     const char *MESSAGE = "\nWhat configuration do you want to access?";
     print_cancel_message();
@@ -169,11 +330,9 @@ bool choose_flash_configuration_index(uint32_t *flash_configuration_index){
 void read_flash_configuration_index(uint32_t *flash_configuration_index){
     bool correct_flash_configuration_input = false;
     while (!correct_flash_configuration_input){
-        for (uint32_t configuration_index = 1; configuration_index <= NUMBER_OF_POSSIBLE_PRESETS; configuration_index++){
-            char string[BUFFER_MAX_STRING_SIZE];
-            snprintf(string, sizeof(string), "%u. Preset Config[%u]\n", configuration_index, configuration_index);
-            printf_and_update_buffer(string);
-        }
+        char string[BUFFER_MAX_STRING_SIZE];
+        snprintf(string, sizeof(string), "Preset Configs: 1-%u\n", NUMBER_OF_POSSIBLE_PRESETS);
+        printf_and_update_buffer(string);
         if (choose_flash_configuration_index(flash_configuration_index)){
             correct_flash_configuration_input = true;
         }else{
@@ -309,11 +468,17 @@ bool read_client_data(input_client_data_t *client_data, client_input_flags_t cli
         client_data->device_state %= 2;
     }
 
+    if (client_input_flags.need_timed_output){
+        if (!read_timed_output_parameters(&client_data->pulse_count, &client_data->pulse_on_ms, &client_data->pulse_off_ms)){
+            return false;
+        }
+    }
+
     if (client_input_flags.need_config_index && !client_input_flags.is_building_preset){
         printf_and_update_buffer("\n");
         server_print_running_client_state((const client_t *)&flash_state->clients[client_data->flash_client_index]);
         printf_and_update_buffer("\n");
-        server_print_client_preset_configurations((const client_t *)&flash_state->clients[client_data->flash_client_index]);
+        server_print_client_preset_configurations(flash_state, client_data->flash_client_index);
 
         read_flash_configuration_index(&client_data->flash_configuration_index);  
         if (!client_data->flash_configuration_index){
@@ -323,7 +488,7 @@ bool read_client_data(input_client_data_t *client_data, client_input_flags_t cli
 
     if (client_input_flags.is_building_preset){
         printf_and_update_buffer("\n");
-        server_print_client_preset_configurations((const client_t *)&flash_state->clients[client_data->flash_client_index]);   
+        server_print_client_preset_configurations(flash_state, client_data->flash_client_index);   
 
         read_flash_configuration_index(&client_data->flash_configuration_index);  
         if (!client_data->flash_configuration_index){
@@ -336,7 +501,7 @@ bool read_client_data(input_client_data_t *client_data, client_input_flags_t cli
         printf_and_update_buffer("\n");
         server_print_running_client_state((const client_t *)&flash_state->clients[client_data->flash_client_index]);
         printf_and_update_buffer("\n");
-        server_print_client_preset_configurations((const client_t *)&flash_state->clients[client_data->flash_client_index]);
+        server_print_client_preset_configurations(flash_state, client_data->flash_client_index);
 
         read_flash_configuration_index(&client_data->flash_configuration_index);    
         if (!client_data->flash_configuration_index){
@@ -348,7 +513,7 @@ bool read_client_data(input_client_data_t *client_data, client_input_flags_t cli
         printf_and_update_buffer("\n");
         server_print_running_client_state((const client_t *)&flash_state->clients[client_data->flash_client_index]);
         printf_and_update_buffer("\n");
-        server_print_client_preset_configurations((const client_t *)&flash_state->clients[client_data->flash_client_index]);
+        server_print_client_preset_configurations(flash_state, client_data->flash_client_index);
 
         read_reset_variant(&client_data->reset_choice);
         if (!client_data->reset_choice){
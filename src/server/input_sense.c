@@ -0,0 +1,368 @@
+/**
+ * @file input_sense.c
+ * @brief Keeps the input state of every client, collected when clients ring.
+ *
+ * Clients are never polled for their inputs. A client with an input change
+ * sends a single zero byte. Between exchanges the server's RX pins are
+ * inputs pulled up, with the awake client holding the line high, so the
+ * start bit of that byte raises a falling edge IRQ on the RX pin of the
+ * client, the doorbell. The IRQ hands over to core1, which collects the
+ * batched changes with "[50,50]", runs the interlocks of the inputs that
+ * rose or fell (see interlock.c) and updates the model. The flash state
+ * writes of the interlocks wait until every client that rang has been
+ * collected.
+ *
+ * The report is a summary rather than one timestamped frame per edge: the
+ * stable levels, the GPIOs that rose and those that fell, the count of
+ * changes and the age of the last one. A burst of edges therefore costs one fixed-size frame
+ * and no client buffer can overflow, at the price of the times of all but
+ * the last change.
+ *
+ * Edges seen while the RX pin is used by an exchange or driven for a wake
+ * pulse, or cleared by `reset_gpio_pins()` at the end of an exchange, are
+ * not doorbells. A doorbell that is missed, for example during an output
+ * stream, is rung again by the client after `INPUT_DOORBELL_RETRY_MS`.
+ *
+ * Clients that sample their ADC or hold a logic capture ring the same
+ * doorbell when sample blocks or a full capture are waiting. The input
+ * report flags them, and they are collected right after it (see adc.c and
+ * logic_capture.c).
+ *
+ * Input levels are live readings kept in RAM. The input configuration is
+ * saved in the flash state, and sent again with `server_input_restore()`
+ * when a client reconnects after a restart or the server boots.
+ */
+
+#include <stdio.h>
+
+#include "pico/stdlib.h"
+#include "hardware/gpio.h"
+#include "hardware/irq.h"
+#include "hardware/sync.h"
+
+#include "server.h"
+#include "menu.h"
+
+#define LOG_MODULE STATE
+#include "log.h"
+
+/**
+ * @brief Input model of one client.
+ */
+typedef struct{
+    uint32_t input_mask;        ///< GPIOs configured as inputs
+    uint32_t levels;            ///< Last collected stable levels
+    uint32_t changes;           ///< Changes seen since the inputs were configured
+    uint64_t changed_at_us;     ///< Server time of the last change, 0 if none
+    uint8_t bulk_sources;       ///< Bulk transfers the client rings for too (`INPUT_BULK_*`)
+}input_client_t;
+
+static input_client_t input_clients[MAX_SERVER_CONNECTIONS];
+static volatile uint32_t input_doorbell_mask = 0;   ///< Active connections that rang
+static uint32_t input_armed_rx_mask = 0;            ///< RX pins watched for doorbells
+static spin_lock_t *input_lock = NULL;
+
+/**
+ * @brief GPIO IRQ handler: records the clients whose RX pin saw a doorbell.
+ */
+static void input_doorbell_irq_handler(void){
+    uint32_t rang_mask = 0;
+    for (uint8_t active_client_index = 0; active_client_index < active_server_connections_number; active_client_index++){
+        uint8_t rx_pin = active_uart_server_connections[active_client_index].pin_pair.rx;
+        if (!(input_armed_rx_mask & (1u << rx_pin)) || !(gpio_get_irq_event_mask(rx_pin) & GPIO_IRQ_EDGE_FALL)){
+            continue;
+        }
+        gpio_acknowledge_irq(rx_pin, GPIO_IRQ_EDGE_FALL);
+        if (gpio_get_function(rx_pin) != GPIO_FUNC_UART && !gpio_is_dir_out(rx_pin)){
+            rang_mask |= 1u << active_client_index;
+        }
+    }
+
+    if (rang_mask){
+        uint32_t irq = spin_lock_blocking(input_lock);
+        input_doorbell_mask |= rang_mask;
+        spin_unlock(input_lock, irq);
+        server_post_core1_message(INPUT_DOORBELL_WAKEUP_MESSAGE);
+    }
+}
+
+void server_input_init(void){
+    input_lock = spin_lock_instance(spin_lock_claim_unused(true));
+    gpio_add_raw_irq_handler_masked(GPIO_DEVICE_MASK, input_doorbell_irq_handler);
+    irq_set_enabled(IO_IRQ_BANK0, true);
+}
+
+/**
+ * @brief Watches or stops watching an RX pin for doorbells.
+ *
+ * @param rx_pin Server RX pin of the client.
+ * @param armed  true while the client has inputs.
+ */
+static void input_arm_doorbell(uint8_t rx_pin, bool armed){
+    if (armed){
+        input_armed_rx_mask |= 1u << rx_pin;
+        gpio_acknowledge_irq(rx_pin, GPIO_IRQ_EDGE_FALL);
+    }else{
+        input_armed_rx_mask &= ~(1u << rx_pin);
+    }
+    gpio_set_irq_enabled(rx_pin, GPIO_IRQ_EDGE_FALL, armed);
+}
+
+/**
+ * @brief Collects the changes of one client and updates its model.
+ *
+ * @param flash_client_index  Index of the client in the persistent state table.
+ * @param active_client_index Active connection of the client.
+ * @param run_interlocks      true on core1, to run the interlocks of the changed inputs.
+ * @return false if the client did not reply.
+ */
+static bool input_collect_client(uint32_t flash_client_index, uint8_t active_client_index, bool run_interlocks){
+    server_uart_connection_t *connection = &active_uart_server_connections[active_client_index];
+    uint32_t levels = 0;
+    uint32_t rise_mask = 0;
+    uint32_t fall_mask = 0;
+    uint32_t age_us = 0;
+    uint32_t changes = 0;
+    uint32_t fired_rules = 0;
+    uint32_t adc_blocks = 0;
+    bool logic_ready = false;
+    if (!server_poll_input_report(connection->pin_pair, connection->uart_instance, &levels, &rise_mask, &fall_mask, &age_us, &changes, &fired_rules, &adc_blocks, &logic_ready)){
+        return false;
+    }
+
+    uint64_t now_us = time_us_64();
+    uint32_t irq = spin_lock_blocking(input_lock);
+    input_client_t *client = &input_clients[flash_client_index];
+    client->levels = levels & client->input_mask;
+    if (changes){
+        client->changes += changes;
+        client->changed_at_us = now_us - age_us;
+    }
+    spin_unlock(input_lock, irq);
+
+    if (changes && run_interlocks){
+        server_interlock_dispatch(flash_client_index, rise_mask, fall_mask, now_us - age_us);
+    }
+    if (changes){
+        LOG_INFO(STATE_INPUT_CHANGED, flash_client_index, levels);
+    }
+    if (fired_rules){
+        server_client_rules_fired(flash_client_index, fired_rules);
+    }
+    if (adc_blocks){
+        server_adc_collect(flash_client_index, active_client_index);
+    }
+    if (logic_ready){
+        server_logic_collect(flash_client_index, active_client_index);
+    }
+    return true;
+}
+
+/**
+ * @brief Configures a client GPIO as an input. Call with the state lock held.
+ *
+ * See `server_input_configure()`.
+ */
+static bool input_configure_locked(uint32_t flash_client_index, uint8_t gpio_number, input_mode_t mode, uint32_t debounce_ms){
+    if (!input_lock || flash_client_index >= MAX_SERVER_CONNECTIONS || gpio_number >= 32 || !(GPIO_DEVICE_MASK & (1u << gpio_number)) ||
+        mode >= INPUT_MODE_COUNT || debounce_ms > INPUT_DEBOUNCE_MAX_MS){
+        return false;
+    }
+    server_persistent_state_t state;
+    load_server_state(&state);
+    uint32_t connection_index = get_active_client_connection_index_from_flash_client_index(flash_client_index, state);
+    if (connection_index == INVALID_CLIENT_INDEX){
+        return false;
+    }
+    uint8_t active_client_index = (uint8_t)connection_index;
+    server_uart_connection_t *connection = &active_uart_server_connections[active_client_index];
+    if (gpio_number == connection->pin_pair.tx || gpio_number == connection->pin_pair.rx){
+        return false;
+    }
+
+    send_wakeup_if_dormant(flash_client_index, &state, connection->pin_pair, connection->uart_instance);
+    server_send_input_config(connection->pin_pair, connection->uart_instance, gpio_number, mode, debounce_ms);
+
+    bool changed = false;
+    if (mode != INPUT_MODE_OFF){
+        client_state_t *client_state = &state.clients[flash_client_index].running_client_state;
+        for (uint8_t device_index = 0; device_index < MAX_NUMBER_OF_GPIOS; device_index++){
+            device_t *device = &client_state->devices[device_index];
+            if (device->gpio_number == gpio_number && (device->is_on || device->pwm_duty)){
+                device->is_on = false;
+                device->pwm_duty = 0;
+                changed = true;
+            }
+        }
+        server_timed_output_forget(flash_client_index, 1u << gpio_number);
+    }
+    client_inputs_t *inputs = &state.clients[flash_client_index].inputs;
+    uint16_t saved_debounce_ms = mode == INPUT_MODE_OFF ? 0 : (uint16_t)debounce_ms;
+    if (inputs->modes[gpio_number] != (uint8_t)mode || inputs->debounce_ms[gpio_number] != saved_debounce_ms){
+        inputs->modes[gpio_number] = (uint8_t)mode;
+        inputs->debounce_ms[gpio_number] = saved_debounce_ms;
+        changed = true;
+    }
+    if (changed){
+        save_server_state(&state);
+    }
+
+    uint32_t irq = spin_lock_blocking(input_lock);
+    input_client_t *client = &input_clients[flash_client_index];
+    if (mode == INPUT_MODE_OFF){
+        client->input_mask &= ~(1u << gpio_number);
+    }else{
+        client->input_mask |= 1u << gpio_number;
+    }
+    bool has_inputs = client->input_mask != 0;
+    bool armed = has_inputs || client->bulk_sources;
+    spin_unlock(input_lock, irq);
+
+    input_arm_doorbell(connection->pin_pair.rx, armed);
+    input_collect_client(flash_client_index, active_client_index, false);
+    if (connection->is_dormant){
+        send_dormant_flag_to_client(active_client_index);
+    }
+    return true;
+}
+
+bool server_input_configure(uint32_t flash_client_index, uint8_t gpio_number, input_mode_t mode, uint32_t debounce_ms){
+    server_state_lock();
+    bool configured = input_configure_locked(flash_client_index, gpio_number, mode, debounce_ms);
+    server_state_unlock();
+    return configured;
+}
+
+void server_input_restore(uint32_t flash_client_index, uint8_t active_client_index, const client_inputs_t *inputs){
+    if (!input_lock || flash_client_index >= MAX_SERVER_CONNECTIONS){
+        return;
+    }
+    server_uart_connection_t *connection = &active_uart_server_connections[active_client_index];
+    uint32_t input_mask = 0;
+    for (uint8_t gpio_number = 0; gpio_number < 32; gpio_number++){
+        input_mode_t mode = (input_mode_t)inputs->modes[gpio_number];
+        if (mode == INPUT_MODE_OFF || mode >= INPUT_MODE_COUNT || !(GPIO_DEVICE_MASK & (1u << gpio_number)) ||
+            gpio_number == connection->pin_pair.tx || gpio_number == connection->pin_pair.rx){
+            continue;
+        }
+        server_send_input_config(connection->pin_pair, connection->uart_instance, gpio_number, mode, inputs->debounce_ms[gpio_number]);
+        input_mask |= 1u << gpio_number;
+    }
+
+    uint32_t irq = spin_lock_blocking(input_lock);
+    input_client_t *client = &input_clients[flash_client_index];
+    client->input_mask = input_mask;
+    client->levels = 0;
+    bool armed = input_mask != 0 || client->bulk_sources;
+    spin_unlock(input_lock, irq);
+
+    input_arm_doorbell(connection->pin_pair.rx, armed);
+    if (input_mask){
+        input_collect_client(flash_client_index, active_client_index, false);
+        LOG_INFO(STATE_INPUT_RESTORED, flash_client_index, input_mask);
+    }
+}
+
+void server_input_collect(void){
+    if (!input_lock || stream_is_active()){
+        return;
+    }
+    uint32_t irq = spin_lock_blocking(input_lock);
+    uint32_t doorbell_mask = input_doorbell_mask;
+    input_doorbell_mask = 0;
+    spin_unlock(input_lock, irq);
+    if (!doorbell_mask){
+        return;
+    }
+
+    const server_persistent_state_t *flash_state = (const server_persistent_state_t *)SERVER_FLASH_ADDR;
+    for (uint32_t flash_client_index = 0; flash_client_index < MAX_SERVER_CONNECTIONS; flash_client_index++){
+        uint32_t active_client_index = get_active_client_connection_index_from_flash_client_index(flash_client_index, *flash_state);
+        if (active_client_index == INVALID_CLIENT_INDEX || !(doorbell_mask & (1u << active_client_index)) ||
+            (!input_clients[flash_client_index].input_mask && !input_clients[flash_client_index].bulk_sources)){
+            continue;
+        }
+        if (!input_collect_client(flash_client_index, (uint8_t)active_client_index, true)){
+            LOG_WARN(STATE_INPUT_NO_REPORT, flash_client_index, active_uart_server_connections[active_client_index].pin_pair.rx);
+        }
+    }
+    server_interlock_flush();
+}
+
+void server_input_set_bulk(uint32_t flash_client_index, uint8_t active_client_index, uint8_t source, bool enabled){
+    if (!input_lock || flash_client_index >= MAX_SERVER_CONNECTIONS){
+        return;
+    }
+    uint32_t irq = spin_lock_blocking(input_lock);
+    input_client_t *client = &input_clients[flash_client_index];
+    if (enabled){
+        client->bulk_sources |= source;
+    }else{
+        client->bulk_sources &= (uint8_t)~source;
+    }
+    bool armed = client->input_mask != 0 || client->bulk_sources;
+    spin_unlock(input_lock, irq);
+
+    input_arm_doorbell(active_uart_server_connections[active_client_index].pin_pair.rx, armed);
+}
+
+bool server_input_get(uint32_t flash_client_index, uint32_t *input_mask, uint32_t *levels, uint32_t *changes, uint64_t *changed_at_us){
+    if (!input_lock || flash_client_index >= MAX_SERVER_CONNECTIONS){
+        return false;
+    }
+    uint32_t irq = spin_lock_blocking(input_lock);
+    input_client_t client = input_clients[flash_client_index];
+    spin_unlock(input_lock, irq);
+
+    *input_mask = client.input_mask;
+    *levels = client.levels;
+    *changes = client.changes;
+    *changed_at_us = client.changed_at_us;
+    return client.input_mask != 0;
+}
+
+void server_input_print(void){
+    bool any = false;
+    for (uint32_t flash_client_index = 0; flash_client_index < MAX_SERVER_CONNECTIONS; flash_client_index++){
+        uint32_t input_mask;
+        uint32_t levels;
+        uint32_t changes;
+        uint64_t changed_at_us;
+        if (!server_input_get(flash_client_index, &input_mask, &levels, &changes, &changed_at_us)){
+            continue;
+        }
+        any = true;
+
+        char string[BUFFER_MAX_STRING_SIZE];
+        snprintf(string, sizeof(string), "\nClient [%lu] Inputs, %lu Changes:\n", (unsigned long)flash_client_index + 1, (unsigned long)changes);
+        printf_and_update_buffer(string);
+        while (input_mask){
+            uint8_t gpio_number = (uint8_t)__builtin_ctz(input_mask);
+            input_mask &= input_mask - 1;
+            snprintf(string, sizeof(string), "GPIO %u = %s\n", gpio_number, (levels & (1u << gpio_number)) ? "HIGH" : "LOW");
+            printf_and_update_buffer(string);
+        }
+    }
+    if (!any){
+        printf_and_update_buffer("\nNo Client Inputs.\n");
+    }
+}
+
+void server_input_print_machine(void){
+    uint64_t now_us = time_us_64();
+    for (uint32_t flash_client_index = 0; flash_client_index < MAX_SERVER_CONNECTIONS; flash_client_index++){
+        uint32_t input_mask;
+        uint32_t levels;
+        uint32_t changes;
+        uint64_t changed_at_us;
+        if (!server_input_get(flash_client_index, &input_mask, &levels, &changes, &changed_at_us)){
+            continue;
+        }
+        printf("INPUT %lu %08lx %08lx %lu %llu\n",
+            (unsigned long)flash_client_index,
+            (unsigned long)input_mask,
+            (unsigned long)levels,
+            (unsigned long)changes,
+            changed_at_us ? (unsigned long long)((now_us - changed_at_us) / 1000u) : 0ull);
+    }
+}
@@ -0,0 +1,270 @@
+/**
+ * @file interlock.c
+ * @brief Cross-client interlocks: an input edge on one client drives an output of another.
+ *
+ * Interlocks are stored in flash (see interlock_store.c). In RAM they are
+ * compiled into an index with one chain per (client, input), so the input
+ * changes collected from a client only visit the interlocks of the inputs
+ * that changed, whatever the size of the table.
+ *
+ * Interlocks run on core1 in the input collect path, right after the input
+ * report has been read (see input_sense.c). The report carries the inputs
+ * that rose and those that fell, so an edge is seen even when the input
+ * bounced back before the collect, and an interlock runs once when any of
+ * its edges was reported. Output frames are sent to the target clients
+ * right away. The switched outputs are only recorded, and written to the
+ * flash state once every client that rang has been collected, so a burst
+ * of edges on several clients costs one flash write. The state lock is
+ * held from the first interlock to that write. The reaction time, from the
+ * input change on the source client to the output frame leaving the
+ * server, is recorded as the `interlock` latency statistic.
+ *
+ * Source inputs must be configured with `server_input_configure()`, else
+ * the source client never reports them. As for the scheduler, the index is
+ * only touched on core1: edits are written to flash and a reload message
+ * makes core1 rebuild it.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+
+#include "server.h"
+#include "menu.h"
+#include "statistics.h"
+
+#define LOG_MODULE STATE
+#include "log.h"
+
+#define INTERLOCK_NODE_NONE 0xFF
+
+_Static_assert(INTERLOCK_MAX_ENTRIES < INTERLOCK_NODE_NONE, "INTERLOCK_NODE_NONE must not be a valid entry index");
+
+static interlock_entry_t interlock_entries[INTERLOCK_MAX_ENTRIES];     ///< RAM copy of the table
+static uint8_t interlock_first[MAX_SERVER_CONNECTIONS][32];           ///< First interlock of each (client, input)
+static uint8_t interlock_next[INTERLOCK_MAX_ENTRIES];
+static uint32_t interlock_source_mask[MAX_SERVER_CONNECTIONS];        ///< Inputs of each client with interlocks
+static volatile uint32_t interlock_fires[INTERLOCK_MAX_ENTRIES];
+
+/**
+ * @brief Outputs switched by interlocks and not yet written to the flash state.
+ */
+typedef struct{
+    uint32_t on_mask[MAX_SERVER_CONNECTIONS];     ///< GPIOs of each client switched ON
+    uint32_t off_mask[MAX_SERVER_CONNECTIONS];    ///< GPIOs of each client switched OFF
+    uint32_t target_clients;                      ///< Clients with switched outputs
+    bool locked;                                  ///< The state lock is held until the flush
+}interlock_pending_t;
+
+static interlock_pending_t interlock_pending;
+
+/**
+ * @brief Checks the fields of an interlock.
+ *
+ * @param entry Interlock to check.
+ * @return true if the interlock is in use and valid.
+ */
+static bool interlock_entry_is_valid(const interlock_entry_t *entry){
+    return entry->edges && entry->edges <= (RULE_EDGE_RISE | RULE_EDGE_FALL) &&
+        entry->source_client < MAX_SERVER_CONNECTIONS && entry->target_client < MAX_SERVER_CONNECTIONS &&
+        entry->source_gpio < 32 && (GPIO_DEVICE_MASK & (1u << entry->source_gpio)) &&
+        entry->target_gpio < 32 && (GPIO_DEVICE_MASK & (1u << entry->target_gpio)) &&
+        entry->action < INTERLOCK_ACTION_COUNT &&
+        !(entry->source_client == entry->target_client && entry->source_gpio == entry->target_gpio);
+}
+
+void server_interlock_reload(void){
+    memcpy(interlock_entries, interlock_store_table()->entries, sizeof(interlock_entries));
+    memset(interlock_first, INTERLOCK_NODE_NONE, sizeof(interlock_first));
+    memset(interlock_source_mask, 0, sizeof(interlock_source_mask));
+
+    for (uint32_t index = INTERLOCK_MAX_ENTRIES; index-- > 0;){
+        const interlock_entry_t *entry = &interlock_entries[index];
+        if (!interlock_entry_is_valid(entry)){
+            continue;
+        }
+        interlock_next[index] = interlock_first[entry->source_client][entry->source_gpio];
+        interlock_first[entry->source_client][entry->source_gpio] = (uint8_t)index;
+        interlock_source_mask[entry->source_client] |= 1u << entry->source_gpio;
+    }
+}
+
+void server_interlock_init(void){
+    server_interlock_reload();
+}
+
+/**
+ * @brief Sends the output of one interlock to its target client and records it for the flush.
+ *
+ * @param index      Table index of the interlock.
+ * @param entry      Interlock to run.
+ * @param state      Copy of the persistent state, to find the target client and its outputs.
+ * @param trigger_us time_us_64() of the input change.
+ * @return false if the target client is not connected.
+ */
+static bool interlock_run(uint32_t index, const interlock_entry_t *entry, server_persistent_state_t *state, uint64_t trigger_us){
+    uint32_t active_client_index = get_active_client_connection_index_from_flash_client_index(entry->target_client, *state);
+    if (active_client_index == (uint32_t)INVALID_CLIENT_INDEX){
+        LOG_WARN(STATE_INTERLOCK_CLIENT_MISSING, index, entry->target_client);
+        return false;
+    }
+    server_uart_connection_t *connection = &active_uart_server_connections[active_client_index];
+    uint8_t gpio_number = entry->target_gpio;
+    uint32_t gpio_bit = 1u << gpio_number;
+    const device_t *device = &state->clients[entry->target_client].running_client_state.devices[gpio_number > 22 ? (gpio_number - 3) : (gpio_number)];
+
+    bool is_on = device->is_on;
+    if (interlock_pending.on_mask[entry->target_client] & gpio_bit){
+        is_on = true;
+    }else if (interlock_pending.off_mask[entry->target_client] & gpio_bit){
+        is_on = false;
+    }
+    bool device_state = entry->action == INTERLOCK_ACTION_TOGGLE ? !is_on : entry->action == INTERLOCK_ACTION_ON;
+    send_wakeup_if_dormant(entry->target_client, state, connection->pin_pair, connection->uart_instance);
+    char msg[8];
+    snprintf(msg, sizeof(msg), "[%d,%d]", gpio_number, device_state);
+    send_uart_message_safe(connection->uart_instance, connection->pin_pair, msg);
+
+    uint64_t reaction_us = time_us_64() - trigger_us;
+    uint32_t reaction_clamped_us = reaction_us > UINT32_MAX ? UINT32_MAX : (uint32_t)reaction_us;
+    statistics_record_latency(STATISTICS_LATENCY_INTERLOCK, reaction_clamped_us);
+    interlock_fires[index]++;
+    LOG_INFO(STATE_INTERLOCK_FIRED, index, reaction_clamped_us);
+
+    if (device_state){
+        interlock_pending.on_mask[entry->target_client] |= gpio_bit;
+        interlock_pending.off_mask[entry->target_client] &= ~gpio_bit;
+        connection->is_dormant = false;
+    }else{
+        interlock_pending.off_mask[entry->target_client] |= gpio_bit;
+        interlock_pending.on_mask[entry->target_client] &= ~gpio_bit;
+    }
+    interlock_pending.target_clients |= 1u << entry->target_client;
+    return true;
+}
+
+void server_interlock_dispatch(uint32_t flash_client_index, uint32_t rise_mask, uint32_t fall_mask, uint64_t trigger_us){
+    if (flash_client_index >= MAX_SERVER_CONNECTIONS){
+        return;
+    }
+    rise_mask &= interlock_source_mask[flash_client_index];
+    fall_mask &= interlock_source_mask[flash_client_index];
+    uint32_t changed_mask = rise_mask | fall_mask;
+    if (!changed_mask){
+        return;
+    }
+
+    server_persistent_state_t state_copy;
+    server_state_lock();
+    memcpy(&state_copy, (const server_persistent_state_t *)SERVER_FLASH_ADDR, sizeof(state_copy));
+
+    while (changed_mask){
+        uint8_t gpio_number = (uint8_t)__builtin_ctz(changed_mask);
+        changed_mask &= changed_mask - 1;
+        uint8_t edges = (uint8_t)(((rise_mask >> gpio_number) & 1u ? RULE_EDGE_RISE : 0) |
+            ((fall_mask >> gpio_number) & 1u ? RULE_EDGE_FALL : 0));
+
+        for (uint8_t node = interlock_first[flash_client_index][gpio_number]; node != INTERLOCK_NODE_NONE; node = interlock_next[node]){
+            const interlock_entry_t *entry = &interlock_entries[node];
+            if (entry->edges & edges){
+                interlock_run(node, entry, &state_copy, trigger_us);
+            }
+        }
+    }
+
+    if (interlock_pending.target_clients && !interlock_pending.locked){
+        interlock_pending.locked = true;
+    }else{
+        server_state_unlock();
+    }
+}
+
+void server_interlock_flush(void){
+    if (!interlock_pending.locked){
+        return;
+    }
+    server_persistent_state_t state;
+    memcpy(&state, (const server_persistent_state_t *)SERVER_FLASH_ADDR, sizeof(state));
+    bool changed = false;
+
+    uint32_t target_clients = interlock_pending.target_clients;
+    while (target_clients){
+        uint32_t target_client = (uint32_t)__builtin_ctz(target_clients);
+        target_clients &= target_clients - 1;
+        uint32_t on_mask = interlock_pending.on_mask[target_client];
+        uint32_t off_mask = interlock_pending.off_mask[target_client];
+        server_timed_output_forget(target_client, on_mask | off_mask);
+
+        client_state_t *client_state = &state.clients[target_client].running_client_state;
+        for (uint8_t device_index = 0; device_index < MAX_NUMBER_OF_GPIOS; device_index++){
+            device_t *device = &client_state->devices[device_index];
+            if (device->gpio_number == UART_CONNECTION_FLAG_NUMBER){
+                continue;
+            }
+            uint32_t gpio_bit = 1u << device->gpio_number;
+            bool device_state = device->is_on;
+            if (on_mask & gpio_bit){
+                device_state = true;
+            }else if (off_mask & gpio_bit){
+                device_state = false;
+            }
+            if (device_state != device->is_on){
+                device->is_on = device_state;
+                changed = true;
+            }
+        }
+
+        uint32_t active_client_index = get_active_client_connection_index_from_flash_client_index(target_client, state);
+        if (active_client_index != (uint32_t)INVALID_CLIENT_INDEX && !client_has_active_devices(state.clients[target_client])){
+            send_dormant_flag_to_client((uint8_t)active_client_index);
+            active_uart_server_connections[active_client_index].is_dormant = true;
+        }
+    }
+
+    if (changed){
+        save_server_state(&state);
+    }
+    memset(&interlock_pending, 0, sizeof(interlock_pending));
+    server_state_unlock();
+}
+
+int32_t server_interlock_add(const interlock_entry_t *entry){
+    if (!interlock_entry_is_valid(entry)){
+        return -1;
+    }
+    const interlock_table_t *table = interlock_store_table();
+    for (uint32_t index = 0; index < INTERLOCK_MAX_ENTRIES; index++){
+        if (!table->entries[index].edges){
+            interlock_store_edit()->entries[index] = *entry;
+            interlock_store_commit();
+            interlock_fires[index] = 0;
+            server_post_core1_message(INTERLOCK_RELOAD_WAKEUP_MESSAGE);
+            return (int32_t)index;
+        }
+    }
+    return -1;
+}
+
+bool server_interlock_remove(uint32_t index){
+    if (index >= INTERLOCK_MAX_ENTRIES || !interlock_store_table()->entries[index].edges){
+        return false;
+    }
+    memset(&interlock_store_edit()->entries[index], 0, sizeof(interlock_entry_t));
+    interlock_store_commit();
+    server_post_core1_message(INTERLOCK_RELOAD_WAKEUP_MESSAGE);
+    return true;
+}
+
+void server_interlock_print_machine(void){
+    const interlock_table_t *table = interlock_store_table();
+    for (uint32_t index = 0; index < INTERLOCK_MAX_ENTRIES; index++){
+        const interlock_entry_t *entry = &table->entries[index];
+        if (!entry->edges){
+            continue;
+        }
+        printf("INTERLOCK %lu %u %u %u %u %u %u %lu\n",
+            (unsigned long)index, entry->source_client, entry->source_gpio, entry->edges,
+            entry->target_client, entry->target_gpio, entry->action, (unsigned long)interlock_fires[index]);
+    }
+}
@@ -0,0 +1,111 @@
+/**
+ * @file interlock_store.c
+ * @brief Interlock table in its own flash sector.
+ *
+ * The table holds `INTERLOCK_MAX_ENTRIES` fixed-size entries of 8 bytes and
+ * lives one sector below the schedule table, so it survives state saves,
+ * preset commits and schedule edits. Entries keep their table index, which
+ * the interlock index in RAM refers to. Reads use the table directly in
+ * flash.
+ */
+
+#include <stddef.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "hardware/flash.h"
+#include "hardware/sync.h"
+
+#include "server.h"
+#include "statistics.h"
+#include "trace.h"
+#include "flash_telemetry.h"
+#include "event_log.h"
+
+#define LOG_MODULE FLASH
+#include "log.h"
+
+#define INTERLOCK_TABLE_PROGRAM_SIZE (((sizeof(interlock_table_t) + SERVER_PAGE_SIZE - 1) / SERVER_PAGE_SIZE) * SERVER_PAGE_SIZE)
+
+_Static_assert(sizeof(interlock_table_t) <= SERVER_SECTOR_SIZE, "interlock table does not fit in one sector");
+
+static union{
+    interlock_table_t table;
+    uint8_t bytes[INTERLOCK_TABLE_PROGRAM_SIZE];
+}interlock_work;
+
+static bool interlock_table_in_flash = false;
+
+/**
+ * @brief Returns the table as mapped in XIP flash.
+ *
+ * @return Stored table, valid or not.
+ */
+static const interlock_table_t *interlock_flash_table(void){
+    return (const interlock_table_t *)(XIP_BASE + INTERLOCK_TABLE_OFFSET);
+}
+
+/**
+ * @brief Checks the magic and CRC of a stored table.
+ *
+ * @param table Table to check.
+ * @return true if the table is valid.
+ */
+static bool interlock_table_is_valid(const interlock_table_t *table){
+    return table->magic == INTERLOCK_TABLE_MAGIC &&
+        table->crc == compute_crc32(table, offsetof(interlock_table_t, crc));
+}
+
+void interlock_store_init(void){
+    interlock_table_in_flash = interlock_table_is_valid(interlock_flash_table());
+    if (!interlock_table_in_flash){
+        memset(&interlock_work.table, 0, sizeof(interlock_table_t));
+        interlock_store_commit();
+    }
+}
+
+const interlock_table_t *interlock_store_table(void){
+    if (!interlock_table_in_flash){
+        return &interlock_work.table;
+    }
+    return interlock_flash_table();
+}
+
+interlock_table_t *interlock_store_edit(void){
+    const interlock_table_t *active = interlock_store_table();
+    if (active != &interlock_work.table){
+        memcpy(&interlock_work.table, active, sizeof(interlock_table_t));
+    }
+    return &interlock_work.table;
+}
+
+void __not_in_flash_func(interlock_store_commit)(void){
+    uint32_t start_us = time_us_32();
+
+    interlock_work.table.magic = INTERLOCK_TABLE_MAGIC;
+    interlock_work.table.crc = compute_crc32(&interlock_work.table, offsetof(interlock_table_t, crc));
+    memset(&interlock_work.bytes[sizeof(interlock_table_t)], 0xFF, INTERLOCK_TABLE_PROGRAM_SIZE - sizeof(interlock_table_t));
+
+    flash_telemetry_record_erase(INTERLOCK_TABLE_OFFSET, SERVER_SECTOR_SIZE);
+    flash_telemetry_record_program(INTERLOCK_TABLE_PROGRAM_SIZE);
+
+    bool locked_out = flash_lockout_begin();
+    uint32_t ints = save_and_disable_interrupts();
+    TRACE_BEGIN(TRACE_SPAN_FLASH_ERASE, 0, INTERLOCK_TABLE_OFFSET);
+    flash_range_erase(INTERLOCK_TABLE_OFFSET, SERVER_SECTOR_SIZE);
+    TRACE_END(TRACE_SPAN_FLASH_ERASE, 0, INTERLOCK_TABLE_OFFSET);
+    TRACE_BEGIN(TRACE_SPAN_FLASH_PROGRAM, 0, INTERLOCK_TABLE_OFFSET);
+    flash_range_program(INTERLOCK_TABLE_OFFSET, interlock_work.bytes, INTERLOCK_TABLE_PROGRAM_SIZE);
+    TRACE_END(TRACE_SPAN_FLASH_PROGRAM, 0, INTERLOCK_TABLE_OFFSET);
+    restore_interrupts(ints);
+    flash_lockout_end(locked_out);
+
+    interlock_table_in_flash = interlock_table_is_valid(interlock_flash_table());
+
+    uint32_t elapsed_us = time_us_32() - start_us;
+    statistics_record_latency(STATISTICS_LATENCY_FLASH_COMMIT, elapsed_us);
+    flash_telemetry_record_commit(elapsed_us);
+    flash_telemetry_store();
+    LOG_DEBUG(FLASH_COMMIT, INTERLOCK_TABLE_OFFSET, elapsed_us);
+    event_log_write(EVENT_COMMIT, (uint16_t)(elapsed_us / 1000u), INTERLOCK_TABLE_OFFSET);
+}
@@ -0,0 +1,38 @@
+/**
+ * @file latch.c
+ * @brief Server side of the shared latch line.
+ *
+ * With `LATCH_LINE_ENABLED`, `LATCH_LINE_GPIO` of the server is wired to
+ * the same GPIO of every client. Its rising edge makes every client apply
+ * the on-mask staged over UART (see `server_send_latch_stage()`).
+ */
+
+#include "pico/stdlib.h"
+#include "hardware/gpio.h"
+#include "hardware/sync.h"
+
+#include "server.h"
+
+static uint32_t latch_sequence = 0;
+
+void server_latch_init(void){
+    #if LATCH_LINE_ENABLED
+        gpio_init(LATCH_LINE_GPIO);
+        gpio_set_dir(LATCH_LINE_GPIO, GPIO_OUT);
+        gpio_put(LATCH_LINE_GPIO, false);
+    #endif
+}
+
+uint32_t server_latch_next_sequence(void){
+    return ++latch_sequence;
+}
+
+void server_latch_pulse(void){
+    #if LATCH_LINE_ENABLED
+        uint32_t irq = save_and_disable_interrupts();
+        gpio_put(LATCH_LINE_GPIO, true);
+        busy_wait_us(LATCH_PULSE_US);
+        gpio_put(LATCH_LINE_GPIO, false);
+        restore_interrupts(irq);
+    #endif
+}
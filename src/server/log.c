@@ -0,0 +1,136 @@
+/**
+ * @file log.c
+ * @brief RAM ring and on-demand formatting for the binary log.
+ *
+ * Writers only copy a record into the ring under a hardware spinlock, so
+ * logging is cheap from either core. Formatting happens when the log is
+ * dumped, on a snapshot taken under the lock. Errors and warnings are also
+ * staged in the persistent event log.
+ *
+ * @see log.h
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "hardware/sync.h"
+
+#include "log.h"
+#include "event_log.h"
+
+typedef struct{
+    uint32_t head;              ///< Total number of records written (wraps the ring)
+    log_record_t records[LOG_RING_SIZE];
+}log_ring_t;
+
+static log_ring_t log_ring;
+static log_ring_t log_snapshot;
+static spin_lock_t *log_lock = NULL;
+
+#define LOG_MESSAGE_FORMAT(name, format) format,
+static const char *const log_formats[LOG_MESSAGE_COUNT] = {
+    LOG_MESSAGES(LOG_MESSAGE_FORMAT)
+};
+#undef LOG_MESSAGE_FORMAT
+
+static const char *const log_level_names[] = {
+    [LOG_LEVEL_NONE]    = "NONE",
+    [LOG_LEVEL_ERROR]   = "ERROR",
+    [LOG_LEVEL_WARN]    = "WARN",
+    [LOG_LEVEL_INFO]    = "INFO",
+    [LOG_LEVEL_DEBUG]   = "DEBUG",
+    [LOG_LEVEL_TRACE]   = "TRACE",
+};
+
+static const char *const log_module_names[LOG_MODULE_ID_COUNT] = {
+    [LOG_MODULE_ID_HANDSHAKE]   = "handshake",
+    [LOG_MODULE_ID_UART]        = "uart",
+    [LOG_MODULE_ID_STATE]       = "state",
+    [LOG_MODULE_ID_FLASH]       = "flash",
+};
+
+void log_init(void){
+    log_lock = spin_lock_instance(spin_lock_claim_unused(true));
+}
+
+void log_write(uint8_t level, log_module_t module, log_message_t message, uint32_t arg0, uint32_t arg1){
+    if (!log_lock){
+        return;
+    }
+    uint32_t timestamp_us = time_us_32();
+    uint32_t irq = spin_lock_blocking(log_lock);
+    log_record_t *record = &log_ring.records[log_ring.head & (LOG_RING_SIZE - 1)];
+    record->timestamp_us = timestamp_us;
+    record->message = (uint16_t)message;
+    record->level = level;
+    record->module = (uint8_t)module;
+    record->arg0 = arg0;
+    record->arg1 = arg1;
+    log_ring.head++;
+    spin_unlock(log_lock, irq);
+
+    if (level <= LOG_LEVEL_WARN){
+        event_log_write(level == LOG_LEVEL_ERROR ? EVENT_ERROR : EVENT_WARNING, (uint16_t)message, arg0);
+    }
+}
+
+/**
+ * @brief Copies the ring into the snapshot, optionally clearing it.
+ *
+ * @param reset true to clear the live ring after copying.
+ * @return Index of the oldest record in the snapshot.
+ */
+static uint32_t log_take_snapshot(bool reset){
+    if (!log_lock){
+        memset(&log_snapshot, 0, sizeof(log_snapshot));
+        return 0;
+    }
+    uint32_t irq = spin_lock_blocking(log_lock);
+    memcpy(&log_snapshot, &log_ring, sizeof(log_ring));
+    if (reset){
+        log_ring.head = 0;
+    }
+    spin_unlock(log_lock, irq);
+    return log_snapshot.head > LOG_RING_SIZE ? log_snapshot.head - LOG_RING_SIZE : 0;
+}
+
+void log_dump(bool reset){
+    uint32_t first = log_take_snapshot(reset);
+
+    printf("\nLog (%lu records, %lu overwritten):\n",
+        (unsigned long)(log_snapshot.head - first),
+        (unsigned long)first);
+    for (uint32_t index = first; index < log_snapshot.head; index++){
+        const log_record_t *record = &log_snapshot.records[index & (LOG_RING_SIZE - 1)];
+        printf("[%10lu] %-5s %-9s ",
+            (unsigned long)record->timestamp_us,
+            record->level <= LOG_LEVEL_TRACE ? log_level_names[record->level] : "?",
+            record->module < LOG_MODULE_ID_COUNT ? log_module_names[record->module] : "?");
+        if (record->message < LOG_MESSAGE_COUNT){
+            printf(log_formats[record->message], (unsigned long)record->arg0, (unsigned long)record->arg1);
+        }else{
+            printf("message %u (%lu, %lu)", record->message, (unsigned long)record->arg0, (unsigned long)record->arg1);
+        }
+        printf("\n");
+    }
+
+    if (reset){
+        printf("\nLog Cleared.\n");
+    }
+}
+
+void log_dump_machine(bool reset){
+    uint32_t first = log_take_snapshot(reset);
+
+    for (uint32_t index = first; index < log_snapshot.head; index++){
+        const log_record_t *record = &log_snapshot.records[index & (LOG_RING_SIZE - 1)];
+        printf("LOG %08lx %x %x %x %08lx %08lx\n",
+            (unsigned long)record->timestamp_us,
+            record->level,
+            record->module,
+            record->message,
+            (unsigned long)record->arg0,
+            (unsigned long)record->arg1);
+    }
+}
@@ -0,0 +1,259 @@
+/**
+ * @file logic_capture.c
+ * @brief Client logic captures: setup, arming, chunk collection and host readout.
+ *
+ * A client captures consecutive GPIOs on its own (see logic_capture.c on
+ * the client) into a RAM buffer, then rings the input doorbell. Core1
+ * collects the capture as run-length encoded chunks right after the input
+ * report, at most `LOGIC_COLLECT_MAX_CHUNKS` per doorbell so the UART lock
+ * is held for a bounded time.
+ *
+ * Runs wait in a buffer of `LOGIC_SERVER_RUNS` until the host reads them
+ * with `LOGIC READ`. Chunks are only requested when their runs fit, so a
+ * slow host delays the capture but never loses part of it; the client
+ * rings again until every chunk is acknowledged. Damaged chunks are
+ * counted and collected again.
+ *
+ * The run buffer is shared: one client holds the capture at a time.
+ * Decoding the runs into waveforms is left to the host.
+ */
+
+#include <stdio.h>
+
+#include "pico/stdlib.h"
+#include "hardware/sync.h"
+
+#include "server.h"
+
+#define LOG_MODULE STATE
+#include "log.h"
+
+#define LOGIC_RUNS_PER_LINE 16
+
+/**
+ * @brief The logic capture and its collected runs.
+ */
+typedef struct{
+    bool in_use;                ///< A client holds the capture
+    uint32_t flash_client_index;
+    uint8_t first_gpio;
+    uint8_t pin_count;
+    uint32_t rate_hz;
+    bool armed;
+    uint32_t samples;           ///< Samples of the full capture, 0 until the client reports it
+    uint32_t received;          ///< Samples collected
+    uint32_t read;              ///< Samples read by the host
+    uint32_t next_sequence;     ///< Next chunk to collect
+    uint32_t bad;               ///< Chunks damaged on the link
+    logic_run_t runs[LOGIC_SERVER_RUNS];
+    uint32_t first;             ///< Oldest run not read by the host
+    uint32_t count;             ///< Runs not read by the host
+}logic_capture_t;
+
+static logic_capture_t logic_capture;
+static spin_lock_t *logic_lock = NULL;
+
+void server_logic_init(void){
+    logic_lock = spin_lock_instance(spin_lock_claim_unused(true));
+}
+
+/**
+ * @brief Tells whether a client holds the capture.
+ *
+ * @param flash_client_index Index of the client in the persistent state table.
+ * @return true if the client holds the capture.
+ */
+static bool logic_held_by(uint32_t flash_client_index){
+    uint32_t irq = spin_lock_blocking(logic_lock);
+    bool held = logic_capture.in_use && logic_capture.flash_client_index == flash_client_index;
+    spin_unlock(logic_lock, irq);
+    return held;
+}
+
+/**
+ * @brief Clears the runs and counters of the capture. Call with the logic lock held.
+ */
+static void logic_clear(void){
+    logic_capture.armed = false;
+    logic_capture.samples = 0;
+    logic_capture.received = 0;
+    logic_capture.read = 0;
+    logic_capture.next_sequence = 0;
+    logic_capture.bad = 0;
+    logic_capture.first = 0;
+    logic_capture.count = 0;
+}
+
+bool server_logic_configure(uint32_t flash_client_index, uint8_t first_gpio, uint8_t pin_count, uint32_t rate_hz){
+    if (!logic_lock || flash_client_index >= MAX_SERVER_CONNECTIONS || pin_count > 32 || first_gpio + pin_count > NUM_BANK0_GPIOS ||
+        first_gpio + pin_count > 32 || (pin_count && (!rate_hz || rate_hz > LOGIC_MAX_RATE_HZ))){
+        return false;
+    }
+    uint32_t irq = spin_lock_blocking(logic_lock);
+    bool taken = logic_capture.in_use && logic_capture.flash_client_index != flash_client_index;
+    spin_unlock(logic_lock, irq);
+    if (taken || (!pin_count && !logic_held_by(flash_client_index))){
+        return false;
+    }
+
+    server_persistent_state_t state;
+    load_server_state(&state);
+    uint32_t connection_index = get_active_client_connection_index_from_flash_client_index(flash_client_index, state);
+    if (connection_index == INVALID_CLIENT_INDEX){
+        return false;
+    }
+    uint8_t active_client_index = (uint8_t)connection_index;
+    server_uart_connection_t *connection = &active_uart_server_connections[active_client_index];
+
+    send_wakeup_if_dormant(flash_client_index, &state, connection->pin_pair, connection->uart_instance);
+    server_send_logic_config(connection->pin_pair, connection->uart_instance, first_gpio, pin_count, rate_hz);
+
+    irq = spin_lock_blocking(logic_lock);
+    logic_clear();
+    logic_capture.in_use = pin_count != 0;
+    logic_capture.flash_client_index = flash_client_index;
+    logic_capture.first_gpio = first_gpio;
+    logic_capture.pin_count = pin_count;
+    logic_capture.rate_hz = rate_hz;
+    spin_unlock(logic_lock, irq);
+
+    server_input_set_bulk(flash_client_index, active_client_index, INPUT_BULK_LOGIC, pin_count != 0);
+    if (connection->is_dormant){
+        send_dormant_flag_to_client(active_client_index);
+    }
+    return true;
+}
+
+bool server_logic_arm(uint32_t flash_client_index, uint32_t trigger_mask, uint32_t trigger_value){
+    if (!logic_lock || !logic_held_by(flash_client_index)){
+        return false;
+    }
+    uint32_t window_mask = logic_capture.pin_count == 32 ? 0xFFFFFFFFu : (1u << logic_capture.pin_count) - 1;
+    uint32_t trigger_run = trigger_mask ? trigger_mask >> __builtin_ctz(trigger_mask) : 0;
+    if ((trigger_mask & ~window_mask) || (trigger_run & (trigger_run + 1))){
+        return false;
+    }
+    server_persistent_state_t state;
+    load_server_state(&state);
+    uint32_t connection_index = get_active_client_connection_index_from_flash_client_index(flash_client_index, state);
+    if (connection_index == INVALID_CLIENT_INDEX){
+        return false;
+    }
+    uint8_t active_client_index = (uint8_t)connection_index;
+    server_uart_connection_t *connection = &active_uart_server_connections[active_client_index];
+
+    uint32_t irq = spin_lock_blocking(logic_lock);
+    logic_clear();
+    logic_capture.armed = true;
+    spin_unlock(logic_lock, irq);
+
+    send_wakeup_if_dormant(flash_client_index, &state, connection->pin_pair, connection->uart_instance);
+    server_send_logic_arm(connection->pin_pair, connection->uart_instance, trigger_mask, trigger_value);
+    if (connection->is_dormant){
+        send_dormant_flag_to_client(active_client_index);
+    }
+    return true;
+}
+
+void server_logic_collect(uint32_t flash_client_index, uint8_t active_client_index){
+    if (!logic_lock || !logic_held_by(flash_client_index)){
+        return;
+    }
+    uint32_t irq = spin_lock_blocking(logic_lock);
+    uint32_t max_chunks = (LOGIC_SERVER_RUNS - logic_capture.count) / LOGIC_CHUNK_RUNS;
+    uint32_t next_sequence = logic_capture.next_sequence;
+    uint8_t pin_count = logic_capture.pin_count;
+    spin_unlock(logic_lock, irq);
+    if (max_chunks > LOGIC_COLLECT_MAX_CHUNKS){
+        max_chunks = LOGIC_COLLECT_MAX_CHUNKS;
+    }
+    if (!max_chunks){
+        return;
+    }
+
+    server_uart_connection_t *connection = &active_uart_server_connections[active_client_index];
+    logic_run_t runs[LOGIC_COLLECT_MAX_CHUNKS * LOGIC_CHUNK_RUNS];
+    uint32_t run_count = 0;
+    uint32_t samples = 0;
+    uint32_t bad_chunks = 0;
+    uint32_t chunks = server_collect_logic_chunks(connection->pin_pair, connection->uart_instance, max_chunks, next_sequence, pin_count,
+        runs, &run_count, &samples, &bad_chunks);
+
+    irq = spin_lock_blocking(logic_lock);
+    if (logic_capture.in_use && logic_capture.flash_client_index == flash_client_index && logic_capture.next_sequence == next_sequence){
+        for (uint32_t index = 0; index < run_count; index++){
+            logic_capture.runs[(logic_capture.first + logic_capture.count) % LOGIC_SERVER_RUNS] = runs[index];
+            logic_capture.count++;
+            logic_capture.received += runs[index].length;
+        }
+        logic_capture.next_sequence += chunks;
+        logic_capture.bad += bad_chunks;
+        if (samples){
+            logic_capture.samples = samples;
+        }
+    }
+    spin_unlock(logic_lock, irq);
+
+    if (bad_chunks){
+        LOG_WARN(STATE_LOGIC_CHUNK_BAD, flash_client_index, bad_chunks);
+    }
+}
+
+void server_logic_print_machine(void){
+    if (!logic_lock){
+        return;
+    }
+    uint32_t irq = spin_lock_blocking(logic_lock);
+    bool in_use = logic_capture.in_use;
+    uint32_t flash_client_index = logic_capture.flash_client_index;
+    uint8_t first_gpio = logic_capture.first_gpio;
+    uint8_t pin_count = logic_capture.pin_count;
+    uint32_t rate_hz = logic_capture.rate_hz;
+    bool armed = logic_capture.armed;
+    uint32_t samples = logic_capture.samples;
+    uint32_t received = logic_capture.received;
+    uint32_t bad = logic_capture.bad;
+    uint32_t waiting = logic_capture.count;
+    spin_unlock(logic_lock, irq);
+    if (!in_use){
+        return;
+    }
+
+    const char *state = "ready";
+    if (samples){
+        state = received < samples ? "collecting" : "done";
+    }else if (armed){
+        state = "armed";
+    }
+    printf("LOGIC %lu %u %u %lu %s %lu %lu %lu %lu\n",
+        (unsigned long)flash_client_index, first_gpio, pin_count, (unsigned long)rate_hz, state,
+        (unsigned long)samples, (unsigned long)received, (unsigned long)bad, (unsigned long)waiting);
+}
+
+bool server_logic_print_runs(uint32_t flash_client_index){
+    if (!logic_lock || !logic_held_by(flash_client_index)){
+        return false;
+    }
+    while (true){
+        logic_run_t runs[LOGIC_RUNS_PER_LINE];
+        uint32_t irq = spin_lock_blocking(logic_lock);
+        uint32_t first_sample = logic_capture.read;
+        uint32_t run_count = 0;
+        while (run_count < LOGIC_RUNS_PER_LINE && logic_capture.count){
+            runs[run_count++] = logic_capture.runs[logic_capture.first];
+            logic_capture.read += logic_capture.runs[logic_capture.first].length;
+            logic_capture.first = (logic_capture.first + 1) % LOGIC_SERVER_RUNS;
+            logic_capture.count--;
+        }
+        spin_unlock(logic_lock, irq);
+        if (!run_count){
+            return true;
+        }
+
+        printf("LOGICRUNS %lu %lu", (unsigned long)flash_client_index, (unsigned long)first_sample);
+        for (uint32_t index = 0; index < run_count; index++){
+            printf(" %lx:%lu", (unsigned long)runs[index].value, (unsigned long)runs[index].length);
+        }
+        printf("\n");
+    }
+}
@@ -14,6 +14,7 @@
 #include <stdbool.h>
 
 #include "pico/multicore.h"
+#include "pico/util/queue.h"
 #include "hardware/watchdog.h"
 #include "hardware/irq.h"
 #include "hardware/regs/usb.h"
@@ -22,10 +23,33 @@
 #include "server.h"
 #include "functions.h"
 #include "menu.h"
+#include "statistics.h"
+#include "profiler.h"
+#include "flash_telemetry.h"
+#include "event_log.h"
+
+#define LOG_MODULE STATE
+#include "log.h"
 
 static repeating_timer_t repeating_timer;
+static queue_t core1_queue;
+static uint32_t core1_stack[CORE1_STACK_SIZE / sizeof(uint32_t)];
+static volatile uint32_t core1_dropped_messages[2] = {0};  ///< Messages lost to a full queue, per posting core
+static uint32_t core1_dropped_reported = 0;                ///< Drops already logged, core1 only
+static uint32_t core1_deferred[CORE1_DEFERRED_LENGTH];     ///< UART work held back during a stream, core1 only
+static uint8_t core1_deferred_count = 0;
 spin_lock_t *uart_lock = NULL;
 
+bool server_post_core1_message(uint32_t message){
+    if (queue_try_add(&core1_queue, &message)){
+        return true;
+    }
+    uint32_t irq = save_and_disable_interrupts();
+    core1_dropped_messages[get_core_num()]++;
+    restore_interrupts(irq);
+    return false;
+}
+
 /**
  * @brief Repeating timer callback to trigger onboard LED blink on core1.
  *
@@ -35,7 +59,7 @@ spin_lock_t *uart_lock = NULL;
  * @return Always true to keep the timer running.
  */
 static bool short_onboard_led_blink(repeating_timer_t *repeating_timer){
-    multicore_fifo_push_blocking(BLINK_LED_WAKEUP_MESSAGE);
+    server_post_core1_message(BLINK_LED_WAKEUP_MESSAGE);
     return true;
 }
 
@@ -49,29 +73,134 @@ static void setup_repeating_timer_for_periodic_onboard_led_blink(){
     add_repeating_timer_ms(PERIODIC_ONBOARD_LED_BLINK_TIME_MS, short_onboard_led_blink, NULL, &repeating_timer);
 }
 
+/**
+ * @brief Returns true if a core1 message leads to UART exchanges with the clients.
+ *
+ * @param cmd One of the `*_WAKEUP_MESSAGE` values.
+ * @return true for messages that must wait while a stream runs.
+ */
+static bool core1_message_needs_uart(uint32_t cmd){
+    return cmd == TIMED_OUTPUT_POLL_WAKEUP_MESSAGE ||
+        cmd == SCHEDULER_TICK_WAKEUP_MESSAGE ||
+        cmd == INPUT_DOORBELL_WAKEUP_MESSAGE ||
+        cmd == BLINK_LED_WAKEUP_MESSAGE;
+}
+
+/**
+ * @brief Holds a UART message back until the stream ends. Repeats of a held message are merged.
+ *
+ * Every held message only asks core1 to look at something (a due poll, the
+ * scheduler clock, pending doorbells), so running it once covers all repeats.
+ *
+ * @param cmd Message to hold back.
+ */
+static void core1_defer(uint32_t cmd){
+    for (uint8_t index = 0; index < core1_deferred_count; index++){
+        if (core1_deferred[index] == cmd){
+            return;
+        }
+    }
+    if (core1_deferred_count < CORE1_DEFERRED_LENGTH){
+        core1_deferred[core1_deferred_count++] = cmd;
+    }
+}
+
+/**
+ * @brief Logs the messages lost to a full core1 queue since the last check.
+ */
+static void core1_report_dropped(void){
+    uint32_t dropped = core1_dropped_messages[0] + core1_dropped_messages[1];
+    if (dropped != core1_dropped_reported){
+        LOG_WARN(STATE_CORE1_DROPPED, dropped, dropped - core1_dropped_reported);
+        core1_dropped_reported = dropped;
+    }
+}
+
+/**
+ * @brief Runs one core1 message.
+ *
+ * @param cmd One of the `*_WAKEUP_MESSAGE` values.
+ */
+static void core1_dispatch(uint32_t cmd){
+    if (cmd == DUMP_BUFFER_WAKEUP_MESSAGE) {
+        for (uint8_t index = 0; index < reconnection_buffer_index; index++) {
+            printf("%s", reconnection_buffer[index]);
+            sleep_ms(2); 
+            server_input_collect();
+        }
+    } 
+    else if (cmd == TIMED_OUTPUT_POLL_WAKEUP_MESSAGE){
+        server_timed_output_poll();
+    }
+    else if (cmd == SCHEDULER_TICK_WAKEUP_MESSAGE){
+        scheduler_tick();
+    }
+    else if (cmd == SCHEDULER_RELOAD_WAKEUP_MESSAGE){
+        scheduler_reload();
+    }
+    else if (cmd == INTERLOCK_RELOAD_WAKEUP_MESSAGE){
+        server_interlock_reload();
+    }
+    else if (cmd == AUDIT_TICK_WAKEUP_MESSAGE){
+        server_audit_tick();
+    }
+    else if (cmd == EVENT_LOG_FLUSH_WAKEUP_MESSAGE){
+        event_log_flush();
+    }
+    else if (cmd == EVENT_LOG_ERASE_WAKEUP_MESSAGE){
+        event_log_erase_ahead();
+    }
+    else if (cmd == BLINK_LED_WAKEUP_MESSAGE){
+        #if PERIODIC_ONBOARD_LED_BLINK_SERVER
+            fast_blink_onboard_led();
+        #endif
+        
+        #if PERIODIC_ONBOARD_LED_BLINK_ALL_CLIENTS
+            send_fast_blink_onboard_led_to_clients();
+        #endif
+    }
+}
+
 void periodic_wakeup(void){
-    multicore_fifo_drain();
+    profiler_init_core();
+    multicore_lockout_victim_init();
     while (true) {
-        __wfe();
-        if (multicore_fifo_rvalid()) {
-            uint32_t cmd = multicore_fifo_pop_blocking();
-
-            if (cmd == DUMP_BUFFER_WAKEUP_MESSAGE) {
-                for (uint8_t index = 0; index < reconnection_buffer_index; index++) {
-                    printf("%s", reconnection_buffer[index]);
-                    sleep_ms(2); 
-                }
-            } 
-            else if (cmd == BLINK_LED_WAKEUP_MESSAGE){
-                #if PERIODIC_ONBOARD_LED_BLINK_SERVER
-                    fast_blink_onboard_led();
-                #endif
-                
-                #if PERIODIC_ONBOARD_LED_BLINK_ALL_CLIENTS
-                    send_fast_blink_onboard_led_to_clients();
-                #endif
+        uint32_t cmd;
+        queue_remove_blocking(&core1_queue, &cmd);
+        core1_report_dropped();
+
+        if (stream_is_active()){
+            if (core1_message_needs_uart(cmd)){
+                core1_defer(cmd);
+            }else{
+                core1_dispatch(cmd);
             }
+            continue;
+        }
+
+        server_input_collect();
+        for (uint8_t index = 0; index < core1_deferred_count; index++){
+            core1_dispatch(core1_deferred[index]);
         }
+        core1_deferred_count = 0;
+        core1_dispatch(cmd);
+    }
+}
+
+/**
+ * @brief Configures the RX pins of all active server UART connections as pulled-up inputs.
+ *
+ * The clients just answered the handshake, so they are awake and hold
+ * their TX pins high. The pins are only driven for wake pulses, and are
+ * pulled down once a client is sent to dormant mode.
+ *
+ * @see set_rx_pin_as_input_for_client()
+ */
+static void set_rx_pins_as_inputs(void){
+    for (uint8_t connection_index = 0; connection_index < active_server_connections_number; connection_index++){
+        uart_pin_pair_t pin_pair = active_uart_server_connections[connection_index].pin_pair;
+        gpio_init(pin_pair.rx);
+        set_rx_pin_as_input_for_client(pin_pair, true);
     }
 }
 
@@ -80,44 +209,25 @@ void periodic_wakeup(void){
  *
  * Loops until at least one UART connection is detected. After that:
  * - Performs a confirmation blink.
+ * - Leaves the RX pins as inputs for doorbells and wakeup handling.
  * - Loads the last saved GPIO states for each client.
  */
 static void find_clients(void){
     while(!server_find_connections()) tight_loop_contents();
 
     blink_onboard_led_blocking();
+    set_rx_pins_as_inputs();
     
     server_load_running_states_to_active_clients();
 }
 
-/**
- * @brief Configures all RX pins of active server UART connections as outputs set to LOW.
- *
- * This is used before entering low-power modes where these pins
- * are repurposed (to trigger wakeup signals).
- *
- * The function:
- * - Deinitializes each RX pin (removing previous uart)
- * - Re-initializes it as a standard GPIO
- * - Sets it as output and drives it LOW
- */
-static void set_pins_as_output_for_dormant_wakeup(){
-    for (uint8_t connection_index = 0; connection_index < active_server_connections_number; connection_index++){
-        uint8_t pin = active_uart_server_connections[connection_index].pin_pair.rx;
-        gpio_deinit(pin);
-        gpio_init(pin);
-        gpio_set_dir(pin, GPIO_OUT);
-        gpio_put(pin, 0);
-    }
-}
-
 /**
  * @brief Final initialization stage and entry into USB CLI display loop.
  *
  * Performs the last setup steps before the main server loop:
- * - Sets RX pins as GPIO outputs for wakeup handling
  * - Starts a periodic onboard LED blink timer (if enabled)
  * - Launches core 1 to handle periodic wakeup tasks
+ * - Starts the scheduler tick, the output audit and the clock governor
  * - Waits for a USB CLI connection and launches the server menu UI
  */
 static void last_inits_and_display_launch(){        
@@ -125,9 +235,10 @@ static void last_inits_and_display_launch(){
         setup_repeating_timer_for_periodic_onboard_led_blink();
     #endif
 
-    multicore_launch_core1(periodic_wakeup);
-
-    set_pins_as_output_for_dormant_wakeup();
+    multicore_launch_core1_with_stack(periodic_wakeup, core1_stack, sizeof(core1_stack));
+    scheduler_init();
+    server_audit_init();
+    server_clock_governor_init();
 
     while(true){
         if (stdio_usb_connected()){
@@ -155,6 +266,25 @@ static void entry_point(){
  */
 int main(void){
     uart_lock = spin_lock_instance(UART_SPINLOCK_ID);
+    server_state_lock_init();
+    queue_init(&core1_queue, sizeof(uint32_t), CORE1_QUEUE_LENGTH);
+    multicore_lockout_victim_init();
+    statistics_init();
+    log_init();
+    flash_telemetry_init();
+    event_log_init();
+    preset_store_init();
+    server_timed_output_init();
+    time_sync_init();
+    server_latch_init();
+    server_input_init();
+    server_adc_init();
+    server_logic_init();
+    server_client_rules_init();
+    schedule_store_init();
+    interlock_store_init();
+    server_interlock_init();
+    profiler_init_core();
 
     if (watchdog_caused_reboot()){
         multicore_fifo_drain();
@@ -6,6 +6,8 @@
  * - Display current client connections.
  * - Select and control GPIO states of client devices.
  * - Toggle GPIO states.
+ * - Run timed outputs and pulse trains on client devices.
+ * - Schedule actions to run at given times, once or repeatedly.
  * - Save/build/load/reset configurations.
  * 
  * Input is read from USB serial, with range validation and error handling.
@@ -13,7 +15,6 @@
 
 #include <string.h>
 
-#include "pico/multicore.h"
 #include "pico/time.h"
 #include "pico/stdio_usb.h"
 #include "hardware/sync.h"
@@ -23,6 +24,13 @@
 #include "functions.h"
 #include "input.h"
 #include "menu.h"
+#include "host_interface.h"
+#include "statistics.h"
+#include "trace.h"
+#include "profiler.h"
+#include "log.h"
+#include "flash_telemetry.h"
+#include "event_log.h"
 
 static bool first_display = true;
 static volatile bool console_connected = false;
@@ -50,6 +58,11 @@ static void display_menu_options(){
     printf_and_update_buffer("7. Reset Configuration\n");
     printf_and_update_buffer("8. Clear Screen\n");
     printf_and_update_buffer("9. Restart System\n");
+    printf_and_update_buffer("10. Diagnostics\n");
+    printf_and_update_buffer("11. Machine Interface\n");
+    printf_and_update_buffer("12. Pulse Client's Device\n");
+    printf_and_update_buffer("13. Schedules\n");
+    printf_and_update_buffer("14. Client Inputs\n");
 }
 
 /**
@@ -61,6 +74,7 @@ static void display_menu_options(){
  * @param string The string to print and store.
  */
 void printf_and_update_buffer(const char *string){
+    PROFILE_ENTER(PROFILE_PRINTF_AND_UPDATE_BUFFER);
     printf("%s", string);
 
     if (BUFFER_MAX_NUMBER_OF_STRINGS - 1 == reconnection_buffer_index){
@@ -81,6 +95,7 @@ void printf_and_update_buffer(const char *string){
             );
         reconnection_buffer_index++;
     }
+    PROFILE_EXIT(PROFILE_PRINTF_AND_UPDATE_BUFFER);
 }
 
 
@@ -88,6 +103,7 @@ void printf_and_update_buffer(const char *string){
  * @brief Reboots the server and all clients.
  */
 static void restart_application(){
+    event_log_flush_all();
     signal_reset_for_all_clients();
     watchdog_reboot(0,0,0);
 }
@@ -136,6 +152,10 @@ static void load_configuration(void){
     
     if (read_client_data(&input_client_data, client_input_flags)){
         load_configuration_into_running_state(input_client_data.flash_configuration_index - 1, input_client_data.flash_client_index);
+
+        char string[BUFFER_MAX_STRING_SIZE];
+        snprintf(string, sizeof(string), "\nConfiguration Preset[%u] Loaded!\n", input_client_data.flash_configuration_index);
+        printf_and_update_buffer(string);
     }
 }
 
@@ -202,6 +222,7 @@ static void toggle_device(void){
                             devices[gpio_index > 22 ? (gpio_index - 3) : (gpio_index)].
                             is_on ? false : true;
     
+        server_state_lock();
         server_set_device_state_and_update_flash(active_uart_server_connections[input_client_data.client_index - 1].pin_pair,
         active_uart_server_connections[input_client_data.client_index - 1].uart_instance,
         gpio_index,
@@ -217,6 +238,8 @@ static void toggle_device(void){
         }else{
             active_uart_server_connections[input_client_data.client_index - 1].is_dormant = false;
         }
+        server_state_unlock();
+        server_state_unlock();
     
         char string[BUFFER_MAX_STRING_SIZE];
         snprintf(string, sizeof(string), "\nDevice[%u] Toggled.\n", input_client_data.device_index);
@@ -250,6 +273,7 @@ static void set_client_device(void){
                               devices[input_client_data.device_index - 1].
                               gpio_number;
     
+        server_state_lock();
         server_set_device_state_and_update_flash(active_uart_server_connections[input_client_data.client_index - 1].pin_pair,
             active_uart_server_connections[input_client_data.client_index - 1].uart_instance,
             gpio_index,
@@ -274,6 +298,223 @@ static void set_client_device(void){
     }
 }
 
+/**
+ * @brief Runs a timed output or pulse train on a selected client device.
+ *
+ * Prompts the user to:
+ * - Select a client and one of its devices
+ * - Choose the number of pulses and the ON/OFF times
+ *
+ * The client times the pulses itself and leaves the device OFF. The flash
+ * state is updated to OFF when the command is sent.
+ */
+static void pulse_client_device(void){
+    input_client_data_t input_client_data = {0};
+    client_input_flags_t client_input_flags = {0};
+    client_input_flags.need_client_index = true;
+    client_input_flags.need_device_index = true;
+    client_input_flags.need_timed_output = true;
+
+    if (read_client_data(&input_client_data, client_input_flags)){
+        uint32_t gpio_index = input_client_data.client_state->
+                              devices[input_client_data.device_index - 1].
+                              gpio_number;
+
+        server_timed_output_start(input_client_data.flash_client_index,
+            input_client_data.client_index - 1,
+            gpio_index,
+            input_client_data.pulse_on_ms,
+            input_client_data.pulse_off_ms,
+            input_client_data.pulse_count);
+
+        char string[BUFFER_MAX_STRING_SIZE];
+        if (input_client_data.pulse_count == 1){
+            snprintf(string, sizeof(string), "\nDevice[%u] ON for %lu ms.\n",
+                input_client_data.device_index,
+                (unsigned long)input_client_data.pulse_on_ms);
+        }else{
+            snprintf(string, sizeof(string), "\nDevice[%u] Pulsing %lux: %lu ms ON, %lu ms OFF.\n",
+                input_client_data.device_index,
+                (unsigned long)input_client_data.pulse_count,
+                (unsigned long)input_client_data.pulse_on_ms,
+                (unsigned long)input_client_data.pulse_off_ms);
+        }
+        printf_and_update_buffer(string);
+    }
+}
+
+/**
+ * @brief Adds a schedule entry built from user input.
+ *
+ * Prompts the user to:
+ * - Choose the action (set, toggle, load preset, load preset on all clients)
+ * - Select the client, device, state or preset the action needs
+ * - Choose when it first runs and whether it repeats
+ */
+static void add_schedule(void){
+    uint32_t action;
+    read_schedule_action(&action);
+    if (!action){
+        return;
+    }
+
+    schedule_entry_t entry = {0};
+    entry.action = action;
+
+    input_client_data_t input_client_data = {0};
+    if (action == SCHEDULE_ACTION_LOAD_SCENE){
+        read_flash_configuration_index(&input_client_data.flash_configuration_index);
+        if (!input_client_data.flash_configuration_index){
+            return;
+        }
+        entry.target = input_client_data.flash_configuration_index - 1;
+    }else{
+        client_input_flags_t client_input_flags = {0};
+        client_input_flags.need_client_index = true;
+        client_input_flags.need_device_index = action != SCHEDULE_ACTION_LOAD_PRESET;
+        client_input_flags.need_device_state = action == SCHEDULE_ACTION_SET;
+        client_input_flags.is_load = action == SCHEDULE_ACTION_LOAD_PRESET;
+        if (!read_client_data(&input_client_data, client_input_flags)){
+            return;
+        }
+
+        entry.flash_client_index = input_client_data.flash_client_index;
+        entry.value = input_client_data.device_state;
+        if (action == SCHEDULE_ACTION_LOAD_PRESET){
+            entry.target = input_client_data.flash_configuration_index - 1;
+        }else{
+            entry.target = input_client_data.client_state->
+                           devices[input_client_data.device_index - 1].
+                           gpio_number;
+        }
+    }
+
+    uint32_t delay_s;
+    uint32_t period_s;
+    if (!read_schedule_timing(&delay_s, &period_s)){
+        return;
+    }
+    entry.time_s = scheduler_clock_now() + delay_s;
+    entry.period_s = period_s;
+
+    int32_t schedule_index = scheduler_add(&entry);
+    if (schedule_index < 0){
+        printf_and_update_buffer("\nSchedule Table Full.\n");
+        return;
+    }
+
+    char string[BUFFER_MAX_STRING_SIZE];
+    snprintf(string, sizeof(string), "\nSchedule [%ld] Added.\n", (long)schedule_index + 1);
+    printf_and_update_buffer(string);
+}
+
+/**
+ * @brief Lists the schedule entries and deletes the one the user picks.
+ */
+static void delete_schedule(void){
+    scheduler_print();
+
+    uint32_t schedule_index;
+    read_schedule_index(&schedule_index);
+    if (!schedule_index){
+        return;
+    }
+
+    char string[BUFFER_MAX_STRING_SIZE];
+    if (scheduler_remove(schedule_index - 1)){
+        snprintf(string, sizeof(string), "\nSchedule [%lu] Deleted.\n", (unsigned long)schedule_index);
+    }else{
+        snprintf(string, sizeof(string), "\nNo Schedule [%lu].\n", (unsigned long)schedule_index);
+    }
+    printf_and_update_buffer(string);
+}
+
+/**
+ * @brief Entry point for the schedules submenu.
+ *
+ * Prompts the user to pick a schedule command and runs it:
+ * - 1: List the pending schedule entries
+ * - 2: Add a schedule entry
+ * - 3: Delete a schedule entry
+ *
+ * Scheduled actions run on core1 without the CLI.
+ */
+static void schedules(void){
+    uint32_t schedule_option;
+    read_schedule_option(&schedule_option);
+
+    switch (schedule_option){
+        case 1: scheduler_print();
+            break;
+        case 2: add_schedule();
+            break;
+        case 3: delete_schedule();
+            break;
+
+        default:
+            break;
+    }
+}
+
+/**
+ * @brief Makes a client device an input, or a device again, from user input.
+ *
+ * Prompts the user to:
+ * - Select the client and the device
+ * - Choose the input mode and the debounce time
+ */
+static void configure_client_input(void){
+    input_client_data_t input_client_data = {0};
+    client_input_flags_t client_input_flags = {0};
+    client_input_flags.need_client_index = true;
+    client_input_flags.need_device_index = true;
+    if (!read_client_data(&input_client_data, client_input_flags)){
+        return;
+    }
+
+    uint32_t mode;
+    uint32_t debounce_ms;
+    if (!read_input_parameters(&mode, &debounce_ms)){
+        return;
+    }
+
+    uint8_t gpio_number = input_client_data.client_state->
+                          devices[input_client_data.device_index - 1].
+                          gpio_number;
+    char string[BUFFER_MAX_STRING_SIZE];
+    if (server_input_configure(input_client_data.flash_client_index, gpio_number, (input_mode_t)mode, debounce_ms)){
+        snprintf(string, sizeof(string), "\nDevice[%u] %s.\n", input_client_data.device_index,
+            mode == INPUT_MODE_OFF ? "Released" : "Is Now An Input");
+    }else{
+        snprintf(string, sizeof(string), "\nDevice[%u] Could Not Be Configured.\n", input_client_data.device_index);
+    }
+    printf_and_update_buffer(string);
+}
+
+/**
+ * @brief Entry point for the client inputs submenu.
+ *
+ * Prompts the user to pick an input command and runs it:
+ * - 1: Show the input levels of every client
+ * - 2: Configure a client input
+ *
+ * Input changes are collected by core1 when a client reports them.
+ */
+static void client_inputs(void){
+    uint32_t input_option;
+    read_input_option(&input_option);
+
+    switch (input_option){
+        case 1: server_input_print();
+            break;
+        case 2: configure_client_input();
+            break;
+
+        default:
+            break;
+    }
+}
+
 /**
  * @brief Prints all currently active UART connections to the console.
  *
@@ -291,12 +532,48 @@ static inline void display_active_clients(void){
     }
 }
 
+/**
+ * @brief Entry point for the diagnostics submenu.
+ *
+ * Prompts the user to pick a diagnostics tool and runs it:
+ * - 1: Dump the hot-path event trace as Chrome trace JSON
+ * - 2: Show runtime statistics
+ * - 3: Show runtime statistics and reset them
+ * - 4: Dump the sampling/cycle profile (profiling builds only)
+ * - 5: Print the binary log as text
+ * - 6: Show flash wear and commit telemetry
+ */
+static void diagnostics(void){
+    uint32_t diagnostics_option;
+    read_diagnostics_option(&diagnostics_option);
+
+    switch (diagnostics_option){
+        case 1: trace_dump_chrome_json();
+            break;
+        case 2: statistics_print(false);
+            break;
+        case 3: statistics_print(true);
+            break;
+        case 4: profiler_dump(false);
+            break;
+        case 5: log_dump(false);
+            break;
+        case 6: flash_telemetry_print();
+            break;
+
+        default:
+            break;
+    }
+}
+
 /**
  * @brief Dispatches the user-selected menu option to the corresponding action.
  *
  * @param choice The selected menu number.
  */
 static void select_action(uint32_t choice){
+    TRACE_BEGIN(TRACE_SPAN_CLI_DISPATCH, choice, 0);
+    event_log_write(EVENT_COMMAND, 0, choice);
     switch (choice){
         case 1: display_active_clients();
             break;
@@ -316,10 +593,21 @@ static void select_action(uint32_t choice){
             break;
         case 9: restart_application();  
             break;
+        case 10: diagnostics();
+            break;
+        case 11: host_interface_run();
+            break;
+        case 12: pulse_client_device();
+            break;
+        case 13: schedules();
+            break;
+        case 14: client_inputs();
+            break;
 
         default: printf_and_update_buffer("Out of range. Try again.\n");
             break;
     }
+    TRACE_END(TRACE_SPAN_CLI_DISPATCH, choice, 0);
 }
     
 /**
@@ -361,10 +649,12 @@ static bool check_console_state(repeating_timer_t *repeating_timer){
     if (console_connected && !stdio_usb_connected()){
         console_connected = false;
         console_disconnected = true;
+        event_log_write(EVENT_USB_LOST, 0, 0);
     }else if (console_disconnected && stdio_usb_connected()){
         console_connected = true;
         console_disconnected = false;
-        multicore_fifo_push_blocking(DUMP_BUFFER_WAKEUP_MESSAGE);
+        event_log_write(EVENT_USB_ATTACHED, 0, 0);
+        server_post_core1_message(DUMP_BUFFER_WAKEUP_MESSAGE);
     }
     return true;
 }
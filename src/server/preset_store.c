@@ -0,0 +1,431 @@
+/**
+ * @file preset_store.c
+ * @brief Content-addressed, deduplicated preset library in its own flash region.
+ *
+ * A preset is stored as a GPIO on-mask in a pool shared by all clients.
+ * Each pool entry is keyed by the hash of its mask and counts how many client
+ * preset slots reference it. Identical presets on any number of clients
+ * therefore share one entry, and all-OFF presets take no entry at all.
+ *
+ * The hash is a bijective 32-bit mix of the mask, so two presets are equal
+ * exactly when their hashes are equal, and only the all-OFF mask hashes to 0.
+ * Entries are found by open addressing with linear probing. A released
+ * entry keeps its hash so that later entries in the same probe chain stay
+ * reachable, and it is reused by the next insertion.
+ *
+ * PWM duties of a preset are stored apart, in a small pool of duty sets
+ * that presets share the same way, found by comparing the duties. Presets
+ * without PWM outputs take no duty set, so the on-mask keeps identifying
+ * them alone.
+ *
+ * The library lives in two banks of `PRESET_LIBRARY_BANK_SECTORS` sectors
+ * below the state sector, so saving the running state never erases it.
+ * Commits go to the inactive bank with the next sequence number, which
+ * spreads wear over both banks and leaves the previous library intact if
+ * power fails during a commit. Reads use the active bank directly in flash.
+ */
+
+#include <stddef.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "hardware/flash.h"
+#include "hardware/sync.h"
+
+#include "server.h"
+#include "statistics.h"
+#include "trace.h"
+#include "flash_telemetry.h"
+#include "event_log.h"
+
+#define LOG_MODULE FLASH
+#include "log.h"
+
+#define PRESET_LIBRARY_PROGRAM_SIZE (((sizeof(preset_library_t) + SERVER_PAGE_SIZE - 1) / SERVER_PAGE_SIZE) * SERVER_PAGE_SIZE)
+#define PRESET_LIBRARY_ERASE_SIZE   (((sizeof(preset_library_t) + SERVER_SECTOR_SIZE - 1) / SERVER_SECTOR_SIZE) * SERVER_SECTOR_SIZE)
+
+_Static_assert(sizeof(preset_library_t) <= PRESET_LIBRARY_BANK_SIZE, "preset library does not fit in one bank");
+_Static_assert(PRESET_POOL_SIZE < PRESET_SLOT_EMPTY, "PRESET_SLOT_EMPTY must not be a valid pool index");
+_Static_assert(PRESET_PWM_POOL_SIZE < PRESET_PWM_SLOT_EMPTY, "PRESET_PWM_SLOT_EMPTY must not be a valid PWM pool index");
+
+static union{
+    preset_library_t library;
+    uint8_t bytes[PRESET_LIBRARY_PROGRAM_SIZE];
+}preset_work;
+
+static int8_t preset_active_bank = -1;
+
+/**
+ * @brief Returns the flash offset of a library bank.
+ *
+ * @param bank Bank number (0 or 1).
+ * @return Flash offset of the bank.
+ */
+static uint32_t preset_bank_offset(uint8_t bank){
+    return PRESET_LIBRARY_OFFSET + bank * PRESET_LIBRARY_BANK_SIZE;
+}
+
+/**
+ * @brief Returns a bank as mapped in XIP flash.
+ *
+ * @param bank Bank number (0 or 1).
+ * @return Library stored in the bank, valid or not.
+ */
+static const preset_library_t *preset_bank(uint8_t bank){
+    return (const preset_library_t *)(XIP_BASE + preset_bank_offset(bank));
+}
+
+/**
+ * @brief Checks the magic and CRC of a stored library.
+ *
+ * @param library Library to check.
+ * @return true if the library is valid.
+ */
+static bool preset_library_is_valid(const preset_library_t *library){
+    return library->magic == PRESET_LIBRARY_MAGIC &&
+        library->crc == compute_crc32(library, offsetof(preset_library_t, crc));
+}
+
+void preset_store_init(void){
+    bool valid_0 = preset_library_is_valid(preset_bank(0));
+    bool valid_1 = preset_library_is_valid(preset_bank(1));
+
+    if (valid_0 && valid_1){
+        preset_active_bank = (int32_t)(preset_bank(1)->sequence - preset_bank(0)->sequence) > 0 ? 1 : 0;
+    }else if (valid_0 || valid_1){
+        preset_active_bank = valid_1 ? 1 : 0;
+    }else{
+        preset_active_bank = -1;
+        preset_store_reset(&preset_work.library);
+        preset_store_commit();
+    }
+}
+
+const preset_library_t *preset_store_library(void){
+    if (preset_active_bank < 0){
+        return &preset_work.library;
+    }
+    return preset_bank((uint8_t)preset_active_bank);
+}
+
+preset_library_t *preset_store_edit(void){
+    const preset_library_t *active = preset_store_library();
+    if (active != &preset_work.library){
+        memcpy(&preset_work.library, active, sizeof(preset_library_t));
+    }
+    return &preset_work.library;
+}
+
+void __not_in_flash_func(preset_store_commit)(void){
+    uint32_t start_us = time_us_32();
+    uint8_t bank = preset_active_bank == 0 ? 1 : 0;
+    uint32_t offset = preset_bank_offset(bank);
+
+    preset_work.library.magic = PRESET_LIBRARY_MAGIC;
+    preset_work.library.sequence = preset_active_bank < 0 ? 1 : preset_bank((uint8_t)preset_active_bank)->sequence + 1;
+    preset_work.library.crc = compute_crc32(&preset_work.library, offsetof(preset_library_t, crc));
+    memset(&preset_work.bytes[sizeof(preset_library_t)], 0xFF, PRESET_LIBRARY_PROGRAM_SIZE - sizeof(preset_library_t));
+
+    flash_telemetry_record_erase(offset, PRESET_LIBRARY_ERASE_SIZE);
+    flash_telemetry_record_program(PRESET_LIBRARY_PROGRAM_SIZE);
+
+    bool locked_out = flash_lockout_begin();
+    uint32_t ints = save_and_disable_interrupts();
+    TRACE_BEGIN(TRACE_SPAN_FLASH_ERASE, 0, offset);
+    flash_range_erase(offset, PRESET_LIBRARY_ERASE_SIZE);
+    TRACE_END(TRACE_SPAN_FLASH_ERASE, 0, offset);
+    TRACE_BEGIN(TRACE_SPAN_FLASH_PROGRAM, 0, offset);
+    flash_range_program(offset, preset_work.bytes, PRESET_LIBRARY_PROGRAM_SIZE);
+    TRACE_END(TRACE_SPAN_FLASH_PROGRAM, 0, offset);
+    restore_interrupts(ints);
+    flash_lockout_end(locked_out);
+
+    if (preset_library_is_valid(preset_bank(bank))){
+        preset_active_bank = (int8_t)bank;
+    }
+
+    uint32_t elapsed_us = time_us_32() - start_us;
+    statistics_record_latency(STATISTICS_LATENCY_FLASH_COMMIT, elapsed_us);
+    flash_telemetry_record_commit(elapsed_us);
+    flash_telemetry_store();
+    LOG_DEBUG(FLASH_COMMIT, offset, elapsed_us);
+    event_log_write(EVENT_COMMIT, (uint16_t)(elapsed_us / 1000u), offset);
+}
+
+uint32_t preset_store_hash(uint32_t gpio_mask){
+    uint32_t hash = gpio_mask;
+    hash ^= hash >> 16;
+    hash *= 0x85EBCA6Bu;
+    hash ^= hash >> 13;
+    hash *= 0xC2B2AE35u;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+/**
+ * @brief Looks up the pool entry holding a given hash.
+ *
+ * @param library    Library holding the pool.
+ * @param hash       Hash to look for (non-zero).
+ * @param free_entry Set to the first reusable entry of the probe chain, or
+ *                   PRESET_SLOT_EMPTY if there is none. May be NULL.
+ * @return Pool index of the entry, or PRESET_SLOT_EMPTY if the hash is not pooled.
+ */
+static uint16_t preset_store_find(const preset_library_t *library, uint32_t hash, uint16_t *free_entry){
+    uint16_t first_free = PRESET_SLOT_EMPTY;
+    uint16_t pool_index = hash % PRESET_POOL_SIZE;
+
+    for (uint16_t probe = 0; probe < PRESET_POOL_SIZE; probe++){
+        const preset_pool_entry_t *entry = &library->preset_pool[pool_index];
+        if (entry->refcount && entry->hash == hash){
+            if (free_entry){
+                *free_entry = first_free;
+            }
+            return pool_index;
+        }
+        if (!entry->refcount && first_free == PRESET_SLOT_EMPTY){
+            first_free = pool_index;
+        }
+        if (!entry->hash){
+            break;
+        }
+        pool_index = (pool_index + 1) % PRESET_POOL_SIZE;
+    }
+
+    if (free_entry){
+        *free_entry = first_free;
+    }
+    return PRESET_SLOT_EMPTY;
+}
+
+/**
+ * @brief Drops one reference to a pool entry.
+ *
+ * @param library    Library holding the pool.
+ * @param pool_index Pool index, PRESET_SLOT_EMPTY is ignored.
+ */
+static void preset_store_release(preset_library_t *library, uint16_t pool_index){
+    if (pool_index < PRESET_POOL_SIZE && library->preset_pool[pool_index].refcount){
+        library->preset_pool[pool_index].refcount--;
+    }
+}
+
+uint32_t preset_store_get_mask(const preset_library_t *library, uint32_t flash_client_index, uint32_t preset_index){
+    uint16_t pool_index = library->preset_slots[flash_client_index][preset_index];
+    if (pool_index >= PRESET_POOL_SIZE){
+        return 0;
+    }
+    return library->preset_pool[pool_index].gpio_mask;
+}
+
+uint32_t preset_store_get_hash(const preset_library_t *library, uint32_t flash_client_index, uint32_t preset_index){
+    uint16_t pool_index = library->preset_slots[flash_client_index][preset_index];
+    if (pool_index >= PRESET_POOL_SIZE){
+        return 0;
+    }
+    return library->preset_pool[pool_index].hash;
+}
+
+/**
+ * @brief Checks whether an on-mask can be stored in a preset without changing anything.
+ *
+ * @param library   Library to check.
+ * @param gpio_mask On-mask to store.
+ * @return false if `preset_store_set_mask()` would fail because the pool is full.
+ */
+static bool preset_store_mask_fits(const preset_library_t *library, uint32_t gpio_mask){
+    gpio_mask &= GPIO_DEVICE_MASK;
+    if (!gpio_mask){
+        return true;
+    }
+    uint16_t free_entry;
+    return preset_store_find(library, preset_store_hash(gpio_mask), &free_entry) != PRESET_SLOT_EMPTY ||
+        free_entry != PRESET_SLOT_EMPTY;
+}
+
+bool preset_store_set_mask(preset_library_t *library, uint32_t flash_client_index, uint32_t preset_index, uint32_t gpio_mask){
+    uint16_t *slot = &library->preset_slots[flash_client_index][preset_index];
+    gpio_mask &= GPIO_DEVICE_MASK;
+
+    if (!gpio_mask){
+        preset_store_release(library, *slot);
+        *slot = PRESET_SLOT_EMPTY;
+        return true;
+    }
+
+    uint32_t hash = preset_store_hash(gpio_mask);
+    if (*slot < PRESET_POOL_SIZE && library->preset_pool[*slot].hash == hash){
+        return true;
+    }
+
+    uint16_t free_entry;
+    uint16_t pool_index = preset_store_find(library, hash, &free_entry);
+    if (pool_index == PRESET_SLOT_EMPTY){
+        if (free_entry == PRESET_SLOT_EMPTY){
+            return false;
+        }
+        pool_index = free_entry;
+        library->preset_pool[pool_index].hash = hash;
+        library->preset_pool[pool_index].gpio_mask = gpio_mask;
+    }
+
+    preset_store_release(library, *slot);
+    library->preset_pool[pool_index].refcount++;
+    *slot = pool_index;
+    return true;
+}
+
+/**
+ * @brief Returns the PWM duty set of a preset.
+ *
+ * @param library            Library holding the pool.
+ * @param flash_client_index Index of the client in the persistent state table.
+ * @param preset_index       Preset slot (0-based).
+ * @return Duty set, or NULL if the preset has no PWM output.
+ */
+static const preset_pwm_entry_t *preset_store_get_pwm(const preset_library_t *library, uint32_t flash_client_index, uint32_t preset_index){
+    uint8_t pwm_index = library->preset_pwm_slots[flash_client_index][preset_index];
+    if (pwm_index >= PRESET_PWM_POOL_SIZE){
+        return NULL;
+    }
+    return &library->preset_pwm_pool[pwm_index];
+}
+
+/**
+ * @brief Copies the PWM duties of a client state.
+ *
+ * @param client_state State holding the duties, NULL for none.
+ * @param duties       Receives one duty per device.
+ * @return true if any duty is non-zero.
+ */
+static bool preset_store_state_duties(const client_state_t *client_state, uint16_t duties[MAX_NUMBER_OF_GPIOS]){
+    bool has_pwm = false;
+    for (uint8_t device_index = 0; device_index < MAX_NUMBER_OF_GPIOS; device_index++){
+        duties[device_index] = client_state ? client_state->devices[device_index].pwm_duty : 0;
+        has_pwm |= duties[device_index] != 0;
+    }
+    return has_pwm;
+}
+
+/**
+ * @brief Looks up the PWM pool entry holding a given duty set.
+ *
+ * @param library    Library holding the pool.
+ * @param duties     Duty set to look for.
+ * @param free_entry Set to the first unused entry, or PRESET_PWM_SLOT_EMPTY if there is none.
+ * @return PWM pool index of the entry, or PRESET_PWM_SLOT_EMPTY if the duty set is not pooled.
+ */
+static uint8_t preset_store_find_pwm(const preset_library_t *library, const uint16_t duties[MAX_NUMBER_OF_GPIOS], uint8_t *free_entry){
+    *free_entry = PRESET_PWM_SLOT_EMPTY;
+    for (uint8_t index = 0; index < PRESET_PWM_POOL_SIZE; index++){
+        const preset_pwm_entry_t *entry = &library->preset_pwm_pool[index];
+        if (entry->refcount && memcmp(entry->duties, duties, MAX_NUMBER_OF_GPIOS * sizeof(uint16_t)) == 0){
+            return index;
+        }
+        if (!entry->refcount && *free_entry == PRESET_PWM_SLOT_EMPTY){
+            *free_entry = index;
+        }
+    }
+    return PRESET_PWM_SLOT_EMPTY;
+}
+
+/**
+ * @brief Checks whether the PWM duties of a client state can be stored without changing anything.
+ *
+ * @param library      Library to check.
+ * @param client_state State holding the duties.
+ * @return false if `preset_store_set_pwm()` would fail because the PWM pool is full.
+ */
+static bool preset_store_pwm_fits(const preset_library_t *library, const client_state_t *client_state){
+    uint16_t duties[MAX_NUMBER_OF_GPIOS];
+    if (!preset_store_state_duties(client_state, duties)){
+        return true;
+    }
+    uint8_t free_entry;
+    return preset_store_find_pwm(library, duties, &free_entry) != PRESET_PWM_SLOT_EMPTY ||
+        free_entry != PRESET_PWM_SLOT_EMPTY;
+}
+
+/**
+ * @brief Stores the PWM duties of a client state in a preset.
+ *
+ * @param library            Library to modify.
+ * @param flash_client_index Index of the client in the persistent state table.
+ * @param preset_index       Preset slot (0-based).
+ * @param client_state       State holding the duties, NULL to clear them.
+ * @return false if the PWM pool is full.
+ */
+static bool preset_store_set_pwm(preset_library_t *library, uint32_t flash_client_index, uint32_t preset_index, const client_state_t *client_state){
+    uint16_t duties[MAX_NUMBER_OF_GPIOS];
+    bool has_pwm = preset_store_state_duties(client_state, duties);
+
+    uint8_t *slot = &library->preset_pwm_slots[flash_client_index][preset_index];
+    uint8_t pwm_index = PRESET_PWM_SLOT_EMPTY;
+    if (has_pwm){
+        uint8_t free_entry;
+        pwm_index = preset_store_find_pwm(library, duties, &free_entry);
+        if (pwm_index != PRESET_PWM_SLOT_EMPTY && pwm_index == *slot){
+            return true;
+        }
+        if (pwm_index == PRESET_PWM_SLOT_EMPTY){
+            if (free_entry == PRESET_PWM_SLOT_EMPTY){
+                return false;
+            }
+            pwm_index = free_entry;
+            memcpy(library->preset_pwm_pool[pwm_index].duties, duties, sizeof(duties));
+        }
+        library->preset_pwm_pool[pwm_index].refcount++;
+    }
+
+    if (*slot < PRESET_PWM_POOL_SIZE && library->preset_pwm_pool[*slot].refcount){
+        library->preset_pwm_pool[*slot].refcount--;
+    }
+    *slot = pwm_index;
+    return true;
+}
+
+bool preset_store_set_state(preset_library_t *library, uint32_t flash_client_index, uint32_t preset_index, const client_state_t *client_state){
+    uint32_t gpio_mask = client_state_gpio_mask(client_state);
+    if (!preset_store_pwm_fits(library, client_state) ||
+        !preset_store_mask_fits(library, gpio_mask)){
+        return false;
+    }
+    return preset_store_set_pwm(library, flash_client_index, preset_index, client_state) &&
+        preset_store_set_mask(library, flash_client_index, preset_index, gpio_mask);
+}
+
+bool preset_store_matches_state(const preset_library_t *library, uint32_t flash_client_index, uint32_t preset_index, const client_state_t *client_state){
+    if (preset_store_hash(client_state_gpio_mask(client_state)) != preset_store_get_hash(library, flash_client_index, preset_index)){
+        return false;
+    }
+    const preset_pwm_entry_t *pwm = preset_store_get_pwm(library, flash_client_index, preset_index);
+    for (uint8_t device_index = 0; device_index < MAX_NUMBER_OF_GPIOS; device_index++){
+        if (client_state->devices[device_index].pwm_duty != (pwm ? pwm->duties[device_index] : 0)){
+            return false;
+        }
+    }
+    return true;
+}
+
+void preset_store_clear(preset_library_t *library, uint32_t flash_client_index, uint32_t preset_index){
+    preset_store_set_pwm(library, flash_client_index, preset_index, NULL);
+    preset_store_set_mask(library, flash_client_index, preset_index, 0);
+}
+
+void preset_store_apply_to_state(const preset_library_t *library, uint32_t flash_client_index, uint32_t preset_index, client_state_t *client_state){
+    uint32_t gpio_mask = preset_store_get_mask(library, flash_client_index, preset_index);
+    const preset_pwm_entry_t *pwm = preset_store_get_pwm(library, flash_client_index, preset_index);
+    for (uint8_t device_index = 0; device_index < MAX_NUMBER_OF_GPIOS; device_index++){
+        device_t *device = &client_state->devices[device_index];
+        if (device->gpio_number != UART_CONNECTION_FLAG_NUMBER){
+            device->is_on = (gpio_mask >> device->gpio_number) & 1u;
+            device->pwm_duty = pwm ? pwm->duties[device_index] : 0;
+        }
+    }
+}
+
+void preset_store_reset(preset_library_t *library){
+    memset(library, 0, sizeof(preset_library_t));
+    memset(library->preset_slots, 0xFF, sizeof(library->preset_slots));
+    memset(library->preset_pwm_slots, 0xFF, sizeof(library->preset_pwm_slots));
+}
@@ -0,0 +1,147 @@
+/**
+ * @file preset_sync.c
+ * @brief Keeps the clients' RAM copies of their presets in sync with the server.
+ *
+ * The server's preset library stays authoritative. Every preset slot has a
+ * version that is bumped whenever the preset changes. Each version sent to a
+ * client is remembered, so only presets whose version changed are sent
+ * again. Recalling a preset then needs only a single frame.
+ *
+ * Versions are kept in RAM only, and clients lose their copies on reboot.
+ * Whenever a client (re)connects, the versions it was sent are forgotten
+ * and all non-empty presets are sent again, whether the server booted or
+ * the audit found the client restarted (see `server_restore_client()`).
+ * Empty presets are sent on their first recall.
+ */
+
+#include "server.h"
+
+#define LOG_MODULE STATE
+#include "log.h"
+
+static uint32_t preset_versions[MAX_SERVER_CONNECTIONS][NUMBER_OF_POSSIBLE_PRESETS];
+static uint32_t preset_synced_versions[MAX_SERVER_CONNECTIONS][NUMBER_OF_POSSIBLE_PRESETS];
+
+uint32_t client_state_gpio_mask(const client_state_t *client_state){
+    uint32_t gpio_mask = 0;
+    for (uint8_t device_index = 0; device_index < MAX_NUMBER_OF_GPIOS; device_index++){
+        const device_t *device = &client_state->devices[device_index];
+        if (device->gpio_number != UART_CONNECTION_FLAG_NUMBER && device->is_on){
+            gpio_mask |= 1u << device->gpio_number;
+        }
+    }
+    return gpio_mask & GPIO_DEVICE_MASK;
+}
+
+/**
+ * @brief Returns the current version of a preset. Version 0 is never used.
+ *
+ * @param flash_client_index Index of the client in the persistent state table.
+ * @param preset_index       Preset slot (0-based).
+ * @return Current version.
+ */
+static uint32_t preset_version(uint32_t flash_client_index, uint32_t preset_index){
+    return preset_versions[flash_client_index][preset_index] + 1;
+}
+
+/**
+ * @brief Returns true if the client does not have the current version of a preset.
+ *
+ * @param flash_client_index Index of the client in the persistent state table.
+ * @param preset_index       Preset slot (0-based).
+ * @return true if the preset must be sent.
+ */
+static bool preset_is_stale(uint32_t flash_client_index, uint32_t preset_index){
+    return preset_synced_versions[flash_client_index][preset_index] != preset_version(flash_client_index, preset_index);
+}
+
+/**
+ * @brief Builds the client-side representation of a preset.
+ *
+ * @param library            Preset library.
+ * @param flash_client_index Index of the client in the persistent state table.
+ * @param preset_index       Preset slot (0-based).
+ * @return Version and GPIO mask of the preset.
+ */
+static client_preset_t preset_build(const preset_library_t *library, uint32_t flash_client_index, uint32_t preset_index){
+    client_preset_t preset = {
+        .version = preset_version(flash_client_index, preset_index),
+        .gpio_mask = preset_store_get_mask(library, flash_client_index, preset_index),
+    };
+    return preset;
+}
+
+void preset_sync_mark_modified(uint32_t flash_client_index, uint32_t preset_index){
+    if (flash_client_index >= MAX_SERVER_CONNECTIONS || preset_index >= NUMBER_OF_POSSIBLE_PRESETS){
+        return;
+    }
+    preset_versions[flash_client_index][preset_index]++;
+}
+
+void preset_sync_mark_all_modified(uint32_t flash_client_index){
+    for (uint8_t preset_index = 0; preset_index < NUMBER_OF_POSSIBLE_PRESETS; preset_index++){
+        preset_sync_mark_modified(flash_client_index, preset_index);
+    }
+}
+
+void preset_sync_forget_client(uint32_t flash_client_index){
+    if (flash_client_index >= MAX_SERVER_CONNECTIONS){
+        return;
+    }
+    for (uint8_t preset_index = 0; preset_index < NUMBER_OF_POSSIBLE_PRESETS; preset_index++){
+        preset_synced_versions[flash_client_index][preset_index] = 0;
+    }
+}
+
+void preset_sync_client(uint32_t flash_client_index, const client_t *client){
+    if (flash_client_index >= MAX_SERVER_CONNECTIONS){
+        return;
+    }
+    const preset_library_t *library = preset_store_library();
+    for (uint8_t preset_index = 0; preset_index < NUMBER_OF_POSSIBLE_PRESETS; preset_index++){
+        if (preset_is_stale(flash_client_index, preset_index) && preset_store_get_hash(library, flash_client_index, preset_index)){
+            client_preset_t preset = preset_build(library, flash_client_index, preset_index);
+            server_send_preset(client->uart_connection.pin_pair, client->uart_connection.uart_instance, preset_index, &preset);
+            preset_synced_versions[flash_client_index][preset_index] = preset.version;
+        }
+    }
+}
+
+/**
+ * @brief Checks whether the client's copy of a preset is out of date and, if so, marks it as sent.
+ *
+ * @param flash_client_index Index of the client in the persistent state table.
+ * @param preset_index       Preset slot (0-based).
+ * @param preset             Set to the preset to send when it is stale.
+ * @return true if the preset must be sent.
+ */
+static bool preset_sync_take_stale(uint32_t flash_client_index, uint32_t preset_index, client_preset_t *preset){
+    if (!preset_is_stale(flash_client_index, preset_index)){
+        return false;
+    }
+    *preset = preset_build(preset_store_library(), flash_client_index, preset_index);
+    preset_synced_versions[flash_client_index][preset_index] = preset->version;
+    LOG_DEBUG(STATE_PRESET_SYNCED, preset_index + 1, preset->version);
+    return true;
+}
+
+void preset_sync_recall(uint32_t flash_client_index, uint32_t preset_index, const client_t *client){
+    if (flash_client_index >= MAX_SERVER_CONNECTIONS || preset_index >= NUMBER_OF_POSSIBLE_PRESETS){
+        return;
+    }
+
+    client_preset_t preset;
+    bool stale = preset_sync_take_stale(flash_client_index, preset_index, &preset);
+    server_send_preset_recall(client->uart_connection.pin_pair, client->uart_connection.uart_instance, (uint8_t)preset_index, stale ? &preset : NULL);
+}
+
+void preset_sync_prepare(uint32_t flash_client_index, uint32_t preset_index, const client_t *client){
+    if (flash_client_index >= MAX_SERVER_CONNECTIONS || preset_index >= NUMBER_OF_POSSIBLE_PRESETS){
+        return;
+    }
+
+    client_preset_t preset;
+    if (preset_sync_take_stale(flash_client_index, preset_index, &preset)){
+        server_send_preset(client->uart_connection.pin_pair, client->uart_connection.uart_instance, (uint8_t)preset_index, &preset);
+    }
+}
@@ -0,0 +1,206 @@
+/**
+ * @file pwm.c
+ * @brief PWM duties of client outputs in the server model.
+ *
+ * A device with a non-zero `pwm_duty` is a PWM output on its client. The
+ * ON/OFF state is kept as for any device, so presets, scenes, schedules
+ * and timed outputs switch PWM outputs too; the duty is only a setpoint.
+ *
+ * Only differences are sent: the PWM mask when it changes, then the duties
+ * of the range of channels that changed. Channel `n` is the `n`-th PWM
+ * output of the client in GPIO order. A window of channels whose duties
+ * all have an exact 8-bit value is sent as 8 duties per frame, any other
+ * as 4 duties of 16 bits.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "hardware/pwm.h"
+
+#include "server.h"
+
+#define PWM_DUTY8_SCALE 257u        ///< 0xFF * 257 = 0xFFFF
+
+uint32_t client_state_pwm_mask(const client_state_t *client_state){
+    uint32_t pwm_mask = 0;
+    for (uint8_t device_index = 0; device_index < MAX_NUMBER_OF_GPIOS; device_index++){
+        const device_t *device = &client_state->devices[device_index];
+        if (device->gpio_number != UART_CONNECTION_FLAG_NUMBER && device->pwm_duty){
+            pwm_mask |= 1u << device->gpio_number;
+        }
+    }
+    return pwm_mask;
+}
+
+/**
+ * @brief Lists the duties of the PWM outputs of a client state by channel.
+ *
+ * @param client_state State to read.
+ * @param duties       Filled with one duty per channel.
+ * @return Number of channels.
+ */
+static uint32_t pwm_channel_duties(const client_state_t *client_state, uint16_t *duties){
+    uint32_t channel_count = 0;
+    for (uint8_t device_index = 0; device_index < MAX_NUMBER_OF_GPIOS; device_index++){
+        const device_t *device = &client_state->devices[device_index];
+        if (device->gpio_number != UART_CONNECTION_FLAG_NUMBER && device->pwm_duty){
+            duties[channel_count++] = device->pwm_duty;
+        }
+    }
+    return channel_count;
+}
+
+/**
+ * @brief Sends the duties of a range of channels with as few frames as possible.
+ *
+ * @param pin_pair      UART TX/RX pin pair to use.
+ * @param uart          UART instance.
+ * @param duties        Duties of every channel of the client.
+ * @param channel_count Number of channels.
+ * @param first_channel First channel to send.
+ * @param last_channel  Last channel to send.
+ */
+static void pwm_send_duty_range(uart_pin_pair_t pin_pair, uart_inst_t *uart, const uint16_t *duties, uint32_t channel_count, uint32_t first_channel, uint32_t last_channel){
+    uint32_t channel = first_channel;
+    while (channel <= last_channel){
+        bool fits_8_bits = true;
+        for (uint32_t index = channel; index < channel + 8 && index < channel_count; index++){
+            fits_8_bits &= duties[index] % PWM_DUTY8_SCALE == 0;
+        }
+
+        uint32_t bits = fits_8_bits ? 8 : 16;
+        uint32_t per_frame = 64 / bits;
+        uint64_t packed = 0;
+        for (uint32_t index = 0; index < per_frame && channel + index < channel_count; index++){
+            uint32_t value = fits_8_bits ? duties[channel + index] / PWM_DUTY8_SCALE : duties[channel + index];
+            packed |= (uint64_t)value << (index * bits);
+        }
+        server_send_pwm_duties(pin_pair, uart, bits, channel, (uint32_t)packed, (uint32_t)(packed >> 32));
+        channel += per_frame;
+    }
+}
+
+void server_pwm_send_state(uart_pin_pair_t pin_pair, uart_inst_t *uart, const client_state_t *previous, const client_state_t *next){
+    uint32_t pwm_mask = client_state_pwm_mask(next);
+    bool mask_changed = !previous || client_state_pwm_mask(previous) != pwm_mask;
+    if (mask_changed){
+        server_send_pwm_mode(pin_pair, uart, pwm_mask);
+    }
+
+    uint16_t duties[MAX_NUMBER_OF_GPIOS];
+    uint32_t channel_count = pwm_channel_duties(next, duties);
+    if (!channel_count){
+        return;
+    }
+    uint32_t first_channel = 0;
+    uint32_t last_channel = channel_count - 1;
+    if (!mask_changed){
+        uint16_t previous_duties[MAX_NUMBER_OF_GPIOS];
+        pwm_channel_duties(previous, previous_duties);
+        while (first_channel < channel_count && duties[first_channel] == previous_duties[first_channel]){
+            first_channel++;
+        }
+        if (first_channel == channel_count){
+            return;
+        }
+        while (duties[last_channel] == previous_duties[last_channel]){
+            last_channel--;
+        }
+    }
+    pwm_send_duty_range(pin_pair, uart, duties, channel_count, first_channel, last_channel);
+}
+
+void server_pwm_sync(uint32_t flash_client_index, server_persistent_state_t *state, const client_state_t *previous){
+    const client_t *client = &state->clients[flash_client_index];
+    if (!client_state_pwm_mask(previous) && !client_state_pwm_mask(&client->running_client_state)){
+        return;
+    }
+    send_wakeup_if_dormant(flash_client_index, state, client->uart_connection.pin_pair, client->uart_connection.uart_instance);
+    server_pwm_send_state(client->uart_connection.pin_pair, client->uart_connection.uart_instance, previous, &client->running_client_state);
+}
+
+/**
+ * @brief Checks that no two PWM outputs of a client share a PWM channel.
+ *
+ * @param pwm_mask GPIOs that are PWM outputs.
+ * @return true if every output has its own channel.
+ */
+static bool pwm_mask_is_valid(uint32_t pwm_mask){
+    uint32_t channel_mask = 0;
+    while (pwm_mask){
+        uint8_t gpio_number = (uint8_t)__builtin_ctz(pwm_mask);
+        pwm_mask &= pwm_mask - 1;
+        uint32_t channel_bit = 1u << (pwm_gpio_to_slice_num(gpio_number) * 2 + pwm_gpio_to_channel(gpio_number));
+        if (channel_mask & channel_bit){
+            return false;
+        }
+        channel_mask |= channel_bit;
+    }
+    return true;
+}
+
+/**
+ * @brief Sets PWM duties of client GPIOs. Call with the state lock held.
+ *
+ * See `server_pwm_set()`.
+ */
+static bool pwm_set_locked(uint32_t flash_client_index, uint32_t count, const uint8_t *gpio_numbers, const uint16_t *duties){
+    if (flash_client_index >= MAX_SERVER_CONNECTIONS || !count){
+        return false;
+    }
+    server_persistent_state_t state;
+    load_server_state(&state);
+    uint32_t active_client_index = get_active_client_connection_index_from_flash_client_index(flash_client_index, state);
+    if (active_client_index == INVALID_CLIENT_INDEX){
+        return false;
+    }
+
+    client_state_t *client_state = &state.clients[flash_client_index].running_client_state;
+    client_state_t previous = *client_state;
+    for (uint32_t index = 0; index < count; index++){
+        uint8_t gpio_number = gpio_numbers[index];
+        if (gpio_number >= 32 || !(GPIO_DEVICE_MASK & (1u << gpio_number))){
+            return false;
+        }
+        device_t *device = &client_state->devices[gpio_number > 22 ? (gpio_number - 3) : (gpio_number)];
+        if (device->gpio_number != gpio_number){
+            return false;
+        }
+        device->pwm_duty = duties[index];
+    }
+    if (!pwm_mask_is_valid(client_state_pwm_mask(client_state))){
+        return false;
+    }
+    if (memcmp(&previous, client_state, sizeof(previous)) == 0){
+        return true;
+    }
+
+    server_pwm_sync(flash_client_index, &state, &previous);
+    if (active_uart_server_connections[active_client_index].is_dormant){
+        send_dormant_flag_to_client((uint8_t)active_client_index);
+    }
+    save_server_state(&state);
+    return true;
+}
+
+bool server_pwm_set(uint32_t flash_client_index, uint32_t count, const uint8_t *gpio_numbers, const uint16_t *duties){
+    server_state_lock();
+    bool applied = pwm_set_locked(flash_client_index, count, gpio_numbers, duties);
+    server_state_unlock();
+    return applied;
+}
+
+void server_pwm_print_machine(void){
+    const server_persistent_state_t *flash_state = (const server_persistent_state_t *)SERVER_FLASH_ADDR;
+    for (uint32_t flash_client_index = 0; flash_client_index < MAX_SERVER_CONNECTIONS; flash_client_index++){
+        const client_state_t *client_state = &flash_state->clients[flash_client_index].running_client_state;
+        for (uint8_t device_index = 0; device_index < MAX_NUMBER_OF_GPIOS; device_index++){
+            const device_t *device = &client_state->devices[device_index];
+            if (device->gpio_number != UART_CONNECTION_FLAG_NUMBER && device->pwm_duty){
+                printf("PWM %lu %u %u %u\n", (unsigned long)flash_client_index, device->gpio_number, device->pwm_duty, device->is_on);
+            }
+        }
+    }
+}
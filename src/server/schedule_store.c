@@ -0,0 +1,111 @@
+/**
+ * @file schedule_store.c
+ * @brief Schedule table in its own flash sector.
+ *
+ * The table holds `SCHEDULE_MAX_ENTRIES` fixed-size entries of 12 bytes and
+ * lives one sector below the preset library, so neither saving the running
+ * state nor committing presets erases it. Entries keep their table index
+ * for their whole life, which lets the timer wheel refer to them by index.
+ * Reads use the table directly in flash.
+ */
+
+#include <stddef.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "hardware/flash.h"
+#include "hardware/sync.h"
+
+#include "server.h"
+#include "statistics.h"
+#include "trace.h"
+#include "flash_telemetry.h"
+#include "event_log.h"
+
+#define LOG_MODULE FLASH
+#include "log.h"
+
+#define SCHEDULE_TABLE_PROGRAM_SIZE (((sizeof(schedule_table_t) + SERVER_PAGE_SIZE - 1) / SERVER_PAGE_SIZE) * SERVER_PAGE_SIZE)
+
+_Static_assert(sizeof(schedule_table_t) <= SERVER_SECTOR_SIZE, "schedule table does not fit in one sector");
+
+static union{
+    schedule_table_t table;
+    uint8_t bytes[SCHEDULE_TABLE_PROGRAM_SIZE];
+}schedule_work;
+
+static bool schedule_table_in_flash = false;
+
+/**
+ * @brief Returns the table as mapped in XIP flash.
+ *
+ * @return Stored table, valid or not.
+ */
+static const schedule_table_t *schedule_flash_table(void){
+    return (const schedule_table_t *)(XIP_BASE + SCHEDULE_TABLE_OFFSET);
+}
+
+/**
+ * @brief Checks the magic and CRC of a stored table.
+ *
+ * @param table Table to check.
+ * @return true if the table is valid.
+ */
+static bool schedule_table_is_valid(const schedule_table_t *table){
+    return table->magic == SCHEDULE_TABLE_MAGIC &&
+        table->crc == compute_crc32(table, offsetof(schedule_table_t, crc));
+}
+
+void schedule_store_init(void){
+    schedule_table_in_flash = schedule_table_is_valid(schedule_flash_table());
+    if (!schedule_table_in_flash){
+        memset(&schedule_work.table, 0, sizeof(schedule_table_t));
+        schedule_store_commit();
+    }
+}
+
+const schedule_table_t *schedule_store_table(void){
+    if (!schedule_table_in_flash){
+        return &schedule_work.table;
+    }
+    return schedule_flash_table();
+}
+
+schedule_table_t *schedule_store_edit(void){
+    const schedule_table_t *active = schedule_store_table();
+    if (active != &schedule_work.table){
+        memcpy(&schedule_work.table, active, sizeof(schedule_table_t));
+    }
+    return &schedule_work.table;
+}
+
+void __not_in_flash_func(schedule_store_commit)(void){
+    uint32_t start_us = time_us_32();
+
+    schedule_work.table.magic = SCHEDULE_TABLE_MAGIC;
+    schedule_work.table.crc = compute_crc32(&schedule_work.table, offsetof(schedule_table_t, crc));
+    memset(&schedule_work.bytes[sizeof(schedule_table_t)], 0xFF, SCHEDULE_TABLE_PROGRAM_SIZE - sizeof(schedule_table_t));
+
+    flash_telemetry_record_erase(SCHEDULE_TABLE_OFFSET, SERVER_SECTOR_SIZE);
+    flash_telemetry_record_program(SCHEDULE_TABLE_PROGRAM_SIZE);
+
+    bool locked_out = flash_lockout_begin();
+    uint32_t ints = save_and_disable_interrupts();
+    TRACE_BEGIN(TRACE_SPAN_FLASH_ERASE, 0, SCHEDULE_TABLE_OFFSET);
+    flash_range_erase(SCHEDULE_TABLE_OFFSET, SERVER_SECTOR_SIZE);
+    TRACE_END(TRACE_SPAN_FLASH_ERASE, 0, SCHEDULE_TABLE_OFFSET);
+    TRACE_BEGIN(TRACE_SPAN_FLASH_PROGRAM, 0, SCHEDULE_TABLE_OFFSET);
+    flash_range_program(SCHEDULE_TABLE_OFFSET, schedule_work.bytes, SCHEDULE_TABLE_PROGRAM_SIZE);
+    TRACE_END(TRACE_SPAN_FLASH_PROGRAM, 0, SCHEDULE_TABLE_OFFSET);
+    restore_interrupts(ints);
+    flash_lockout_end(locked_out);
+
+    schedule_table_in_flash = schedule_table_is_valid(schedule_flash_table());
+
+    uint32_t elapsed_us = time_us_32() - start_us;
+    statistics_record_latency(STATISTICS_LATENCY_FLASH_COMMIT, elapsed_us);
+    flash_telemetry_record_commit(elapsed_us);
+    flash_telemetry_store();
+    LOG_DEBUG(FLASH_COMMIT, SCHEDULE_TABLE_OFFSET, elapsed_us);
+    event_log_write(EVENT_COMMIT, (uint16_t)(elapsed_us / 1000u), SCHEDULE_TABLE_OFFSET);
+}
@@ -0,0 +1,396 @@
+/**
+ * @file scheduler.c
+ * @brief Runs scheduled actions from a hierarchical timer wheel on core1.
+ *
+ * Schedule entries are stored in flash (see schedule_store.c). In RAM, each
+ * pending entry is a node linked into one slot of a timer wheel with
+ * `SCHEDULER_WHEEL_LEVELS` levels of 64 slots, where a level-`n` slot spans
+ * 64^n seconds. One repeating timer posts a tick per second to core1, which
+ * moves the nodes of the next coarser slot down whenever a level wraps and
+ * then runs the nodes of the current level-0 slot. A tick therefore costs
+ * the same whatever the number of pending entries, and each node is moved
+ * at most once per level before it runs.
+ *
+ * Actions go through the same paths as the CLI commands, so the running
+ * state in flash, dormant handling and preset sync stay consistent.
+ *
+ * The wheel is only touched on core1. Entries added or removed from the CLI
+ * are written to flash, and a reload message makes core1 rebuild the wheel.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "pico/time.h"
+
+#include "server.h"
+#include "menu.h"
+
+#define LOG_MODULE STATE
+#include "log.h"
+
+#define SCHEDULER_WHEEL_SLOTS       (1u << SCHEDULER_WHEEL_SLOT_BITS)
+#define SCHEDULER_WHEEL_SLOT_MASK   (SCHEDULER_WHEEL_SLOTS - 1)
+#define SCHEDULER_WHEEL_SPAN_S      (1u << (SCHEDULER_WHEEL_SLOT_BITS * SCHEDULER_WHEEL_LEVELS))
+#define SCHEDULER_NODE_NONE         0xFFFF
+
+_Static_assert(SCHEDULE_MAX_ENTRIES < SCHEDULER_NODE_NONE, "SCHEDULER_NODE_NONE must not be a valid entry index");
+_Static_assert(SCHEDULER_WHEEL_SLOT_BITS * SCHEDULER_WHEEL_LEVELS < 32, "timer wheel span must fit in 32 bits");
+
+static repeating_timer_t scheduler_timer;
+static volatile uint32_t scheduler_clock_offset_s = 0;
+
+static uint16_t wheel_slots[SCHEDULER_WHEEL_LEVELS][SCHEDULER_WHEEL_SLOTS];
+static uint16_t wheel_next[SCHEDULE_MAX_ENTRIES];
+static uint32_t wheel_expires[SCHEDULE_MAX_ENTRIES];
+static uint32_t wheel_now_s = 0;
+static bool wheel_ready = false;
+
+uint32_t scheduler_clock_now(void){
+    return scheduler_clock_offset_s + (uint32_t)(time_us_64() / 1000000u);
+}
+
+void scheduler_clock_set(uint32_t now_s){
+    scheduler_clock_offset_s = now_s - (uint32_t)(time_us_64() / 1000000u);
+    server_post_core1_message(SCHEDULER_RELOAD_WAKEUP_MESSAGE);
+}
+
+uint32_t scheduler_next_run(const schedule_entry_t *entry, uint32_t after_s){
+    if (entry->action == SCHEDULE_ACTION_NONE || entry->action >= SCHEDULE_ACTION_COUNT){
+        return 0;
+    }
+    if (entry->time_s > after_s){
+        return entry->time_s;
+    }
+    if (!entry->period_s){
+        return 0;
+    }
+    uint64_t next_s = entry->time_s + ((uint64_t)(after_s - entry->time_s) / entry->period_s + 1) * entry->period_s;
+    return next_s > UINT32_MAX ? 0 : (uint32_t)next_s;
+}
+
+/**
+ * @brief Links a node into the wheel slot matching its expiry.
+ *
+ * The level is chosen from the distance to the expiry; expiries beyond the
+ * wheel span are parked in the last slot reachable and linked again from there.
+ *
+ * @param node      Entry index.
+ * @param expires_s Time at which the entry runs (at or after `wheel_now_s`).
+ */
+static void wheel_link(uint16_t node, uint32_t expires_s){
+    wheel_expires[node] = expires_s;
+
+    uint32_t delta_s = expires_s - wheel_now_s;
+    if (delta_s >= SCHEDULER_WHEEL_SPAN_S){
+        delta_s = SCHEDULER_WHEEL_SPAN_S - 1;
+        expires_s = wheel_now_s + delta_s;
+    }
+
+    uint32_t level = 0;
+    while (delta_s >> (SCHEDULER_WHEEL_SLOT_BITS * (level + 1))){
+        level++;
+    }
+    uint32_t slot = (expires_s >> (SCHEDULER_WHEEL_SLOT_BITS * level)) & SCHEDULER_WHEEL_SLOT_MASK;
+
+    wheel_next[node] = wheel_slots[level][slot];
+    wheel_slots[level][slot] = node;
+}
+
+/**
+ * @brief Detaches all nodes of a slot.
+ *
+ * @param level Wheel level.
+ * @param slot  Slot within the level.
+ * @return First node of the detached list.
+ */
+static uint16_t wheel_take(uint32_t level, uint32_t slot){
+    uint16_t node = wheel_slots[level][slot];
+    wheel_slots[level][slot] = SCHEDULER_NODE_NONE;
+    return node;
+}
+
+/**
+ * @brief Returns the active connection of a stored client.
+ *
+ * @param flash_client_index Index of the client in the persistent state table.
+ * @return Active connection index, or INVALID_CLIENT_INDEX if the client is not connected.
+ */
+static uint32_t scheduler_active_client_index(uint32_t flash_client_index){
+    const server_persistent_state_t *flash_state = (const server_persistent_state_t *)SERVER_FLASH_ADDR;
+    return get_active_client_connection_index_from_flash_client_index(flash_client_index, *flash_state);
+}
+
+/**
+ * @brief Sets or toggles a client GPIO and updates the client's dormant state.
+ *
+ * @param entry               SCHEDULE_ACTION_SET or SCHEDULE_ACTION_TOGGLE entry.
+ * @param active_client_index Active connection of the entry's client.
+ */
+static void scheduler_set_device(const schedule_entry_t *entry, uint32_t active_client_index){
+    const server_persistent_state_t *flash_state = (const server_persistent_state_t *)SERVER_FLASH_ADDR;
+    const client_t *client = &flash_state->clients[entry->flash_client_index];
+    uint8_t gpio_number = entry->target;
+
+    bool device_state = entry->value;
+    if (entry->action == SCHEDULE_ACTION_TOGGLE){
+        device_state = !client->running_client_state.devices[gpio_number > 22 ? (gpio_number - 3) : (gpio_number)].is_on;
+    }
+
+    server_uart_connection_t *connection = &active_uart_server_connections[active_client_index];
+    server_set_device_state_and_update_flash(connection->pin_pair, connection->uart_instance, gpio_number, device_state, entry->flash_client_index);
+
+    if (device_state){
+        connection->is_dormant = false;
+    }else if (!client_has_active_devices(*client)){
+        send_dormant_flag_to_client(active_client_index);
+        connection->is_dormant = true;
+    }
+}
+
+/**
+ * @brief Runs the action of a schedule entry.
+ *
+ * Clients that are not connected are skipped. A scene switches all
+ * connected clients at the same time, see `load_scene_into_running_states()`.
+ *
+ * @param index Entry index, used for logging.
+ * @param entry Entry to run.
+ */
+static void scheduler_run_action(uint32_t index, const schedule_entry_t *entry){
+    if (entry->action == SCHEDULE_ACTION_LOAD_SCENE){
+        load_scene_into_running_states(entry->target);
+        LOG_INFO(STATE_SCHEDULE_RAN, index, entry->action);
+        return;
+    }
+
+    uint32_t active_client_index = scheduler_active_client_index(entry->flash_client_index);
+    if (active_client_index == (uint32_t)INVALID_CLIENT_INDEX){
+        LOG_WARN(STATE_SCHEDULE_CLIENT_MISSING, index, entry->flash_client_index);
+        return;
+    }
+
+    if (entry->action == SCHEDULE_ACTION_LOAD_PRESET){
+        load_configuration_into_running_state(entry->target, entry->flash_client_index);
+    }else{
+        scheduler_set_device(entry, active_client_index);
+    }
+    LOG_INFO(STATE_SCHEDULE_RAN, index, entry->action);
+}
+
+/**
+ * @brief Runs a node that reached the current tick and links its next run.
+ *
+ * The entry is checked against the table in flash first, so a node left
+ * over from an entry that was changed since the last reload does nothing.
+ *
+ * @param node Entry index.
+ */
+static void scheduler_run_node(uint16_t node){
+    schedule_entry_t entry = schedule_store_table()->entries[node];
+    if (scheduler_next_run(&entry, wheel_now_s - 1) != wheel_now_s){
+        return;
+    }
+
+    server_state_lock();
+    scheduler_run_action(node, &entry);
+    server_state_unlock();
+
+    uint32_t next_s = scheduler_next_run(&entry, wheel_now_s);
+    if (next_s){
+        wheel_link(node, next_s);
+    }
+}
+
+/**
+ * @brief Advances the wheel by one second.
+ *
+ * Cascades the coarser levels that wrap at the new time, then runs the
+ * nodes of the current level-0 slot.
+ */
+static void wheel_advance(void){
+    wheel_now_s++;
+
+    for (uint32_t level = 1; level < SCHEDULER_WHEEL_LEVELS; level++){
+        if (wheel_now_s & ((1u << (SCHEDULER_WHEEL_SLOT_BITS * level)) - 1)){
+            break;
+        }
+        uint16_t node = wheel_take(level, (wheel_now_s >> (SCHEDULER_WHEEL_SLOT_BITS * level)) & SCHEDULER_WHEEL_SLOT_MASK);
+        while (node != SCHEDULER_NODE_NONE){
+            uint16_t next = wheel_next[node];
+            wheel_link(node, wheel_expires[node]);
+            node = next;
+        }
+    }
+
+    uint16_t node = wheel_take(0, wheel_now_s & SCHEDULER_WHEEL_SLOT_MASK);
+    while (node != SCHEDULER_NODE_NONE){
+        uint16_t next = wheel_next[node];
+        if (wheel_expires[node] == wheel_now_s){
+            scheduler_run_node(node);
+        }else{
+            wheel_link(node, wheel_expires[node]);
+        }
+        node = next;
+    }
+}
+
+void scheduler_reload(void){
+    memset(wheel_slots, 0xFF, sizeof(wheel_slots));
+    wheel_now_s = scheduler_clock_now();
+
+    const schedule_table_t *table = schedule_store_table();
+    for (uint16_t index = 0; index < SCHEDULE_MAX_ENTRIES; index++){
+        uint32_t next_s = scheduler_next_run(&table->entries[index], wheel_now_s);
+        if (next_s){
+            wheel_link(index, next_s);
+        }
+    }
+    wheel_ready = true;
+}
+
+void scheduler_tick(void){
+    uint32_t now_s = scheduler_clock_now();
+    if (!wheel_ready || now_s - wheel_now_s > SCHEDULER_MAX_CATCH_UP_S){
+        scheduler_reload();
+        return;
+    }
+    while (wheel_now_s != now_s){
+        wheel_advance();
+    }
+}
+
+/**
+ * @brief Repeating timer callback: hands the tick over to core1.
+ *
+ * @param repeating_timer Unused.
+ * @return Always true to keep the timer running.
+ */
+static bool scheduler_tick_callback(repeating_timer_t *repeating_timer){
+    server_post_core1_message(SCHEDULER_TICK_WAKEUP_MESSAGE);
+    return true;
+}
+
+void scheduler_init(void){
+    server_post_core1_message(SCHEDULER_RELOAD_WAKEUP_MESSAGE);
+    add_repeating_timer_ms(-1000, scheduler_tick_callback, NULL, &scheduler_timer);
+}
+
+/**
+ * @brief Checks that an entry names an existing client, GPIO or preset.
+ *
+ * @param entry Entry to check.
+ * @return true if the entry can be stored.
+ */
+static bool scheduler_entry_is_valid(const schedule_entry_t *entry){
+    switch (entry->action){
+        case SCHEDULE_ACTION_SET:
+        case SCHEDULE_ACTION_TOGGLE:
+            return entry->flash_client_index < MAX_SERVER_CONNECTIONS &&
+                entry->target < 32 && (GPIO_DEVICE_MASK & (1u << entry->target)) &&
+                entry->value <= 1;
+        case SCHEDULE_ACTION_LOAD_PRESET:
+            return entry->flash_client_index < MAX_SERVER_CONNECTIONS &&
+                entry->target < NUMBER_OF_POSSIBLE_PRESETS;
+        case SCHEDULE_ACTION_LOAD_SCENE:
+            return entry->target < NUMBER_OF_POSSIBLE_PRESETS;
+        default:
+            return false;
+    }
+}
+
+int32_t scheduler_add(const schedule_entry_t *entry){
+    uint32_t now_s = scheduler_clock_now();
+    if (!scheduler_entry_is_valid(entry) || !scheduler_next_run(entry, now_s)){
+        return -1;
+    }
+
+    const schedule_table_t *table = schedule_store_table();
+    for (uint32_t index = 0; index < SCHEDULE_MAX_ENTRIES; index++){
+        if (!scheduler_next_run(&table->entries[index], now_s)){
+            schedule_store_edit()->entries[index] = *entry;
+            schedule_store_commit();
+            server_post_core1_message(SCHEDULER_RELOAD_WAKEUP_MESSAGE);
+            return (int32_t)index;
+        }
+    }
+    return -1;
+}
+
+bool scheduler_remove(uint32_t index){
+    if (index >= SCHEDULE_MAX_ENTRIES || !scheduler_next_run(&schedule_store_table()->entries[index], scheduler_clock_now())){
+        return false;
+    }
+    memset(&schedule_store_edit()->entries[index], 0, sizeof(schedule_entry_t));
+    schedule_store_commit();
+    server_post_core1_message(SCHEDULER_RELOAD_WAKEUP_MESSAGE);
+    return true;
+}
+
+void scheduler_print(void){
+    const server_persistent_state_t *flash_state = (const server_persistent_state_t *)SERVER_FLASH_ADDR;
+    const schedule_table_t *table = schedule_store_table();
+    uint32_t now_s = scheduler_clock_now();
+    uint32_t pending = 0;
+
+    char string[BUFFER_MAX_STRING_SIZE];
+    snprintf(string, sizeof(string), "\nServer Clock: %lu s\n", (unsigned long)now_s);
+    printf_and_update_buffer(string);
+
+    for (uint32_t index = 0; index < SCHEDULE_MAX_ENTRIES; index++){
+        const schedule_entry_t *entry = &table->entries[index];
+        uint32_t next_s = scheduler_next_run(entry, now_s);
+        if (!next_s){
+            continue;
+        }
+        pending++;
+
+        uart_pin_pair_t pin_pair = flash_state->clients[entry->flash_client_index].uart_connection.pin_pair;
+        switch (entry->action){
+            case SCHEDULE_ACTION_SET:
+                snprintf(string, sizeof(string), "%lu. Client [%u,%u]: Set GPIO %u %s.\n", (unsigned long)index + 1,
+                    pin_pair.tx, pin_pair.rx, entry->target, entry->value ? "ON" : "OFF");
+                break;
+            case SCHEDULE_ACTION_TOGGLE:
+                snprintf(string, sizeof(string), "%lu. Client [%u,%u]: Toggle GPIO %u.\n", (unsigned long)index + 1,
+                    pin_pair.tx, pin_pair.rx, entry->target);
+                break;
+            case SCHEDULE_ACTION_LOAD_PRESET:
+                snprintf(string, sizeof(string), "%lu. Client [%u,%u]: Load Preset[%u].\n", (unsigned long)index + 1,
+                    pin_pair.tx, pin_pair.rx, entry->target + 1);
+                break;
+            default:
+                snprintf(string, sizeof(string), "%lu. All Clients: Load Preset[%u].\n", (unsigned long)index + 1,
+                    entry->target + 1);
+                break;
+        }
+        printf_and_update_buffer(string);
+
+        if (entry->period_s){
+            snprintf(string, sizeof(string), "   Next in %lu s, then every %lu s.\n",
+                (unsigned long)(next_s - now_s), (unsigned long)entry->period_s);
+        }else{
+            snprintf(string, sizeof(string), "   Once, in %lu s.\n", (unsigned long)(next_s - now_s));
+        }
+        printf_and_update_buffer(string);
+    }
+
+    snprintf(string, sizeof(string), "%lu of %u Schedules used.\n", (unsigned long)pending, SCHEDULE_MAX_ENTRIES);
+    printf_and_update_buffer(string);
+}
+
+void scheduler_print_machine(void){
+    const schedule_table_t *table = schedule_store_table();
+    uint32_t now_s = scheduler_clock_now();
+
+    for (uint32_t index = 0; index < SCHEDULE_MAX_ENTRIES; index++){
+        const schedule_entry_t *entry = &table->entries[index];
+        uint32_t next_s = scheduler_next_run(entry, now_s);
+        if (next_s){
+            printf("SCHEDULE %lu %u %u %u %u %lu %lu %lu\n",
+                (unsigned long)index, entry->action, entry->flash_client_index, entry->target, entry->value,
+                (unsigned long)entry->time_s, (unsigned long)entry->period_s, (unsigned long)next_s);
+        }
+    }
+}
@@ -0,0 +1,163 @@
+/**
+ * @file sequence.c
+ * @brief Uploads output sequences to clients and controls their playback.
+ *
+ * A sequence is uploaded once with one define frame and one frame per step,
+ * and is then played by the client from its own hardware alarm, so the
+ * UART link stays idle and the client may be sent to dormant mode while it
+ * plays (it goes dormant once the sequence has finished).
+ *
+ * A sequence always ends with its GPIOs OFF, so, as for timed outputs, the
+ * final value is written to the flash state when playback starts.
+ */
+
+#include "pico/stdlib.h"
+
+#include "server.h"
+
+#define LOG_MODULE STATE
+#include "log.h"
+
+/**
+ * @brief Sequence uploaded to one client.
+ */
+typedef struct{
+    uint32_t step_count;
+    uint32_t used_mask;     ///< GPIOs set by at least one step
+}sequence_client_t;
+
+static sequence_client_t sequence_clients[MAX_SERVER_CONNECTIONS];
+
+/**
+ * @brief Finds the connection of a client and wakes it if it is dormant.
+ *
+ * @param flash_client_index  Index of the client in the persistent state table.
+ * @param state               Loaded with the persistent state.
+ * @param active_client_index Set to the active connection of the client.
+ * @return false if the client is not connected.
+ */
+static bool sequence_wake_client(uint32_t flash_client_index, server_persistent_state_t *state, uint8_t *active_client_index){
+    if (flash_client_index >= MAX_SERVER_CONNECTIONS){
+        return false;
+    }
+    load_server_state(state);
+    uint32_t connection_index = get_active_client_connection_index_from_flash_client_index(flash_client_index, *state);
+    if (connection_index == INVALID_CLIENT_INDEX){
+        return false;
+    }
+    *active_client_index = (uint8_t)connection_index;
+    server_uart_connection_t *connection = &active_uart_server_connections[connection_index];
+    send_wakeup_if_dormant(flash_client_index, state, connection->pin_pair, connection->uart_instance);
+    return true;
+}
+
+/**
+ * @brief Sends a client woken by `sequence_wake_client()` back to dormant mode.
+ *
+ * @param active_client_index Active connection of the client.
+ */
+static void sequence_restore_dormant(uint8_t active_client_index){
+    if (active_uart_server_connections[active_client_index].is_dormant){
+        send_dormant_flag_to_client(active_client_index);
+    }
+}
+
+bool server_sequence_define(uint32_t flash_client_index, uint32_t step_count, uint32_t loop_count){
+    if (step_count == 0 || step_count > SEQUENCE_MAX_STEPS){
+        return false;
+    }
+    server_persistent_state_t state;
+    uint8_t active_client_index;
+    if (!sequence_wake_client(flash_client_index, &state, &active_client_index)){
+        return false;
+    }
+    server_uart_connection_t *connection = &active_uart_server_connections[active_client_index];
+    server_send_sequence_define(connection->pin_pair, connection->uart_instance, step_count, loop_count);
+    sequence_restore_dormant(active_client_index);
+
+    sequence_clients[flash_client_index].step_count = step_count;
+    sequence_clients[flash_client_index].used_mask = 0;
+    return true;
+}
+
+bool server_sequence_set_step(uint32_t flash_client_index, uint32_t step, uint32_t gpio_mask, uint32_t duration_us){
+    if (flash_client_index >= MAX_SERVER_CONNECTIONS || step >= sequence_clients[flash_client_index].step_count){
+        return false;
+    }
+    server_persistent_state_t state;
+    uint8_t active_client_index;
+    if (!sequence_wake_client(flash_client_index, &state, &active_client_index)){
+        return false;
+    }
+    gpio_mask &= GPIO_DEVICE_MASK;
+    server_uart_connection_t *connection = &active_uart_server_connections[active_client_index];
+    server_send_sequence_step(connection->pin_pair, connection->uart_instance, step, gpio_mask, duration_us);
+    sequence_restore_dormant(active_client_index);
+
+    sequence_clients[flash_client_index].used_mask |= gpio_mask;
+    return true;
+}
+
+/**
+ * @brief Starts, stops or seeks the sequence of a client. Call with the state lock held.
+ *
+ * See `server_sequence_control()`.
+ */
+static bool sequence_control_locked(uint32_t flash_client_index, sequence_control_t control, uint32_t step){
+    if (flash_client_index >= MAX_SERVER_CONNECTIONS){
+        return false;
+    }
+    const sequence_client_t *sequence = &sequence_clients[flash_client_index];
+    if (control != SEQUENCE_CONTROL_STOP && step >= sequence->step_count){
+        return false;
+    }
+    server_persistent_state_t state;
+    uint8_t active_client_index;
+    if (!sequence_wake_client(flash_client_index, &state, &active_client_index)){
+        return false;
+    }
+    server_uart_connection_t *connection = &active_uart_server_connections[active_client_index];
+    server_send_sequence_control(connection->pin_pair, connection->uart_instance, control, step);
+
+    if (control == SEQUENCE_CONTROL_START){
+        bool changed = false;
+        client_state_t *client_state = &state.clients[flash_client_index].running_client_state;
+        for (uint8_t device_index = 0; device_index < MAX_NUMBER_OF_GPIOS; device_index++){
+            device_t *device = &client_state->devices[device_index];
+            if (device->gpio_number != UART_CONNECTION_FLAG_NUMBER && (sequence->used_mask & (1u << device->gpio_number)) && device->is_on){
+                device->is_on = false;
+                changed = true;
+            }
+        }
+        if (changed){
+            save_server_state(&state);
+        }
+        server_timed_output_forget(flash_client_index, sequence->used_mask);
+        LOG_INFO(STATE_SEQUENCE_STARTED, flash_client_index, sequence->step_count);
+    }
+
+    if (!client_has_active_devices(state.clients[flash_client_index])){
+        send_dormant_flag_to_client(active_client_index);
+        connection->is_dormant = true;
+    }
+    return true;
+}
+
+bool server_sequence_control(uint32_t flash_client_index, sequence_control_t control, uint32_t step){
+    server_state_lock();
+    bool sent = sequence_control_locked(flash_client_index, control, step);
+    server_state_unlock();
+    return sent;
+}
+
+bool server_sequence_status(uint32_t flash_client_index, bool *playing, uint32_t *step, uint32_t *loops_done){
+    server_persistent_state_t state;
+    uint8_t active_client_index;
+    if (!sequence_wake_client(flash_client_index, &state, &active_client_index)){
+        return false;
+    }
+    server_uart_connection_t *connection = &active_uart_server_connections[active_client_index];
+    bool reported = server_poll_sequence_report(connection->pin_pair, connection->uart_instance, playing, step, loops_done);
+    sequence_restore_dormant(active_client_index);
+    return reported;
+}
@@ -8,6 +8,10 @@
  * - Sends an echo of the client's TX/RX pin pair.
  * - Validates the acknowledgment from the client.
  * - Stores successful connections in a global array.
+ *
+ * A client that restarts while the server runs goes back to requesting a
+ * connection. `server_reconnect_client()` listens for it on the pin pair
+ * the client had, so it can be accepted again without a server reboot.
  */
 
 #include <stdio.h>
@@ -18,6 +22,11 @@
 #include "server.h"
 #include "functions.h"
 #include "config.h"
+#include "statistics.h"
+#include "event_log.h"
+
+#define LOG_MODULE HANDSHAKE
+#include "log.h"
 
 server_uart_connection_t active_uart_server_connections[MAX_SERVER_CONNECTIONS];
 uint8_t active_server_connections_number = 0;
@@ -75,11 +84,23 @@ static bool server_uart_read(uart_inst_t* uart_instance, uint32_t timeout_ms){
  *
  * @param pin_pair The TX/RX pin pair to test.
  * @param uart_instance Pointer to the UART peripheral (e.g., uart0 or uart1).
+ * @param timeout_ms Time to wait for the request.
  * @return true if a connection request is successfully detected, false otherwise.
  */
-static bool server_check_pin_pair(uart_pin_pair_t pin_pair, uart_inst_t * uart_instance){
+static bool server_check_pin_pair(uart_pin_pair_t pin_pair, uart_inst_t * uart_instance, uint32_t timeout_ms){
+    uint32_t start_us = time_us_32();
     uart_init_with_pins(uart_instance, pin_pair, DEFAULT_BAUDRATE);
-    return server_uart_read(uart_instance, SERVER_TIMEOUT_MS);
+    bool connected = server_uart_read(uart_instance, timeout_ms);
+
+    uint32_t elapsed_us = time_us_32() - start_us;
+    statistics_record_handshake(pin_pair, connected, elapsed_us);
+    if (connected){
+        LOG_INFO(HANDSHAKE_ACCEPTED, pin_pair.tx, pin_pair.rx);
+        event_log_write(EVENT_CLIENT_ATTACHED, (uint16_t)(pin_pair.tx | pin_pair.rx << 8), elapsed_us);
+    }else{
+        LOG_TRACE(HANDSHAKE_NO_CLIENT, pin_pair.tx, pin_pair.rx);
+    }
+    return connected;
 }
 
 /**
@@ -97,6 +118,8 @@ static inline void server_add_active_pair(uart_pin_pair_t pin_pair, uart_inst_t
         active_uart_server_connections[active_server_connections_number].uart_pin_pair_from_client_to_server.tx = actual_client_to_server_pin_pair.tx;
         active_uart_server_connections[active_server_connections_number].uart_pin_pair_from_client_to_server.rx = actual_client_to_server_pin_pair.rx;
         active_server_connections_number++;
+    }else{
+        LOG_WARN(HANDSHAKE_TABLE_FULL, pin_pair.tx, pin_pair.rx);
     }
 }
 
@@ -108,7 +131,7 @@ static inline void server_add_active_pair(uart_pin_pair_t pin_pair, uart_inst_t
  */
 static void server_check_connections_for_uart0_instance(void){
     for (uint8_t index = 0; index < PIN_PAIRS_UART0_LEN; index++){
-        if(server_check_pin_pair(pin_pairs_uart0[index], uart0)){
+        if(server_check_pin_pair(pin_pairs_uart0[index], uart0, SERVER_TIMEOUT_MS)){
             server_add_active_pair(pin_pairs_uart0[index], uart0);
         }
         reset_gpio_pins(pin_pairs_uart0[index]);
@@ -123,7 +146,7 @@ static void server_check_connections_for_uart0_instance(void){
  */
 static void server_check_connections_for_uart1_instance(void){
     for (uint8_t index = 0; index < PIN_PAIRS_UART1_LEN; index++){
-        if(server_check_pin_pair(pin_pairs_uart1[index], uart1)){
+        if(server_check_pin_pair(pin_pairs_uart1[index], uart1, SERVER_TIMEOUT_MS)){
             server_add_active_pair(pin_pairs_uart1[index], uart1);
         }
         reset_gpio_pins(pin_pairs_uart1[index]);
@@ -143,3 +166,15 @@ bool server_find_connections(void){
 
     return false;
 }
+
+bool server_reconnect_client(uint8_t connection_index){
+    if (connection_index >= active_server_connections_number){
+        return false;
+    }
+    server_uart_connection_t *connection = &active_uart_server_connections[connection_index];
+    uint32_t irq = uart_lock_acquire();
+    bool connected = server_check_pin_pair(connection->pin_pair, connection->uart_instance, SERVER_RECONNECT_LISTEN_MS);
+    reset_gpio_pins(connection->pin_pair);
+    uart_lock_release(irq);
+    return connected;
+}
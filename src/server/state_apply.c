@@ -9,7 +9,8 @@
  * - Apply user input to modify preset configurations
  *
  * Used by the server to manage persistent client data and push changes
- * over UART with synchronization and power state awareness.
+ * over UART with synchronization and power state awareness. Every change
+ * runs under the state lock, as both cores call into this module.
  *
  * @see server_persistent_state_t
  * @see client_state_t
@@ -20,6 +21,10 @@
 
 #include "server.h"
 #include "input.h"
+#include "statistics.h"
+
+#define LOG_MODULE STATE
+#include "log.h"
 
 /**
  * @brief Sends the current state of a GPIO to a client device via UART.
@@ -50,24 +55,38 @@ static void server_send_device_state(uart_pin_pair_t pin_pair, uart_inst_t* uart
 }
 
 void server_set_device_state_and_update_flash(uart_pin_pair_t pin_pair, uart_inst_t* uart_instance, uint8_t gpio_index, bool device_state, uint32_t flash_client_index){
+    uint32_t start_us = time_us_32();
     server_persistent_state_t state_copy;
+    server_state_lock();
     memcpy(&state_copy, (const server_persistent_state_t *)SERVER_FLASH_ADDR, sizeof(state_copy));
 
     server_send_device_state(pin_pair, uart_instance, gpio_index, device_state, &state_copy, flash_client_index);
+    server_timed_output_forget(flash_client_index, 1u << gpio_index);
     state_copy.clients[flash_client_index].running_client_state.devices[gpio_index > 22 ? (gpio_index - 3) : (gpio_index)].is_on = device_state;
     save_server_state(&state_copy);
+    server_state_unlock();
+    statistics_record_latency(STATISTICS_LATENCY_COMMAND, time_us_32() - start_us);
 }
 
 void save_running_configuration_into_preset_configuration(uint32_t flash_configuration_index, uint32_t flash_client_index){
+    uint32_t start_us = time_us_32();
     server_persistent_state_t state;
+    server_state_lock();
     load_server_state(&state);
 
-    memcpy(
-        &state.clients[flash_client_index].preset_configs[flash_configuration_index],
-        &state.clients[flash_client_index].running_client_state,
-        sizeof(client_state_t));
-    
-    save_server_state(&state);
+    if (!preset_store_matches_state(preset_store_library(), flash_client_index, flash_configuration_index, &state.clients[flash_client_index].running_client_state)){
+        preset_library_t *library = preset_store_edit();
+        if (!preset_store_set_state(library, flash_client_index, flash_configuration_index, &state.clients[flash_client_index].running_client_state)){
+            server_state_unlock();
+            printf_and_update_buffer("\nPreset Pool Full.\n");
+            return;
+        }
+        preset_sync_mark_modified(flash_client_index, flash_configuration_index);
+        preset_store_commit();
+    }
+    server_state_unlock();
+    statistics_record_latency(STATISTICS_LATENCY_COMMAND, time_us_32() - start_us);
+    LOG_INFO(STATE_PRESET_SAVED, flash_configuration_index + 1, flash_client_index);
 
     char string[BUFFER_MAX_STRING_SIZE];
     snprintf(string, sizeof(string), "\nConfiguration saved in Preset[%u].\n", flash_configuration_index + 1);
@@ -75,17 +94,17 @@ void save_running_configuration_into_preset_configuration(uint32_t flash_configu
 }
 
 void load_configuration_into_running_state(uint32_t flash_configuration_index, uint32_t flash_client_index){
+    uint32_t start_us = time_us_32();
     server_persistent_state_t state;
+    server_state_lock();
     load_server_state(&state);
 
-    memcpy(
-        &state.clients[flash_client_index].running_client_state,
-        &state.clients[flash_client_index].preset_configs[flash_configuration_index],
-        sizeof(client_state_t));
+    client_state_t previous = state.clients[flash_client_index].running_client_state;
+    preset_store_apply_to_state(preset_store_library(), flash_client_index, flash_configuration_index, &state.clients[flash_client_index].running_client_state);
 
-    server_send_client_state(state.clients[flash_client_index].uart_connection.pin_pair,
-                            state.clients[flash_client_index].uart_connection.uart_instance,
-                            &state.clients[flash_client_index].running_client_state);
+    server_pwm_sync(flash_client_index, &state, &previous);
+    preset_sync_recall(flash_client_index, flash_configuration_index, &state.clients[flash_client_index]);
+    server_timed_output_forget(flash_client_index, GPIO_DEVICE_MASK);
     save_server_state(&state);
 
     
@@ -96,10 +115,128 @@ void load_configuration_into_running_state(uint32_t flash_configuration_index, u
     }else{
         active_uart_server_connections[active_client_index].is_dormant = false;
     }
+    server_state_unlock();
+    statistics_record_latency(STATISTICS_LATENCY_COMMAND, time_us_32() - start_us);
+    LOG_INFO(STATE_PRESET_LOADED, flash_configuration_index + 1, flash_client_index);
+}
 
-    char string[BUFFER_MAX_STRING_SIZE];
-    snprintf(string, sizeof(string), "\nConfiguration Preset[%u] Loaded!\n", flash_configuration_index + 1);
-    printf_and_update_buffer(string);
+#if LATCH_LINE_ENABLED
+/**
+ * @brief Switches the clients of a scene together with the latch line.
+ *
+ * The clients must be awake. Clients that do not report the commit as
+ * applied recall the preset directly.
+ *
+ * @param state                     Persistent state holding the new running states.
+ * @param flash_configuration_index Preset to load.
+ * @param flash_clients             Flash indexes of the scene's clients.
+ * @param client_count              Number of clients in the scene.
+ */
+static void scene_commit_with_latch(const server_persistent_state_t *state, uint32_t flash_configuration_index, const uint8_t *flash_clients, uint8_t client_count){
+    uint32_t sequence = server_latch_next_sequence();
+    for (uint8_t scene_index = 0; scene_index < client_count; scene_index++){
+        const client_t *client = &state->clients[flash_clients[scene_index]];
+        server_send_latch_stage(client->uart_connection.pin_pair, client->uart_connection.uart_instance,
+            client_state_gpio_mask(&client->running_client_state), sequence);
+    }
+    server_latch_pulse();
+
+    for (uint8_t scene_index = 0; scene_index < client_count; scene_index++){
+        const client_t *client = &state->clients[flash_clients[scene_index]];
+        uint32_t applied_sequence = 0;
+        uint32_t missed_edges = 0;
+        bool reported = server_poll_latch_report(client->uart_connection.pin_pair, client->uart_connection.uart_instance, &applied_sequence, &missed_edges);
+        if (!reported || applied_sequence != sequence){
+            LOG_WARN(STATE_LATCH_MISSED, flash_clients[scene_index], sequence);
+            preset_sync_recall(flash_clients[scene_index], flash_configuration_index, client);
+        }
+    }
+}
+#else
+/**
+ * @brief Switches the clients of a scene together with "apply at" frames.
+ *
+ * The clients must be awake. Clients without a clock sync recall the
+ * preset on receipt.
+ *
+ * @param state                     Persistent state holding the new running states.
+ * @param flash_configuration_index Preset to load.
+ * @param flash_clients             Flash indexes of the scene's clients.
+ * @param active_clients            Active connection indexes of the scene's clients.
+ * @param client_count              Number of clients in the scene.
+ */
+static void scene_commit_at_common_time(const server_persistent_state_t *state, uint32_t flash_configuration_index, const uint8_t *flash_clients, const uint8_t *active_clients, uint8_t client_count){
+    bool synced[MAX_SERVER_CONNECTIONS];
+    for (uint8_t scene_index = 0; scene_index < client_count; scene_index++){
+        synced[scene_index] = time_sync_ensure(active_clients[scene_index]);
+        preset_sync_prepare(flash_clients[scene_index], flash_configuration_index, &state->clients[flash_clients[scene_index]]);
+    }
+
+    uint64_t apply_at_us = time_us_64() + client_count * APPLY_AT_FRAME_BUDGET_US + APPLY_AT_MARGIN_US;
+    for (uint8_t scene_index = 0; scene_index < client_count; scene_index++){
+        const client_t *client = &state->clients[flash_clients[scene_index]];
+        uint64_t client_time_us;
+        if (synced[scene_index] && time_sync_client_time(active_clients[scene_index], apply_at_us, &client_time_us)){
+            server_send_apply_at(client->uart_connection.pin_pair, client->uart_connection.uart_instance,
+                client_time_us, PRESET_RECALL_FLAG_NUMBER, flash_configuration_index);
+        }else{
+            server_send_preset_recall(client->uart_connection.pin_pair, client->uart_connection.uart_instance,
+                (uint8_t)flash_configuration_index, NULL);
+        }
+    }
+}
+#endif
+
+void load_scene_into_running_states(uint32_t flash_configuration_index){
+    uint32_t start_us = time_us_32();
+    server_persistent_state_t state;
+    server_state_lock();
+    load_server_state(&state);
+    const preset_library_t *library = preset_store_library();
+
+    uint8_t scene_flash_clients[MAX_SERVER_CONNECTIONS];
+    uint8_t scene_active_clients[MAX_SERVER_CONNECTIONS];
+    uint8_t scene_client_count = 0;
+
+    for (uint32_t flash_client_index = 0; flash_client_index < MAX_SERVER_CONNECTIONS; flash_client_index++){
+        uint32_t active_client_index = get_active_client_connection_index_from_flash_client_index(flash_client_index, state);
+        if (active_client_index == (uint32_t)INVALID_CLIENT_INDEX){
+            continue;
+        }
+        client_t *client = &state.clients[flash_client_index];
+        client_state_t previous = client->running_client_state;
+        preset_store_apply_to_state(library, flash_client_index, flash_configuration_index, &client->running_client_state);
+        send_wakeup_if_dormant(flash_client_index, &state, client->uart_connection.pin_pair, client->uart_connection.uart_instance);
+        server_pwm_sync(flash_client_index, &state, &previous);
+
+        scene_flash_clients[scene_client_count] = (uint8_t)flash_client_index;
+        scene_active_clients[scene_client_count] = (uint8_t)active_client_index;
+        scene_client_count++;
+    }
+
+    #if LATCH_LINE_ENABLED
+        scene_commit_with_latch(&state, flash_configuration_index, scene_flash_clients, scene_client_count);
+    #else
+        scene_commit_at_common_time(&state, flash_configuration_index, scene_flash_clients, scene_active_clients, scene_client_count);
+    #endif
+
+    for (uint8_t scene_index = 0; scene_index < scene_client_count; scene_index++){
+        server_timed_output_forget(scene_flash_clients[scene_index], GPIO_DEVICE_MASK);
+    }
+    save_server_state(&state);
+
+    for (uint8_t scene_index = 0; scene_index < scene_client_count; scene_index++){
+        uint8_t active_client_index = scene_active_clients[scene_index];
+        if (!client_has_active_devices(state.clients[scene_flash_clients[scene_index]])){
+            send_dormant_flag_to_client(active_client_index);
+            active_uart_server_connections[active_client_index].is_dormant = true;
+        }else{
+            active_uart_server_connections[active_client_index].is_dormant = false;
+        }
+    }
+    server_state_unlock();
+    statistics_record_latency(STATISTICS_LATENCY_COMMAND, time_us_32() - start_us);
+    LOG_INFO(STATE_SCENE_LOADED, flash_configuration_index + 1, scene_client_count);
 }
 
 void set_configuration_devices(uint32_t flash_client_index, uint32_t flash_configuration_index, input_client_data_t *input_client_data){
@@ -107,11 +244,14 @@ void set_configuration_devices(uint32_t flash_client_index, uint32_t flash_confi
     load_server_state(&state);
 
     while(true){
+        client_state_t preset_state = state.clients[flash_client_index].running_client_state;
+        preset_store_apply_to_state(preset_store_library(), flash_client_index, flash_configuration_index, &preset_state);
+
         uint32_t device_index;
         read_device_index(&device_index,
             flash_client_index,
             &state,
-            &state.clients[flash_client_index].preset_configs[flash_configuration_index]
+            &preset_state
         );
         if (!device_index){
             return;
@@ -124,35 +264,53 @@ void set_configuration_devices(uint32_t flash_client_index, uint32_t flash_confi
         }
         device_state %= 2;
 
-        state.clients[flash_client_index].preset_configs[flash_configuration_index].devices[device_index - 1].is_on = device_state;
+        server_state_lock();
+        preset_state.devices[device_index - 1].is_on = device_state;
+        if (!preset_store_set_state(preset_store_edit(), flash_client_index, flash_configuration_index, &preset_state)){
+            server_state_unlock();
+            printf_and_update_buffer("\nPreset Pool Full.\n");
+            return;
+        }
+        preset_sync_mark_modified(flash_client_index, flash_configuration_index);
 
-        save_server_state(&state);
+        preset_store_commit();
+        server_state_unlock();
     }
 }
 
 void reset_all_client_data(uint32_t flash_client_index){
+    uint32_t start_us = time_us_32();
     server_persistent_state_t state;
+    server_state_lock();
     load_server_state(&state);
     server_reset_configuration(&state.clients[flash_client_index].running_client_state);
 
     server_send_client_state(state.clients[flash_client_index].uart_connection.pin_pair,
                             state.clients[flash_client_index].uart_connection.uart_instance,
                             &state.clients[flash_client_index].running_client_state);
+    server_timed_output_forget(flash_client_index, GPIO_DEVICE_MASK);
 
     uint8_t active_client_index = get_active_client_connection_index_from_flash_client_index(flash_client_index, state);
     send_dormant_flag_to_client(active_client_index);
     active_uart_server_connections[active_client_index].is_dormant = true;
 
+    save_server_state(&state);
+
+    preset_library_t *library = preset_store_edit();
     for (uint8_t configuration_index = 0; configuration_index < NUMBER_OF_POSSIBLE_PRESETS; configuration_index++){
-        server_reset_configuration(&state.clients[flash_client_index].preset_configs[configuration_index]);
+        preset_store_clear(library, flash_client_index, configuration_index);
     }
-
-    save_server_state(&state);
+    preset_sync_mark_all_modified(flash_client_index);
+    preset_store_commit();
+    server_state_unlock();
+    statistics_record_latency(STATISTICS_LATENCY_COMMAND, time_us_32() - start_us);
     printf_and_update_buffer("\nAll Client Data Reset.\n");
 }
 
 void reset_running_configuration(uint32_t flash_client_index){
+    uint32_t start_us = time_us_32();
     server_persistent_state_t state;
+    server_state_lock();
     load_server_state(&state);
 
     server_reset_configuration(&state.clients[flash_client_index].running_client_state);
@@ -160,22 +318,28 @@ void reset_running_configuration(uint32_t flash_client_index){
     server_send_client_state(state.clients[flash_client_index].uart_connection.pin_pair,
                             state.clients[flash_client_index].uart_connection.uart_instance,
                             &state.clients[flash_client_index].running_client_state);
+    server_timed_output_forget(flash_client_index, GPIO_DEVICE_MASK);
 
     uint8_t active_client_index = get_active_client_connection_index_from_flash_client_index(flash_client_index, state);
     send_dormant_flag_to_client(active_client_index);
     active_uart_server_connections[active_client_index].is_dormant = true;
     
     save_server_state(&state);
+    server_state_unlock();
+    statistics_record_latency(STATISTICS_LATENCY_COMMAND, time_us_32() - start_us);
 
     printf_and_update_buffer("\nRunning Configuration Reset.\n");
 }
 
 void reset_preset_configuration(uint32_t flash_client_index, uint32_t flash_configuration_index){
-    server_persistent_state_t state;
-    load_server_state(&state);
-    server_reset_configuration(&state.clients[flash_client_index].preset_configs[flash_configuration_index - 1]);
+    uint32_t start_us = time_us_32();
+    server_state_lock();
+    preset_store_clear(preset_store_edit(), flash_client_index, flash_configuration_index - 1);
+    preset_sync_mark_modified(flash_client_index, flash_configuration_index - 1);
 
-    save_server_state(&state);
+    preset_store_commit();
+    server_state_unlock();
+    statistics_record_latency(STATISTICS_LATENCY_COMMAND, time_us_32() - start_us);
 
     char string[BUFFER_MAX_STRING_SIZE];
     snprintf(string, sizeof(string), "\nPreset Configuration [%u] Reset.\n", flash_configuration_index);
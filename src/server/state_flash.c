@@ -6,6 +6,9 @@
  * - CRC32 checksum computation for data integrity
  * - Functions to load and save the server's persistent state to internal flash
  * - Interrupt-safe flash programming using temporary buffers
+ * - Multicore lockout, so that either core can write flash while the other runs
+ * - The state lock, which serializes every load-modify-save of the state
+ *   between the two cores
  *
  * All operations ensure the data structure integrity is verified before being accepted
  * (via CRC32) and written atomically to avoid corruption.
@@ -17,19 +20,38 @@
 #include <string.h> 
 
 #include "pico/stdlib.h"
+#include "pico/multicore.h"
+#include "pico/mutex.h"
 #include "hardware/flash.h"
 #include "hardware/sync.h"
 
 #include "server.h"
+#include "statistics.h"
+#include "trace.h"
+#include "flash_telemetry.h"
+#include "event_log.h"
+#include "profiler.h"
 
-/**
- * @brief Computes CRC32 checksum over a block of memory.
- *
- * @param data Pointer to the data block.
- * @param length Number of bytes to process.
- * @return uint32_t CRC32 checksum.
- */
-static uint32_t compute_crc32(const void *data, uint32_t length) {
+#define LOG_MODULE FLASH
+#include "log.h"
+
+static recursive_mutex_t server_state_mutex;
+
+void server_state_lock_init(void){
+    recursive_mutex_init(&server_state_mutex);
+}
+
+void server_state_lock(void){
+    recursive_mutex_enter_blocking(&server_state_mutex);
+}
+
+void server_state_unlock(void){
+    recursive_mutex_exit(&server_state_mutex);
+}
+
+uint32_t compute_crc32(const void *data, uint32_t length) {
+    PROFILE_ENTER(PROFILE_COMPUTE_CRC32);
+    TRACE_BEGIN(TRACE_SPAN_CRC, 0, length);
     const uint8_t *bytes = (const uint8_t *)data;
     uint32_t crc = 0xFFFFFFFF;
 
@@ -43,6 +65,8 @@ static uint32_t compute_crc32(const void *data, uint32_t length) {
         }
     }
 
+    TRACE_END(TRACE_SPAN_CRC, 0, length);
+    PROFILE_EXIT(PROFILE_COMPUTE_CRC32);
     return ~crc;
 }
 
@@ -58,7 +82,24 @@ bool load_server_state(server_persistent_state_t *out_state) {
     return (saved_crc == computed_crc);
 }
 
+bool flash_lockout_begin(void){
+    server_clock_governor_boost();
+    if (!multicore_lockout_victim_is_initialized(get_core_num() ^ 1)){
+        return false;
+    }
+    multicore_lockout_start_blocking();
+    return true;
+}
+
+void flash_lockout_end(bool locked_out){
+    if (locked_out){
+        multicore_lockout_end_blocking();
+    }
+}
+
 void __not_in_flash_func(save_server_state)(const server_persistent_state_t *state_in) {
+    PROFILE_ENTER(PROFILE_SAVE_SERVER_STATE);
+    uint32_t start_us = time_us_32();
     server_persistent_state_t temp;
     memcpy(&temp, state_in, sizeof(temp));
 
@@ -68,8 +109,25 @@ void __not_in_flash_func(save_server_state)(const server_persistent_state_t *sta
     uint8_t buffer[SERVER_SECTOR_SIZE] = {0};
     memcpy(buffer, &temp, sizeof(temp));
 
+    flash_telemetry_record_erase(SERVER_FLASH_OFFSET, SERVER_SECTOR_SIZE);
+    flash_telemetry_record_program(SERVER_SECTOR_SIZE);
+
+    bool locked_out = flash_lockout_begin();
     uint32_t ints = save_and_disable_interrupts();
+    TRACE_BEGIN(TRACE_SPAN_FLASH_ERASE, 0, SERVER_FLASH_OFFSET);
     flash_range_erase(SERVER_FLASH_OFFSET, SERVER_SECTOR_SIZE);
+    TRACE_END(TRACE_SPAN_FLASH_ERASE, 0, SERVER_FLASH_OFFSET);
+    TRACE_BEGIN(TRACE_SPAN_FLASH_PROGRAM, 0, SERVER_FLASH_OFFSET);
     flash_range_program(SERVER_FLASH_OFFSET, buffer, SERVER_SECTOR_SIZE);
+    TRACE_END(TRACE_SPAN_FLASH_PROGRAM, 0, SERVER_FLASH_OFFSET);
     restore_interrupts(ints);
+    flash_lockout_end(locked_out);
+
+    uint32_t elapsed_us = time_us_32() - start_us;
+    statistics_record_latency(STATISTICS_LATENCY_FLASH_COMMIT, elapsed_us);
+    flash_telemetry_record_commit(elapsed_us);
+    flash_telemetry_store();
+    LOG_DEBUG(FLASH_COMMIT, SERVER_FLASH_OFFSET, elapsed_us);
+    event_log_write(EVENT_COMMIT, (uint16_t)(elapsed_us / 1000u), SERVER_FLASH_OFFSET);
+    PROFILE_EXIT(PROFILE_SAVE_SERVER_STATE);
 }
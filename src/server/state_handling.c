@@ -19,6 +19,9 @@
 
 #include "server.h"
 
+#define LOG_MODULE STATE
+#include "log.h"
+
 uint32_t get_active_client_connection_index_from_flash_client_index(uint32_t flash_client_index, server_persistent_state_t state){
     for (uint8_t active_client_index = 0; active_client_index < active_server_connections_number; active_client_index++){
         if (active_uart_server_connections[active_client_index].pin_pair.tx == state.clients[flash_client_index].uart_connection.pin_pair.tx){
@@ -60,11 +63,16 @@ static void set_dormant_flag_to_standby_clients(server_persistent_state_t *serve
  * @brief Loads the running state for an active client and sends it over UART.
  *
  * - Sends the device states to the client
+ * - Replicates the client's presets so they can be recalled with one frame
+ * - Sends its saved input configuration, then its local rules
+ *
+ * The client starts from empty RAM, so every preset is sent again.
  *
- * @param server_uart_connection Connection info (pin pair + instance).
+ * @param connection_index Index of the client in the active server connections.
  * @param server_persistent_state Pointer to loaded flash state.
  */
-static void server_load_client_state(server_uart_connection_t server_uart_connection, server_persistent_state_t *server_persistent_state) {
+static void server_load_client_state(uint8_t connection_index, server_persistent_state_t *server_persistent_state) {
+    server_uart_connection_t server_uart_connection = active_uart_server_connections[connection_index];
     for (uint8_t flash_client_index = 0; flash_client_index < MAX_SERVER_CONNECTIONS; flash_client_index++) {
         client_t *saved_client = &server_persistent_state->clients[flash_client_index];
         
@@ -73,6 +81,10 @@ static void server_load_client_state(server_uart_connection_t server_uart_connec
             saved_client->uart_connection.uart_instance == server_uart_connection.uart_instance) {
                 
             server_send_client_state(server_uart_connection.pin_pair, server_uart_connection.uart_instance, &saved_client->running_client_state);
+            preset_sync_forget_client(flash_client_index);
+            preset_sync_client(flash_client_index, saved_client);
+            server_input_restore(flash_client_index, connection_index, &saved_client->inputs);
+            server_client_rules_restore(flash_client_index, connection_index);
             return;
         }
     }
@@ -84,12 +96,37 @@ void server_load_running_states_to_active_clients(void){
 
     if (valid_crc) {
         for (uint8_t index = 0; index < active_server_connections_number; index++) {
-            server_load_client_state(active_uart_server_connections[index], &server_persistent_state);
+            server_load_client_state(index, &server_persistent_state);
         }
     } else {
         server_configure_persistent_state(&server_persistent_state);
+        LOG_WARN(STATE_CRC_INVALID, active_server_connections_number, sizeof(server_persistent_state));
     }
 
     set_dormant_flag_to_standby_clients(&server_persistent_state);
     send_dormant_to_standby_clients();
 }
+
+void server_restore_client(uint8_t connection_index){
+    server_persistent_state_t server_persistent_state;
+    server_state_lock();
+    if (connection_index >= active_server_connections_number || !load_server_state(&server_persistent_state)){
+        server_state_unlock();
+        return;
+    }
+    server_uart_connection_t *connection = &active_uart_server_connections[connection_index];
+
+    time_sync_invalidate(connection_index);
+    set_rx_pin_as_input_for_client(connection->pin_pair, true);
+    server_load_client_state(connection_index, &server_persistent_state);
+    for (uint8_t flash_client_index = 0; flash_client_index < MAX_SERVER_CONNECTIONS; flash_client_index++){
+        if (get_active_client_connection_index_from_flash_client_index(flash_client_index, server_persistent_state) == connection_index){
+            connection->is_dormant = !client_has_active_devices(server_persistent_state.clients[flash_client_index]);
+            break;
+        }
+    }
+    if (connection->is_dormant){
+        send_dormant_flag_to_client(connection_index);
+    }
+    server_state_unlock();
+}
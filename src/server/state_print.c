@@ -4,8 +4,9 @@
  *
  * This file provides:
  * - Functions to print the current (running) GPIO state of a client
- * - Functions to print each preset configuration associated with a client
+ * - Functions to print each stored (non-empty) preset configuration of a client
  * - UART-protected GPIOs are identified and marked as restricted
+ * - PWM outputs show their duty in percent
  *
  * The output is formatted and routed through `printf_and_update_buffer()`,
  * making it suitable for CLI menus or serial interfaces.
@@ -32,6 +33,14 @@ static void server_print_gpio_state(uint8_t gpio_index, const client_state_t *cl
         char string[BUFFER_MAX_STRING_SIZE];
         snprintf(string, sizeof(string), "%2u. UART connection, no access.\n", gpio_index + 1);
         printf_and_update_buffer(string);
+    }else if (client_state->devices[gpio_index].pwm_duty){
+        char string[BUFFER_MAX_STRING_SIZE];
+        snprintf(string, sizeof(string), "%2u. GPIO_NO: %2u  Power: %s  PWM: %3lu%%\n",
+            gpio_index + 1,
+            client_state->devices[gpio_index].gpio_number,
+            client_state->devices[gpio_index].is_on ? "ON" : "OFF",
+            (unsigned long)((client_state->devices[gpio_index].pwm_duty * 100u + 0x7FFFu) / 0xFFFFu));
+        printf_and_update_buffer(string);
     }else{
         char string[BUFFER_MAX_STRING_SIZE];
         snprintf(string, sizeof(string), "%2u. GPIO_NO: %2u  Power: %s\n",
@@ -53,16 +62,29 @@ void server_print_running_client_state(const client_t *client){
     server_print_state_devices(&client->running_client_state);
 }
 
-void server_print_client_preset_configuration(const client_t *client, uint8_t client_preset_index){
+void server_print_client_preset_configuration(const server_persistent_state_t *state, uint32_t flash_client_index, uint8_t client_preset_index){
+    client_state_t preset_state = state->clients[flash_client_index].running_client_state;
+    preset_store_apply_to_state(preset_store_library(), flash_client_index, client_preset_index, &preset_state);
+
     char string[BUFFER_MAX_STRING_SIZE];
     snprintf(string, sizeof(string), "Preset Config[%u] Devices:\n", client_preset_index + 1);
     printf_and_update_buffer(string);
-    server_print_state_devices(&client->preset_configs[client_preset_index]);
+    server_print_state_devices(&preset_state);
 }
 
-void server_print_client_preset_configurations(const client_t *client){
+void server_print_client_preset_configurations(const server_persistent_state_t *state, uint32_t flash_client_index){
+    const preset_library_t *library = preset_store_library();
+    uint32_t stored_presets = 0;
     for (uint32_t preset_config_index = 0; preset_config_index < NUMBER_OF_POSSIBLE_PRESETS; preset_config_index++){
-        server_print_client_preset_configuration(client, preset_config_index);
-        printf_and_update_buffer("\n");
+        if (preset_store_get_hash(library, flash_client_index, preset_config_index)){
+            server_print_client_preset_configuration(state, flash_client_index, preset_config_index);
+            printf_and_update_buffer("\n");
+            stored_presets++;
+        }
     }
+
+    char string[BUFFER_MAX_STRING_SIZE];
+    snprintf(string, sizeof(string), "%lu of %u Presets stored, others all OFF.\n",
+        (unsigned long)stored_presets, NUMBER_OF_POSSIBLE_PRESETS);
+    printf_and_update_buffer(string);
 }
\ No newline at end of file
@@ -0,0 +1,273 @@
+/**
+ * @file statistics.c
+ * @brief Runtime statistics collection and reporting for the UART server.
+ *
+ * Samples are recorded from both cores under a dedicated hardware spinlock.
+ * Printing works on a snapshot so the lock is never held while USB output
+ * is being written.
+ *
+ * @see statistics.h
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "hardware/sync.h"
+
+#include "statistics.h"
+#include "menu.h"
+
+static server_statistics_t statistics;
+static server_statistics_t statistics_snapshot;
+static spin_lock_t *statistics_lock = NULL;
+
+static const char *const latency_names[STATISTICS_LATENCY_COUNT] = {
+    [STATISTICS_LATENCY_COMMAND]        = "command",
+    [STATISTICS_LATENCY_FLASH_COMMIT]   = "flash_commit",
+    [STATISTICS_LATENCY_WAKE]           = "wake",
+    [STATISTICS_LATENCY_SYNC_ERROR]     = "sync_error",
+    [STATISTICS_LATENCY_INTERLOCK]      = "interlock",
+    [STATISTICS_LATENCY_CLOCK_BOOST]    = "clock_boost",
+    [STATISTICS_LATENCY_CLOCK_DROP]     = "clock_drop",
+};
+
+static const char *const latency_titles[STATISTICS_LATENCY_COUNT] = {
+    [STATISTICS_LATENCY_COMMAND]        = "Command End-To-End",
+    [STATISTICS_LATENCY_FLASH_COMMIT]   = "Flash Commit",
+    [STATISTICS_LATENCY_WAKE]           = "Client Wake",
+    [STATISTICS_LATENCY_SYNC_ERROR]     = "Clock Sync Error",
+    [STATISTICS_LATENCY_INTERLOCK]      = "Interlock Reaction",
+    [STATISTICS_LATENCY_CLOCK_BOOST]    = "Clock Boost",
+    [STATISTICS_LATENCY_CLOCK_DROP]     = "Clock Drop",
+};
+
+void statistics_init(void){
+    statistics_lock = spin_lock_instance(spin_lock_claim_unused(true));
+}
+
+/**
+ * @brief Maps a server-side pin pair to its scan slot.
+ *
+ * @param pin_pair Server-side TX/RX pin pair.
+ * @return Slot index, or MAX_SERVER_CONNECTIONS if the pair is unknown.
+ */
+static uint8_t statistics_pin_pair_slot(uart_pin_pair_t pin_pair){
+    for (uint8_t index = 0; index < PIN_PAIRS_UART0_LEN; index++){
+        if (pin_pairs_uart0[index].tx == pin_pair.tx){
+            return index;
+        }
+    }
+    for (uint8_t index = 0; index < PIN_PAIRS_UART1_LEN; index++){
+        if (pin_pairs_uart1[index].tx == pin_pair.tx){
+            return PIN_PAIRS_UART0_LEN + index;
+        }
+    }
+    return MAX_SERVER_CONNECTIONS;
+}
+
+/**
+ * @brief Returns the log2 histogram bucket of a sample.
+ *
+ * @param elapsed_us Sample in microseconds.
+ * @return Bucket index, clamped to the last bucket.
+ */
+static uint8_t statistics_bucket(uint32_t elapsed_us){
+    uint8_t bucket = elapsed_us ? (uint8_t)(32 - __builtin_clz(elapsed_us)) : 0;
+    return bucket < STATISTICS_HISTOGRAM_BUCKETS ? bucket : STATISTICS_HISTOGRAM_BUCKETS - 1;
+}
+
+/**
+ * @brief Adds a sample to a histogram. Caller must hold the statistics lock.
+ *
+ * @param histogram  Histogram to update.
+ * @param elapsed_us Sample in microseconds.
+ */
+static void histogram_add(latency_histogram_t *histogram, uint32_t elapsed_us){
+    if (!histogram->count || elapsed_us < histogram->min_us){
+        histogram->min_us = elapsed_us;
+    }
+    if (elapsed_us > histogram->max_us){
+        histogram->max_us = elapsed_us;
+    }
+    histogram->count++;
+    histogram->total_us += elapsed_us;
+    histogram->buckets[statistics_bucket(elapsed_us)]++;
+}
+
+void statistics_record_latency(statistics_latency_t metric, uint32_t elapsed_us){
+    if (!statistics_lock || metric >= STATISTICS_LATENCY_COUNT){
+        return;
+    }
+    uint32_t irq = spin_lock_blocking(statistics_lock);
+    histogram_add(&statistics.latencies[metric], elapsed_us);
+    spin_unlock(statistics_lock, irq);
+}
+
+void statistics_record_handshake(uart_pin_pair_t pin_pair, bool success, uint32_t elapsed_us){
+    uint8_t slot = statistics_pin_pair_slot(pin_pair);
+    if (!statistics_lock || slot >= MAX_SERVER_CONNECTIONS){
+        return;
+    }
+    uint32_t irq = spin_lock_blocking(statistics_lock);
+    statistics.handshakes[slot].attempts++;
+    if (success){
+        statistics.handshakes[slot].successes++;
+    }
+    histogram_add(&statistics.handshakes[slot].latency, elapsed_us);
+    spin_unlock(statistics_lock, irq);
+}
+
+void statistics_record_traffic(uart_pin_pair_t pin_pair, uint32_t frames, uint32_t bytes){
+    uint8_t slot = statistics_pin_pair_slot(pin_pair);
+    if (!statistics_lock || slot >= MAX_SERVER_CONNECTIONS){
+        return;
+    }
+    uint32_t irq = spin_lock_blocking(statistics_lock);
+    statistics.traffic[slot].frames += frames;
+    statistics.traffic[slot].bytes += bytes;
+    spin_unlock(statistics_lock, irq);
+}
+
+/**
+ * @brief Copies the statistics into the snapshot, optionally clearing them.
+ *
+ * @param reset true to clear the live statistics after copying.
+ */
+static void statistics_take_snapshot(bool reset){
+    uint32_t irq = spin_lock_blocking(statistics_lock);
+    memcpy(&statistics_snapshot, &statistics, sizeof(statistics));
+    if (reset){
+        memset(&statistics, 0, sizeof(statistics));
+    }
+    spin_unlock(statistics_lock, irq);
+}
+
+/**
+ * @brief Returns the server-side pin pair for a scan slot.
+ *
+ * @param slot Scan slot index.
+ * @return Pin pair of the slot.
+ */
+static uart_pin_pair_t statistics_slot_pin_pair(uint8_t slot){
+    return slot < PIN_PAIRS_UART0_LEN ? pin_pairs_uart0[slot] : pin_pairs_uart1[slot - PIN_PAIRS_UART0_LEN];
+}
+
+/**
+ * @brief Prints the summary and non-empty buckets of a histogram to the CLI.
+ *
+ * @param title     Heading printed before the summary.
+ * @param histogram Histogram to print.
+ */
+static void histogram_print(const char *title, const latency_histogram_t *histogram){
+    char string[BUFFER_MAX_STRING_SIZE];
+    snprintf(string, sizeof(string), "%s: n=%lu\n", title, (unsigned long)histogram->count);
+    printf_and_update_buffer(string);
+    if (!histogram->count){
+        return;
+    }
+
+    snprintf(string, sizeof(string), "  min=%luus avg=%luus max=%luus\n",
+        (unsigned long)histogram->min_us,
+        (unsigned long)(histogram->total_us / histogram->count),
+        (unsigned long)histogram->max_us);
+    printf_and_update_buffer(string);
+
+    for (uint8_t bucket = 0; bucket < STATISTICS_HISTOGRAM_BUCKETS; bucket++){
+        if (histogram->buckets[bucket]){
+            if (bucket == STATISTICS_HISTOGRAM_BUCKETS - 1){
+                snprintf(string, sizeof(string), "  >= %8luus: %lu\n",
+                    (unsigned long)(1ul << (bucket - 1)), (unsigned long)histogram->buckets[bucket]);
+            }else{
+                snprintf(string, sizeof(string), "  <  %8luus: %lu\n",
+                    (unsigned long)(1ul << bucket), (unsigned long)histogram->buckets[bucket]);
+            }
+            printf_and_update_buffer(string);
+        }
+    }
+}
+
+void statistics_print(bool reset){
+    statistics_take_snapshot(reset);
+
+    printf_and_update_buffer("\nServer Statistics:\n");
+    for (uint8_t metric = 0; metric < STATISTICS_LATENCY_COUNT; metric++){
+        histogram_print(latency_titles[metric], &statistics_snapshot.latencies[metric]);
+    }
+
+    for (uint8_t slot = 0; slot < MAX_SERVER_CONNECTIONS; slot++){
+        const handshake_statistics_t *handshake = &statistics_snapshot.handshakes[slot];
+        if (!handshake->attempts){
+            continue;
+        }
+        uart_pin_pair_t pin_pair = statistics_slot_pin_pair(slot);
+        char title[BUFFER_MAX_STRING_SIZE];
+        snprintf(title, sizeof(title), "Handshake [%u,%u] (%lu/%lu ok)",
+            pin_pair.tx, pin_pair.rx,
+            (unsigned long)handshake->successes,
+            (unsigned long)handshake->attempts);
+        histogram_print(title, &handshake->latency);
+    }
+
+    for (uint8_t slot = 0; slot < MAX_SERVER_CONNECTIONS; slot++){
+        const client_traffic_statistics_t *traffic = &statistics_snapshot.traffic[slot];
+        if (!traffic->frames){
+            continue;
+        }
+        uart_pin_pair_t pin_pair = statistics_slot_pin_pair(slot);
+        char string[BUFFER_MAX_STRING_SIZE];
+        snprintf(string, sizeof(string), "Client [%u,%u] Traffic: %lu frames, %lu bytes\n",
+            pin_pair.tx, pin_pair.rx,
+            (unsigned long)traffic->frames,
+            (unsigned long)traffic->bytes);
+        printf_and_update_buffer(string);
+    }
+
+    if (reset){
+        printf_and_update_buffer("\nStatistics Reset.\n");
+    }
+}
+
+/**
+ * @brief Prints one histogram as a single machine-readable line.
+ *
+ * @param name      Metric name.
+ * @param histogram Histogram to print.
+ */
+static void histogram_print_machine(const char *name, const latency_histogram_t *histogram){
+    printf("STAT %s count=%lu min_us=%lu avg_us=%lu max_us=%lu buckets=",
+        name,
+        (unsigned long)histogram->count,
+        (unsigned long)histogram->min_us,
+        (unsigned long)(histogram->count ? histogram->total_us / histogram->count : 0),
+        (unsigned long)histogram->max_us);
+    for (uint8_t bucket = 0; bucket < STATISTICS_HISTOGRAM_BUCKETS; bucket++){
+        printf("%s%lu", bucket ? "," : "", (unsigned long)histogram->buckets[bucket]);
+    }
+    printf("\n");
+}
+
+void statistics_print_machine(bool reset){
+    statistics_take_snapshot(reset);
+
+    for (uint8_t metric = 0; metric < STATISTICS_LATENCY_COUNT; metric++){
+        histogram_print_machine(latency_names[metric], &statistics_snapshot.latencies[metric]);
+    }
+
+    for (uint8_t slot = 0; slot < MAX_SERVER_CONNECTIONS; slot++){
+        uart_pin_pair_t pin_pair = statistics_slot_pin_pair(slot);
+        char name[24];
+
+        snprintf(name, sizeof(name), "handshake_%u_%u", pin_pair.tx, pin_pair.rx);
+        printf("STAT %s_result attempts=%lu successes=%lu\n",
+            name,
+            (unsigned long)statistics_snapshot.handshakes[slot].attempts,
+            (unsigned long)statistics_snapshot.handshakes[slot].successes);
+        histogram_print_machine(name, &statistics_snapshot.handshakes[slot].latency);
+
+        printf("STAT traffic_%u_%u frames=%lu bytes=%lu\n",
+            pin_pair.tx, pin_pair.rx,
+            (unsigned long)statistics_snapshot.traffic[slot].frames,
+            (unsigned long)statistics_snapshot.traffic[slot].bytes);
+    }
+}
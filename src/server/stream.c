@@ -0,0 +1,400 @@
+/**
+ * @file stream.c
+ * @brief Forwards a stream of per-client output masks from USB to the clients.
+ *
+ * Streaming bypasses the flash state and the per-message UART setup. When
+ * it starts, each client gets a stream address (its flash index + 1) and
+ * every UART instance is set up once, with the TX pins of all of its
+ * clients attached. The clients on one UART instance form a lane and all
+ * receive the same bytes; each client applies only the
+ * "[42,address,gpio_mask]" frames that carry its own address.
+ *
+ * A repeating timer ticks at the stream rate. On each tick, the newest
+ * mask received for each client since the previous tick is written into
+ * the idle buffer of its lane, and a DMA channel paced by the UART sends
+ * that buffer while the next tick fills the other one. A client with no
+ * new mask on a tick counts an underrun. A lane whose DMA is still busy
+ * from the previous tick is skipped, which counts an overrun for its
+ * clients; their masks are sent on the next tick.
+ *
+ * A rate is only accepted if every lane can send a full-length frame for
+ * each of its clients within one tick, at 10 bit times per byte and
+ * `DEFAULT_BAUDRATE`; with one client on a UART instance that is about
+ * 820 Hz.
+ *
+ * Streamed masks are never written to flash. When the stream ends, every
+ * client is set back to its stored running state.
+ *
+ * Other UART traffic waits until the stream ends: core1 holds its UART
+ * work back (scheduler, timed output polls, input reports, LED blink) and
+ * runs it once `STREAM_ENDED_WAKEUP_MESSAGE` arrives, while core0 waits in
+ * `uart_lock_acquire()`.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "pico/time.h"
+#include "hardware/dma.h"
+#include "hardware/sync.h"
+#include "hardware/uart.h"
+
+#include "server.h"
+#include "functions.h"
+#include "statistics.h"
+#include "menu.h"
+
+#define LOG_MODULE UART
+#include "log.h"
+
+#define STREAM_FRAME_MAX_SIZE   18      ///< "[42,address,gpio_mask]" with a 10-digit mask
+#define STREAM_LANE_COUNT       2
+#define STREAM_LANE_BUFFER_SIZE (MAX_SERVER_CONNECTIONS * STREAM_FRAME_MAX_SIZE)
+
+/**
+ * @brief Stream state of one client.
+ */
+typedef struct{
+    uint32_t next_mask;         ///< Newest mask received from the host
+    bool fresh;                 ///< next_mask has not been sent yet
+    bool streamed;              ///< The host has sent at least one mask
+    uint32_t frames;
+    uint32_t underruns;
+    uint32_t overruns;
+    uint32_t bytes;
+}stream_client_t;
+
+/**
+ * @brief Clients sharing one UART instance and its DMA channel.
+ */
+typedef struct{
+    uart_inst_t *uart;
+    int dma_channel;
+    uint8_t client_count;
+    uint8_t active_clients[MAX_SERVER_CONNECTIONS];
+    uint8_t buffers[2][STREAM_LANE_BUFFER_SIZE];
+    uint8_t next_buffer;
+}stream_lane_t;
+
+static stream_client_t stream_clients[MAX_SERVER_CONNECTIONS];
+static uint8_t stream_flash_clients[MAX_SERVER_CONNECTIONS];
+static stream_lane_t stream_lanes[STREAM_LANE_COUNT];
+static repeating_timer_t stream_timer;
+static uint64_t stream_started_us = 0;
+static uint64_t stream_stopped_us = 0;
+static volatile bool stream_active = false;
+
+bool stream_is_active(void){
+    return stream_active;
+}
+
+/**
+ * @brief Appends a decimal number to a frame buffer.
+ *
+ * @param buffer Destination.
+ * @param value  Number to append.
+ * @return Number of characters written.
+ */
+static uint32_t stream_append_number(uint8_t *buffer, uint32_t value){
+    char digits[10];
+    uint32_t count = 0;
+    do{
+        digits[count++] = (char)('0' + value % 10);
+        value /= 10;
+    }while (value);
+
+    for (uint32_t index = 0; index < count; index++){
+        buffer[index] = (uint8_t)digits[count - 1 - index];
+    }
+    return count;
+}
+
+/**
+ * @brief Writes "[42,address,gpio_mask]" into a frame buffer.
+ *
+ * @param buffer    Destination, at least `STREAM_FRAME_MAX_SIZE` bytes.
+ * @param address   Stream address of the client.
+ * @param gpio_mask Mask to send.
+ * @return Frame length.
+ */
+static uint32_t stream_write_frame(uint8_t *buffer, uint32_t address, uint32_t gpio_mask){
+    uint32_t length = 0;
+    buffer[length++] = '[';
+    length += stream_append_number(&buffer[length], STREAM_FRAME_FLAG_NUMBER);
+    buffer[length++] = ',';
+    length += stream_append_number(&buffer[length], address);
+    buffer[length++] = ',';
+    length += stream_append_number(&buffer[length], gpio_mask);
+    buffer[length++] = ']';
+    return length;
+}
+
+/**
+ * @brief Fills the idle buffer of a lane and starts its DMA transfer.
+ *
+ * @param lane Lane to serve.
+ */
+static void stream_serve_lane(stream_lane_t *lane){
+    bool busy = dma_channel_is_busy(lane->dma_channel);
+    uint8_t *buffer = lane->buffers[lane->next_buffer];
+    uint32_t length = 0;
+
+    for (uint8_t lane_index = 0; lane_index < lane->client_count; lane_index++){
+        uint8_t active_client_index = lane->active_clients[lane_index];
+        stream_client_t *client = &stream_clients[active_client_index];
+        if (!client->streamed){
+            continue;
+        }
+        if (!client->fresh){
+            client->underruns++;
+            continue;
+        }
+        if (busy){
+            client->overruns++;
+            continue;
+        }
+        uint32_t frame_length = stream_write_frame(&buffer[length], stream_flash_clients[active_client_index] + 1u, client->next_mask);
+        length += frame_length;
+        client->bytes += frame_length;
+        client->frames++;
+        client->fresh = false;
+    }
+
+    if (length){
+        dma_channel_transfer_from_buffer_now(lane->dma_channel, buffer, length);
+        lane->next_buffer ^= 1;
+    }
+}
+
+/**
+ * @brief Repeating timer callback: sends one tick of masks on every lane.
+ *
+ * @param timer Stream timer.
+ * @return true to keep the timer running.
+ */
+static bool stream_timer_callback(repeating_timer_t *timer){
+    for (uint8_t lane_index = 0; lane_index < STREAM_LANE_COUNT; lane_index++){
+        if (stream_lanes[lane_index].client_count){
+            stream_serve_lane(&stream_lanes[lane_index]);
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Sets up the UART instance and DMA channel of a lane.
+ *
+ * @param lane Lane with its clients filled in.
+ */
+static void stream_lane_start(stream_lane_t *lane){
+    uart_deinit(lane->uart);
+    uart_init(lane->uart, DEFAULT_BAUDRATE);
+    for (uint8_t lane_index = 0; lane_index < lane->client_count; lane_index++){
+        gpio_set_function(active_uart_server_connections[lane->active_clients[lane_index]].pin_pair.tx, GPIO_FUNC_UART);
+    }
+
+    lane->dma_channel = dma_claim_unused_channel(true);
+    dma_channel_config config = dma_channel_get_default_config(lane->dma_channel);
+    channel_config_set_transfer_data_size(&config, DMA_SIZE_8);
+    channel_config_set_read_increment(&config, true);
+    channel_config_set_write_increment(&config, false);
+    channel_config_set_dreq(&config, uart_get_dreq(lane->uart, true));
+    dma_channel_configure(lane->dma_channel, &config, &uart_get_hw(lane->uart)->dr, lane->buffers[0], 0, false);
+    lane->next_buffer = 0;
+}
+
+/**
+ * @brief Waits for the last frames of a lane and releases its UART and DMA channel.
+ *
+ * @param lane Lane to stop.
+ */
+static void stream_lane_stop(stream_lane_t *lane){
+    dma_channel_wait_for_finish_blocking(lane->dma_channel);
+    uart_tx_wait_blocking(lane->uart);
+    dma_channel_unclaim(lane->dma_channel);
+
+    for (uint8_t lane_index = 0; lane_index < lane->client_count; lane_index++){
+        reset_gpio_pins(active_uart_server_connections[lane->active_clients[lane_index]].pin_pair);
+    }
+    uart_deinit(lane->uart);
+}
+
+/**
+ * @brief Returns the highest tick rate at which a lane still fits every frame in a tick.
+ *
+ * Each client is counted with its longest frame, an all-ON mask, and each
+ * byte takes 10 bit times (start, 8 data, stop).
+ *
+ * @param lane Lane with its clients filled in.
+ * @return Highest rate in Hz.
+ */
+static uint32_t stream_lane_max_rate_hz(const stream_lane_t *lane){
+    uint8_t frame[STREAM_FRAME_MAX_SIZE];
+    uint32_t bits_per_tick = 0;
+    for (uint8_t lane_index = 0; lane_index < lane->client_count; lane_index++){
+        uint32_t address = stream_flash_clients[lane->active_clients[lane_index]] + 1u;
+        bits_per_tick += 10u * stream_write_frame(frame, address, GPIO_DEVICE_MASK);
+    }
+    return bits_per_tick ? DEFAULT_BAUDRATE / bits_per_tick : UINT32_MAX;
+}
+
+/**
+ * @brief Sends a client its stream address, 0 to leave streaming.
+ *
+ * @param active_client_index Index of the client in the active connections.
+ * @param address             Stream address.
+ */
+static void stream_send_address(uint8_t active_client_index, uint32_t address){
+    char msg[CLIENT_COMMAND_BUFFER_SIZE];
+    snprintf(msg, sizeof(msg), "[%d,%lu]", STREAM_ADDRESS_FLAG_NUMBER, (unsigned long)address);
+    send_uart_message_safe(active_uart_server_connections[active_client_index].uart_instance,
+        active_uart_server_connections[active_client_index].pin_pair,
+        msg);
+}
+
+bool stream_start(uint32_t rate_hz){
+    if (stream_active || !rate_hz || rate_hz > STREAM_MAX_RATE_HZ){
+        return false;
+    }
+    server_persistent_state_t state;
+    load_server_state(&state);
+
+    memset(stream_clients, 0, sizeof(stream_clients));
+    memset(stream_lanes, 0, sizeof(stream_lanes));
+    stream_lanes[0].uart = uart0;
+    stream_lanes[1].uart = uart1;
+
+    for (uint32_t flash_client_index = 0; flash_client_index < MAX_SERVER_CONNECTIONS; flash_client_index++){
+        uint32_t active_client_index = get_active_client_connection_index_from_flash_client_index(flash_client_index, state);
+        if (active_client_index == (uint32_t)INVALID_CLIENT_INDEX){
+            continue;
+        }
+        server_uart_connection_t *connection = &active_uart_server_connections[active_client_index];
+        stream_flash_clients[active_client_index] = (uint8_t)flash_client_index;
+        stream_lane_t *lane = &stream_lanes[connection->uart_instance == uart0 ? 0 : 1];
+        lane->active_clients[lane->client_count++] = (uint8_t)active_client_index;
+    }
+
+    for (uint8_t lane_index = 0; lane_index < STREAM_LANE_COUNT; lane_index++){
+        uint32_t max_rate_hz = stream_lane_max_rate_hz(&stream_lanes[lane_index]);
+        if (rate_hz > max_rate_hz){
+            LOG_WARN(UART_STREAM_REFUSED, rate_hz, max_rate_hz);
+            return false;
+        }
+    }
+
+    for (uint8_t lane_index = 0; lane_index < STREAM_LANE_COUNT; lane_index++){
+        const stream_lane_t *lane = &stream_lanes[lane_index];
+        for (uint8_t index = 0; index < lane->client_count; index++){
+            uint8_t active_client_index = lane->active_clients[index];
+            uint32_t flash_client_index = stream_flash_clients[active_client_index];
+            server_uart_connection_t *connection = &active_uart_server_connections[active_client_index];
+            send_wakeup_if_dormant(flash_client_index, &state, connection->pin_pair, connection->uart_instance);
+            stream_send_address(active_client_index, flash_client_index + 1);
+            server_timed_output_forget(flash_client_index, GPIO_DEVICE_MASK);
+        }
+    }
+
+    uint32_t irq = spin_lock_blocking(uart_lock);
+    stream_active = true;
+    spin_unlock(uart_lock, irq);
+
+    for (uint8_t lane_index = 0; lane_index < STREAM_LANE_COUNT; lane_index++){
+        if (stream_lanes[lane_index].client_count){
+            stream_lane_start(&stream_lanes[lane_index]);
+        }
+    }
+    stream_started_us = time_us_64();
+    add_repeating_timer_us(-(int64_t)(1000000u / rate_hz), stream_timer_callback, NULL, &stream_timer);
+    return true;
+}
+
+bool stream_set_mask(uint32_t flash_client_index, uint32_t gpio_mask){
+    if (!stream_active || flash_client_index >= MAX_SERVER_CONNECTIONS){
+        return false;
+    }
+    for (uint8_t active_client_index = 0; active_client_index < active_server_connections_number; active_client_index++){
+        stream_client_t *client = &stream_clients[active_client_index];
+        if (stream_flash_clients[active_client_index] != flash_client_index){
+            continue;
+        }
+        uint32_t irq = save_and_disable_interrupts();
+        client->next_mask = gpio_mask & GPIO_DEVICE_MASK;
+        client->fresh = true;
+        client->streamed = true;
+        restore_interrupts(irq);
+        return true;
+    }
+    return false;
+}
+
+void stream_stop(void){
+    if (!stream_active){
+        return;
+    }
+    cancel_repeating_timer(&stream_timer);
+    for (uint8_t lane_index = 0; lane_index < STREAM_LANE_COUNT; lane_index++){
+        if (stream_lanes[lane_index].client_count){
+            stream_lane_stop(&stream_lanes[lane_index]);
+        }
+    }
+
+    stream_stopped_us = time_us_64();
+    uint32_t irq = spin_lock_blocking(uart_lock);
+    stream_active = false;
+    spin_unlock(uart_lock, irq);
+    server_post_core1_message(STREAM_ENDED_WAKEUP_MESSAGE);
+
+    uint32_t frames = 0;
+    uint32_t underruns = 0;
+    for (uint8_t active_client_index = 0; active_client_index < MAX_SERVER_CONNECTIONS; active_client_index++){
+        frames += stream_clients[active_client_index].frames;
+        underruns += stream_clients[active_client_index].underruns;
+    }
+    LOG_INFO(UART_STREAM_ENDED, frames, underruns);
+
+    server_persistent_state_t state;
+    server_state_lock();
+    load_server_state(&state);
+    for (uint8_t lane_index = 0; lane_index < STREAM_LANE_COUNT; lane_index++){
+        const stream_lane_t *lane = &stream_lanes[lane_index];
+        for (uint8_t index = 0; index < lane->client_count; index++){
+            uint8_t active_client_index = lane->active_clients[index];
+            const client_t *client = &state.clients[stream_flash_clients[active_client_index]];
+            server_uart_connection_t *connection = &active_uart_server_connections[active_client_index];
+
+            statistics_record_traffic(connection->pin_pair, stream_clients[active_client_index].frames, stream_clients[active_client_index].bytes);
+            stream_send_address(active_client_index, 0);
+            server_send_client_state(connection->pin_pair, connection->uart_instance, &client->running_client_state);
+            if (!client_has_active_devices(*client)){
+                send_dormant_flag_to_client(active_client_index);
+                connection->is_dormant = true;
+            }else{
+                connection->is_dormant = false;
+            }
+        }
+    }
+    server_state_unlock();
+}
+
+void stream_print_machine(void){
+    uint64_t elapsed_us = (stream_active ? time_us_64() : stream_stopped_us) - stream_started_us;
+    for (uint8_t lane_index = 0; lane_index < STREAM_LANE_COUNT; lane_index++){
+        const stream_lane_t *lane = &stream_lanes[lane_index];
+        for (uint8_t index = 0; index < lane->client_count; index++){
+            uint8_t active_client_index = lane->active_clients[index];
+            uint32_t irq = save_and_disable_interrupts();
+            stream_client_t client = stream_clients[active_client_index];
+            restore_interrupts(irq);
+
+            uint32_t frames_per_second = elapsed_us ? (uint32_t)((uint64_t)client.frames * 1000000u / elapsed_us) : 0;
+            printf("STREAM %u %lu %lu %lu %lu\n",
+                stream_flash_clients[active_client_index],
+                (unsigned long)client.frames,
+                (unsigned long)client.underruns,
+                (unsigned long)client.overruns,
+                (unsigned long)frames_per_second);
+        }
+    }
+}
@@ -0,0 +1,166 @@
+/**
+ * @file time_sync.c
+ * @brief Estimates the clock offset and drift of each client.
+ *
+ * A sync sends `TIME_SYNC_SAMPLES` requests and keeps the sample with the
+ * smallest offset, which is the one whose reply was stamped with the least
+ * delay on the client. The server stamps a request when its stop bit has
+ * left the UART, and the client as soon as the frame is received, so the
+ * remaining error is a few microseconds of polling delay. It is about the
+ * same on every client, so it cancels out when clients switch together.
+ *
+ * The drift is the change of the offset between two syncs of the same
+ * awake period, averaged over successive syncs. The client timer stops
+ * while it is dormant, so the offset is dropped whenever a client is sent
+ * to dormant mode, while the drift, which depends on the client's crystal,
+ * is kept.
+ *
+ * Each resync compares the measured offset with the model's prediction and
+ * records the difference as `STATISTICS_LATENCY_SYNC_ERROR`. Two clients
+ * applying a command at the same time are off from each other by at most
+ * the sum of their errors.
+ */
+
+#include <stdlib.h>
+
+#include "pico/stdlib.h"
+#include "hardware/sync.h"
+
+#include "server.h"
+#include "statistics.h"
+
+#define LOG_MODULE UART
+#include "log.h"
+
+/**
+ * @brief Clock model of one client.
+ */
+typedef struct{
+    int64_t offset_us;              ///< Client time minus server time at synced_at_us
+    uint64_t synced_at_us;          ///< Server time of the last sync
+    int64_t drift_base_offset_us;   ///< Offset at the start of the current drift measurement
+    uint64_t drift_base_at_us;
+    int32_t drift_ppb;              ///< Client clock rate error, in parts per billion
+    bool offset_valid;
+    bool drift_valid;
+}time_sync_client_t;
+
+static time_sync_client_t time_sync_clients[MAX_SERVER_CONNECTIONS];
+static spin_lock_t *time_sync_lock = NULL;
+
+void time_sync_init(void){
+    time_sync_lock = spin_lock_instance(spin_lock_claim_unused(true));
+}
+
+/**
+ * @brief Returns the offset the model predicts for a given server time.
+ *
+ * @param client    Client model with a valid offset.
+ * @param server_us Server time.
+ * @return Predicted client time minus server time.
+ */
+static int64_t time_sync_predict_offset(const time_sync_client_t *client, uint64_t server_us){
+    int64_t offset_us = client->offset_us;
+    if (client->drift_valid){
+        offset_us += (int64_t)(server_us - client->synced_at_us) * client->drift_ppb / 1000000000;
+    }
+    return offset_us;
+}
+
+/**
+ * @brief Updates the drift estimate with a new offset measurement.
+ *
+ * @param client       Client model with a valid offset.
+ * @param offset_us    Measured offset.
+ * @param synced_at_us Server time of the measurement.
+ */
+static void time_sync_update_drift(time_sync_client_t *client, int64_t offset_us, uint64_t synced_at_us){
+    int64_t elapsed_us = (int64_t)(synced_at_us - client->drift_base_at_us);
+    if (elapsed_us < (int64_t)TIME_SYNC_MIN_DRIFT_INTERVAL_MS * 1000){
+        return;
+    }
+
+    int64_t change_us = offset_us - client->drift_base_offset_us;
+    if (llabs(change_us) <= elapsed_us / 1000){
+        int64_t drift_ppb = change_us * 1000000000 / elapsed_us;
+        if (llabs(drift_ppb) <= TIME_SYNC_MAX_DRIFT_PPB){
+            client->drift_ppb = client->drift_valid ? (int32_t)((client->drift_ppb + drift_ppb) / 2) : (int32_t)drift_ppb;
+            client->drift_valid = true;
+        }
+    }
+    client->drift_base_offset_us = offset_us;
+    client->drift_base_at_us = synced_at_us;
+}
+
+bool time_sync_client(uint8_t active_client_index){
+    if (!time_sync_lock || active_client_index >= active_server_connections_number){
+        return false;
+    }
+    server_uart_connection_t *connection = &active_uart_server_connections[active_client_index];
+
+    int64_t offset_us = 0;
+    uint64_t synced_at_us = 0;
+    if (!server_time_sync_exchange(connection->pin_pair, connection->uart_instance, &offset_us, &synced_at_us)){
+        time_sync_invalidate(active_client_index);
+        LOG_WARN(UART_TIME_SYNC_FAILED, connection->pin_pair.tx, TIME_SYNC_SAMPLES);
+        return false;
+    }
+
+    uint32_t irq = spin_lock_blocking(time_sync_lock);
+    time_sync_client_t *client = &time_sync_clients[active_client_index];
+    bool had_offset = client->offset_valid;
+    int64_t error_us = had_offset ? llabs(offset_us - time_sync_predict_offset(client, synced_at_us)) : 0;
+    if (had_offset){
+        time_sync_update_drift(client, offset_us, synced_at_us);
+    }else{
+        client->drift_base_offset_us = offset_us;
+        client->drift_base_at_us = synced_at_us;
+    }
+    client->offset_us = offset_us;
+    client->synced_at_us = synced_at_us;
+    client->offset_valid = true;
+    int32_t drift_ppb = client->drift_ppb;
+    spin_unlock(time_sync_lock, irq);
+
+    if (had_offset){
+        statistics_record_latency(STATISTICS_LATENCY_SYNC_ERROR, error_us > UINT32_MAX ? UINT32_MAX : (uint32_t)error_us);
+    }
+    LOG_DEBUG(UART_TIME_SYNCED, active_client_index, drift_ppb);
+    return true;
+}
+
+bool time_sync_ensure(uint8_t active_client_index){
+    if (!time_sync_lock || active_client_index >= MAX_SERVER_CONNECTIONS){
+        return false;
+    }
+    uint32_t irq = spin_lock_blocking(time_sync_lock);
+    const time_sync_client_t *client = &time_sync_clients[active_client_index];
+    uint64_t max_age_us = (client->drift_valid ? TIME_SYNC_MAX_AGE_MS : TIME_SYNC_MAX_AGE_UNCOMPENSATED_MS) * 1000ull;
+    bool fresh = client->offset_valid && time_us_64() - client->synced_at_us <= max_age_us;
+    spin_unlock(time_sync_lock, irq);
+
+    return fresh || time_sync_client(active_client_index);
+}
+
+void time_sync_invalidate(uint8_t active_client_index){
+    if (!time_sync_lock || active_client_index >= MAX_SERVER_CONNECTIONS){
+        return;
+    }
+    uint32_t irq = spin_lock_blocking(time_sync_lock);
+    time_sync_clients[active_client_index].offset_valid = false;
+    spin_unlock(time_sync_lock, irq);
+}
+
+bool time_sync_client_time(uint8_t active_client_index, uint64_t server_us, uint64_t *client_us){
+    if (!time_sync_lock || active_client_index >= MAX_SERVER_CONNECTIONS){
+        return false;
+    }
+    uint32_t irq = spin_lock_blocking(time_sync_lock);
+    const time_sync_client_t *client = &time_sync_clients[active_client_index];
+    bool valid = client->offset_valid;
+    if (valid){
+        *client_us = server_us + (uint64_t)time_sync_predict_offset(client, server_us);
+    }
+    spin_unlock(time_sync_lock, irq);
+    return valid;
+}
@@ -0,0 +1,206 @@
+/**
+ * @file timed_output.c
+ * @brief Starts client-side timed outputs and collects their completion reports.
+ *
+ * The client runs the pulse train on its own hardware alarms. Because a
+ * timed output always ends OFF, the final value is written to the flash
+ * state when the command is sent, with no extra round trip once it ends.
+ *
+ * Each started output is kept as pending for its client, with its own
+ * poll time. An alarm fires `OUTPUT_REPORT_MARGIN_MS` after the expected
+ * end and wakes core1, which polls the client for its completion report.
+ * Outputs that are due and not reported are polled again up to
+ * `OUTPUT_REPORT_MAX_RETRIES` times; outputs that are still running keep
+ * their own poll time and retries.
+ */
+
+#include "pico/stdlib.h"
+#include "pico/time.h"
+#include "hardware/sync.h"
+
+#include "server.h"
+#include "menu.h"
+
+#define LOG_MODULE STATE
+#include "log.h"
+
+/**
+ * @brief Timed outputs of one client that have not been reported yet.
+ */
+typedef struct{
+    uint32_t pending_mask;      ///< GPIOs with an unreported timed output
+    uint64_t poll_due_us[32];   ///< time_us_64() at which each pending GPIO is polled
+    uint8_t retries[32];
+}timed_output_client_t;
+
+static timed_output_client_t timed_output_clients[MAX_SERVER_CONNECTIONS];
+static spin_lock_t *timed_output_lock = NULL;
+
+void server_timed_output_init(void){
+    timed_output_lock = spin_lock_instance(spin_lock_claim_unused(true));
+}
+
+/**
+ * @brief Alarm callback: hands the report poll over to core1.
+ *
+ * @param id        Alarm ID.
+ * @param user_data Unused.
+ * @return 0, the alarm does not repeat.
+ */
+static int64_t timed_output_poll_alarm_callback(alarm_id_t id, void *user_data){
+    server_post_core1_message(TIMED_OUTPUT_POLL_WAKEUP_MESSAGE);
+    return 0;
+}
+
+/**
+ * @brief Schedules a report poll of some GPIOs of one client.
+ *
+ * @param flash_client_index Index of the client in the persistent state table.
+ * @param gpio_mask          GPIOs polled at that time.
+ * @param delay_us           Delay until the poll.
+ */
+static void timed_output_schedule_poll(uint32_t flash_client_index, uint32_t gpio_mask, uint64_t delay_us){
+    uint64_t due_us = time_us_64() + delay_us;
+    uint32_t irq = spin_lock_blocking(timed_output_lock);
+    for (uint32_t remaining_mask = gpio_mask; remaining_mask; remaining_mask &= remaining_mask - 1){
+        timed_output_clients[flash_client_index].poll_due_us[__builtin_ctz(remaining_mask)] = due_us;
+    }
+    spin_unlock(timed_output_lock, irq);
+
+    add_alarm_in_us(delay_us, timed_output_poll_alarm_callback, NULL, true);
+}
+
+/**
+ * @brief Returns the pending GPIOs of a client whose poll time has come. Call with the lock held.
+ *
+ * @param client Timed outputs of the client.
+ * @param now_us time_us_64().
+ * @return Due GPIOs.
+ */
+static uint32_t timed_output_due_mask(const timed_output_client_t *client, uint64_t now_us){
+    uint32_t due_mask = 0;
+    for (uint32_t remaining_mask = client->pending_mask; remaining_mask; remaining_mask &= remaining_mask - 1){
+        uint8_t gpio_number = (uint8_t)__builtin_ctz(remaining_mask);
+        if (now_us >= client->poll_due_us[gpio_number]){
+            due_mask |= 1u << gpio_number;
+        }
+    }
+    return due_mask;
+}
+
+void server_timed_output_start(uint32_t flash_client_index, uint8_t active_client_index, uint8_t gpio_number, uint32_t on_ms, uint32_t off_ms, uint32_t pulse_count){
+    if (!timed_output_lock || flash_client_index >= MAX_SERVER_CONNECTIONS || !pulse_count){
+        return;
+    }
+    server_uart_connection_t *connection = &active_uart_server_connections[active_client_index];
+    server_persistent_state_t state_copy;
+    server_state_lock();
+    load_server_state(&state_copy);
+
+    send_wakeup_if_dormant(flash_client_index, &state_copy, connection->pin_pair, connection->uart_instance);
+    server_send_timed_output(connection->pin_pair, connection->uart_instance, gpio_number, on_ms, off_ms, pulse_count);
+
+    device_t *device = &state_copy.clients[flash_client_index].running_client_state.devices[gpio_number > 22 ? (gpio_number - 3) : (gpio_number)];
+    if (device->is_on){
+        device->is_on = false;
+        save_server_state(&state_copy);
+    }
+
+    uint64_t duration_us = (uint64_t)pulse_count * on_ms * 1000u + (uint64_t)(pulse_count - 1) * off_ms * 1000u;
+    uint32_t irq = spin_lock_blocking(timed_output_lock);
+    timed_output_clients[flash_client_index].pending_mask |= 1u << gpio_number;
+    timed_output_clients[flash_client_index].poll_due_us[gpio_number] = UINT64_MAX;
+    timed_output_clients[flash_client_index].retries[gpio_number] = 0;
+    spin_unlock(timed_output_lock, irq);
+
+    timed_output_schedule_poll(flash_client_index, 1u << gpio_number, duration_us + OUTPUT_REPORT_MARGIN_MS * 1000u);
+
+    if (!client_has_active_devices(state_copy.clients[flash_client_index])){
+        send_dormant_flag_to_client(active_client_index);
+        connection->is_dormant = true;
+    }
+    server_state_unlock();
+    LOG_INFO(STATE_TIMED_OUTPUT_STARTED, gpio_number, pulse_count);
+}
+
+void server_timed_output_forget(uint32_t flash_client_index, uint32_t gpio_mask){
+    if (!timed_output_lock || flash_client_index >= MAX_SERVER_CONNECTIONS){
+        return;
+    }
+    uint32_t irq = spin_lock_blocking(timed_output_lock);
+    timed_output_clients[flash_client_index].pending_mask &= ~gpio_mask;
+    spin_unlock(timed_output_lock, irq);
+}
+
+/**
+ * @brief Polls one client and clears its reported outputs.
+ *
+ * Only the GPIOs that were due count a retry or are given up; the report
+ * also clears any other output it shows completed.
+ *
+ * @param flash_client_index Index of the client in the persistent state table.
+ * @param state              Persistent state, used to find the client's connection.
+ */
+static void timed_output_poll_client(uint32_t flash_client_index, server_persistent_state_t *state){
+    uint8_t active_client_index = get_active_client_connection_index_from_flash_client_index(flash_client_index, *state);
+    server_uart_connection_t *connection = &active_uart_server_connections[active_client_index];
+
+    uint32_t completed_mask = 0;
+    uint32_t gpio_on_mask = 0;
+    bool reported = server_poll_output_report(connection->pin_pair, connection->uart_instance, &completed_mask, &gpio_on_mask);
+
+    uint32_t retry_mask = 0;
+    uint32_t lost_mask = 0;
+    uint32_t irq = spin_lock_blocking(timed_output_lock);
+    timed_output_client_t *client = &timed_output_clients[flash_client_index];
+    if (reported){
+        client->pending_mask &= ~completed_mask;
+    }
+    for (uint32_t due_mask = timed_output_due_mask(client, time_us_64()); due_mask; due_mask &= due_mask - 1){
+        uint8_t gpio_number = (uint8_t)__builtin_ctz(due_mask);
+        if (client->retries[gpio_number] < OUTPUT_REPORT_MAX_RETRIES){
+            client->retries[gpio_number]++;
+            client->poll_due_us[gpio_number] = UINT64_MAX;
+            retry_mask |= 1u << gpio_number;
+        }else{
+            lost_mask |= 1u << gpio_number;
+        }
+    }
+    client->pending_mask &= ~lost_mask;
+    spin_unlock(timed_output_lock, irq);
+
+    if (reported && completed_mask){
+        LOG_DEBUG(STATE_TIMED_OUTPUT_REPORTED, flash_client_index, completed_mask);
+    }
+    if (reported && (completed_mask & gpio_on_mask)){
+        LOG_WARN(STATE_TIMED_OUTPUT_MISMATCH, flash_client_index, completed_mask & gpio_on_mask);
+    }
+    if (retry_mask){
+        timed_output_schedule_poll(flash_client_index, retry_mask, OUTPUT_REPORT_MARGIN_MS * 1000u);
+    }
+    if (lost_mask){
+        LOG_WARN(STATE_TIMED_OUTPUT_NO_REPORT, flash_client_index, lost_mask);
+    }
+
+    if (connection->is_dormant){
+        send_dormant_flag_to_client(active_client_index);
+    }
+}
+
+void server_timed_output_poll(void){
+    if (!timed_output_lock){
+        return;
+    }
+    server_persistent_state_t state;
+    load_server_state(&state);
+
+    for (uint32_t flash_client_index = 0; flash_client_index < MAX_SERVER_CONNECTIONS; flash_client_index++){
+        uint32_t irq = spin_lock_blocking(timed_output_lock);
+        bool due = timed_output_due_mask(&timed_output_clients[flash_client_index], time_us_64()) != 0;
+        spin_unlock(timed_output_lock, irq);
+
+        if (due){
+            timed_output_poll_client(flash_client_index, &state);
+        }
+    }
+}
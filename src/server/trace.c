@@ -0,0 +1,122 @@
+/**
+ * @file trace.c
+ * @brief Storage and USB export for the server's hot-path event trace.
+ *
+ * The recorder itself is inlined from `trace.h`. This file owns the per-core
+ * rings and converts them to Chrome trace JSON on demand, so no formatting
+ * cost is paid while events are being recorded.
+ *
+ * @see trace.h
+ */
+
+#include <stdio.h>
+
+#include "trace.h"
+
+#if SERVER_TRACE_ENABLED
+
+trace_ring_t trace_rings[NUM_CORES];
+volatile bool trace_paused = false;
+
+static const char *const trace_span_names[TRACE_SPAN_COUNT] = {
+    [TRACE_SPAN_UART_SEND]      = "uart_send",
+    [TRACE_SPAN_WAKE_PULSE]     = "wake_pulse",
+    [TRACE_SPAN_FLASH_ERASE]    = "flash_erase",
+    [TRACE_SPAN_FLASH_PROGRAM]  = "flash_program",
+    [TRACE_SPAN_CRC]            = "crc32",
+    [TRACE_SPAN_UART_LOCK]      = "uart_lock",
+    [TRACE_SPAN_CLI_DISPATCH]   = "cli_dispatch",
+};
+
+/**
+ * @brief Returns the index of the oldest event still present in a ring.
+ *
+ * @param ring Ring to inspect.
+ * @return Absolute event index (compare against `ring->head`).
+ */
+static uint32_t trace_ring_first_index(const trace_ring_t *ring){
+    return ring->head > TRACE_RING_SIZE ? ring->head - TRACE_RING_SIZE : 0;
+}
+
+/**
+ * @brief Prints one event as a Chrome trace JSON object.
+ *
+ * @param event     Event to print.
+ * @param core      Core that recorded the event (used as thread ID).
+ * @param base_us   Timestamp of the oldest dumped event.
+ * @param first     true if this is the first object in the array.
+ */
+static void trace_print_event(const trace_event_t *event, uint8_t core, uint32_t base_us, bool first){
+    uint16_t span = event->event & ~TRACE_PHASE_END_BIT;
+    const char *name = span < TRACE_SPAN_COUNT ? trace_span_names[span] : "unknown";
+
+    printf("%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%lu,\"pid\":0,\"tid\":%u,\"args\":{\"arg0\":%u,\"arg1\":%lu}}\n",
+        first ? "" : ",",
+        name,
+        (event->event & TRACE_PHASE_END_BIT) ? 'E' : 'B',
+        (unsigned long)(event->timestamp_us - base_us),
+        core,
+        event->arg0,
+        (unsigned long)event->arg1);
+}
+
+void trace_dump_chrome_json(void){
+    trace_paused = true;
+
+    uint32_t next[NUM_CORES];
+    uint32_t end[NUM_CORES];
+    for (uint8_t core = 0; core < NUM_CORES; core++){
+        next[core] = trace_ring_first_index(&trace_rings[core]);
+        end[core] = trace_rings[core].head;
+    }
+
+    bool have_base = false;
+    uint32_t base_us = 0;
+    for (uint8_t core = 0; core < NUM_CORES; core++){
+        if (next[core] != end[core]){
+            uint32_t timestamp = trace_rings[core].events[next[core] & (TRACE_RING_SIZE - 1)].timestamp_us;
+            if (!have_base || (int32_t)(timestamp - base_us) < 0){
+                base_us = timestamp;
+                have_base = true;
+            }
+        }
+    }
+
+    printf("{\"traceEvents\":[\n");
+    bool first = true;
+    while (true){
+        int8_t selected_core = -1;
+        uint32_t selected_timestamp = 0;
+        for (uint8_t core = 0; core < NUM_CORES; core++){
+            if (next[core] == end[core]){
+                continue;
+            }
+            uint32_t timestamp = trace_rings[core].events[next[core] & (TRACE_RING_SIZE - 1)].timestamp_us;
+            if (selected_core < 0 || (int32_t)(timestamp - selected_timestamp) < 0){
+                selected_core = core;
+                selected_timestamp = timestamp;
+            }
+        }
+        if (selected_core < 0){
+            break;
+        }
+
+        trace_print_event(&trace_rings[selected_core].events[next[selected_core] & (TRACE_RING_SIZE - 1)], selected_core, base_us, first);
+        next[selected_core]++;
+        first = false;
+    }
+    printf("]}\n");
+
+    for (uint8_t core = 0; core < NUM_CORES; core++){
+        trace_rings[core].head = 0;
+    }
+    trace_paused = false;
+}
+
+#else
+
+void trace_dump_chrome_json(void){
+    printf("\nTracing is disabled. Rebuild with -DSERVER_TRACE_ENABLED=1.\n");
+}
+
+#endif